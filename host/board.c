@@ -0,0 +1,70 @@
+/* Drivers of the node on the host: LEDs and GPIO do nothing, and the Wi-Fi
+   connection of every wake cycle comes from a script (host_wifi_script) */
+#include "esp32_general.h"
+#include "esp32_wifi.h"
+#include "board.h"
+
+#include <unistd.h>
+
+static char         s_script[256];
+static const char*  s_next = NULL;
+static wifi_stats_t s_stats;
+
+
+void host_wifi_script(const char* script){
+    snprintf(s_script, sizeof(s_script), "%s", script);
+    s_next = s_script;
+}
+
+
+void wifi_scan(char* ssid_buffer, size_t buffer_size){
+    // Next entry of the script: EDGE, MODEM or anything else (no AP found)
+    const char* ap = FAILED_WIFI_SCANNING;
+    size_t len = (s_next != NULL) ? strcspn(s_next, ",") : 0;
+    if (len == 4 && strncmp(s_next, "EDGE", len) == 0) {
+        ap = EDGE_AP;
+    }
+    else if (len == 5 && strncmp(s_next, "MODEM", len) == 0) {
+        ap = MODEM_AP;
+    }
+    if (s_next != NULL) {
+        s_next = (s_next[len] == ',') ? s_next + len + 1 : NULL;
+    }
+
+    s_stats.cycles++;
+    if (strcmp(ap, FAILED_WIFI_SCANNING) == 0) {
+        s_stats.failures++;
+    }
+    else {
+        s_stats.fast_connects++;
+    }
+    snprintf(ssid_buffer, buffer_size, "%s", ap);
+}
+
+
+int host_wifi_pending(){
+    return s_next != NULL;
+}
+
+
+void wifi_get_stats(wifi_stats_t* stats){
+    *stats = s_stats;
+}
+
+
+void led_set(enum _led pin_led, enum _color color){
+    (void) pin_led;
+    (void) color;
+}
+
+
+void led_set_pattern(enum _led pin_led, enum _color color, enum _pattern pattern){
+    (void) pin_led;
+    (void) color;
+    (void) pattern;
+}
+
+
+void delay_ms(int time_in_ms){
+    usleep((useconds_t) time_in_ms * 1000);
+}
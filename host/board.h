@@ -0,0 +1,18 @@
+#ifndef __HOST_BOARD_
+#define __HOST_BOARD_
+// ----------------------------------------------------------------- //
+
+/**
+ * @brief Wi-Fi result of the next wake cycles, ex. "EDGE,MODEM": EDGE connects to
+ *        EDGE_AP, MODEM to MODEM_AP and anything else fails (FAILED_WIFI_SCANNING)
+ */
+void host_wifi_script(const char* script);
+
+
+/**
+ * @brief 1 while the script has cycles left
+ */
+int host_wifi_pending();
+
+// ----------------------------------------------------------------- //
+#endif /* __HOST_BOARD_ */
@@ -0,0 +1,135 @@
+/* Host stand-in of the continuous ADC driver and of its line fitting calibration:
+   the conversions come from a trace set by the test, in frames of
+   conv_frame_size bytes like the DMA */
+#include "esp_adc/adc_continuous.h"
+#include "esp_adc/adc_cali_scheme.h"
+#include "host_idf.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+struct host_adc {
+    uint32_t frame_size;
+    int      started;
+};
+
+static uint16_t* s_adc_trace = NULL;
+static size_t    s_adc_count = 0;
+static size_t    s_adc_read = 0;
+
+// Valores del eFuse: slope_uv = 0 es un chip sin calibracion
+struct host_adc_cali {
+    int slope_uv;
+    int offset_mv;
+};
+static struct host_adc_cali s_cali = { 0, 0 };
+
+
+void host_adc_trace(const uint16_t* words, size_t count){
+    free(s_adc_trace);
+    s_adc_trace = (count > 0) ? malloc(count * sizeof(uint16_t)) : NULL;
+    s_adc_count = (s_adc_trace != NULL) ? count : 0;
+    s_adc_read  = 0;
+    if (s_adc_trace != NULL) {
+        memcpy(s_adc_trace, words, count * sizeof(uint16_t));
+    }
+}
+
+
+void host_adc_calibration(int slope_uv, int offset_mv){
+    s_cali.slope_uv  = slope_uv;
+    s_cali.offset_mv = offset_mv;
+}
+
+
+esp_err_t adc_continuous_new_handle(const adc_continuous_handle_cfg_t* config, adc_continuous_handle_t* handle){
+    if (config->conv_frame_size == 0 || config->conv_frame_size % SOC_ADC_DIGI_RESULT_BYTES != 0) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *handle = calloc(1, sizeof(struct host_adc));
+    if (*handle == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    (*handle)->frame_size = config->conv_frame_size;
+    return ESP_OK;
+}
+
+
+esp_err_t adc_continuous_config(adc_continuous_handle_t handle, const adc_continuous_config_t* config){
+    (void) handle;
+    return (config->pattern_num > 0 && config->adc_pattern != NULL) ? ESP_OK : ESP_ERR_INVALID_ARG;
+}
+
+
+esp_err_t adc_continuous_start(adc_continuous_handle_t handle){
+    if (handle->started) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    handle->started = 1;
+    return ESP_OK;
+}
+
+
+// Un frame por llamada (o lo que quede de la traza); sin conversiones, timeout
+esp_err_t adc_continuous_read(adc_continuous_handle_t handle, uint8_t* buf, uint32_t length_max,
+                              uint32_t* out_length, uint32_t timeout_ms){
+    (void) timeout_ms;
+    *out_length = 0;
+    if (!handle->started) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    size_t words = ((handle->frame_size < length_max) ? handle->frame_size : length_max) / SOC_ADC_DIGI_RESULT_BYTES;
+    if (words > s_adc_count - s_adc_read) {
+        words = s_adc_count - s_adc_read;
+    }
+    if (words == 0) {
+        return ESP_ERR_TIMEOUT;
+    }
+    memcpy(buf, s_adc_trace + s_adc_read, words * SOC_ADC_DIGI_RESULT_BYTES);
+    s_adc_read += words;
+    *out_length = words * SOC_ADC_DIGI_RESULT_BYTES;
+    return ESP_OK;
+}
+
+
+esp_err_t adc_continuous_stop(adc_continuous_handle_t handle){
+    if (!handle->started) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    handle->started = 0;
+    return ESP_OK;
+}
+
+
+esp_err_t adc_continuous_deinit(adc_continuous_handle_t handle){
+    if (handle->started) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    free(handle);
+    return ESP_OK;
+}
+
+
+esp_err_t adc_cali_create_scheme_line_fitting(const adc_cali_line_fitting_config_t* config, adc_cali_handle_t* handle){
+    (void) config;
+    if (s_cali.slope_uv == 0) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    *handle = &s_cali;
+    return ESP_OK;
+}
+
+
+esp_err_t adc_cali_raw_to_voltage(adc_cali_handle_t handle, int raw, int* voltage){
+    if (handle == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *voltage = raw * handle->slope_uv / 1000 + handle->offset_mv;
+    return ESP_OK;
+}
+
+
+esp_err_t adc_cali_delete_scheme_line_fitting(adc_cali_handle_t handle){
+    (void) handle;
+    return ESP_OK;
+}
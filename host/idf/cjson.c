@@ -0,0 +1,325 @@
+/* Host stand-in of the IDF "json" component: a strict JSON parser that builds
+   the same cJSON tree (main/ only reads it, nothing is printed) */
+#include "cJSON.h"
+
+#include <ctype.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#define CJSON_MAX_DEPTH     1000    // CJSON_NESTING_LIMIT of cJSON
+
+typedef struct {
+    const char* cursor;
+    const char* end;
+    int         depth;
+} cjson_parser_t;
+
+static cJSON* cjson_value(cjson_parser_t* p);
+
+
+static void cjson_skip(cjson_parser_t* p){
+    while (p->cursor < p->end && isspace((unsigned char) *p->cursor)) {
+        p->cursor++;
+    }
+}
+
+
+static int cjson_literal(cjson_parser_t* p, const char* word){
+    size_t len = strlen(word);
+    if ((size_t) (p->end - p->cursor) < len || memcmp(p->cursor, word, len) != 0) {
+        return 0;
+    }
+    p->cursor += len;
+    return 1;
+}
+
+
+static int cjson_hex4(const char* in, unsigned* out){
+    *out = 0;
+    for (int i = 0; i < 4; i++) {
+        char c = in[i];
+        *out <<= 4;
+        if (c >= '0' && c <= '9')      *out |= c - '0';
+        else if (c >= 'a' && c <= 'f') *out |= c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F') *out |= c - 'A' + 10;
+        else return 0;
+    }
+    return 1;
+}
+
+
+static size_t cjson_utf8(unsigned code, char* out){
+    if (code < 0x80) {
+        out[0] = (char) code;
+        return 1;
+    }
+    if (code < 0x800) {
+        out[0] = (char) (0xC0 | (code >> 6));
+        out[1] = (char) (0x80 | (code & 0x3F));
+        return 2;
+    }
+    if (code < 0x10000) {
+        out[0] = (char) (0xE0 | (code >> 12));
+        out[1] = (char) (0x80 | ((code >> 6) & 0x3F));
+        out[2] = (char) (0x80 | (code & 0x3F));
+        return 3;
+    }
+    out[0] = (char) (0xF0 | (code >> 18));
+    out[1] = (char) (0x80 | ((code >> 12) & 0x3F));
+    out[2] = (char) (0x80 | ((code >> 6) & 0x3F));
+    out[3] = (char) (0x80 | (code & 0x3F));
+    return 4;
+}
+
+
+/* "..." -> new string without escapes, NULL on error */
+static char* cjson_string(cjson_parser_t* p){
+    if (p->cursor >= p->end || *p->cursor != '"') {
+        return NULL;
+    }
+    const char* start = ++p->cursor;
+    const char* close = start;
+    while (close < p->end && *close != '"') {
+        close += (*close == '\\') ? 2 : 1;
+    }
+    if (close >= p->end) {
+        return NULL;
+    }
+    // Escapes only make the string shorter
+    char* out = malloc(close - start + 1);
+    if (out == NULL) {
+        return NULL;
+    }
+    size_t len = 0;
+    for (const char* in = start; in < close; in++) {
+        if ((unsigned char) *in < 0x20) {
+            free(out);
+            return NULL;
+        }
+        if (*in != '\\') {
+            out[len++] = *in;
+            continue;
+        }
+        switch (*++in) {
+            case '"': case '\\': case '/': out[len++] = *in; break;
+            case 'b': out[len++] = '\b'; break;
+            case 'f': out[len++] = '\f'; break;
+            case 'n': out[len++] = '\n'; break;
+            case 'r': out[len++] = '\r'; break;
+            case 't': out[len++] = '\t'; break;
+            case 'u': {
+                unsigned code, low;
+                if (close - in < 5 || !cjson_hex4(in + 1, &code)) {
+                    free(out);
+                    return NULL;
+                }
+                in += 4;
+                // Surrogate pair: \uD8xx\uDCxx
+                if (code >= 0xD800 && code <= 0xDBFF && close - in >= 7 && in[1] == '\\' && in[2] == 'u'
+                    && cjson_hex4(in + 3, &low) && low >= 0xDC00 && low <= 0xDFFF) {
+                    code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                    in += 6;
+                }
+                len += cjson_utf8(code, out + len);
+                break;
+            }
+            default:
+                free(out);
+                return NULL;
+        }
+    }
+    out[len] = '\0';
+    p->cursor = close + 1;
+    return out;
+}
+
+
+static cJSON* cjson_new(int type){
+    cJSON* item = calloc(1, sizeof(cJSON));
+    if (item != NULL) {
+        item->type = type;
+    }
+    return item;
+}
+
+
+static cJSON* cjson_number(cjson_parser_t* p){
+    char text[64];
+    size_t len = 0;
+    while (p->cursor + len < p->end && len < sizeof(text) - 1 && p->cursor[len] != '\0' &&
+           strchr("+-0123456789.eE", p->cursor[len]) != NULL) {
+        len++;
+    }
+    memcpy(text, p->cursor, len);
+    text[len] = '\0';
+    char* after = NULL;
+    double value = strtod(text, &after);
+    if (len == 0 || after != text + len) {
+        return NULL;
+    }
+    cJSON* item = cjson_new(cJSON_Number);
+    if (item == NULL) {
+        return NULL;
+    }
+    p->cursor += len;
+    item->valuedouble = value;
+    // Same saturation as cJSON
+    item->valueint = (value >= INT_MAX) ? INT_MAX : (value <= (double) INT_MIN) ? INT_MIN : (int) value;
+    return item;
+}
+
+
+/* Array or object: items separated by ',' until close */
+static cJSON* cjson_container(cjson_parser_t* p, int type, char close){
+    if (++p->depth > CJSON_MAX_DEPTH) {
+        return NULL;
+    }
+    cJSON* container = cjson_new(type);
+    if (container == NULL) {
+        return NULL;
+    }
+    p->cursor++;
+    cjson_skip(p);
+    if (p->cursor < p->end && *p->cursor == close) {
+        p->cursor++;
+        p->depth--;
+        return container;
+    }
+
+    cJSON* last = NULL;
+    while (1) {
+        char* key = NULL;
+        cjson_skip(p);
+        if (type == cJSON_Object) {
+            key = cjson_string(p);
+            cjson_skip(p);
+            if (key == NULL || p->cursor >= p->end || *p->cursor != ':') {
+                free(key);
+                cJSON_Delete(container);
+                return NULL;
+            }
+            p->cursor++;
+        }
+        cJSON* item = cjson_value(p);
+        if (item == NULL) {
+            free(key);
+            cJSON_Delete(container);
+            return NULL;
+        }
+        item->string = key;
+        if (last == NULL) {
+            container->child = item;
+        }
+        else {
+            last->next = item;
+            item->prev = last;
+        }
+        last = item;
+        // cJSON keeps the last item in child->prev
+        container->child->prev = last;
+
+        cjson_skip(p);
+        if (p->cursor < p->end && *p->cursor == ',') {
+            p->cursor++;
+            continue;
+        }
+        if (p->cursor < p->end && *p->cursor == close) {
+            p->cursor++;
+            p->depth--;
+            return container;
+        }
+        cJSON_Delete(container);
+        return NULL;
+    }
+}
+
+
+static cJSON* cjson_value(cjson_parser_t* p){
+    cjson_skip(p);
+    if (p->cursor >= p->end) {
+        return NULL;
+    }
+    switch (*p->cursor) {
+        case '{': return cjson_container(p, cJSON_Object, '}');
+        case '[': return cjson_container(p, cJSON_Array, ']');
+        case '"': {
+            char* text = cjson_string(p);
+            cJSON* item = (text != NULL) ? cjson_new(cJSON_String) : NULL;
+            if (item == NULL) {
+                free(text);
+                return NULL;
+            }
+            item->valuestring = text;
+            return item;
+        }
+        case 't':
+            if (cjson_literal(p, "true")) {
+                cJSON* item = cjson_new(cJSON_True);
+                if (item != NULL) {
+                    item->valueint = 1;
+                }
+                return item;
+            }
+            return NULL;
+        case 'f': return cjson_literal(p, "false") ? cjson_new(cJSON_False) : NULL;
+        case 'n': return cjson_literal(p, "null") ? cjson_new(cJSON_NULL) : NULL;
+        default:  return cjson_number(p);
+    }
+}
+
+
+cJSON* cJSON_ParseWithLength(const char* value, size_t length){
+    if (value == NULL) {
+        return NULL;
+    }
+    cjson_parser_t parser = { .cursor = value, .end = value + length };
+    cJSON* root = cjson_value(&parser);
+    // Like cJSON, text after the value is allowed only if it is whitespace or the NUL
+    cjson_skip(&parser);
+    if (root != NULL && parser.cursor < parser.end && *parser.cursor != '\0') {
+        cJSON_Delete(root);
+        return NULL;
+    }
+    return root;
+}
+
+
+cJSON* cJSON_Parse(const char* value){
+    return (value != NULL) ? cJSON_ParseWithLength(value, strlen(value) + 1) : NULL;
+}
+
+
+void cJSON_Delete(cJSON* item){
+    while (item != NULL) {
+        cJSON* next = item->next;
+        cJSON_Delete(item->child);
+        free(item->valuestring);
+        free(item->string);
+        free(item);
+        item = next;
+    }
+}
+
+
+int cJSON_GetArraySize(const cJSON* array){
+    int size = 0;
+    for (const cJSON* item = (array != NULL) ? array->child : NULL; item != NULL; item = item->next) {
+        size++;
+    }
+    return size;
+}
+
+
+cJSON* cJSON_GetObjectItem(const cJSON* object, const char* string){
+    if (object == NULL || string == NULL) {
+        return NULL;
+    }
+    for (cJSON* item = object->child; item != NULL; item = item->next) {
+        if (item->string != NULL && strcasecmp(item->string, string) == 0) {
+            return item;
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,136 @@
+/* Host stand-in of the periodic esp_timer: every timer has a thread that calls
+   the callback while the timer is active (ESP_TIMER_TASK dispatch) */
+#include "esp_timer.h"
+
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+
+struct host_timer {
+    esp_timer_cb_t  callback;
+    void*           arg;
+    pthread_t       thread;
+    pthread_mutex_t lock;
+    pthread_cond_t  changed;
+    uint64_t        period_us;      // 0 = stopped
+    uint32_t        generation;     // Changes with every start/stop: the wait starts again
+    int             deleted;        // esp_timer_delete(): the thread frees the timer
+};
+
+static pthread_mutex_t  s_count_lock = PTHREAD_MUTEX_INITIALIZER;
+static int              s_count = 0;    // Timers created and not deleted
+
+
+static void* host_timer_thread(void* arg){
+    struct host_timer* timer = arg;
+    pthread_mutex_lock(&timer->lock);
+    while (!timer->deleted) {
+        if (timer->period_us == 0) {
+            pthread_cond_wait(&timer->changed, &timer->lock);
+            continue;
+        }
+        uint32_t generation = timer->generation;
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        uint64_t ns = (uint64_t) deadline.tv_nsec + timer->period_us * 1000;
+        deadline.tv_sec += ns / 1000000000;
+        deadline.tv_nsec = ns % 1000000000;
+        while (timer->generation == generation &&
+               pthread_cond_timedwait(&timer->changed, &timer->lock, &deadline) == 0) {
+        }
+        if (timer->generation != generation) {
+            continue;
+        }
+        // The callback runs without the lock: it can call stop/start
+        pthread_mutex_unlock(&timer->lock);
+        timer->callback(timer->arg);
+        pthread_mutex_lock(&timer->lock);
+    }
+    pthread_mutex_unlock(&timer->lock);
+    pthread_mutex_destroy(&timer->lock);
+    pthread_cond_destroy(&timer->changed);
+    free(timer);
+    return NULL;
+}
+
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* args, esp_timer_handle_t* handle){
+    struct host_timer* timer = calloc(1, sizeof(struct host_timer));
+    if (timer == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    timer->callback = args->callback;
+    timer->arg      = args->arg;
+    pthread_mutex_init(&timer->lock, NULL);
+    pthread_cond_init(&timer->changed, NULL);
+    if (pthread_create(&timer->thread, NULL, host_timer_thread, timer) != 0) {
+        free(timer);
+        return ESP_FAIL;
+    }
+    pthread_detach(timer->thread);
+    pthread_mutex_lock(&s_count_lock);
+    s_count++;
+    pthread_mutex_unlock(&s_count_lock);
+    *handle = timer;
+    return ESP_OK;
+}
+
+
+static esp_err_t host_timer_set(esp_timer_handle_t timer, uint64_t period_us, int must_run){
+    pthread_mutex_lock(&timer->lock);
+    if ((timer->period_us != 0) != must_run) {
+        pthread_mutex_unlock(&timer->lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->period_us = period_us;
+    timer->generation++;
+    pthread_cond_signal(&timer->changed);
+    pthread_mutex_unlock(&timer->lock);
+    return ESP_OK;
+}
+
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period_us){
+    return host_timer_set(timer, period_us > 0 ? period_us : 1, 0);
+}
+
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer){
+    return host_timer_set(timer, 0, 1);
+}
+
+
+bool esp_timer_is_active(esp_timer_handle_t timer){
+    pthread_mutex_lock(&timer->lock);
+    bool active = timer->period_us != 0;
+    pthread_mutex_unlock(&timer->lock);
+    return active;
+}
+
+
+/* Like the IDF: a running timer can not be deleted */
+esp_err_t esp_timer_delete(esp_timer_handle_t timer){
+    if (timer == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    pthread_mutex_lock(&timer->lock);
+    if (timer->period_us != 0) {
+        pthread_mutex_unlock(&timer->lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    timer->deleted = 1;
+    pthread_cond_signal(&timer->changed);
+    pthread_mutex_unlock(&timer->lock);
+    pthread_mutex_lock(&s_count_lock);
+    s_count--;
+    pthread_mutex_unlock(&s_count_lock);
+    return ESP_OK;
+}
+
+
+int host_timer_count(void){
+    pthread_mutex_lock(&s_count_lock);
+    int count = s_count;
+    pthread_mutex_unlock(&s_count_lock);
+    return count;
+}
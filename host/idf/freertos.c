@@ -0,0 +1,269 @@
+/* Host stand-in of FreeRTOS over POSIX threads: tasks, queues, counting
+   semaphores and task notifications, with the blocking times of the real API (ticks = ms) */
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+struct host_queue {
+    pthread_mutex_t lock;
+    pthread_cond_t  not_empty;
+    pthread_cond_t  not_full;
+    size_t          item_size;  // 0 = semaphore: only the count matters
+    size_t          length;
+    size_t          head;
+    size_t          count;
+    uint8_t         items[];
+};
+
+struct host_task {
+    TaskFunction_t  function;
+    void*           arg;
+    pthread_t       thread;
+    struct host_queue* notify;  // Notification value: a counting semaphore
+};
+
+static __thread struct host_task* s_current;
+static int s_task_failures = 0;     // host_task_fail(): next xTaskCreate() calls that fail
+
+
+static void host_deadline(struct timespec* deadline, TickType_t ticks){
+    clock_gettime(CLOCK_REALTIME, deadline);
+    deadline->tv_sec  += ticks / 1000;
+    deadline->tv_nsec += (long) (ticks % 1000) * 1000000L;
+    if (deadline->tv_nsec >= 1000000000L) {
+        deadline->tv_sec++;
+        deadline->tv_nsec -= 1000000000L;
+    }
+}
+
+
+/* Waits on cond until ready() or the ticks pass. Called with the lock taken */
+static int host_wait(struct host_queue* queue, pthread_cond_t* cond, int (*ready)(struct host_queue*), TickType_t ticks){
+    struct timespec deadline;
+    if (ticks != portMAX_DELAY) {
+        host_deadline(&deadline, ticks);
+    }
+    while (!ready(queue)) {
+        if (ticks == 0) {
+            return 0;
+        }
+        if (ticks == portMAX_DELAY) {
+            pthread_cond_wait(cond, &queue->lock);
+        }
+        else if (pthread_cond_timedwait(cond, &queue->lock, &deadline) == ETIMEDOUT) {
+            return ready(queue);
+        }
+    }
+    return 1;
+}
+
+
+static int host_queue_has_items(struct host_queue* queue){ return queue->count > 0; }
+static int host_queue_has_space(struct host_queue* queue){ return queue->count < queue->length; }
+
+
+QueueHandle_t xQueueCreate(UBaseType_t length, UBaseType_t item_size){
+    struct host_queue* queue = calloc(1, sizeof(struct host_queue) + (size_t) length * item_size);
+    if (queue == NULL) {
+        return NULL;
+    }
+    pthread_mutex_init(&queue->lock, NULL);
+    pthread_cond_init(&queue->not_empty, NULL);
+    pthread_cond_init(&queue->not_full, NULL);
+    queue->item_size = item_size;
+    queue->length    = length;
+    return queue;
+}
+
+
+SemaphoreHandle_t host_semaphore_create(UBaseType_t max, UBaseType_t initial){
+    struct host_queue* queue = xQueueCreate(max, 0);
+    if (queue != NULL) {
+        queue->count = initial;
+    }
+    return queue;
+}
+
+
+BaseType_t xQueueSend(QueueHandle_t queue, const void* item, TickType_t wait){
+    pthread_mutex_lock(&queue->lock);
+    if (!host_wait(queue, &queue->not_full, host_queue_has_space, wait)) {
+        pthread_mutex_unlock(&queue->lock);
+        return pdFALSE;
+    }
+    if (queue->item_size > 0) {
+        size_t slot = (queue->head + queue->count) % queue->length;
+        memcpy(queue->items + slot * queue->item_size, item, queue->item_size);
+    }
+    queue->count++;
+    pthread_cond_signal(&queue->not_empty);
+    pthread_mutex_unlock(&queue->lock);
+    return pdTRUE;
+}
+
+
+static BaseType_t host_queue_take(QueueHandle_t queue, void* item, TickType_t wait, int remove){
+    pthread_mutex_lock(&queue->lock);
+    if (!host_wait(queue, &queue->not_empty, host_queue_has_items, wait)) {
+        pthread_mutex_unlock(&queue->lock);
+        return pdFALSE;
+    }
+    if (queue->item_size > 0) {
+        memcpy(item, queue->items + queue->head * queue->item_size, queue->item_size);
+    }
+    if (remove) {
+        queue->head = (queue->head + 1) % queue->length;
+        queue->count--;
+        pthread_cond_signal(&queue->not_full);
+    }
+    pthread_mutex_unlock(&queue->lock);
+    return pdTRUE;
+}
+
+
+BaseType_t xQueueReceive(QueueHandle_t queue, void* item, TickType_t wait){
+    return host_queue_take(queue, item, wait, 1);
+}
+
+
+BaseType_t xQueuePeek(QueueHandle_t queue, void* item, TickType_t wait){
+    return host_queue_take(queue, item, wait, 0);
+}
+
+
+void vQueueDelete(QueueHandle_t queue){
+    if (queue == NULL) {
+        return;
+    }
+    pthread_cond_destroy(&queue->not_full);
+    pthread_cond_destroy(&queue->not_empty);
+    pthread_mutex_destroy(&queue->lock);
+    free(queue);
+}
+
+
+#define HOST_NOTIFY_MAX     UINT16_MAX
+
+
+static struct host_task* host_task_new(void){
+    struct host_task* task = calloc(1, sizeof(struct host_task));
+    if (task == NULL) {
+        return NULL;
+    }
+    task->notify = host_semaphore_create(HOST_NOTIFY_MAX, 0);
+    if (task->notify == NULL) {
+        free(task);
+        return NULL;
+    }
+    return task;
+}
+
+
+static void host_task_free(struct host_task* task){
+    vQueueDelete(task->notify);
+    free(task);
+}
+
+
+static void* host_task_entry(void* arg){
+    s_current = arg;
+    s_current->function(s_current->arg);
+    // A FreeRTOS task must not return: it ends with vTaskDelete(NULL)
+    vTaskDelete(NULL);
+    return NULL;
+}
+
+
+BaseType_t xTaskCreate(TaskFunction_t function, const char* name, uint32_t stack_depth, void* arg,
+                       UBaseType_t priority, TaskHandle_t* handle){
+    (void) name;
+    (void) priority;
+    if (__atomic_load_n(&s_task_failures, __ATOMIC_SEQ_CST) > 0 &&
+        __atomic_sub_fetch(&s_task_failures, 1, __ATOMIC_SEQ_CST) >= 0) {
+        return pdFAIL;
+    }
+    struct host_task* task = host_task_new();
+    if (task == NULL) {
+        return pdFAIL;
+    }
+    task->function = function;
+    task->arg      = arg;
+
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    // The stack of the ESP32 (bytes) is too small for the libc of the host
+    pthread_attr_setstacksize(&attr, stack_depth < 65536 ? 65536 : stack_depth);
+    int error = pthread_create(&task->thread, &attr, host_task_entry, task);
+    pthread_attr_destroy(&attr);
+    if (error != 0) {
+        host_task_free(task);
+        return pdFAIL;
+    }
+    if (handle != NULL) {
+        *handle = task;
+    }
+    return pdPASS;
+}
+
+
+void vTaskDelete(TaskHandle_t task){
+    // Only a task can end itself: main/ never deletes other tasks
+    if (task == NULL || task == s_current) {
+        host_task_free(s_current);
+        s_current = NULL;
+        pthread_exit(NULL);
+    }
+}
+
+
+void vTaskDelay(TickType_t ticks){
+    usleep((useconds_t) ticks * 1000);
+}
+
+
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void){
+    // Threads not created by xTaskCreate (main) get a handle the first time
+    if (s_current == NULL) {
+        s_current = host_task_new();
+    }
+    return s_current;
+}
+
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task){
+    // A full count behaves like the 32 bits of FreeRTOS: nothing is lost before it is taken
+    xQueueSend(task->notify, NULL, 0);
+    return pdPASS;
+}
+
+
+uint32_t ulTaskNotifyTake(BaseType_t clear_on_exit, TickType_t wait){
+    TaskHandle_t task = xTaskGetCurrentTaskHandle();
+    if (xQueueReceive(task->notify, NULL, wait) != pdTRUE) {
+        return 0;
+    }
+    uint32_t value = 1;
+    while (xQueueReceive(task->notify, NULL, 0) == pdTRUE) {
+        value++;
+    }
+    if (!clear_on_exit) {
+        for (uint32_t i = 1; i < value; i++) {
+            xQueueSend(task->notify, NULL, 0);
+        }
+    }
+    return value;
+}
+
+
+void host_task_fail(int count){
+    __atomic_store_n(&s_task_failures, count, __ATOMIC_SEQ_CST);
+}
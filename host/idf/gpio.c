@@ -0,0 +1,49 @@
+/* Host stand-in of the GPIO output register: W1TS/W1TC writes update a word that
+   the tests read. A test can hold the writer to make the LED queue fill up */
+#include "soc/gpio_reg.h"
+#include "host_idf.h"
+
+#include <pthread.h>
+
+static pthread_mutex_t s_gpio_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  s_gpio_released = PTHREAD_COND_INITIALIZER;
+static uint32_t        s_gpio_out = 0;
+static uint32_t        s_gpio_writes = 0;
+static int             s_gpio_held = 0;
+
+
+void host_reg_write(uint32_t reg, uint32_t value){
+    pthread_mutex_lock(&s_gpio_lock);
+    while (s_gpio_held) {
+        pthread_cond_wait(&s_gpio_released, &s_gpio_lock);
+    }
+    if (reg == GPIO_OUT_W1TS_REG) {
+        s_gpio_out |= value;
+    }
+    else if (reg == GPIO_OUT_W1TC_REG) {
+        s_gpio_out &= ~value;
+    }
+    s_gpio_writes++;
+    pthread_mutex_unlock(&s_gpio_lock);
+}
+
+
+uint32_t host_gpio_out(uint32_t* writes){
+    pthread_mutex_lock(&s_gpio_lock);
+    uint32_t out = s_gpio_out;
+    if (writes != NULL) {
+        *writes = s_gpio_writes;
+    }
+    pthread_mutex_unlock(&s_gpio_lock);
+    return out;
+}
+
+
+void host_gpio_hold(int hold){
+    pthread_mutex_lock(&s_gpio_lock);
+    s_gpio_held = hold;
+    if (!hold) {
+        pthread_cond_broadcast(&s_gpio_released);
+    }
+    pthread_mutex_unlock(&s_gpio_lock);
+}
@@ -0,0 +1,519 @@
+/* Host stand-in of esp_http_client over POSIX sockets: HTTP/1.1 with keep-alive
+   and Content-Length bodies, enough for the requests of main/esp32_http.c.
+   Every request is timed (open -> last byte of the body) for the benchmark */
+#include "esp_http_client.h"
+#include "esp_timer.h"
+#include "host_idf.h"
+
+#include <errno.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#define HOST_HTTP_MAX_HEADERS   16
+#define HOST_HTTP_MAX_ROUTES    8
+#define HOST_HTTP_HOST_SIZE     128
+#define HOST_HTTP_URL_SIZE      512
+#define HOST_HTTP_BUFFER_SIZE   4096
+#define HOST_HTTP_MAX_SAMPLES   (256 * 1024)
+
+#define MIN_SIZE(a, b)          ((a) < (b) ? (a) : (b))
+
+typedef struct {
+    char* key;
+    char* value;
+} host_http_header_t;
+
+struct host_http_client {
+    http_event_handle_cb        event_handler;
+    void*                       user_data;
+    int                         timeout_ms;
+    esp_http_client_method_t    method;
+    char                        host[HOST_HTTP_HOST_SIZE];  // As written in the URL (host[:port])
+    char                        path[HOST_HTTP_URL_SIZE];
+    int                         default_port;
+    host_http_header_t          headers[HOST_HTTP_MAX_HEADERS];
+
+    int                         fd;
+    char                        connected_host[HOST_HTTP_HOST_SIZE];
+    int                         server_closes;              // "Connection: close" in the last response
+
+    // Response
+    int                         status_code;
+    int64_t                     content_length;             // -1: the body ends when the server closes
+    int64_t                     received;
+    int                         eof;
+    char                        buffer[HOST_HTTP_BUFFER_SIZE];  // Bytes received after the headers
+    size_t                      buffer_pos;
+    size_t                      buffer_len;
+    int64_t                     opened_at;
+    int                         timed;
+};
+
+static struct {
+    char host[HOST_HTTP_HOST_SIZE];
+    char address[HOST_HTTP_HOST_SIZE];
+} s_routes[HOST_HTTP_MAX_ROUTES];
+static int              s_route_count = 0;
+
+static pthread_mutex_t  s_stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static int64_t*         s_samples;
+static size_t           s_sample_count;
+static uint64_t         s_bytes_sent;
+static uint64_t         s_bytes_received;
+
+
+void host_http_route(const char* host, const char* address){
+    if (s_route_count < HOST_HTTP_MAX_ROUTES) {
+        snprintf(s_routes[s_route_count].host, HOST_HTTP_HOST_SIZE, "%s", host);
+        snprintf(s_routes[s_route_count].address, HOST_HTTP_HOST_SIZE, "%s", address);
+        s_route_count++;
+    }
+}
+
+
+size_t host_http_take_samples(int64_t* samples, size_t max){
+    pthread_mutex_lock(&s_stats_lock);
+    size_t count = s_sample_count;
+    memcpy(samples, s_samples, (count < max ? count : max) * sizeof(int64_t));
+    s_sample_count = 0;
+    pthread_mutex_unlock(&s_stats_lock);
+    return count;
+}
+
+
+void host_http_bytes(uint64_t* sent, uint64_t* received){
+    pthread_mutex_lock(&s_stats_lock);
+    *sent     = s_bytes_sent;
+    *received = s_bytes_received;
+    pthread_mutex_unlock(&s_stats_lock);
+}
+
+
+static void host_http_count(uint64_t* counter, size_t bytes){
+    pthread_mutex_lock(&s_stats_lock);
+    *counter += bytes;
+    pthread_mutex_unlock(&s_stats_lock);
+}
+
+
+static void host_http_event(esp_http_client_handle_t client, esp_http_client_event_id_t id, void* data, int len){
+    if (client->event_handler == NULL) {
+        return;
+    }
+    esp_http_client_event_t event = {
+        .event_id  = id,
+        .client    = client,
+        .data      = data,
+        .data_len  = len,
+        .user_data = client->user_data,
+    };
+    client->event_handler(&event);
+}
+
+
+/* The body ended: the request goes to the latency samples once */
+static void host_http_finish(esp_http_client_handle_t client){
+    if (client->timed) {
+        return;
+    }
+    client->timed = 1;
+    int64_t elapsed = esp_timer_get_time() - client->opened_at;
+    pthread_mutex_lock(&s_stats_lock);
+    if (s_samples == NULL) {
+        s_samples = malloc(HOST_HTTP_MAX_SAMPLES * sizeof(int64_t));
+    }
+    if (s_samples != NULL && s_sample_count < HOST_HTTP_MAX_SAMPLES) {
+        s_samples[s_sample_count++] = elapsed;
+    }
+    pthread_mutex_unlock(&s_stats_lock);
+    host_http_event(client, HTTP_EVENT_ON_FINISH, NULL, 0);
+}
+
+
+esp_http_client_handle_t esp_http_client_init(const esp_http_client_config_t* config){
+    esp_http_client_handle_t client = calloc(1, sizeof(struct host_http_client));
+    if (client == NULL) {
+        return NULL;
+    }
+    client->event_handler = config->event_handler;
+    client->user_data     = config->user_data;
+    client->timeout_ms    = (config->timeout_ms > 0) ? config->timeout_ms : 5000;
+    client->fd            = -1;
+    if (config->url != NULL && esp_http_client_set_url(client, config->url) != ESP_OK) {
+        free(client);
+        return NULL;
+    }
+    return client;
+}
+
+
+esp_err_t esp_http_client_set_url(esp_http_client_handle_t client, const char* url){
+    const char* rest = url;
+    client->default_port = 80;
+    if (strncmp(url, "http://", 7) == 0) {
+        rest = url + 7;
+    }
+    else if (strncmp(url, "https://", 8) == 0) {
+        rest = url + 8;
+        client->default_port = 443;
+    }
+    size_t host_len = strcspn(rest, "/?");
+    if (host_len == 0 || host_len >= HOST_HTTP_HOST_SIZE) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memcpy(client->host, rest, host_len);
+    client->host[host_len] = '\0';
+    const char* path = rest + host_len;
+    if (snprintf(client->path, HOST_HTTP_URL_SIZE, "%s%s", (*path == '/') ? "" : "/", path) >= HOST_HTTP_URL_SIZE) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return ESP_OK;
+}
+
+
+esp_err_t esp_http_client_set_method(esp_http_client_handle_t client, esp_http_client_method_t method){
+    client->method = method;
+    return ESP_OK;
+}
+
+
+esp_err_t esp_http_client_set_header(esp_http_client_handle_t client, const char* key, const char* value){
+    host_http_header_t* free_slot = NULL;
+    for (int i = 0; i < HOST_HTTP_MAX_HEADERS; i++) {
+        host_http_header_t* header = &client->headers[i];
+        if (header->key != NULL && strcasecmp(header->key, key) == 0) {
+            free(header->value);
+            header->value = strdup(value);
+            return ESP_OK;
+        }
+        if (header->key == NULL && free_slot == NULL) {
+            free_slot = header;
+        }
+    }
+    if (free_slot == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    free_slot->key   = strdup(key);
+    free_slot->value = strdup(value);
+    return ESP_OK;
+}
+
+
+esp_err_t esp_http_client_delete_header(esp_http_client_handle_t client, const char* key){
+    for (int i = 0; i < HOST_HTTP_MAX_HEADERS; i++) {
+        host_http_header_t* header = &client->headers[i];
+        if (header->key != NULL && strcasecmp(header->key, key) == 0) {
+            free(header->key);
+            free(header->value);
+            header->key = header->value = NULL;
+        }
+    }
+    return ESP_OK;
+}
+
+
+esp_err_t esp_http_client_get_user_data(esp_http_client_handle_t client, void** data){
+    *data = client->user_data;
+    return ESP_OK;
+}
+
+
+/* The kept connection can be used if the server did not close it and did not send anything else */
+static int host_http_alive(esp_http_client_handle_t client){
+    if (client->fd < 0 || client->server_closes || strcmp(client->connected_host, client->host) != 0) {
+        return 0;
+    }
+    char byte;
+    ssize_t peeked = recv(client->fd, &byte, 1, MSG_PEEK | MSG_DONTWAIT);
+    return peeked < 0 && (errno == EAGAIN || errno == EWOULDBLOCK);
+}
+
+
+static esp_err_t host_http_connect(esp_http_client_handle_t client){
+    // host:port of the route, or the host of the URL
+    char address[HOST_HTTP_HOST_SIZE];
+    snprintf(address, sizeof(address), "%s", client->host);
+    for (int i = 0; i < s_route_count; i++) {
+        if (strcmp(s_routes[i].host, client->host) == 0) {
+            snprintf(address, sizeof(address), "%s", s_routes[i].address);
+            break;
+        }
+    }
+    char port[8];
+    char* colon = strrchr(address, ':');
+    if (colon != NULL) {
+        *colon = '\0';
+        snprintf(port, sizeof(port), "%s", colon + 1);
+    }
+    else {
+        snprintf(port, sizeof(port), "%d", client->default_port);
+    }
+
+    struct addrinfo hints = { .ai_family = AF_INET, .ai_socktype = SOCK_STREAM };
+    struct addrinfo* result = NULL;
+    if (getaddrinfo(address, port, &hints, &result) != 0) {
+        return ESP_FAIL;
+    }
+    int fd = socket(result->ai_family, result->ai_socktype, result->ai_protocol);
+    if (fd < 0 || connect(fd, result->ai_addr, result->ai_addrlen) != 0) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        freeaddrinfo(result);
+        return ESP_FAIL;
+    }
+    freeaddrinfo(result);
+
+    struct timeval timeout = { .tv_sec = client->timeout_ms / 1000, .tv_usec = (client->timeout_ms % 1000) * 1000 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+    client->fd = fd;
+    client->server_closes = 0;
+    snprintf(client->connected_host, HOST_HTTP_HOST_SIZE, "%s", client->host);
+    host_http_event(client, HTTP_EVENT_ON_CONNECTED, NULL, 0);
+    return ESP_OK;
+}
+
+
+static int host_http_send(esp_http_client_handle_t client, const char* data, size_t length){
+    size_t sent = 0;
+    while (sent < length) {
+        ssize_t n = send(client->fd, data + sent, length - sent, MSG_NOSIGNAL);
+        if (n <= 0) {
+            return -1;
+        }
+        sent += n;
+    }
+    host_http_count(&s_bytes_sent, length);
+    return (int) length;
+}
+
+
+esp_err_t esp_http_client_open(esp_http_client_handle_t client, int write_len){
+    client->opened_at = esp_timer_get_time();
+    if (!host_http_alive(client)) {
+        esp_http_client_close(client);
+        if (host_http_connect(client) != ESP_OK) {
+            return ESP_FAIL;
+        }
+    }
+
+    char request[HOST_HTTP_URL_SIZE + 1024];
+    int length = snprintf(request, sizeof(request), "%s %s HTTP/1.1\r\nHost: %s\r\nUser-Agent: ESP32 HTTP Client/1.0\r\n",
+                          (client->method == HTTP_METHOD_POST) ? "POST" : "GET", client->path, client->host);
+    for (int i = 0; i < HOST_HTTP_MAX_HEADERS && length < (int) sizeof(request); i++) {
+        if (client->headers[i].key != NULL) {
+            length += snprintf(request + length, sizeof(request) - length, "%s: %s\r\n",
+                               client->headers[i].key, client->headers[i].value);
+        }
+    }
+    if (length < (int) sizeof(request) && (client->method == HTTP_METHOD_POST || write_len > 0)) {
+        length += snprintf(request + length, sizeof(request) - length, "Content-Length: %d\r\n", write_len);
+    }
+    if (length < (int) sizeof(request)) {
+        length += snprintf(request + length, sizeof(request) - length, "\r\n");
+    }
+    if (length >= (int) sizeof(request)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    client->status_code    = 0;
+    client->content_length = -1;
+    client->received       = 0;
+    client->eof            = 0;
+    client->buffer_pos     = client->buffer_len = 0;
+    client->timed          = 0;
+    if (host_http_send(client, request, length) < 0) {
+        esp_http_client_close(client);
+        return ESP_FAIL;
+    }
+    host_http_event(client, HTTP_EVENT_HEADERS_SENT, NULL, 0);
+    return ESP_OK;
+}
+
+
+int esp_http_client_write(esp_http_client_handle_t client, const char* buffer, int len){
+    if (client->fd < 0) {
+        return -1;
+    }
+    return host_http_send(client, buffer, len);
+}
+
+
+static int host_http_recv(esp_http_client_handle_t client, char* buffer, size_t size){
+    ssize_t n = recv(client->fd, buffer, size, 0);
+    if (n > 0) {
+        host_http_count(&s_bytes_received, n);
+    }
+    return (int) n;
+}
+
+
+int64_t esp_http_client_fetch_headers(esp_http_client_handle_t client){
+    if (client->fd < 0) {
+        return ESP_FAIL;
+    }
+    // Status line + headers, the rest of the buffer is the start of the body
+    char* end = NULL;
+    size_t used = 0;
+    while (end == NULL) {
+        if (used == sizeof(client->buffer) - 1) {
+            return ESP_FAIL;
+        }
+        int n = host_http_recv(client, client->buffer + used, sizeof(client->buffer) - 1 - used);
+        if (n <= 0) {
+            return ESP_FAIL;
+        }
+        used += n;
+        client->buffer[used] = '\0';
+        end = strstr(client->buffer, "\r\n\r\n");
+    }
+    *end = '\0';
+    client->buffer_pos = (end + 4) - client->buffer;
+    client->buffer_len = used;
+
+    if (sscanf(client->buffer, "HTTP/1.%*d %d", &client->status_code) != 1) {
+        return ESP_FAIL;
+    }
+    char* line = strstr(client->buffer, "\r\n");
+    while (line != NULL) {
+        line += 2;
+        char* next = strstr(line, "\r\n");
+        if (next != NULL) {
+            *next = '\0';
+        }
+        char* colon = strchr(line, ':');
+        if (colon != NULL) {
+            *colon = '\0';
+            char* value = colon + 1 + strspn(colon + 1, " \t");
+            if (strcasecmp(line, "Content-Length") == 0) {
+                client->content_length = strtoll(value, NULL, 10);
+            }
+            else if (strcasecmp(line, "Connection") == 0) {
+                client->server_closes = (strcasecmp(value, "close") == 0);
+            }
+            esp_http_client_event_t event = {
+                .event_id = HTTP_EVENT_ON_HEADER, .client = client, .user_data = client->user_data,
+                .header_key = line, .header_value = value,
+            };
+            if (client->event_handler != NULL) {
+                client->event_handler(&event);
+            }
+        }
+        line = next;
+    }
+    if (client->content_length == 0) {
+        host_http_finish(client);
+    }
+    return (client->content_length >= 0) ? client->content_length : 0;
+}
+
+
+int esp_http_client_read(esp_http_client_handle_t client, char* buffer, int len){
+    if (client->fd < 0) {
+        return -1;
+    }
+    int64_t left = (client->content_length >= 0) ? client->content_length - client->received : len;
+    if (left <= 0 || client->eof || len <= 0) {
+        return 0;
+    }
+    if (left > len) {
+        left = len;
+    }
+
+    int n;
+    if (client->buffer_pos < client->buffer_len) {
+        n = (int) MIN_SIZE(client->buffer_len - client->buffer_pos, (size_t) left);
+        memcpy(buffer, client->buffer + client->buffer_pos, n);
+        client->buffer_pos += n;
+    }
+    else {
+        n = host_http_recv(client, buffer, (size_t) left);
+        if (n == 0 && client->content_length < 0) {
+            // Without Content-Length the body ends with the connection
+            client->eof = 1;
+            client->server_closes = 1;
+            host_http_finish(client);
+            return 0;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+    }
+    client->received += n;
+    host_http_event(client, HTTP_EVENT_ON_DATA, buffer, n);
+    if (client->content_length >= 0 && client->received == client->content_length) {
+        host_http_finish(client);
+    }
+    return n;
+}
+
+
+int esp_http_client_read_response(esp_http_client_handle_t client, char* buffer, int len){
+    int total = 0;
+    while (total < len) {
+        int n = esp_http_client_read(client, buffer + total, len - total);
+        if (n < 0) {
+            return -1;
+        }
+        if (n == 0) {
+            break;
+        }
+        total += n;
+    }
+    return total;
+}
+
+
+int esp_http_client_get_status_code(esp_http_client_handle_t client){
+    return client->status_code;
+}
+
+
+int64_t esp_http_client_get_content_length(esp_http_client_handle_t client){
+    return client->content_length;
+}
+
+
+bool esp_http_client_is_complete_data_received(esp_http_client_handle_t client){
+    if (client->content_length < 0) {
+        return client->eof;
+    }
+    return client->received == client->content_length;
+}
+
+
+esp_err_t esp_http_client_close(esp_http_client_handle_t client){
+    if (client->fd >= 0) {
+        close(client->fd);
+        client->fd = -1;
+        host_http_event(client, HTTP_EVENT_DISCONNECTED, NULL, 0);
+    }
+    return ESP_OK;
+}
+
+
+esp_err_t esp_http_client_cleanup(esp_http_client_handle_t client){
+    if (client == NULL) {
+        return ESP_FAIL;
+    }
+    esp_http_client_close(client);
+    for (int i = 0; i < HOST_HTTP_MAX_HEADERS; i++) {
+        free(client->headers[i].key);
+        free(client->headers[i].value);
+    }
+    free(client);
+    return ESP_OK;
+}
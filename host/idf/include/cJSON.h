@@ -0,0 +1,42 @@
+/* Host stand-in of the IDF "json" component: the part of the cJSON API used by
+   main/ (parse, walk, delete), with the same node layout */
+#pragma once
+#include <stddef.h>
+
+#define cJSON_Invalid   (0)
+#define cJSON_False     (1 << 0)
+#define cJSON_True      (1 << 1)
+#define cJSON_NULL      (1 << 2)
+#define cJSON_Number    (1 << 3)
+#define cJSON_String    (1 << 4)
+#define cJSON_Array     (1 << 5)
+#define cJSON_Object    (1 << 6)
+
+typedef struct cJSON {
+    struct cJSON* next;
+    struct cJSON* prev;
+    struct cJSON* child;
+    int           type;
+    char*         valuestring;
+    int           valueint;
+    double        valuedouble;
+    char*         string;
+} cJSON;
+
+cJSON* cJSON_Parse(const char* value);
+cJSON* cJSON_ParseWithLength(const char* value, size_t length);
+void cJSON_Delete(cJSON* item);
+int cJSON_GetArraySize(const cJSON* array);
+cJSON* cJSON_GetObjectItem(const cJSON* object, const char* string);
+
+#define cJSON_IsFalse(item)     ((item) != NULL && ((item)->type & 0xFF) == cJSON_False)
+#define cJSON_IsTrue(item)      ((item) != NULL && ((item)->type & 0xFF) == cJSON_True)
+#define cJSON_IsBool(item)      ((item) != NULL && ((item)->type & (cJSON_True | cJSON_False)) != 0)
+#define cJSON_IsNull(item)      ((item) != NULL && ((item)->type & 0xFF) == cJSON_NULL)
+#define cJSON_IsNumber(item)    ((item) != NULL && ((item)->type & 0xFF) == cJSON_Number)
+#define cJSON_IsString(item)    ((item) != NULL && ((item)->type & 0xFF) == cJSON_String)
+#define cJSON_IsArray(item)     ((item) != NULL && ((item)->type & 0xFF) == cJSON_Array)
+#define cJSON_IsObject(item)    ((item) != NULL && ((item)->type & 0xFF) == cJSON_Object)
+
+#define cJSON_ArrayForEach(element, array) \
+    for (element = (array != NULL) ? (array)->child : NULL; element != NULL; element = element->next)
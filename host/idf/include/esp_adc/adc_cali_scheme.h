@@ -0,0 +1,13 @@
+/* Host stand-in of ESP-IDF: line fitting scheme of the ESP32. The eFuse values
+   are set with host_adc_calibration() (host/idf/adc.c) */
+#pragma once
+#include "esp_adc/adc_cali.h"
+
+typedef struct {
+    adc_unit_t     unit_id;
+    adc_atten_t    atten;
+    adc_bitwidth_t bitwidth;
+} adc_cali_line_fitting_config_t;
+
+esp_err_t adc_cali_create_scheme_line_fitting(const adc_cali_line_fitting_config_t* config, adc_cali_handle_t* handle);
+esp_err_t adc_cali_delete_scheme_line_fitting(adc_cali_handle_t handle);
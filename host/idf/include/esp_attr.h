@@ -0,0 +1,5 @@
+/* Host stand-in of ESP-IDF: there is no RTC or DMA memory, the attributes are dropped */
+#pragma once
+#define RTC_DATA_ATTR
+#define DMA_ATTR
+#define IRAM_ATTR
@@ -0,0 +1,5 @@
+/* Host stand-in of ESP-IDF: there is no TLS, the bundle is never attached */
+#pragma once
+#include "esp_err.h"
+
+esp_err_t esp_crt_bundle_attach(void* conf);
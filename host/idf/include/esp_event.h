@@ -0,0 +1,5 @@
+/* Host stand-in of ESP-IDF: only the types (the Wi-Fi events are not built) */
+#pragma once
+#include "esp_err.h"
+
+typedef const char* esp_event_base_t;
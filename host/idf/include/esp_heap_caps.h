@@ -0,0 +1,12 @@
+/* Host stand-in of ESP-IDF: the heap of the process (the counters are 0) */
+#pragma once
+#include <stdlib.h>
+#include <stdint.h>
+
+#define MALLOC_CAP_DMA          (1 << 3)
+#define MALLOC_CAP_8BIT         (1 << 2)
+
+static inline void* heap_caps_malloc(size_t size, uint32_t caps){ (void) caps; return malloc(size); }
+static inline size_t heap_caps_get_free_size(uint32_t caps){ (void) caps; return 0; }
+static inline size_t heap_caps_get_minimum_free_size(uint32_t caps){ (void) caps; return 0; }
+static inline size_t heap_caps_get_largest_free_block(uint32_t caps){ (void) caps; return 0; }
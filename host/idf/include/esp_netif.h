@@ -0,0 +1,3 @@
+/* Host stand-in of ESP-IDF: the Wi-Fi driver is replaced by host/board.c */
+#pragma once
+#include "esp_err.h"
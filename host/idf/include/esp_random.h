@@ -0,0 +1,5 @@
+/* Host stand-in of ESP-IDF */
+#pragma once
+#include <stdint.h>
+
+uint32_t esp_random(void);
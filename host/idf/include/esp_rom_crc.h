@@ -0,0 +1,5 @@
+/* Host stand-in of ESP-IDF: same CRC32 as the ROM, so the log files are the same on both sides */
+#pragma once
+#include <stdint.h>
+
+uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t* buf, uint32_t len);
@@ -0,0 +1,3 @@
+/* Host stand-in of ESP-IDF */
+#pragma once
+#include "esp_err.h"
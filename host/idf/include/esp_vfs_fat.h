@@ -0,0 +1,4 @@
+/* Host stand-in of ESP-IDF: the card is a directory (MOUNT_POINT), esp32_sd_card.c is not built */
+#pragma once
+#include "esp_err.h"
+#include "sdmmc_cmd.h"
@@ -0,0 +1,23 @@
+/* Host stand-in of FreeRTOS over POSIX threads (host/idf/freertos.c). A tick is 1 ms */
+#pragma once
+#include <stdint.h>
+#include <pthread.h>
+#include "sdkconfig.h"
+
+typedef int           BaseType_t;
+typedef unsigned int  UBaseType_t;
+typedef uint32_t      TickType_t;
+
+#define pdTRUE                  1
+#define pdFALSE                 0
+#define pdPASS                  pdTRUE
+#define pdFAIL                  pdFALSE
+#define portMAX_DELAY           ((TickType_t) UINT32_MAX)
+#define portTICK_PERIOD_MS      1
+#define pdMS_TO_TICKS(ms)       ((TickType_t) (ms))
+
+// Critical sections are a mutex: the host has no interrupts to mask
+typedef pthread_mutex_t portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED    PTHREAD_MUTEX_INITIALIZER
+#define portENTER_CRITICAL(mux)         pthread_mutex_lock(mux)
+#define portEXIT_CRITICAL(mux)          pthread_mutex_unlock(mux)
@@ -0,0 +1,9 @@
+/* Host stand-in of FreeRTOS: only the types (the Wi-Fi events are not built) */
+#pragma once
+#include "freertos/FreeRTOS.h"
+
+typedef struct host_event_group* EventGroupHandle_t;
+typedef uint32_t EventBits_t;
+
+#define BIT0    (1 << 0)
+#define BIT1    (1 << 1)
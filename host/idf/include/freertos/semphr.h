@@ -0,0 +1,12 @@
+/* Host stand-in of FreeRTOS: a counting semaphore is a queue of empty items */
+#pragma once
+#include "freertos/queue.h"
+
+typedef QueueHandle_t SemaphoreHandle_t;
+
+#define xSemaphoreCreateCounting(max, initial)  host_semaphore_create(max, initial)
+#define xSemaphoreGive(sem)                     xQueueSend(sem, NULL, 0)
+#define xSemaphoreTake(sem, wait)               xQueueReceive(sem, NULL, wait)
+#define vSemaphoreDelete(sem)                   vQueueDelete(sem)
+
+SemaphoreHandle_t host_semaphore_create(UBaseType_t max, UBaseType_t initial);
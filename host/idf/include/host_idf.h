@@ -0,0 +1,57 @@
+/* Controls of the host stand-ins, used by host/sync_bench.c and the tests */
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+/**
+ * @brief Requests to host (as written in the URL, ex. "10.42.0.1:5000") go to
+ *        address ("127.0.0.1:5000"). Hosts without a route are used as they are
+ */
+void host_http_route(const char* host, const char* address);
+
+/**
+ * @brief Time of every completed request (open -> last byte of the response), in
+ *        microseconds. Copies up to max samples taken since the last call and
+ *        returns how many there were
+ */
+size_t host_http_take_samples(int64_t* samples, size_t max);
+
+/**
+ * @brief Bytes sent and received by every client since the start
+ */
+void host_http_bytes(uint64_t* sent, uint64_t* received);
+
+/**
+ * @brief GPIO output register written by REG_WRITE(GPIO_OUT_W1TS/W1TC_REG), and
+ *        the number of register writes when writes is not NULL
+ */
+uint32_t host_gpio_out(uint32_t* writes);
+
+/**
+ * @brief hold = 1 blocks every REG_WRITE() until host_gpio_hold(0): the task that
+ *        writes the pins stops and its commands pile up
+ */
+void host_gpio_hold(int hold);
+
+/**
+ * @brief Conversions returned by adc_continuous_read(): words of the DMA as the
+ *        ESP32 writes them (channel << 12 | 12 bit value). The trace is copied;
+ *        once it is read, adc_continuous_read() times out
+ */
+void host_adc_trace(const uint16_t* words, size_t count);
+
+/**
+ * @brief eFuse calibration seen by adc_cali line fitting: pin mV = raw *
+ *        slope_uv / 1000 + offset_mv. slope_uv = 0 = chip without eFuse values
+ */
+void host_adc_calibration(int slope_uv, int offset_mv);
+
+/**
+ * @brief The next count calls to xTaskCreate() fail (pdFAIL), like without heap
+ */
+void host_task_fail(int count);
+
+/**
+ * @brief Timers created with esp_timer_create() and not deleted
+ */
+int host_timer_count(void);
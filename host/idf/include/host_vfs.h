@@ -0,0 +1,31 @@
+/* Host stand-in of the FAT VFS limit: esp_vfs_fat_sdmmc_mount() opens at most
+   max_files (SD_MAX_FILES) files at the same time and fopen() fails past it.
+   Included before every main/ source of the host build (-include) */
+#pragma once
+#include <stdio.h>
+
+FILE* host_fopen(const char* path, const char* mode);
+int host_fclose(FILE* file);
+size_t host_fread(void* buffer, size_t size, size_t count, FILE* file);
+
+/**
+ * @brief Files open now, and the most that were open at the same time since the
+ *        last call (the peak is reset to the files open now)
+ */
+int host_vfs_open_files(void);
+int host_vfs_take_peak(void);
+
+/**
+ * @brief Files that can be open at the same time (SD_MAX_FILES by default)
+ */
+void host_vfs_set_max(int max_files);
+
+/**
+ * @brief After skip more calls to fread() the next one fails (0 items), like a
+ *        single read error of the card. -1 cancels it
+ */
+void host_vfs_fail_read(int skip);
+
+#define fopen(path, mode)   host_fopen(path, mode)
+#define fclose(file)        host_fclose(file)
+#define fread(buffer, size, count, file)    host_fread(buffer, size, count, file)
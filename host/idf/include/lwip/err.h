@@ -0,0 +1,2 @@
+/* Host stand-in of ESP-IDF: lwIP is not used, the host has its own sockets */
+#pragma once
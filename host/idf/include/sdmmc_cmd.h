@@ -0,0 +1,6 @@
+/* Host stand-in of ESP-IDF: only the types of the esp32_sd.h prototypes */
+#pragma once
+#include "esp_err.h"
+
+typedef struct sdmmc_card_s sdmmc_card_t;
+typedef struct { int slot; int max_freq_khz; } sdmmc_host_t;
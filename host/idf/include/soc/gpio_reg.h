@@ -0,0 +1,11 @@
+/* Host stand-in of ESP-IDF: the GPIO output register is a variable (host/idf/gpio.c),
+   read back by the tests with host_gpio_out() */
+#pragma once
+#include <stdint.h>
+
+#define GPIO_OUT_W1TS_REG       0x3FF44008  // Write 1 to set
+#define GPIO_OUT_W1TC_REG       0x3FF4400C  // Write 1 to clear
+
+void host_reg_write(uint32_t reg, uint32_t value);
+
+#define REG_WRITE(reg, value)   host_reg_write((reg), (value))
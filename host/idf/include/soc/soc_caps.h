@@ -0,0 +1,6 @@
+/* Host stand-in of ESP-IDF */
+#pragma once
+#include "esp_err.h"
+
+#define SOC_ADC_DIGI_RESULT_BYTES   2       // adc_digi_output_data_t of the ESP32
+#define SOC_ADC_DIGI_MAX_BITWIDTH   12
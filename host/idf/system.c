@@ -0,0 +1,122 @@
+/* Host stand-in of the ESP-IDF system calls used by main/: timer, CRC, random,
+   logs, error names, MAC address and the certificate bundle */
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_timer.h"
+#include "esp_random.h"
+#include "esp_rom_crc.h"
+#include "esp_crt_bundle.h"
+#include "esp_wifi.h"
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static pthread_once_t   s_log_once = PTHREAD_ONCE_INIT;
+static esp_log_level_t  s_log_level = ESP_LOG_WARN;
+
+
+int64_t esp_timer_get_time(void){
+    // Since the host booted: only differences are used
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (int64_t) now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+
+uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t* buf, uint32_t len){
+    // Reflected 0xEDB88320, inverted on input and output (same as zlib crc32())
+    crc = ~crc;
+    for (uint32_t i = 0; i < len; i++) {
+        crc ^= buf[i];
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+        }
+    }
+    return ~crc;
+}
+
+
+uint32_t esp_random(void){
+    static __thread unsigned int seed = 0;
+    if (seed == 0) {
+        seed = (unsigned int) time(NULL) ^ (unsigned int) (uintptr_t) &seed;
+    }
+    return ((uint32_t) rand_r(&seed) << 16) ^ (uint32_t) rand_r(&seed);
+}
+
+
+const char* esp_err_to_name(esp_err_t code){
+    switch (code) {
+        case ESP_OK:                return "ESP_OK";
+        case ESP_FAIL:              return "ESP_FAIL";
+        case ESP_ERR_NO_MEM:        return "ESP_ERR_NO_MEM";
+        case ESP_ERR_INVALID_ARG:   return "ESP_ERR_INVALID_ARG";
+        case ESP_ERR_INVALID_STATE: return "ESP_ERR_INVALID_STATE";
+        case ESP_ERR_INVALID_SIZE:  return "ESP_ERR_INVALID_SIZE";
+        case ESP_ERR_NOT_FOUND:     return "ESP_ERR_NOT_FOUND";
+        case ESP_ERR_NOT_SUPPORTED: return "ESP_ERR_NOT_SUPPORTED";
+        case ESP_ERR_TIMEOUT:       return "ESP_ERR_TIMEOUT";
+        case ESP_ERR_INVALID_RESPONSE: return "ESP_ERR_INVALID_RESPONSE";
+        case ESP_ERR_INVALID_CRC:   return "ESP_ERR_INVALID_CRC";
+    }
+    return "UNKNOWN ERROR";
+}
+
+
+static void host_log_level(void){
+    const char* level = getenv("NODO_LOG");
+    if (level == NULL) {
+        return;
+    }
+    switch (level[0]) {
+        case 'N': s_log_level = ESP_LOG_NONE;    break;
+        case 'E': s_log_level = ESP_LOG_ERROR;   break;
+        case 'W': s_log_level = ESP_LOG_WARN;    break;
+        case 'I': s_log_level = ESP_LOG_INFO;    break;
+        case 'D': s_log_level = ESP_LOG_DEBUG;   break;
+        case 'V': s_log_level = ESP_LOG_VERBOSE; break;
+    }
+}
+
+
+void host_log(esp_log_level_t level, const char* tag, const char* format, ...){
+    pthread_once(&s_log_once, host_log_level);
+    if (level > s_log_level) {
+        return;
+    }
+    static const char letters[] = "NEWIDV";
+    char message[512];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(message, sizeof(message), format, args);
+    va_end(args);
+    // main/ ends most messages with '\n', ESP_LOGx adds its own
+    size_t len = strlen(message);
+    while (len > 0 && message[len - 1] == '\n') {
+        message[--len] = '\0';
+    }
+    fprintf(stderr, "%c (%lld) %s: %s\n", letters[level], (long long) (esp_timer_get_time() / 1000), tag, message);
+}
+
+
+esp_err_t esp_wifi_get_mac(wifi_interface_t ifx, uint8_t mac[6]){
+    (void) ifx;
+    static const uint8_t host_mac[6] = { 0x24, 0x0A, 0xC4, 0x00, 0x00, 0x01 };
+    memcpy(mac, host_mac, sizeof(host_mac));
+    return ESP_OK;
+}
+
+
+esp_err_t esp_wifi_stop(void){
+    return ESP_OK;
+}
+
+
+esp_err_t esp_crt_bundle_attach(void* conf){
+    (void) conf;
+    return ESP_OK;
+}
@@ -0,0 +1,89 @@
+/* Host stand-in of the FAT VFS file table: counts the FILEs opened by main/
+   and fails with ENFILE past max_files, like the card mounted by esp32_sd_card.c.
+   fclose() syncs the file like f_close() of FatFs, so a file per record pays
+   its write to the card as on the ESP32. host_vfs_fail_read() makes one fread()
+   fail like a read error of the card */
+#include "host_vfs.h"
+#include "esp32_sd.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#undef fopen
+#undef fclose
+#undef fread
+
+static pthread_mutex_t s_vfs_lock = PTHREAD_MUTEX_INITIALIZER;
+static int s_vfs_max  = SD_MAX_FILES;
+static int s_vfs_open = 0;
+static int s_vfs_peak = 0;
+static int s_vfs_read_skip = -1;   // fread() calls before the one that fails
+
+
+FILE* host_fopen(const char* path, const char* mode){
+    pthread_mutex_lock(&s_vfs_lock);
+    if (s_vfs_open >= s_vfs_max) {
+        pthread_mutex_unlock(&s_vfs_lock);
+        fprintf(stderr, "VFS: %d archivos abiertos, no se puede abrir %s\n", s_vfs_open, path);
+        errno = ENFILE;
+        return NULL;
+    }
+    FILE* file = fopen(path, mode);
+    if (file != NULL) {
+        s_vfs_open++;
+        if (s_vfs_open > s_vfs_peak) {
+            s_vfs_peak = s_vfs_open;
+        }
+    }
+    pthread_mutex_unlock(&s_vfs_lock);
+    return file;
+}
+
+
+int host_fclose(FILE* file){
+    pthread_mutex_lock(&s_vfs_lock);
+    s_vfs_open--;
+    pthread_mutex_unlock(&s_vfs_lock);
+    fflush(file);
+    fsync(fileno(file));
+    return fclose(file);
+}
+
+
+size_t host_fread(void* buffer, size_t size, size_t count, FILE* file){
+    if (__atomic_load_n(&s_vfs_read_skip, __ATOMIC_SEQ_CST) >= 0 &&
+        __atomic_sub_fetch(&s_vfs_read_skip, 1, __ATOMIC_SEQ_CST) == -1) {
+        return 0;
+    }
+    return fread(buffer, size, count, file);
+}
+
+
+int host_vfs_open_files(void){
+    pthread_mutex_lock(&s_vfs_lock);
+    int open = s_vfs_open;
+    pthread_mutex_unlock(&s_vfs_lock);
+    return open;
+}
+
+
+int host_vfs_take_peak(void){
+    pthread_mutex_lock(&s_vfs_lock);
+    int peak = s_vfs_peak;
+    s_vfs_peak = s_vfs_open;
+    pthread_mutex_unlock(&s_vfs_lock);
+    return peak;
+}
+
+
+void host_vfs_set_max(int max_files){
+    pthread_mutex_lock(&s_vfs_lock);
+    s_vfs_max = max_files;
+    pthread_mutex_unlock(&s_vfs_lock);
+}
+
+
+void host_vfs_fail_read(int skip){
+    __atomic_store_n(&s_vfs_read_skip, skip, __ATOMIC_SEQ_CST);
+}
@@ -0,0 +1,240 @@
+/*  Throughput of the SD storage on the host: the segmented record log of
+    esp32_sd.c against the legacy storage of one file per record (<prefix>N.txt
+    + counter file) that it replaced.
+
+        log_bench [--records 10000] [--size 160] [--import 10000] [--sd <dir>]
+
+    append  : N records written (sd_log_append / create_file + counter)
+    iterate : N records read and removed (sd_log_iter_next + sd_log_commit /
+              leer_file_sd + delete_file_sd)
+    import  : --import legacy files moved into a log by sd_log_import_files(),
+              as sync_open() does on the first boot after an update (0 = skip)
+
+    The SD card is a directory (MOUNT_POINT "."): the figures are for comparing
+    both paths on the same machine, not the speed of the card */
+#include "esp32_sd.h"
+#include "esp32_mem.h"
+#include "esp_timer.h"
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define BENCH_BUFFER_SIZE       20480       // MAX_HTTP_OUTPUT_BUFFER of main.c
+#define BENCH_LOG_PREFIX        "bn_"
+#define BENCH_LOG_INDEX         "bench"
+#define BENCH_LEGACY_COUNT      "bench"
+#define BENCH_LEGACY_DATA       "bn"
+#define BENCH_IMPORT_PREFIX     "im_"
+#define BENCH_IMPORT_INDEX      "import"
+
+
+static void bench_report(const char* path, const char* phase, int records, int64_t start_us){
+    double seconds = (esp_timer_get_time() - start_us) / 1e6;
+    printf("%-7s %-8s %7d registros en %7.3f s = %9.1f reg/s\n", path, phase, records, seconds,
+           (seconds > 0) ? records / seconds : 0);
+    fflush(stdout);
+}
+
+
+// Registro de prueba: JSON de size bytes como los del Edge, distinto en cada seq
+static size_t bench_record(char* record, size_t size, int seq){
+    int length = snprintf(record, size, "{\"id\":%d,\"rfid\":\"982000%09d\",\"peso\":%d,\"obs\":\"", seq, seq, 300 + seq % 200);
+    while ((size_t) length < size - 3) {
+        record[length] = 'a' + (seq + length) % 26;
+        length++;
+    }
+    record[length++] = '"';
+    record[length++] = '}';
+    record[length] = '\0';
+    return length;
+}
+
+
+static int bench_log(int records, size_t size, char* buffer){
+    char record[BENCH_BUFFER_SIZE];
+    sd_log_t log;
+    sd_log_iter_t iter;
+    int read = 0;
+
+    if (sd_log_open(&log, BENCH_LOG_PREFIX, BENCH_LOG_INDEX) != ESP_OK) {
+        return -1;
+    }
+    int64_t start = esp_timer_get_time();
+    for (int i = 0; i < records; i++) {
+        size_t length = bench_record(record, size, i);
+        if (sd_log_append(&log, record, length) != ESP_OK) {
+            fprintf(stderr, "sd_log_append fallo en el registro %d\n", i);
+            return -1;
+        }
+    }
+    sd_log_close(&log);
+    bench_report("log", "append", records, start);
+
+    start = esp_timer_get_time();
+    size_t length;
+    sd_log_iter_begin(&log, &iter);
+    while (sd_log_iter_next(&iter, buffer, BENCH_BUFFER_SIZE, &length) == ESP_OK) {
+        bench_record(record, size, read);
+        if (length != size - 1 || memcmp(buffer, record, length) != 0) {
+            fprintf(stderr, "Registro %d distinto en el log\n", read);
+            return -1;
+        }
+        read++;
+    }
+    sd_log_cursor_t end = iter.pos;
+    sd_log_iter_end(&iter);
+    if (sd_log_commit(&log, &end) != ESP_OK) {
+        return -1;
+    }
+    bench_report("log", "iterate", read, start);
+    return read;
+}
+
+
+static int bench_legacy(int records, size_t size, char* buffer){
+    char record[BENCH_BUFFER_SIZE];
+    char name_file[30];
+    int read = 0;
+
+    // Como el firmware anterior: un archivo por registro y el contador al final del lote
+    int64_t start = esp_timer_get_time();
+    for (int i = 0; i < records; i++) {
+        bench_record(record, size, i);
+        snprintf(name_file, sizeof(name_file), "%s%d.txt", BENCH_LEGACY_DATA, i);
+        if (create_file(name_file, record) != ESP_OK) {
+            return -1;
+        }
+    }
+    snprintf(record, sizeof(record), "%d", records);
+    snprintf(name_file, sizeof(name_file), "%s.txt", BENCH_LEGACY_COUNT);
+    guardar_file_sd(record, name_file);
+    bench_report("legacy", "append", records, start);
+
+    start = esp_timer_get_time();
+    leer_file_sd(name_file, buffer, BENCH_BUFFER_SIZE);
+    int count = atoi(buffer);
+    for (int i = 0; i < count; i++) {
+        snprintf(name_file, sizeof(name_file), "%s%d.txt", BENCH_LEGACY_DATA, i);
+        size_t length = leer_file_sd(name_file, buffer, BENCH_BUFFER_SIZE);
+        bench_record(record, size, i);
+        if (length != size - 1 || memcmp(buffer, record, length) != 0) {
+            fprintf(stderr, "Registro %d distinto en %s\n", i, name_file);
+            return -1;
+        }
+        delete_file_sd(name_file);
+        read++;
+    }
+    snprintf(name_file, sizeof(name_file), "%s.txt", BENCH_LEGACY_COUNT);
+    delete_file_sd(name_file);
+    bench_report("legacy", "iterate", read, start);
+    return read;
+}
+
+
+static int bench_import(int files, size_t size, char* buffer){
+    char record[BENCH_BUFFER_SIZE];
+    char name_file[30];
+    sd_log_t log;
+    sd_log_iter_t iter;
+
+    // Los archivos del firmware anterior (fuera de la medicion)
+    for (int i = 0; i < files; i++) {
+        bench_record(record, size, i);
+        snprintf(name_file, sizeof(name_file), "%s%d.txt", BENCH_LEGACY_DATA, i);
+        if (create_file(name_file, record) != ESP_OK) {
+            return -1;
+        }
+    }
+    snprintf(record, sizeof(record), "%d", files);
+    snprintf(name_file, sizeof(name_file), "%s.txt", BENCH_LEGACY_COUNT);
+    guardar_file_sd(record, name_file);
+
+    if (sd_log_open(&log, BENCH_IMPORT_PREFIX, BENCH_IMPORT_INDEX) != ESP_OK) {
+        return -1;
+    }
+    int64_t start = esp_timer_get_time();
+    int imported = sd_log_import_files(&log, BENCH_LEGACY_COUNT, BENCH_LEGACY_DATA, buffer, BENCH_BUFFER_SIZE);
+    sd_log_close(&log);
+    bench_report("legacy", "import", imported, start);
+    if (file_exists(name_file)) {
+        fprintf(stderr, "%s sigue en la SD despues de importar\n", name_file);
+        return -1;
+    }
+
+    // Todos en el log, en orden y sin archivos sobrantes
+    int read = 0;
+    size_t length;
+    sd_log_iter_begin(&log, &iter);
+    while (sd_log_iter_next(&iter, buffer, BENCH_BUFFER_SIZE, &length) == ESP_OK) {
+        bench_record(record, size, read);
+        snprintf(name_file, sizeof(name_file), "%s%d.txt", BENCH_LEGACY_DATA, read);
+        if (length != size - 1 || memcmp(buffer, record, length) != 0 || file_exists(name_file)) {
+            fprintf(stderr, "Registro importado %d distinto (o %s sigue en la SD)\n", read, name_file);
+            sd_log_iter_end(&iter);
+            return -1;
+        }
+        read++;
+    }
+    sd_log_iter_end(&iter);
+    return (imported == read) ? read : -1;
+}
+
+
+int main(int argc, char** argv){
+    static char buffer[BENCH_BUFFER_SIZE];
+    int records = 10000;
+    int import = 10000;
+    size_t size = 160;
+    const char* sd = NULL;
+
+    static const struct option options[] = {
+        { "records", required_argument, NULL, 'r' },
+        { "size",    required_argument, NULL, 's' },
+        { "import",  required_argument, NULL, 'i' },
+        { "sd",      required_argument, NULL, 'd' },
+        { NULL, 0, NULL, 0 },
+    };
+    int option;
+    while ((option = getopt_long(argc, argv, "", options, NULL)) != -1) {
+        switch (option) {
+            case 'r': records = atoi(optarg); break;
+            case 's': size    = (size_t) atoi(optarg); break;
+            case 'i': import  = atoi(optarg); break;
+            case 'd': sd      = optarg; break;
+            default:
+                fprintf(stderr, "Uso: %s [--records N] [--size bytes] [--import N] [--sd dir]\n", argv[0]);
+                return 2;
+        }
+    }
+    if (size < 64 || size >= BENCH_BUFFER_SIZE) {
+        fprintf(stderr, "--size entre 64 y %d\n", BENCH_BUFFER_SIZE - 1);
+        return 2;
+    }
+
+    char sd_dir[] = "/tmp/nodo_sd.XXXXXX";
+    if (sd == NULL && (sd = mkdtemp(sd_dir)) == NULL) {
+        perror("mkdtemp");
+        return 1;
+    }
+    if (chdir(sd) != 0) {
+        perror(sd);
+        return 1;
+    }
+    printf("SD = %s, %d registros de %u bytes\n", sd, records, (unsigned) size);
+    mem_init();
+
+    int log_read = bench_log(records, size, buffer);
+    int legacy_read = bench_legacy(records, size, buffer);
+    if (log_read != records || legacy_read != records) {
+        fprintf(stderr, "Registros leidos: log = %d, legacy = %d, se esperaban %d\n", log_read, legacy_read, records);
+        return 1;
+    }
+    if (import > 0 && bench_import(import, size, buffer) != import) {
+        fprintf(stderr, "No se importaron los %d archivos\n", import);
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,219 @@
+/*  Benchmark of the sync engine on the host: replays the wake cycles of app_main
+    (main.c) with the SD card in a directory, the servers behind a local stand-in
+    (tools/edge_stub.py) and the Wi-Fi result of every cycle taken from a script.
+
+        sync_bench [--edge 127.0.0.1:5000] [--upload 127.0.0.1:5000]
+                   [--wifi EDGE,MODEM] [--sd <dir>] [--max-files 10]
+
+    For every EDGE cycle it reports the records downloaded, and for every MODEM
+    cycle the records uploaded, with records/s and the latency of the requests.
+    Every cycle also reports the most files open at the same time on the SD: past
+    --max-files (max_files of the FAT VFS) fopen() fails like on the card.
+    Every cycle runs in its own process: on the ESP32 deep sleep clears the RAM,
+    and the static buffers of main/ (arena, pools) count on it */
+#include "esp32_sync.h"
+#include "esp32_mem.h"
+#include "esp32_telem.h"
+#include "esp32_wifi.h"
+#include "credenciales.h"
+#include "host_idf.h"
+#include "host_vfs.h"
+#include "board.h"
+
+#include <getopt.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#define BENCH_BUFFER_SIZE       20480       // MAX_HTTP_OUTPUT_BUFFER of main.c
+#define BENCH_MAX_SAMPLES       (256 * 1024)
+#define BENCH_HOST_SIZE         128
+
+#define TAG_BENCH               "BENCH"
+
+static int64_t s_samples[BENCH_MAX_SAMPLES];
+
+
+static int bench_compare(const void* a, const void* b){
+    int64_t x = *(const int64_t*) a;
+    int64_t y = *(const int64_t*) b;
+    return (x > y) - (x < y);
+}
+
+
+static double bench_percentile(const int64_t* sorted, size_t count, int percent){
+    if (count == 0) {
+        return 0;
+    }
+    size_t index = (count * percent + 99) / 100;
+    return sorted[(index > 0 ? index : 1) - 1] / 1000.0;
+}
+
+
+/* One line per phase: records, records/s, requests and their latency in ms */
+static void bench_report(const char* phase, int records, int64_t elapsed_us, uint64_t sent, uint64_t received){
+    size_t count = host_http_take_samples(s_samples, BENCH_MAX_SAMPLES);
+    if (count > BENCH_MAX_SAMPLES) {
+        count = BENCH_MAX_SAMPLES;
+    }
+    qsort(s_samples, count, sizeof(int64_t), bench_compare);
+    double seconds = elapsed_us / 1e6;
+    printf("%-6s %7d registros en %7.3f s = %9.1f reg/s | %6u peticiones, latencia p50 = %.2f ms, "
+           "p90 = %.2f ms, p99 = %.2f ms, max = %.2f ms | %.1f KB enviados, %.1f KB recibidos\n",
+           phase, records, seconds, (seconds > 0) ? records / seconds : 0, (unsigned) count,
+           bench_percentile(s_samples, count, 50), bench_percentile(s_samples, count, 90),
+           bench_percentile(s_samples, count, 99), (count > 0) ? s_samples[count - 1] / 1000.0 : 0,
+           sent / 1024.0, received / 1024.0);
+    fflush(stdout);
+}
+
+
+/* host[:port] of a URL of credenciales.h */
+static void bench_url_host(const char* url, char* host, size_t size){
+    const char* start = strstr(url, "://");
+    start = (start != NULL) ? start + 3 : url;
+    size_t len = strcspn(start, "/?");
+    snprintf(host, size, "%.*s", (int) len, start);
+}
+
+
+static void bench_cycle(const char* ssid, char* buffer, size_t size){
+    static sync_t streams;
+    uint64_t sent0, received0, sent1, received1;
+
+    // Lo mismo que app_main en cada despertar
+    mem_init();
+    telem_init();
+    memset(&streams, 0, sizeof(streams));
+    if (sync_open(&streams, buffer, size) != ESP_OK) {
+        ESP_LOGE(TAG_BENCH, "No se pudieron abrir los logs de la SD\n");
+        exit(1);
+    }
+    if (streams.battery.file != NULL) {
+        sd_battery_append(&streams.battery, (uint32_t) time(NULL), 3900, sync_clock_valid() ? SD_BATTERY_DATED : 0);
+    }
+
+    if (strcmp(ssid, EDGE_AP) == 0) {
+        char url[100];
+        char localtime_buffer[60] = "";
+        esp_http_client_handle_t client = sync_edge_client();
+        if (client != NULL && snprintf(url, sizeof(url), "http://%s%s", edge_server, edge_localtime) < (int) sizeof(url)) {
+            esp_http_client_set_url(client, url);
+            get_request(client, localtime_buffer, sizeof(localtime_buffer));
+            sync_set_clock(&streams, localtime_buffer);
+        }
+        int edge_records = sync_edge_query(&streams);
+        host_http_take_samples(s_samples, BENCH_MAX_SAMPLES);
+
+        host_http_bytes(&sent0, &received0);
+        int64_t start = esp_timer_get_time();
+        int downloaded = sync_edge_download(&streams, buffer, size);
+        int64_t elapsed = esp_timer_get_time() - start;
+        host_http_bytes(&sent1, &received1);
+        bench_report("EDGE", downloaded, elapsed, sent1 - sent0, received1 - received0);
+        if (downloaded < edge_records || streams.edge_failed > 0) {
+            ESP_LOGW(TAG_BENCH, "Descargados %d de %d (%d streams con error)\n",
+                     downloaded, edge_records, streams.edge_failed);
+        }
+    }
+    else if (strcmp(ssid, MODEM_AP) == 0) {
+        uint32_t pending = sync_pending(&streams);
+        host_http_take_samples(s_samples, BENCH_MAX_SAMPLES);
+
+        host_http_bytes(&sent0, &received0);
+        int64_t start = esp_timer_get_time();
+        int failed = sync_upload(&streams);
+        int64_t elapsed = esp_timer_get_time() - start;
+        host_http_bytes(&sent1, &received1);
+        uint32_t left = sync_pending(&streams);
+        bench_report("MODEM", (int) (pending - left), elapsed, sent1 - sent0, received1 - received0);
+        if (failed != 0) {
+            ESP_LOGW(TAG_BENCH, "Registros con error = %d, pendientes = %u\n", failed, (unsigned) left);
+        }
+    }
+    else {
+        printf("%-6s sin red, los registros quedan en la SD (%u pendientes)\n", "-", (unsigned) sync_pending(&streams));
+    }
+
+    http_pool_cleanup();
+    sync_close(&streams);
+    printf("%-6s archivos abiertos a la vez en la SD = %d (max %d), abiertos al cerrar = %d\n",
+           "VFS", host_vfs_take_peak(), SD_MAX_FILES, host_vfs_open_files());
+}
+
+
+int main(int argc, char** argv){
+    static char buffer[BENCH_BUFFER_SIZE];
+    const char* edge   = "127.0.0.1:5000";
+    const char* upload = "127.0.0.1:5000";
+    const char* wifi   = "EDGE,MODEM";
+    const char* sd     = NULL;
+
+    static const struct option options[] = {
+        { "edge",   required_argument, NULL, 'e' },
+        { "upload", required_argument, NULL, 'u' },
+        { "wifi",   required_argument, NULL, 'w' },
+        { "sd",     required_argument, NULL, 's' },
+        { "max-files", required_argument, NULL, 'f' },
+        { NULL, 0, NULL, 0 },
+    };
+    int option;
+    while ((option = getopt_long(argc, argv, "", options, NULL)) != -1) {
+        switch (option) {
+            case 'e': edge   = optarg; break;
+            case 'u': upload = optarg; break;
+            case 'w': wifi   = optarg; break;
+            case 's': sd     = optarg; break;
+            case 'f': host_vfs_set_max(atoi(optarg)); break;
+            default:
+                fprintf(stderr, "Uso: %s [--edge host:port] [--upload host:port] [--wifi EDGE,MODEM,...] [--sd dir] "
+                        "[--max-files N]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    // La tarjeta SD es un directorio: MOUNT_POINT es "." en host/
+    char sd_dir[] = "/tmp/nodo_sd.XXXXXX";
+    if (sd == NULL && (sd = mkdtemp(sd_dir)) == NULL) {
+        perror("mkdtemp");
+        return 1;
+    }
+    if (chdir(sd) != 0) {
+        perror(sd);
+        return 1;
+    }
+    printf("SD = %s, edge = %s, servidores = %s, wifi = %s\n", sd, edge, upload, wifi);
+    fflush(stdout);
+
+    char host[BENCH_HOST_SIZE];
+    host_http_route(edge_server, edge);
+    bench_url_host(cst_server, host, sizeof(host));
+    host_http_route(host, upload);
+    bench_url_host(tpi_server, host, sizeof(host));
+    host_http_route(host, upload);
+
+    host_wifi_script(wifi);
+    while (host_wifi_pending()) {
+        char ssid[33];
+        wifi_scan(ssid, sizeof(ssid));
+        // El ciclo corre en un proceso nuevo, como despues de un deep sleep
+        pid_t pid = fork();
+        if (pid < 0) {
+            perror("fork");
+            return 1;
+        }
+        if (pid == 0) {
+            bench_cycle(ssid, buffer, sizeof(buffer));
+            exit(0);
+        }
+        int status;
+        if (waitpid(pid, &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            fprintf(stderr, "El ciclo %s termino con error\n", ssid);
+            return 1;
+        }
+    }
+    return 0;
+}
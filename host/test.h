@@ -0,0 +1,26 @@
+/*  Checks of the host tests (host/test_<module>.c): a failed CHECK prints where
+    and what, the test goes on and TEST_RESULT() makes main() return 1 */
+#pragma once
+#include <stdio.h>
+
+static int s_test_checks = 0;
+static int s_test_failed = 0;
+
+#define CHECK(cond) do {                                                        \
+        s_test_checks++;                                                        \
+        if (!(cond)) {                                                          \
+            s_test_failed++;                                                    \
+            fprintf(stderr, "%s:%d: CHECK(%s) fallo\n", __FILE__, __LINE__, #cond); \
+        }                                                                       \
+    } while (0)
+
+#define CHECK_EQ(a, b, fmt) do {                                                \
+        s_test_checks++;                                                        \
+        if ((a) != (b)) {                                                       \
+            s_test_failed++;                                                    \
+            fprintf(stderr, "%s:%d: %s = " fmt ", se esperaba " fmt "\n",       \
+                    __FILE__, __LINE__, #a, (a), (b));                          \
+        }                                                                       \
+    } while (0)
+
+#define TEST_RESULT() (printf("%d checks, %d fallidos\n", s_test_checks, s_test_failed), s_test_failed != 0)
@@ -0,0 +1,171 @@
+/*  esp32_battery.c against DMA traces of the ADC (host/idf/adc.c): the trimmed
+    mean ignores the other channel, the spikes and the voltage sag of a Wi-Fi
+    burst, the eFuse calibration is used when the chip has it, and over a whole
+    discharge the millivolts and the SOC follow the resting voltage of the cell.
+
+    The traces are built here from a resting voltage and the noise seen on the
+    pin (uniform noise, sag while the radio transmits, single-sample spikes) */
+#include "esp32_battery.h"
+#include "host_idf.h"
+#include "test.h"
+
+#include <stdlib.h>
+
+#define TEST_SLOPE_UV       800         // Line fitting: pin mV = raw * 0.8 + 75
+#define TEST_OFFSET_MV      75
+#define TEST_OTHER_CHANNEL  ADC_CHANNEL_5
+#define TEST_MAX_WORDS      (2 * BAT_SAMPLES)
+#define TEST_TOLERANCE_MV   10          // ~4 LSB of the ADC behind the divider
+#define TEST_TOLERANCE_SOC  3           // % on the steepest part of the curve
+
+static uint32_t s_rand = 1;
+
+
+static int test_rand(int min, int max){
+    s_rand = s_rand * 1103515245u + 12345u;
+    return min + (int) ((s_rand >> 8) % (uint32_t) (max - min + 1));
+}
+
+
+static uint16_t test_word(int channel, int raw){
+    raw = (raw < 0) ? 0 : (raw > 4095) ? 4095 : raw;
+    return (uint16_t) ((channel << 12) | raw);
+}
+
+
+// Raw del ADC para una tension de bateria con la calibracion de prueba
+static int test_raw(int millivolts){
+    float pin_mv = millivolts / BAT_DIVIDER;
+    return (int) ((pin_mv - TEST_OFFSET_MV) * 1000 / TEST_SLOPE_UV + 0.5f);
+}
+
+
+/*  Traza de una medicion: samples conversiones del canal de la bateria con
+    ruido, un tramo con la caida del Wi-Fi y picos sueltos, y cada 8 palabras
+    una de otro canal. Retorna las palabras escritas */
+static size_t test_trace(uint16_t* words, int raw, int samples){
+    size_t count = 0;
+    int sag_start = test_rand(0, samples - samples / 6);
+    for (int i = 0; i < samples; i++) {
+        if (count % 8 == 7) {
+            words[count++] = test_word(TEST_OTHER_CHANNEL, 4095);
+        }
+        int value = raw + test_rand(-8, 8);
+        if (i >= sag_start && i < sag_start + samples / 7) {
+            value -= 300;
+        }
+        int spike = test_rand(0, 99);
+        if (spike == 0) {
+            value = 0;
+        }
+        else if (spike == 1) {
+            value = 4095;
+        }
+        words[count++] = test_word(BAT_ADC_CHANNEL, value);
+    }
+    return count;
+}
+
+
+static void test_filter(void){
+    uint16_t samples[BAT_SAMPLES];
+    CHECK_EQ(battery_filter(samples, 0), 0, "%d");
+
+    samples[0] = 1234;
+    CHECK_EQ(battery_filter(samples, 1), 1234, "%d");
+
+    // 1/4 de picos arriba y 1/4 abajo no mueven el resultado
+    for (int i = 0; i < BAT_SAMPLES; i++) {
+        samples[i] = (i % 4 == 0) ? 4095 : (i % 4 == 1) ? 0 : 2000 + (i % 3);
+    }
+    CHECK_EQ(battery_filter(samples, BAT_SAMPLES), 2001, "%d");
+}
+
+
+static void test_soc_curve(void){
+    CHECK_EQ(battery_soc(0), 0, "%d");
+    CHECK_EQ(battery_soc(3270), 0, "%d");
+    CHECK_EQ(battery_soc(3840), 50, "%d");
+    CHECK_EQ(battery_soc(4200), 100, "%d");
+    CHECK_EQ(battery_soc(4350), 100, "%d");
+
+    // Monotona y sin saltos: 1 mV nunca cambia mas de 1 %
+    int previous = battery_soc(3000);
+    int monotonic = 1, step = 1;
+    for (int millivolts = 3001; millivolts <= 4300; millivolts++) {
+        int soc = battery_soc(millivolts);
+        monotonic = monotonic && soc >= previous;
+        step = step && soc - previous <= 1;
+        previous = soc;
+    }
+    CHECK(monotonic);
+    CHECK(step);
+}
+
+
+static void test_measure(void){
+    uint16_t words[TEST_MAX_WORDS];
+    battery_reading_t reading;
+
+    // Con calibracion eFuse: la conversion de adc_cali, las muestras de otro canal no cuentan
+    host_adc_calibration(TEST_SLOPE_UV, TEST_OFFSET_MV);
+    host_adc_trace(words, test_trace(words, test_raw(3900), BAT_SAMPLES));
+    CHECK_EQ(battery_measure(&reading), ESP_OK, "%d");
+    CHECK_EQ(reading.samples, BAT_SAMPLES, "%d");
+    CHECK_EQ(reading.calibrated, 1, "%d");
+    CHECK(abs((int) reading.millivolts - 3900) <= TEST_TOLERANCE_MV);
+    CHECK_EQ(reading.soc, battery_soc(reading.millivolts), "%d");
+
+    // Sin calibracion: la formula anterior raw * 1.6 / 620.61
+    host_adc_calibration(0, 0);
+    int raw = 1551;
+    host_adc_trace(words, test_trace(words, raw, BAT_SAMPLES));
+    CHECK_EQ(battery_measure(&reading), ESP_OK, "%d");
+    CHECK_EQ(reading.calibrated, 0, "%d");
+    CHECK(abs((int) reading.millivolts - (int) (raw * BAT_RAW_TO_V * 1000)) <= TEST_TOLERANCE_MV);
+
+    // El DMA entrega menos muestras: se usan las que llegaron; ninguna es un error
+    host_adc_trace(words, test_trace(words, raw, BAT_SAMPLES / 4));
+    CHECK_EQ(battery_measure(&reading), ESP_OK, "%d");
+    CHECK_EQ(reading.samples, BAT_SAMPLES / 4, "%d");
+    host_adc_trace(NULL, 0);
+    CHECK(battery_measure(&reading) != ESP_OK);
+}
+
+
+/*  Descarga completa de la celda, de 4.18 V a 3.30 V: una medicion por cada
+    despertar. Los mV siguen la tension de reposo y el SOC solo baja */
+static void test_discharge(void){
+    uint16_t words[TEST_MAX_WORDS];
+    battery_reading_t reading;
+    int previous_soc = 100;
+    int worst_mv = 0, worst_soc = 0, rises = 0;
+
+    host_adc_calibration(TEST_SLOPE_UV, TEST_OFFSET_MV);
+    for (int rest_mv = 4180; rest_mv >= 3300; rest_mv -= 20) {
+        host_adc_trace(words, test_trace(words, test_raw(rest_mv), BAT_SAMPLES));
+        if (battery_measure(&reading) != ESP_OK) {
+            CHECK(0);
+            break;
+        }
+        int error_mv = abs((int) reading.millivolts - rest_mv);
+        int error_soc = abs((int) reading.soc - (int) battery_soc(rest_mv));
+        worst_mv  = (error_mv > worst_mv) ? error_mv : worst_mv;
+        worst_soc = (error_soc > worst_soc) ? error_soc : worst_soc;
+        rises += (reading.soc > previous_soc);
+        previous_soc = reading.soc;
+    }
+    printf("Descarga: error maximo %d mV, %d %% de SOC\n", worst_mv, worst_soc);
+    CHECK(worst_mv <= TEST_TOLERANCE_MV);
+    CHECK(worst_soc <= TEST_TOLERANCE_SOC);
+    CHECK_EQ(rises, 0, "%d");
+}
+
+
+int main(void){
+    test_filter();
+    test_soc_curve();
+    test_measure();
+    test_discharge();
+    return TEST_RESULT();
+}
@@ -0,0 +1,543 @@
+/*  Round trips of esp32_codec.c:
+
+    cbor    : JSON -> CBOR -> JSON gives the same tree (same keys in the same
+              order, strings byte by byte, numbers with the same double) and
+              encoding the result again gives the same CBOR. Fixed cases plus
+              random documents; too small buffers and nesting deeper than the
+              decoder accepts must fail instead of producing unreadable CBOR
+    deflate : codec_compress() in gzip and zlib format inflated by zlib gives
+              back the input, with the CRC32/Adler-32 checked by zlib
+    log     : codec_log_append() stores CBOR when it can and text otherwise,
+              and the records read back from the log decode to the same JSON
+
+        test_codec [--iterations 500] [--seed 1] */
+#include "esp32_codec.h"
+#include "esp32_mem.h"
+#include "test.h"
+
+#include <getopt.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#define TEST_JSON_SIZE      (2 * CODEC_MAX_RECORD)
+#define TEST_CANARY         0xA5
+#define TEST_MAX_INPUT      60000       // codec_compress() takes up to 0xFFFF bytes
+#define TEST_DEPTH_SIZE     (6 * (CODEC_MAX_DEPTH + 4) + 16)
+#define TEST_PREFIX         "tc_"
+#define TEST_INDEX          "tcidx"
+
+static uint32_t s_rand;
+static uint16_t s_hash_table[CODEC_HASH_SIZE];
+
+
+static uint32_t test_rand(void){
+    s_rand ^= s_rand << 13;
+    s_rand ^= s_rand >> 17;
+    s_rand ^= s_rand << 5;
+    return s_rand;
+}
+
+
+static uint32_t test_range(uint32_t min, uint32_t max){
+    return min + test_rand() % (max - min + 1);
+}
+
+
+// Mismo arbol: tipos, claves en el mismo orden, strings y doubles identicos
+static int test_json_equal(const cJSON* a, const cJSON* b){
+    if ((a->type & 0xFF) != (b->type & 0xFF)) {
+        return 0;
+    }
+    if ((a->string == NULL) != (b->string == NULL) || (a->string != NULL && strcmp(a->string, b->string) != 0)) {
+        return 0;
+    }
+    if (cJSON_IsString(a)) {
+        return strcmp(a->valuestring, b->valuestring) == 0;
+    }
+    if (cJSON_IsNumber(a)) {
+        return a->valuedouble == b->valuedouble;
+    }
+    const cJSON* child_a = a->child;
+    const cJSON* child_b = b->child;
+    for (; child_a != NULL && child_b != NULL; child_a = child_a->next, child_b = child_b->next) {
+        if (!test_json_equal(child_a, child_b)) {
+            return 0;
+        }
+    }
+    return child_a == NULL && child_b == NULL;
+}
+
+
+/*  JSON -> CBOR -> JSON -> CBOR. Retorna 1 si el arbol y el CBOR se mantienen;
+    en decoded queda el JSON decodificado */
+static int test_cbor_round_trip(const char* json, char* decoded, size_t decoded_size){
+    static uint8_t cbor[TEST_JSON_SIZE];
+    static uint8_t cbor_again[TEST_JSON_SIZE];
+    int cbor_length = codec_json_to_cbor(json, strlen(json), cbor, sizeof(cbor));
+    if (cbor_length <= 0) {
+        fprintf(stderr, "No se pudo codificar: %.200s\n", json);
+        return 0;
+    }
+    int json_length = codec_cbor_to_json(cbor, cbor_length, decoded, decoded_size);
+    if (json_length < 0 || (size_t) json_length != strlen(decoded)) {
+        fprintf(stderr, "No se pudo decodificar: %.200s\n", json);
+        return 0;
+    }
+
+    cJSON* original = cJSON_Parse(json);
+    cJSON* result = cJSON_Parse(decoded);
+    int equal = original != NULL && result != NULL && test_json_equal(original, result);
+    cJSON_Delete(original);
+    cJSON_Delete(result);
+    if (!equal) {
+        fprintf(stderr, "Distinto despues de CBOR:\n  %.300s\n  %.300s\n", json, decoded);
+        return 0;
+    }
+
+    int again = codec_json_to_cbor(decoded, json_length, cbor_again, sizeof(cbor_again));
+    if (again != cbor_length || memcmp(cbor, cbor_again, cbor_length) != 0) {
+        fprintf(stderr, "El CBOR cambia al codificar otra vez: %.200s\n", json);
+        return 0;
+    }
+    return 1;
+}
+
+
+static void test_cbor_cases(void){
+    static char decoded[TEST_JSON_SIZE];
+    static const struct {
+        const char* json;
+        const char* expected;     // NULL = solo el arbol
+    } cases[] = {
+        { "{\"id\":1,\"rfid\":\"982000123456789\",\"peso\":301.25,\"ok\":true,\"obs\":null}",
+          "{\"id\":1,\"rfid\":\"982000123456789\",\"peso\":301.25,\"ok\":true,\"obs\":null}" },
+        { " [ 0 , -1 , 23 , 24 , 255 , 256 , 65535 , 65536 , 4294967296 , -4294967297 ] ",
+          "[0,-1,23,24,255,256,65535,65536,4294967296,-4294967297]" },
+        { "[9007199254740991,-9007199254740991]", "[9007199254740991,-9007199254740991]" },
+        { "[0.5,-2.25,0.1,1e-7,3.4028234663852886e-38,1.401298464324817e-45,2.2250738585072014e-308]", NULL },
+        { "[0.30000001192092896,16777217.5,1.5e-300,-0.0,8e6]", NULL },
+        { "\"comillas \\\" barra \\\\ control \\n\\t\\u0001 unicode \\u00f1\\u20ac\\ud83d\\ude00\"",
+          "\"comillas \\\" barra \\\\ control \\u000a\\u0009\\u0001 unicode \xc3\xb1\xe2\x82\xac\xf0\x9f\x98\x80\"" },
+        { "{\"\":{},\"a\":[],\"b\":[[[]]],\"a\":2}", "{\"\":{},\"a\":[],\"b\":[[[]]],\"a\":2}" },
+        { "true", "true" },
+    };
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        int ok = test_cbor_round_trip(cases[i].json, decoded, sizeof(decoded));
+        CHECK(ok);
+        if (ok && cases[i].expected != NULL && strcmp(decoded, cases[i].expected) != 0) {
+            fprintf(stderr, "Caso %u: %s, se esperaba %s\n", (unsigned) i, decoded, cases[i].expected);
+            CHECK(0);
+        }
+    }
+
+    // JSON invalido, enteros desde 2^53 (el double ya perdio precision), Inf no existe en JSON
+    uint8_t cbor[64];
+    const char* invalid[] = { "", "{", "[1,]", "{\"a\"}", "nul", "18014398509481985", "[1.5e300]", "[1e400]" };
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++) {
+        CHECK_EQ(codec_json_to_cbor(invalid[i], strlen(invalid[i]), cbor, sizeof(cbor)), -1, "%d");
+    }
+
+    // CBOR truncado o con tipos que el codificador no escribe
+    const char* json = "{\"a\":[1,\"xyz\",2.5]}";
+    int length = codec_json_to_cbor(json, strlen(json), cbor, sizeof(cbor));
+    for (int cut = 0; cut < length; cut++) {
+        CHECK_EQ(codec_cbor_to_json(cbor, cut, decoded, sizeof(decoded)), -1, "%d");
+    }
+    const uint8_t bytes[] = { 0x41, 0x00 };         // Byte string
+    const uint8_t tag[] = { 0xC1, 0x00 };           // Tag 1
+    const uint8_t indefinite[] = { 0x9F, 0xFF };    // Array de largo indefinido
+    const uint8_t key[] = { 0xA1, 0x01, 0x02 };     // Clave que no es texto
+    CHECK_EQ(codec_cbor_to_json(bytes, sizeof(bytes), decoded, sizeof(decoded)), -1, "%d");
+    CHECK_EQ(codec_cbor_to_json(tag, sizeof(tag), decoded, sizeof(decoded)), -1, "%d");
+    CHECK_EQ(codec_cbor_to_json(indefinite, sizeof(indefinite), decoded, sizeof(decoded)), -1, "%d");
+    CHECK_EQ(codec_cbor_to_json(key, sizeof(key), decoded, sizeof(decoded)), -1, "%d");
+}
+
+
+// Buffers justos: con un byte menos falla sin escribir fuera del buffer
+static void test_cbor_limits(void){
+    static uint8_t cbor[256 + 1];
+    static char decoded[256 + 1];
+    const char* json = "{\"id\":12345,\"rfid\":\"982000123456789\",\"peso\":301.25,\"lista\":[1,2,3]}";
+    int cbor_length = codec_json_to_cbor(json, strlen(json), cbor, 256);
+    int json_length = codec_cbor_to_json(cbor, cbor_length, decoded, 256);
+    CHECK(cbor_length > 0 && json_length > 0);
+
+    int overflow = 0;
+    for (int size = 0; size < cbor_length; size++) {
+        memset(cbor, TEST_CANARY, sizeof(cbor));
+        overflow += codec_json_to_cbor(json, strlen(json), cbor, size) != -1 || cbor[size] != TEST_CANARY;
+    }
+    codec_json_to_cbor(json, strlen(json), cbor, sizeof(cbor));
+    for (int size = 0; size <= json_length; size++) {
+        memset(decoded, TEST_CANARY, sizeof(decoded));
+        overflow += codec_cbor_to_json(cbor, cbor_length, decoded, size) != -1 ||
+                    (uint8_t) decoded[size] != TEST_CANARY;
+    }
+    CHECK_EQ(overflow, 0, "%d");
+    CHECK_EQ(codec_cbor_to_json(cbor, cbor_length, decoded, json_length + 1), json_length, "%d");
+}
+
+
+// Anidamiento: hasta CODEC_MAX_DEPTH ida y vuelta, mas profundo no se codifica
+static void test_cbor_depth(void){
+    static char json[TEST_DEPTH_SIZE];
+    static char decoded[TEST_DEPTH_SIZE];
+    uint8_t cbor[TEST_DEPTH_SIZE];
+    for (int depth = 1; depth <= CODEC_MAX_DEPTH + 4; depth++) {
+        size_t length = 0;
+        for (int i = 0; i < depth; i++) {
+            json[length++] = (i % 2) ? '[' : '{';
+            if (i % 2 == 0) {
+                length += sprintf(json + length, "\"k\":");
+            }
+        }
+        json[length++] = '1';
+        for (int i = depth - 1; i >= 0; i--) {
+            json[length++] = (i % 2) ? ']' : '}';
+        }
+        json[length] = '\0';
+
+        int cbor_length = codec_json_to_cbor(json, length, cbor, sizeof(cbor));
+        if (depth <= CODEC_MAX_DEPTH) {
+            CHECK(cbor_length > 0 && codec_cbor_to_json(cbor, cbor_length, decoded, sizeof(decoded)) == (int) length);
+        }
+        else {
+            // Lo que se codifica se tiene que poder leer
+            CHECK(cbor_length == -1 || codec_cbor_to_json(cbor, cbor_length, decoded, sizeof(decoded)) > 0);
+        }
+    }
+}
+
+
+/* ------------------------- JSON al azar ------------------------- */
+
+typedef struct {
+    char*  text;
+    size_t length;
+    size_t size;
+} test_text_t;
+
+
+static void test_put(test_text_t* text, const char* data){
+    size_t length = strlen(data);
+    if (text->length + length < text->size) {
+        memcpy(text->text + text->length, data, length + 1);
+        text->length += length;
+    }
+}
+
+
+static void test_put_space(test_text_t* text){
+    static const char* const spaces[] = { "", "", "", " ", "\n", "\t", "  \r\n" };
+    test_put(text, spaces[test_range(0, 6)]);
+}
+
+
+static void test_put_string(test_text_t* text){
+    static const char* const pieces[] = {
+        "a", "Z", "0", " ", "\\\"", "\\\\", "\\/", "\\n", "\\t", "\\b", "\\f", "\\r", "\\u0000", "\\u001f",
+        "\\u00e9", "\xc3\xb1", "\xe2\x82\xac", "\\ud83d\\ude00", "\xf0\x9f\x90\x84", "peso", "rfid", "}", "]", ":", ",",
+    };
+    test_put(text, "\"");
+    for (int i = test_range(0, 12); i > 0; i--) {
+        test_put(text, pieces[test_range(0, sizeof(pieces) / sizeof(pieces[0]) - 1)]);
+    }
+    test_put(text, "\"");
+}
+
+
+static void test_put_number(test_text_t* text){
+    char number[40];
+    int64_t big = ((int64_t) test_rand() << 21) ^ test_rand();     // Hasta 2^53
+    switch (test_range(0, 7)) {
+        case 0: snprintf(number, sizeof(number), "%d", (int) test_range(0, 30)); break;
+        case 1: snprintf(number, sizeof(number), "%d", -(int) test_range(1, 70000)); break;
+        case 2: snprintf(number, sizeof(number), "%lld", (long long) big * (test_range(0, 1) ? 1 : -1)); break;
+        case 3: snprintf(number, sizeof(number), "%d.%02d", (int) test_range(0, 999), (int) test_range(0, 99)); break;
+        case 4: snprintf(number, sizeof(number), "%.9g", (double) ((float) test_rand() / (float) test_rand())); break;
+        case 5: snprintf(number, sizeof(number), "%.17g", (double) test_rand() / (double) test_rand() * 1e-3); break;
+        case 6: snprintf(number, sizeof(number), "%de%d", (int) test_range(1, 9), (int) test_range(0, 20) - 10); break;
+        default: snprintf(number, sizeof(number), "-%d.%dE+%d", (int) test_range(1, 9), (int) test_range(0, 9), (int) test_range(0, 3)); break;
+    }
+    test_put(text, number);
+}
+
+
+static void test_put_value(test_text_t* text, int depth){
+    int kind = test_range(0, (depth < CODEC_MAX_DEPTH - 1) ? 7 : 4);
+    test_put_space(text);
+    switch (kind) {
+        case 0: test_put(text, "true"); break;
+        case 1: test_put(text, test_range(0, 1) ? "false" : "null"); break;
+        case 2: test_put_string(text); break;
+        case 3:
+        case 4: test_put_number(text); break;
+        default: {
+            int is_object = kind == 7 || test_range(0, 1);
+            test_put(text, is_object ? "{" : "[");
+            for (int i = test_range(0, 6), first = 1; i > 0; i--, first = 0) {
+                if (!first) {
+                    test_put(text, ",");
+                }
+                if (is_object) {
+                    test_put_space(text);
+                    test_put_string(text);
+                    test_put_space(text);
+                    test_put(text, ":");
+                }
+                test_put_value(text, depth + 1);
+            }
+            test_put_space(text);
+            test_put(text, is_object ? "}" : "]");
+        }
+    }
+    test_put_space(text);
+}
+
+
+static void test_cbor_random(int iterations){
+    static char json[CODEC_MAX_RECORD];
+    static char decoded[TEST_JSON_SIZE];
+    int failed = 0;
+    for (int i = 0; i < iterations; i++) {
+        test_text_t text = { json, 0, sizeof(json) };
+        json[0] = '\0';
+        test_put_value(&text, 0);
+        // Un documento cortado por el limite del buffer de prueba no es JSON valido
+        cJSON* parsed = cJSON_Parse(json);
+        if (parsed == NULL) {
+            continue;
+        }
+        cJSON_Delete(parsed);
+        failed += !test_cbor_round_trip(json, decoded, sizeof(decoded));
+    }
+    CHECK_EQ(failed, 0, "%d");
+}
+
+
+/* ---------------------------- Deflate ---------------------------- */
+
+// Descomprime con zlib (gzip o zlib segun encoding). Retorna el largo o -1
+static int test_inflate(const uint8_t* in, size_t length, uint8_t* out, size_t out_size, enum _codec_encoding encoding){
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    if (inflateInit2(&stream, MAX_WBITS + (encoding == CODEC_ENCODING_GZIP ? 16 : 0)) != Z_OK) {
+        return -1;
+    }
+    stream.next_in   = (Bytef*) in;
+    stream.avail_in  = length;
+    stream.next_out  = out;
+    stream.avail_out = out_size;
+    int ret = inflate(&stream, Z_FINISH);
+    int total = stream.total_out;
+    int rest = stream.avail_in;
+    inflateEnd(&stream);
+    return (ret == Z_STREAM_END && rest == 0) ? total : -1;
+}
+
+
+static int test_deflate_one(const char* name, const uint8_t* in, size_t length, int print){
+    static uint8_t compressed[TEST_MAX_INPUT * 2];
+    static uint8_t inflated[TEST_MAX_INPUT + 1];
+    static const enum _codec_encoding encodings[] = { CODEC_ENCODING_GZIP, CODEC_ENCODING_DEFLATE };
+    int ok = 1;
+    for (int e = 0; e < 2; e++) {
+        int size = codec_compress(in, length, compressed, sizeof(compressed), encodings[e], s_hash_table);
+        int back = (size > 0) ? test_inflate(compressed, size, inflated, sizeof(inflated), encodings[e]) : -1;
+        if (back != (int) length || memcmp(in, inflated, length) != 0) {
+            fprintf(stderr, "%s (%u bytes) en %s: comprimido = %d, inflado = %d\n", name, (unsigned) length,
+                    codec_encoding_name(encodings[e]), size, back);
+            ok = 0;
+        }
+        else if (print && encodings[e] == CODEC_ENCODING_GZIP) {
+            printf("deflate %-10s %6u -> %6d bytes (%.0f %%)\n", name, (unsigned) length, size,
+                   length > 0 ? 100.0 * size / length : 0);
+        }
+    }
+    return ok;
+}
+
+
+// Lote de registros como los que sube upload: JSON parecidos entre si
+static size_t test_batch(uint8_t* out, size_t size){
+    size_t length = 0;
+    out[length++] = '[';
+    for (int i = 0; length + 200 < size; i++) {
+        length += snprintf((char*) out + length, size - length,
+                           "%s{\"id\":%d,\"rfid\":\"982000%09u\",\"peso\":%u.%u,\"fecha\":\"2026-10-%02u 08:%02u:%02u\"}",
+                           i ? "," : "", i, (unsigned) test_range(0, 999999999), (unsigned) test_range(250, 450),
+                           (unsigned) test_range(0, 9), (unsigned) test_range(1, 28), (unsigned) test_range(0, 59),
+                           (unsigned) test_range(0, 59));
+    }
+    out[length++] = ']';
+    return length;
+}
+
+
+static void test_deflate(int iterations){
+    static uint8_t input[TEST_MAX_INPUT];
+    static uint8_t compressed[TEST_MAX_INPUT * 2];
+
+    CHECK(test_deflate_one("vacio", input, 0, 0));
+    input[0] = 'x';
+    CHECK(test_deflate_one("1 byte", input, 1, 0));
+
+    size_t length = test_batch(input, 8192);
+    CHECK(test_deflate_one("lote", input, length, 1));
+    int size = codec_compress(input, length, compressed, sizeof(compressed), CODEC_ENCODING_GZIP, s_hash_table);
+    CHECK(size > 0 && (size_t) size < length / 2);
+
+    for (size_t i = 0; i < TEST_MAX_INPUT; i++) {
+        input[i] = test_rand();
+    }
+    CHECK(test_deflate_one("al azar", input, TEST_MAX_INPUT, 1));
+
+    // Coincidencias largas y a la distancia maxima de la ventana
+    memset(input, 'a', TEST_MAX_INPUT);
+    CHECK(test_deflate_one("repetido", input, TEST_MAX_INPUT, 1));
+    for (size_t i = 0; i < TEST_MAX_INPUT; i++) {
+        input[i] = (i < CODEC_WINDOW_SIZE - 100) ? test_rand() : input[i - (CODEC_WINDOW_SIZE - 100)];
+    }
+    CHECK(test_deflate_one("ventana", input, TEST_MAX_INPUT, 1));
+    for (size_t i = 0; i < TEST_MAX_INPUT; i++) {
+        input[i] = (i < CODEC_WINDOW_SIZE + 100) ? test_rand() : input[i - (CODEC_WINDOW_SIZE + 100)];
+    }
+    CHECK(test_deflate_one("fuera", input, TEST_MAX_INPUT, 0));
+
+    // Al azar: largos y alfabetos distintos
+    int failed = 0;
+    for (int i = 0; i < iterations; i++) {
+        size_t random_length = test_range(0, (i % 10 == 0) ? TEST_MAX_INPUT : 2000);
+        uint32_t alphabet = test_range(1, 256);
+        for (size_t j = 0; j < random_length; j++) {
+            input[j] = (test_range(0, 3) == 0 && j > 300) ? input[j - test_range(1, 300)] : test_rand() % alphabet;
+        }
+        failed += !test_deflate_one("al azar", input, random_length, 0);
+    }
+    CHECK_EQ(failed, 0, "%d");
+
+    // Sin lugar: -1 sin escribir fuera del buffer; mas de 0xFFFF bytes no se aceptan
+    length = test_batch(input, 2000);
+    size = codec_compress(input, length, compressed, sizeof(compressed), CODEC_ENCODING_DEFLATE, s_hash_table);
+    int overflow = 0;
+    for (int out_size = 0; out_size < size; out_size++) {
+        memset(compressed, TEST_CANARY, sizeof(compressed));
+        overflow += codec_compress(input, length, compressed, out_size, CODEC_ENCODING_DEFLATE, s_hash_table) != -1 ||
+                    compressed[out_size] != TEST_CANARY;
+    }
+    CHECK_EQ(overflow, 0, "%d");
+    CHECK_EQ(codec_compress(input, 0xFFFF, compressed, sizeof(compressed), CODEC_ENCODING_GZIP, s_hash_table), -1, "%d");
+    CHECK_EQ(codec_compress(input, 10, compressed, sizeof(compressed), CODEC_ENCODING_NONE, s_hash_table), -1, "%d");
+}
+
+
+/* ------------------------------ Log ------------------------------ */
+
+static void test_log(void){
+    static char big[CODEC_MAX_RECORD + 100];
+    static char buffer[TEST_JSON_SIZE];
+    static char decoded[TEST_JSON_SIZE];
+    const char* records[] = {
+        "{\"id\":1,\"rfid\":\"982000123456789\",\"peso\":301.25}",
+        "{\"id\":2,\"nota\":\"\\u00f1and\\u00fa\",\"lista\":[1,2.5,null,false]}",
+        "no es JSON",
+        "{\"a\":{\"a\":{\"a\":{\"a\":{\"a\":{\"a\":{\"a\":{\"a\":{\"a\":{\"a\":{\"a\":{\"a\":{\"a\":{\"a\":"
+            "{\"a\":{\"a\":{\"a\":{\"a\":{\"a\":1}}}}}}}}}}}}}}}}}}}",
+        big,
+    };
+    int count = sizeof(records) / sizeof(records[0]);
+
+    // Un registro mas grande que CODEC_MAX_RECORD va como texto
+    size_t length = snprintf(big, sizeof(big), "{\"obs\":\"");
+    while (length < CODEC_MAX_RECORD + 10) {
+        big[length] = 'a' + length % 26;
+        length++;
+    }
+    strcpy(big + length, "\"}");
+
+    sd_log_t log;
+    sd_log_iter_t iter;
+    CHECK_EQ(sd_log_open(&log, TEST_PREFIX, TEST_INDEX), ESP_OK, "%d");
+    for (int i = 0; i < count; i++) {
+        CHECK_EQ(codec_log_append(&log, records[i], strlen(records[i])), ESP_OK, "%d");
+    }
+
+    int read = 0;
+    size_t record_length;
+    sd_log_iter_begin(&log, &iter);
+    while (read < count && sd_log_iter_next(&iter, buffer, sizeof(buffer), &record_length) == ESP_OK) {
+        const char* json = records[read];
+        if (iter.current.flags & SD_LOG_FLAG_CBOR) {
+            int json_length = codec_cbor_to_json((const uint8_t*) buffer, record_length, decoded, sizeof(decoded));
+            cJSON* original = cJSON_Parse(json);
+            cJSON* result = (json_length > 0) ? cJSON_Parse(decoded) : NULL;
+            CHECK(original != NULL && result != NULL && test_json_equal(original, result));
+            CHECK(record_length < strlen(json));
+            cJSON_Delete(original);
+            cJSON_Delete(result);
+        }
+        else {
+            // Texto: solo cuando no se podia (o no se debia) codificar
+            CHECK(record_length == strlen(json) && memcmp(buffer, json, record_length) == 0);
+            CHECK(!CONFIG_NODO_STORE_CBOR || strlen(json) > CODEC_MAX_RECORD ||
+                  codec_json_to_cbor(json, strlen(json), (uint8_t*) decoded, sizeof(decoded)) < 0);
+        }
+        read++;
+    }
+    sd_log_iter_end(&iter);
+    sd_log_close(&log);
+    CHECK_EQ(read, count, "%d");
+}
+
+
+int main(int argc, char** argv){
+    int iterations = 500;
+    uint32_t seed = 1;
+
+    static const struct option options[] = {
+        { "iterations", required_argument, NULL, 'i' },
+        { "seed",       required_argument, NULL, 's' },
+        { NULL, 0, NULL, 0 },
+    };
+    int option;
+    while ((option = getopt_long(argc, argv, "", options, NULL)) != -1) {
+        switch (option) {
+            case 'i': iterations = atoi(optarg); break;
+            case 's': seed = strtoul(optarg, NULL, 0); break;
+            default:
+                fprintf(stderr, "Uso: %s [--iterations N] [--seed S]\n", argv[0]);
+                return 2;
+        }
+    }
+    s_rand = seed * 2654435761u + 1;
+    // Los registros que van como texto avisan con un warning
+    setenv("NODO_LOG", "N", 0);
+
+    test_cbor_cases();
+    test_cbor_limits();
+    test_cbor_depth();
+    test_cbor_random(iterations);
+    test_deflate(iterations / 5);
+
+    // La tarjeta SD es un directorio: MOUNT_POINT es "." en host/
+    char sd_dir[] = "/tmp/nodo_test_codec.XXXXXX";
+    if (mkdtemp(sd_dir) == NULL || chdir(sd_dir) != 0) {
+        perror(sd_dir);
+        return 1;
+    }
+    mem_init();
+    test_log();
+    char path[SD_PATH_SIZE];
+    for (int segment = 0; segment < 4; segment++) {
+        snprintf(path, sizeof(path), "%s%05X.log", TEST_PREFIX, segment);
+        remove(path);
+    }
+    if (chdir("/") == 0) {
+        rmdir(sd_dir);
+    }
+    return TEST_RESULT();
+}
@@ -0,0 +1,453 @@
+/*  esp32_http.c against an HTTP sink in the same process (one thread per
+    connection, keep-alive): http_post_stream() delivers byte-identical bodies
+    whatever the block size and the short reads of the reader, from RAM and
+    streamed from the record log, bodies far bigger than the 20 KB buffer of
+    the old uploads included. A reader that fails aborts the request before the
+    server sees a complete body, a response bigger than the buffer is cut, and
+    the client keeps working after both. A kept connection that the server
+    closes with the request on the way is retried once on a new one, a new
+    connection that fails is not */
+#define _GNU_SOURCE                     // memmem(), strcasestr()
+#include "esp32_http.h"
+#include "esp32_sd.h"
+#include "esp32_mem.h"
+#include "host_idf.h"
+#include "test.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#define TEST_HOST           "sink.test"
+#define TEST_URL            "http://" TEST_HOST "/registros"
+#define TEST_MAX_BODY       (256 * 1024)
+#define TEST_MAX_BODIES     64
+#define TEST_RESPONSE_SIZE  200         // Response buffer of the uploads
+#define TEST_PREFIX         "th_"
+#define TEST_INDEX          "thidx"
+
+/* Lo que recibio el servidor: solo peticiones completas */
+static char*            s_bodies[TEST_MAX_BODIES];
+static size_t           s_lengths[TEST_MAX_BODIES];
+static int              s_body_count;
+static int              s_connections;
+static int              s_drop;         // Peticiones completas que se cortan sin responder
+static int              s_dropped;
+static const char*      s_response = "{\"ok\":true}";
+static pthread_mutex_t  s_lock = PTHREAD_MUTEX_INITIALIZER;
+static uint32_t         s_rand = 1;
+
+
+static uint32_t test_rand(void){
+    s_rand ^= s_rand << 13;
+    s_rand ^= s_rand >> 17;
+    s_rand ^= s_rand << 5;
+    return s_rand;
+}
+
+
+static void test_reset(const char* response){
+    pthread_mutex_lock(&s_lock);
+    for (int i = 0; i < s_body_count; i++) {
+        free(s_bodies[i]);
+    }
+    s_body_count = 0;
+    s_response = response;
+    pthread_mutex_unlock(&s_lock);
+}
+
+
+/* ----------------------------- Servidor ----------------------------- */
+
+// Una conexion: peticiones con Content-Length una detras de otra hasta que el cliente cierra
+static void* test_connection(void* arg){
+    int fd = (int) (intptr_t) arg;
+    size_t size = TEST_MAX_BODY + 4096;
+    char* buffer = malloc(size);
+    size_t used = 0;
+    while (buffer != NULL) {
+        char* end;
+        while ((end = memmem(buffer, used, "\r\n\r\n", 4)) == NULL) {
+            ssize_t n = (used < size) ? recv(fd, buffer + used, size - used, 0) : -1;
+            if (n <= 0) {
+                goto closed;
+            }
+            used += n;
+        }
+        *end = '\0';
+        const char* length_header = strcasestr(buffer, "\r\nContent-Length:");
+        size_t length = (length_header != NULL) ? strtoul(length_header + 17, NULL, 10) : 0;
+        size_t header = end + 4 - buffer;
+        if (header + length > size) {
+            break;
+        }
+        while (used < header + length) {
+            ssize_t n = recv(fd, buffer + used, header + length - used, 0);
+            if (n <= 0) {
+                goto closed;
+            }
+            used += n;
+        }
+
+        pthread_mutex_lock(&s_lock);
+        if (s_drop > 0) {
+            // Keep-alive vencido en el servidor con la peticion en camino
+            s_drop--;
+            s_dropped++;
+            pthread_mutex_unlock(&s_lock);
+            break;
+        }
+        const char* body = s_response;
+        if (s_body_count < TEST_MAX_BODIES && (s_bodies[s_body_count] = malloc(length + 1)) != NULL) {
+            memcpy(s_bodies[s_body_count], buffer + header, length);
+            s_lengths[s_body_count++] = length;
+        }
+        pthread_mutex_unlock(&s_lock);
+
+        char* response = malloc(strlen(body) + 128);
+        int response_length = sprintf(response, "HTTP/1.1 200 OK\r\nContent-Length: %u\r\n\r\n%s",
+                                      (unsigned) strlen(body), body);
+        ssize_t sent = send(fd, response, response_length, MSG_NOSIGNAL);
+        free(response);
+        if (sent != response_length) {
+            break;
+        }
+        memmove(buffer, buffer + header + length, used - header - length);
+        used -= header + length;
+    }
+closed:
+    free(buffer);
+    close(fd);
+    return NULL;
+}
+
+
+static void* test_server(void* arg){
+    int listener = (int) (intptr_t) arg;
+    int fd;
+    while ((fd = accept(listener, NULL, NULL)) >= 0) {
+        pthread_t thread;
+        pthread_mutex_lock(&s_lock);
+        s_connections++;
+        pthread_mutex_unlock(&s_lock);
+        if (pthread_create(&thread, NULL, test_connection, (void*) (intptr_t) fd) == 0) {
+            pthread_detach(thread);
+        }
+        else {
+            close(fd);
+        }
+    }
+    return NULL;
+}
+
+
+// Servidor en 127.0.0.1 con un puerto libre; TEST_HOST apunta a el
+static int test_server_start(void){
+    struct sockaddr_in address = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    socklen_t address_length = sizeof(address);
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    if (listener < 0 || bind(listener, (struct sockaddr*) &address, sizeof(address)) != 0 ||
+        listen(listener, 8) != 0 || getsockname(listener, (struct sockaddr*) &address, &address_length) != 0) {
+        perror("servidor");
+        return -1;
+    }
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, test_server, (void*) (intptr_t) listener) != 0) {
+        return -1;
+    }
+    pthread_detach(thread);
+
+    char route[32];
+    snprintf(route, sizeof(route), "127.0.0.1:%u", (unsigned) ntohs(address.sin_port));
+    host_http_route(TEST_HOST, route);
+    return 0;
+}
+
+
+/* ----------------------------- Lectores ----------------------------- */
+
+/*  Cuerpo en RAM entregado en lecturas cortas al azar (como fread() al cruzar
+    un bloque); fail_at corta la lectura en ese offset */
+typedef struct {
+    const char* data;
+    size_t      length;
+    size_t      offset;
+    size_t      fail_at;
+} test_reader_t;
+
+
+static int test_read(void* ctx, char* buffer, size_t size){
+    test_reader_t* reader = (test_reader_t*) ctx;
+    if (reader->offset >= reader->fail_at) {
+        return -1;
+    }
+    size_t to_copy = size;
+    if (size > 1 && test_rand() % 3 == 0) {
+        to_copy = 1 + test_rand() % size;
+    }
+    if (to_copy > reader->length - reader->offset) {
+        to_copy = reader->length - reader->offset;
+    }
+    memcpy(buffer, reader->data + reader->offset, to_copy);
+    reader->offset += to_copy;
+    return to_copy;
+}
+
+
+static esp_err_t test_rewind(void* ctx){
+    ((test_reader_t*) ctx)->offset = 0;
+    return ESP_OK;
+}
+
+
+static int test_read_log(void* ctx, char* buffer, size_t size){
+    return sd_log_iter_read((sd_log_iter_t*) ctx, buffer, size);
+}
+
+
+static esp_err_t test_rewind_log(void* ctx){
+    return sd_log_iter_rewind_record((sd_log_iter_t*) ctx);
+}
+
+
+/* ----------------------------- Pruebas ----------------------------- */
+
+static esp_http_client_handle_t test_client(void){
+    esp_http_client_config_t config = {
+        .url        = TEST_URL,
+        .timeout_ms = 5000,
+    };
+    esp_http_client_handle_t client = http_pool_get("sink", &config);
+    esp_http_client_set_header(client, "Content-Type", "application/json");
+    return client;
+}
+
+
+// Cuerpos de todos los largos alrededor del bloque, con bloques de 1 byte a 2 KB
+static void test_identical(esp_http_client_handle_t client){
+    static char body[TEST_MAX_BODY];
+    static const size_t chunks[] = { 1, 7, 512, 2048 };
+    const size_t lengths[] = { 1, 2, 511, 2047, 2048, 2049, 20480, 20481, 100000, TEST_MAX_BODY };
+    char chunk[2048];
+    char response[TEST_RESPONSE_SIZE];
+
+    for (size_t i = 0; i < sizeof(body); i++) {
+        body[i] = (char) test_rand();   // Tambien bytes 0: el cuerpo no es un string
+    }
+    test_reset("{\"ok\":true}");
+    int requests = 0, wrong_status = 0;
+    for (size_t c = 0; c < sizeof(chunks) / sizeof(chunks[0]); c++) {
+        for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]); l++) {
+            if (chunks[c] == 1 && lengths[l] > 20481) {
+                continue;
+            }
+            test_reader_t reader = { .data = body, .length = lengths[l], .fail_at = SIZE_MAX };
+            int status = http_post_stream(client, lengths[l], test_read, test_rewind, &reader, chunk, chunks[c],
+                                          response, sizeof(response));
+            wrong_status += (status != 200 || strcmp(response, "{\"ok\":true}") != 0);
+            requests++;
+        }
+    }
+    CHECK_EQ(wrong_status, 0, "%d");
+    CHECK_EQ(s_body_count, requests, "%d");
+
+    int different = 0, index = 0;
+    for (size_t c = 0; c < sizeof(chunks) / sizeof(chunks[0]); c++) {
+        for (size_t l = 0; l < sizeof(lengths) / sizeof(lengths[0]) && index < s_body_count; l++) {
+            if (chunks[c] == 1 && lengths[l] > 20481) {
+                continue;
+            }
+            different += s_lengths[index] != lengths[l] || memcmp(s_bodies[index], body, lengths[l]) != 0;
+            index++;
+        }
+    }
+    CHECK_EQ(different, 0, "%d");
+}
+
+
+// Registros del log enviados desde la SD, como upload_record_direct()
+static void test_from_log(esp_http_client_handle_t client){
+    static char records[3][40000];
+    const size_t lengths[] = { 300, 20481, sizeof(records[2]) };
+    char chunk[1024];
+    char response[TEST_RESPONSE_SIZE];
+    sd_log_t log;
+    sd_log_iter_t iter;
+    sd_log_record_t record;
+
+    test_reset("OK");
+    CHECK_EQ(sd_log_open(&log, TEST_PREFIX, TEST_INDEX), ESP_OK, "%d");
+    for (int i = 0; i < 3; i++) {
+        for (size_t j = 0; j < lengths[i]; j++) {
+            records[i][j] = 'a' + (i + j) % 26;
+        }
+        CHECK_EQ(sd_log_append(&log, records[i], lengths[i]), ESP_OK, "%d");
+    }
+    sd_log_iter_begin(&log, &iter);
+    for (int i = 0; i < 3 && sd_log_iter_next_record(&iter, &record) == ESP_OK; i++) {
+        CHECK_EQ(http_post_stream(client, record.length, test_read_log, test_rewind_log, &iter, chunk, sizeof(chunk),
+                                  response, sizeof(response)), 200, "%d");
+    }
+    sd_log_iter_end(&iter);
+    sd_log_close(&log);
+
+    CHECK_EQ(s_body_count, 3, "%d");
+    for (int i = 0; i < 3 && i < s_body_count; i++) {
+        CHECK(s_lengths[i] == lengths[i] && memcmp(s_bodies[i], records[i], lengths[i]) == 0);
+    }
+}
+
+
+/*  Un lector que falla a mitad del cuerpo: HTTP_STREAM_ABORTED, el servidor no
+    recibe una peticion completa y la siguiente va por una conexion nueva */
+static void test_abort(esp_http_client_handle_t client){
+    static char body[10000];
+    char chunk[2048];
+    char response[TEST_RESPONSE_SIZE];
+    memset(body, 'x', sizeof(body));
+
+    test_reset("OK");
+    test_reader_t reader = { .data = body, .length = sizeof(body), .fail_at = 5000 };
+    CHECK_EQ(http_post_stream(client, sizeof(body), test_read, test_rewind, &reader, chunk, sizeof(chunk),
+                              response, sizeof(response)), HTTP_STREAM_ABORTED, "%d");
+    reader = (test_reader_t) { .data = body, .length = 100, .fail_at = SIZE_MAX };
+    CHECK_EQ(http_post_stream(client, 100, test_read, test_rewind, &reader, chunk, sizeof(chunk),
+                              response, sizeof(response)), 200, "%d");
+    CHECK_EQ(s_body_count, 1, "%d");
+    CHECK(s_body_count == 1 && s_lengths[0] == 100);
+}
+
+
+// Una respuesta mas grande que el buffer se corta (con '\0') y la conexion se descarta
+static void test_big_response(esp_http_client_handle_t client){
+    static char big[4 * TEST_RESPONSE_SIZE];
+    char chunk[2048];
+    char response[TEST_RESPONSE_SIZE];
+    memset(big, 'r', sizeof(big) - 1);
+
+    test_reset(big);
+    test_reader_t reader = { .data = "{}", .length = 2, .fail_at = SIZE_MAX };
+    CHECK_EQ(http_post_stream(client, 2, test_read, test_rewind, &reader, chunk, sizeof(chunk),
+                              response, sizeof(response)), 200, "%d");
+    CHECK_EQ(strlen(response), (size_t) TEST_RESPONSE_SIZE - 1, "%zu");
+
+    test_reset("OK");
+    reader = (test_reader_t) { .data = "{}", .length = 2, .fail_at = SIZE_MAX };
+    CHECK_EQ(http_post_stream(client, 2, test_read, test_rewind, &reader, chunk, sizeof(chunk),
+                              response, sizeof(response)), 200, "%d");
+    CHECK(strcmp(response, "OK") == 0);
+}
+
+
+/*  El servidor corta la conexion que quedo abierta al recibir la peticion: se
+    reenvia una vez por una conexion nueva (POST desde la RAM y desde el log, GET).
+    Sin rewind_body, o si la conexion nueva tambien falla, no hay mas intentos */
+static void test_stale(esp_http_client_handle_t client){
+    static char body[30000];
+    char chunk[2048];
+    char response[TEST_RESPONSE_SIZE];
+    for (size_t i = 0; i < sizeof(body); i++) {
+        body[i] = 'A' + i % 23;
+    }
+
+    // Una peticion para que la conexion quede abierta
+    test_reset("OK");
+    test_reader_t reader = { .data = body, .length = 10, .fail_at = SIZE_MAX };
+    CHECK_EQ(http_post_stream(client, 10, test_read, test_rewind, &reader, chunk, sizeof(chunk),
+                              response, sizeof(response)), 200, "%d");
+
+    test_reset("OK");
+    int connections = s_connections;
+    s_dropped = 0;
+    s_drop = 1;
+    reader = (test_reader_t) { .data = body, .length = sizeof(body), .fail_at = SIZE_MAX };
+    CHECK_EQ(http_post_stream(client, sizeof(body), test_read, test_rewind, &reader, chunk, sizeof(chunk),
+                              response, sizeof(response)), 200, "%d");
+    CHECK_EQ(s_dropped, 1, "%d");
+    CHECK_EQ(s_connections, connections + 1, "%d");
+    CHECK(s_body_count == 1 && s_lengths[0] == sizeof(body) && memcmp(s_bodies[0], body, sizeof(body)) == 0);
+
+    s_drop = 1;
+    CHECK_EQ(get_request(client, response, sizeof(response)), 200, "%d");
+    CHECK_EQ(s_dropped, 2, "%d");
+    CHECK(strcmp(response, "OK") == 0);
+
+    // Desde el log: el registro se vuelve a leer desde la SD
+    sd_log_t log;
+    sd_log_iter_t iter;
+    sd_log_record_t record;
+    test_reset("OK");
+    CHECK_EQ(sd_log_open(&log, TEST_PREFIX "s", TEST_INDEX "s"), ESP_OK, "%d");
+    CHECK_EQ(sd_log_append(&log, body, 5000), ESP_OK, "%d");
+    sd_log_iter_begin(&log, &iter);
+    CHECK_EQ(sd_log_iter_next_record(&iter, &record), ESP_OK, "%d");
+    s_drop = 1;
+    CHECK_EQ(http_post_stream(client, record.length, test_read_log, test_rewind_log, &iter, chunk, sizeof(chunk),
+                              response, sizeof(response)), 200, "%d");
+    CHECK_EQ(s_dropped, 3, "%d");
+    CHECK(s_body_count == 1 && s_lengths[0] == 5000 && memcmp(s_bodies[0], body, 5000) == 0);
+    sd_log_iter_end(&iter);
+    sd_log_close(&log);
+
+    // Sin rewind_body el cuerpo ya consumido no se puede reenviar
+    test_reset("OK");
+    s_drop = 1;
+    reader = (test_reader_t) { .data = body, .length = 100, .fail_at = SIZE_MAX };
+    CHECK_EQ(http_post_stream(client, 100, test_read, NULL, &reader, chunk, sizeof(chunk),
+                              response, sizeof(response)), -1, "%d");
+    CHECK_EQ(s_dropped, 4, "%d");
+
+    // Conexion nueva (la anterior se cerro): un corte no se reintenta
+    s_drop = 1;
+    reader = (test_reader_t) { .data = body, .length = 100, .fail_at = SIZE_MAX };
+    CHECK_EQ(http_post_stream(client, 100, test_read, test_rewind, &reader, chunk, sizeof(chunk),
+                              response, sizeof(response)), -1, "%d");
+    CHECK_EQ(s_dropped, 5, "%d");
+
+    // Conexion abierta y el reintento tambien se corta: un solo reintento
+    reader = (test_reader_t) { .data = body, .length = 100, .fail_at = SIZE_MAX };
+    CHECK_EQ(http_post_stream(client, 100, test_read, test_rewind, &reader, chunk, sizeof(chunk),
+                              response, sizeof(response)), 200, "%d");
+    s_drop = 3;
+    reader = (test_reader_t) { .data = body, .length = 100, .fail_at = SIZE_MAX };
+    CHECK_EQ(http_post_stream(client, 100, test_read, test_rewind, &reader, chunk, sizeof(chunk),
+                              response, sizeof(response)), -1, "%d");
+    CHECK_EQ(s_dropped, 7, "%d");
+    s_drop = 0;
+    CHECK_EQ(s_body_count, 1, "%d");
+}
+
+
+int main(void){
+    // Los cortes a proposito escriben errores
+    setenv("NODO_LOG", "N", 0);
+
+    // La tarjeta SD es un directorio: MOUNT_POINT es "." en host/
+    char sd_dir[] = "/tmp/nodo_test_http.XXXXXX";
+    if (mkdtemp(sd_dir) == NULL || chdir(sd_dir) != 0 || test_server_start() != 0) {
+        perror(sd_dir);
+        return 1;
+    }
+    mem_init();
+    esp_http_client_handle_t client = test_client();
+
+    test_identical(client);
+    test_from_log(client);
+    test_abort(client);
+    test_big_response(client);
+    test_stale(client);
+    printf("%d conexiones para todas las peticiones\n", s_connections);
+
+    http_pool_cleanup();
+    test_reset(NULL);
+    if (chdir("/") == 0) {
+        char command[64];
+        snprintf(command, sizeof(command), "rm -rf %s", sd_dir);
+        CHECK_EQ(system(command), 0, "%d");
+    }
+    return TEST_RESULT();
+}
@@ -0,0 +1,118 @@
+/*  esp32_led.c against a mock GPIO register (host/idf/gpio.c): the last color of
+    every LED reaches the pins even when the command queue overflows, the
+    pattern timer only runs while a LED blinks, and a failed led_init() does
+    not leave its timer behind */
+#include "esp32_led.h"
+#include "host_idf.h"
+#include "test.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#define TEST_FLUSH_MS   1000
+
+
+// Pines que deben quedar en alto para un color en cada LED (enum _led - 1)
+static uint32_t test_mask(const enum _color colors[3]){
+    static const uint8_t pins[3][3] = {
+        { ESP_LED_BAT_R,   ESP_LED_BAT_G,   ESP_LED_BAT_B   },
+        { ESP_LED_WIFI_R,  ESP_LED_WIFI_G,  ESP_LED_WIFI_B  },
+        { ESP_LED_CHECK_R, ESP_LED_CHECK_G, ESP_LED_CHECK_B },
+    };
+    static const uint8_t rgb[] = { 0, 4, 2, 1, 5, 3, 6, 7 };
+    uint32_t mask = 0;
+    for (int led = 0; led < 3; led++) {
+        for (int bit = 0; bit < 3; bit++) {
+            if (rgb[colors[led]] & (4 >> bit)) {
+                mask |= 1UL << pins[led][bit];
+            }
+        }
+    }
+    return mask;
+}
+
+
+// Antes de led_init() los pines se escriben en la llamada
+static void test_before_init(void){
+    const enum _color colors[3] = { RED, OFF, WHITE };
+    led_set(BAT, RED);
+    led_set(CHECK, WHITE);
+    CHECK_EQ(host_gpio_out(NULL), test_mask(colors), "0x%08x");
+    power_off_leds();
+    CHECK_EQ(host_gpio_out(NULL), 0u, "0x%08x");
+}
+
+
+// La tarea se queda escribiendo los pines mientras llegan muchos mas comandos que
+// LED_QUEUE_LENGTH: el ultimo de cada LED (el OFF antes de dormir) no se pierde
+static void test_queue_overflow(void){
+    const enum _color colors[3] = { OFF, BLUE, RED };
+    host_gpio_hold(1);
+    led_set(WIFI, GREEN);
+    usleep(20 * 1000);
+    for (int i = 0; i < 4 * LED_QUEUE_LENGTH; i++) {
+        led_set(BAT, (enum _color) (1 + i % 7));
+        led_set(WIFI, (enum _color) (1 + (i + 3) % 7));
+        led_set(CHECK, (enum _color) (1 + (i + 5) % 7));
+    }
+    led_set(BAT, OFF);
+    led_set(WIFI, BLUE);
+    led_set(CHECK, RED);
+    host_gpio_hold(0);
+    CHECK(led_flush(TEST_FLUSH_MS));
+    CHECK_EQ(host_gpio_out(NULL), test_mask(colors), "0x%08x");
+
+    power_off_leds();
+    CHECK(led_flush(TEST_FLUSH_MS));
+    CHECK_EQ(host_gpio_out(NULL), 0u, "0x%08x");
+}
+
+
+// LED_BLINK prende y apaga los pines con el timer; con todo fijo el timer se detiene
+static void test_blink(void){
+    const enum _color colors[3] = { OFF, OFF, GREEN };
+    uint32_t start, blink, solid, idle;
+    led_set_pattern(CHECK, GREEN, LED_BLINK);
+    CHECK(led_flush(TEST_FLUSH_MS));
+    host_gpio_out(&start);
+
+    int seen_on = 0, seen_off = 0;
+    for (int i = 0; i < 40; i++) {
+        usleep(LED_TICK_MS * 1000 / 2);
+        uint32_t out = host_gpio_out(NULL);
+        seen_on  |= (out == test_mask(colors));
+        seen_off |= (out == 0);
+    }
+    host_gpio_out(&blink);
+    CHECK(seen_on && seen_off);
+    CHECK(blink - start >= 10);
+
+    led_set(CHECK, OFF);
+    CHECK(led_flush(TEST_FLUSH_MS));
+    host_gpio_out(&solid);
+    usleep(5 * LED_TICK_MS * 1000);
+    CHECK_EQ(host_gpio_out(&idle), 0u, "0x%08x");
+    CHECK_EQ(idle, solid, "%u");
+}
+
+
+// Sin la tarea led_init() falla sin dejar el timer creado, y el siguiente intento crea uno solo
+static void test_init_failure(void){
+    int timers = host_timer_count();
+    host_task_fail(1);
+    CHECK(led_init() != ESP_OK);
+    CHECK_EQ(host_timer_count(), timers, "%d");
+    CHECK(led_init() == ESP_OK);
+    CHECK_EQ(host_timer_count(), timers + 1, "%d");
+}
+
+
+int main(void){
+    // El error de test_init_failure() es esperado
+    setenv("NODO_LOG", "N", 0);
+    test_before_init();
+    test_init_failure();
+    test_queue_overflow();
+    test_blink();
+    return TEST_RESULT();
+}
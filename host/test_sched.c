@@ -0,0 +1,275 @@
+/*  esp32_sched.c fed with traces of wake cycles: every step of a scenario is the
+    outcome of one cycle (link, failure, records, battery) and the interval that
+    sched_next_minutes() has to pick. Every scenario starts from a power-on (its
+    own process: the RTC history is empty).
+
+    The simulator replays three days of a node that spends the night out of
+    range, the morning at a busy edge, noon at the modem, and so on, with the
+    battery running down on the last day. It checks the intervals against the
+    bounds and what they are for: the busy edge is emptied soon, the modem
+    drains the backlog, the night costs few wakes and a critical battery only
+    wakes every SCHED_MAX_MINUTES */
+#include "esp32_sched.h"
+#include "test.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#define D                   SCHED_DEFAULT_MINUTES
+#define CLAMP(m)            ((m) < SCHED_MIN_MINUTES ? SCHED_MIN_MINUTES : (m) > SCHED_MAX_MINUTES ? SCHED_MAX_MINUTES : (m))
+#define LOW_V               ((SCHED_LOW_BATTERY_MV - 50) / 1000.0f)
+#define CRITICAL_V          ((SCHED_CRITICAL_BATTERY_MV - 50) / 1000.0f)
+#define GOOD_V              3.9f
+
+#define SIM_DAYS            3
+#define SIM_UPLOAD_CYCLE    400         // Records that one modem cycle uploads
+#define SIM_FAIL_EVERY      17          // One edge cycle out of SIM_FAIL_EVERY fails
+
+typedef struct {
+    uint8_t  link;
+    uint8_t  failed;
+    uint32_t fetched;
+    uint32_t backlog;
+    float    battery;
+    int      expected;
+} test_step_t;
+
+typedef struct {
+    const char*        name;
+    const test_step_t* steps;
+    int                count;
+} test_scenario_t;
+
+static int s_slept = -1;
+
+
+// sleep_ESP32() de esp32_general.c: el test solo guarda los minutos
+void sleep_ESP32(int _time_to_sleep){
+    s_slept = _time_to_sleep;
+}
+
+
+static const test_step_t s_no_network[] = {
+    { SCHED_LINK_NONE, 0, 0, 0, GOOD_V, CLAMP(D << 1) },
+    { SCHED_LINK_NONE, 0, 0, 0, GOOD_V, CLAMP(D << 2) },
+    { SCHED_LINK_NONE, 0, 0, 0, GOOD_V, CLAMP(D << 3) },
+    { SCHED_LINK_NONE, 0, 0, 0, GOOD_V, CLAMP(D << 4) },
+    { SCHED_LINK_NONE, 0, 0, 0, GOOD_V, CLAMP(D << 5) },
+    { SCHED_LINK_NONE, 0, 0, 0, GOOD_V, CLAMP(D << SCHED_MAX_BACKOFF) },
+    { SCHED_LINK_NONE, 0, 0, 0, GOOD_V, CLAMP(D << SCHED_MAX_BACKOFF) },
+    // De vuelta en zona, y la siguiente vez fuera de zona el backoff empieza de nuevo
+    { SCHED_LINK_EDGE, 0, 10, 0, GOOD_V, D },
+    { SCHED_LINK_NONE, 0, 0, 0, GOOD_V, CLAMP(D << 1) },
+};
+
+// Despues de dormir SCHED_MIN_MINUTES, el Edge sigue ocupado con RATE_BUSY registros
+#define RATE_BUSY           ((SCHED_BUSY_RECORDS * SCHED_MIN_MINUTES + D - 1) / D)
+
+static const test_step_t s_edge[] = {
+    { SCHED_LINK_EDGE, 0, SCHED_BUSY_RECORDS,     0, GOOD_V, SCHED_MIN_MINUTES },
+    { SCHED_LINK_EDGE, 0, RATE_BUSY,              0, GOOD_V, SCHED_MIN_MINUTES },
+    { SCHED_LINK_EDGE, 0, RATE_BUSY - 1,          0, GOOD_V, D },
+    { SCHED_LINK_EDGE, 0, 0,                      0, GOOD_V, CLAMP(2 * D) },
+    { SCHED_LINK_EDGE, 0, SCHED_BUSY_RECORDS - 1, 0, GOOD_V, D },
+    { SCHED_LINK_EDGE, 0, 1,                      0, GOOD_V, D },
+};
+
+static const test_step_t s_modem[] = {
+    { SCHED_LINK_MODEM, 0, 0, 120, GOOD_V, SCHED_MIN_MINUTES },
+    { SCHED_LINK_MODEM, 0, 0, 1,   GOOD_V, SCHED_MIN_MINUTES },
+    { SCHED_LINK_MODEM, 0, 0, 0,   GOOD_V, D },
+};
+
+// Cada enlace lleva su propio backoff
+static const test_step_t s_backoff[] = {
+    { SCHED_LINK_EDGE,  1, 0, 0, GOOD_V, CLAMP(D << 1) },
+    { SCHED_LINK_EDGE,  1, 0, 0, GOOD_V, CLAMP(D << 2) },
+    { SCHED_LINK_MODEM, 1, 0, 5, GOOD_V, CLAMP(D << 1) },
+    { SCHED_LINK_MODEM, 0, 0, 0, GOOD_V, D },
+    { SCHED_LINK_EDGE,  1, 0, 0, GOOD_V, CLAMP(D << 3) },
+    { SCHED_LINK_EDGE,  0, 5, 0, GOOD_V, D },
+    { SCHED_LINK_EDGE,  1, 0, 0, GOOD_V, CLAMP(D << 1) },
+};
+
+static const test_step_t s_battery[] = {
+    { SCHED_LINK_EDGE,  0, 10,                 0, LOW_V,      CLAMP(2 * D) },
+    { SCHED_LINK_EDGE,  0, SCHED_BUSY_RECORDS, 0, LOW_V,      CLAMP(2 * SCHED_MIN_MINUTES) },
+    { SCHED_LINK_MODEM, 0, 0,                  9, CRITICAL_V, SCHED_MAX_MINUTES },
+    { SCHED_LINK_NONE,  0, 0,                  0, CRITICAL_V, SCHED_MAX_MINUTES },
+    // Tension desconocida: no cambia el intervalo
+    { SCHED_LINK_EDGE,  0, 10,                 0, 0,          D },
+};
+
+#define SCENARIO(steps) { #steps, steps, sizeof(steps) / sizeof(steps[0]) }
+
+static const test_scenario_t s_scenarios[] = {
+    SCENARIO(s_no_network),
+    SCENARIO(s_edge),
+    SCENARIO(s_modem),
+    SCENARIO(s_backoff),
+    SCENARIO(s_battery),
+};
+
+
+static void test_scenario(const test_scenario_t* scenario){
+    for (int i = 0; i < scenario->count; i++) {
+        const test_step_t* step = &scenario->steps[i];
+        sched_cycle_t cycle = {
+            .link    = step->link,
+            .failed  = step->failed,
+            .fetched = step->fetched,
+            .backlog = step->backlog,
+            .battery = step->battery,
+        };
+        s_slept = -1;
+        sched_sleep(&cycle);
+        if (s_slept != step->expected) {
+            fprintf(stderr, "%s paso %d: %d min, se esperaban %d\n", scenario->name, i, s_slept, step->expected);
+        }
+        CHECK_EQ(s_slept, step->expected, "%d");
+    }
+}
+
+
+/* ---------------------------------- Simulador ---------------------------------- */
+
+// Donde esta el nodo a cada hora del dia
+static uint8_t sim_zone(int minute){
+    int hour = (minute / 60) % 24;
+    if (hour < 6 || hour >= 22) {
+        return SCHED_LINK_NONE;
+    }
+    if (hour == 12 || hour >= 18) {
+        return SCHED_LINK_MODEM;
+    }
+    return SCHED_LINK_EDGE;
+}
+
+
+// Registros nuevos en el Edge por minuto (x10): la manga se usa de 7 a 10
+static int sim_edge_rate_x10(int minute){
+    int hour = (minute / 60) % 24;
+    return (hour >= 7 && hour < 10) ? 60 : (hour >= 10 && hour < 18) ? 5 : 0;
+}
+
+
+// Dos dias con la bateria sana, el tercero se descarga hasta pasar la tension critica
+static float sim_battery(int minute){
+    const int day = 24 * 60;
+    if (minute < 2 * day) {
+        return 3.95f - 0.2f * minute / (2 * day);
+    }
+    return 3.70f - 0.35f * (minute - 2 * day) / day;
+}
+
+
+static void test_simulator(void){
+    uint32_t edge_queue = 0, edge_x10 = 0, backlog = 0;
+    int oldest = -1;                // Minuto del registro mas viejo en el Edge
+    int wakes[SCHED_LINK_COUNT] = { 0 };
+    int night_wakes = 0, max_night_wakes = 0;
+    int max_delay = 0, busy_delay = 0;
+    int out_of_bounds = 0, critical_not_max = 0, backlog_left = 0;
+    int edge_cycles = 0;
+    int edge_since = 0;             // Minuto en que el nodo llego a la zona del Edge
+    uint8_t last_zone = SCHED_LINK_NONE;
+    uint32_t last_backlog = 0;
+
+    for (int minute = 6 * 60; minute < SIM_DAYS * 24 * 60; ) {
+        uint8_t zone = sim_zone(minute);
+        float battery = sim_battery(minute);
+        uint32_t battery_mv = (uint32_t) (battery * 1000);
+
+        // Al salir de la zona del modem no tiene que quedar nada por subir
+        if (last_zone == SCHED_LINK_MODEM && zone != SCHED_LINK_MODEM && last_backlog > 0 &&
+            battery_mv >= SCHED_LOW_BATTERY_MV) {
+            backlog_left++;
+        }
+        if (zone == SCHED_LINK_NONE && last_zone != SCHED_LINK_NONE) {
+            night_wakes = 0;
+        }
+
+        if (zone == SCHED_LINK_EDGE && last_zone != SCHED_LINK_EDGE) {
+            edge_since = minute;
+        }
+
+        sched_cycle_t cycle = { .link = zone, .battery = battery };
+        if (zone == SCHED_LINK_EDGE) {
+            if (++edge_cycles % SIM_FAIL_EVERY == 0) {
+                cycle.failed = 1;
+            }
+            else {
+                int delay = (edge_queue > 0) ? minute - oldest : 0;
+                int hour = (minute / 60) % 24;
+                // Solo cuentan los registros que llegaron con el nodo en la zona del Edge
+                if (oldest >= edge_since && battery_mv >= SCHED_LOW_BATTERY_MV) {
+                    max_delay = (delay > max_delay) ? delay : max_delay;
+                    if (hour >= 8 && hour < 10) {
+                        busy_delay = (delay > busy_delay) ? delay : busy_delay;
+                    }
+                }
+                cycle.fetched = edge_queue;
+                backlog += edge_queue;
+                edge_queue = 0;
+                oldest = -1;
+            }
+        }
+        else if (zone == SCHED_LINK_MODEM) {
+            backlog -= (backlog < SIM_UPLOAD_CYCLE) ? backlog : SIM_UPLOAD_CYCLE;
+        }
+        else {
+            night_wakes++;
+            max_night_wakes = (night_wakes > max_night_wakes) ? night_wakes : max_night_wakes;
+        }
+        cycle.backlog = backlog;
+        wakes[zone]++;
+
+        int minutes = sched_next_minutes(&cycle);
+        out_of_bounds += (minutes < SCHED_MIN_MINUTES || minutes > SCHED_MAX_MINUTES);
+        critical_not_max += (battery_mv < SCHED_CRITICAL_BATTERY_MV && minutes != SCHED_MAX_MINUTES);
+        last_zone = zone;
+        last_backlog = backlog;
+
+        // El Edge sigue generando registros mientras el nodo duerme
+        for (int i = 0; i < minutes; i++) {
+            edge_x10 += sim_edge_rate_x10(minute + i);
+            if (edge_x10 >= 10 && oldest < 0) {
+                oldest = minute + i;
+            }
+            edge_queue += edge_x10 / 10;
+            edge_x10 %= 10;
+        }
+        minute += minutes;
+    }
+
+    printf("Simulacion de %d dias: despertares edge = %d, modem = %d, sin red = %d (max %d por noche), "
+           "demora max en el Edge = %d min (%d min con la manga llena)\n", SIM_DAYS,
+           wakes[SCHED_LINK_EDGE], wakes[SCHED_LINK_MODEM], wakes[SCHED_LINK_NONE], max_night_wakes,
+           max_delay, busy_delay);
+    CHECK_EQ(out_of_bounds, 0, "%d");
+    CHECK_EQ(critical_not_max, 0, "%d");
+    CHECK_EQ(backlog_left, 0, "%d");
+    // Con la manga llena el nodo vuelve al minimo (una vuelta extra si un ciclo falla)
+    CHECK(busy_delay <= SCHED_MIN_MINUTES + CLAMP(D << 1));
+    // Un Edge tranquilo espera el doble, un fallo lo dobla otra vez
+    CHECK(max_delay <= CLAMP(2 * D) + CLAMP(D << 1));
+    // La noche: el backoff llega al maximo y se queda ahi
+    CHECK(max_night_wakes <= 8 * 60 / SCHED_MAX_MINUTES + SCHED_MAX_BACKOFF);
+}
+
+
+int main(void){
+    // Cada escenario empieza de un power-on: un proceso nuevo, sin historial en la RTC
+    for (size_t i = 0; i < sizeof(s_scenarios) / sizeof(s_scenarios[0]); i++) {
+        pid_t pid = fork();
+        if (pid == 0) {
+            test_scenario(&s_scenarios[i]);
+            exit(s_test_failed != 0);
+        }
+        int status;
+        CHECK(pid > 0 && waitpid(pid, &status, 0) == pid && WIFEXITED(status) && WEXITSTATUS(status) == 0);
+    }
+    test_simulator();
+    return TEST_RESULT();
+}
@@ -0,0 +1,833 @@
+/*  Fuzz of the record log of esp32_sd.c, two kinds of iterations:
+
+    power cut : appends and commits random records, then leaves the files as a
+                reset in the middle of an append or of a commit would (truncated
+                segment, final header not written, index copy torn, consumed
+                segments not removed yet) and opens the log again. sd_log_open()
+                must come back to the last committed head with every durable
+                record after it: no duplicates and none lost.
+    corrupt   : flips bits, overwrites ranges or replaces whole segments with
+                random bytes and reads the log with sd_log_iter_next(). Every
+                record returned is intact, the records of untouched segments are
+                all returned and every damaged one ends in the quarantine log.
+
+    A read error of the card, or a quarantine copy that fails, never skips a
+    record: the iterator stays before it and a commit keeps it. Records
+    imported into a log with a download cursor do not move the cursor, even
+    if the import is cut.
+
+        test_sd [--iterations 100] [--seed 1]
+
+    A failure prints the seed and the damage: test_sd --seed S --iterations 1
+    repeats it. NODO_LOG=E shows the recovery logs */
+#include "esp32_sd.h"
+#include "esp32_mem.h"
+#include "host_vfs.h"
+#include "test.h"
+
+#include <dirent.h>
+#include <getopt.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define TEST_PREFIX         "ts_"
+#define TEST_INDEX          "tsidx"
+#define TEST_QUARANTINE     "tq_"
+#define TEST_QUARANTINE_IDX "tqidx"
+#define TEST_CURSOR         "tscur"
+#define TEST_MAX_PAYLOAD    6000        // ~40 records per segment of SD_LOG_SEGMENT_SIZE
+#define TEST_BUFFER_SIZE    (TEST_MAX_PAYLOAD + 1)
+#define TEST_MAX_SEGMENTS   64
+#define TEST_MAX_RECORDS    512
+
+// Donde se corta la energia
+enum test_cut {
+    CUT_APPEND_TRUNCATED,   // Registro a medias: el archivo termina dentro de el
+    CUT_APPEND_HEADER,      // Payload escrito, queda el encabezado provisional (todo 0)
+    CUT_APPEND_PAYLOAD,     // Encabezado definitivo escrito, un sector del payload no
+    CUT_APPEND_GARBAGE,     // Cluster asignado con basura despues de la cola
+    CUT_INDEX_TORN,         // Copia nueva del indice a medias, los segmentos no se borraron
+    CUT_INDEX_DELETE,       // Indice escrito, el corte llega mientras se borran segmentos
+    CUT_COUNT
+};
+
+static const char* const s_cut_names[CUT_COUNT] = {
+    "append truncado", "append sin encabezado", "append con payload a medias",
+    "basura tras la cola", "indice a medias", "borrado de segmentos a medias",
+};
+
+// Dano de los segmentos en las iteraciones "corrupt"
+enum test_damage {
+    DAMAGE_BITS,            // Algunos bits invertidos
+    DAMAGE_RANGE,           // Un rango sobrescrito con bytes al azar
+    DAMAGE_SEGMENT,         // Todo el segmento al azar, de otro largo
+    DAMAGE_COUNT
+};
+
+static const char* const s_damage_names[DAMAGE_COUNT] = {
+    "bits invertidos", "rango al azar", "segmento al azar",
+};
+
+// Estado esperado: registros [head_seq, tail_seq) en el log
+typedef struct {
+    uint32_t head_seq;
+    uint32_t tail_seq;
+} test_model_t;
+
+static uint32_t s_rand;
+static uint32_t s_salt;
+
+
+static uint32_t test_rand(void){
+    // xorshift32: la misma secuencia en cada maquina para repetir una iteracion
+    s_rand ^= s_rand << 13;
+    s_rand ^= s_rand >> 17;
+    s_rand ^= s_rand << 5;
+    return s_rand;
+}
+
+
+static uint32_t test_range(uint32_t min, uint32_t max){
+    return min + test_rand() % (max - min + 1);
+}
+
+
+static uint32_t test_hash(uint32_t x){
+    x ^= s_salt;
+    x = (x ^ (x >> 16)) * 0x45d9f3b;
+    x = (x ^ (x >> 16)) * 0x45d9f3b;
+    return x ^ (x >> 16);
+}
+
+
+// Payload del registro seq: largo y bytes dependen solo de seq (y de la iteracion)
+static size_t test_length(uint32_t seq){
+    return 1 + test_hash(seq) % TEST_MAX_PAYLOAD;
+}
+
+
+static size_t test_payload(uint32_t seq, char* payload){
+    size_t length = test_length(seq);
+    uint32_t word = test_hash(seq + 0x9e3779b9);
+    for (size_t i = 0; i < length; i++) {
+        if ((i & 3) == 0) {
+            word = test_hash(word + i);
+        }
+        payload[i] = (char) (word >> ((i & 3) * 8));
+    }
+    return length;
+}
+
+
+static void test_segment_path(uint32_t segment, char* path, size_t size){
+    sd_path(path, size, "%s%05lX.log", TEST_PREFIX, (unsigned long) segment);
+}
+
+
+static void test_clear_dir(void){
+    DIR* dir = opendir(".");
+    struct dirent* entry;
+    while (dir != NULL && (entry = readdir(dir)) != NULL) {
+        if (entry->d_name[0] != '.') {
+            remove(entry->d_name);
+        }
+    }
+    if (dir != NULL) {
+        closedir(dir);
+    }
+}
+
+
+// Segmentos del log que quedan en el directorio antes de segment
+static int test_segments_before(uint32_t segment){
+    int count = 0;
+    size_t prefix_len = strlen(TEST_PREFIX);
+    DIR* dir = opendir(".");
+    struct dirent* entry;
+    while (dir != NULL && (entry = readdir(dir)) != NULL) {
+        if (strncmp(entry->d_name, TEST_PREFIX, prefix_len) == 0 &&
+            strtoul(entry->d_name + prefix_len, NULL, 16) < segment) {
+            count++;
+        }
+    }
+    if (dir != NULL) {
+        closedir(dir);
+    }
+    return count;
+}
+
+
+static long test_file_size(const char* path){
+    FILE* f = fopen(path, "rb");
+    if (f == NULL) {
+        return -1;
+    }
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fclose(f);
+    return size;
+}
+
+
+static void test_truncate(const char* path, long size){
+    if (truncate(path, size) != 0) {
+        perror(path);
+    }
+}
+
+
+// XOR con bytes distintos de 0: cada byte del rango cambia
+static void test_damage(const char* path, long offset, long length){
+    FILE* f = fopen(path, "r+b");
+    if (f == NULL) {
+        return;
+    }
+    for (long i = 0; i < length; i++) {
+        fseek(f, offset + i, SEEK_SET);
+        int c = fgetc(f);
+        if (c == EOF) {
+            break;
+        }
+        fseek(f, offset + i, SEEK_SET);
+        fputc(c ^ test_range(1, 255), f);
+    }
+    fclose(f);
+}
+
+
+static void test_overwrite(const char* path, long offset, int value, long length){
+    FILE* f = fopen(path, "r+b");
+    if (f == NULL) {
+        return;
+    }
+    fseek(f, offset, SEEK_SET);
+    for (long i = 0; i < length; i++) {
+        fputc(value, f);
+    }
+    fclose(f);
+}
+
+
+static void test_append_garbage(const char* path, long length){
+    FILE* f = fopen(path, "ab");
+    if (f == NULL) {
+        return;
+    }
+    for (long i = 0; i < length; i++) {
+        fputc((int) (test_rand() & 0xFF), f);
+    }
+    fclose(f);
+}
+
+
+static void test_flip_bit(const char* path, long offset, int bit){
+    FILE* f = fopen(path, "r+b");
+    if (f == NULL) {
+        return;
+    }
+    fseek(f, offset, SEEK_SET);
+    int c = fgetc(f);
+    fseek(f, offset, SEEK_SET);
+    fputc(c ^ (1 << bit), f);
+    fclose(f);
+}
+
+
+static void test_write_garbage(const char* path, long offset, long length){
+    FILE* f = fopen(path, "r+b");
+    if (f == NULL) {
+        return;
+    }
+    fseek(f, offset, SEEK_SET);
+    for (long i = 0; i < length; i++) {
+        fputc((int) (test_rand() & 0xFF), f);
+    }
+    fclose(f);
+}
+
+
+static char* test_read_file(const char* path, long* size){
+    *size = test_file_size(path);
+    if (*size < 0) {
+        return NULL;
+    }
+    char* data = malloc(*size + 1);
+    FILE* f = fopen(path, "rb");
+    if (data == NULL || f == NULL || fread(data, 1, *size, f) != (size_t) *size) {
+        free(data);
+        data = NULL;
+    }
+    if (f != NULL) {
+        fclose(f);
+    }
+    return data;
+}
+
+
+static void test_write_file(const char* path, const char* data, long size){
+    FILE* f = fopen(path, "wb");
+    if (f != NULL) {
+        fwrite(data, 1, size, f);
+        fclose(f);
+    }
+}
+
+
+static int test_append(sd_log_t* log, test_model_t* model){
+    char payload[TEST_BUFFER_SIZE];
+    size_t length = test_payload(model->tail_seq, payload);
+    if (sd_log_append(log, payload, length) != ESP_OK) {
+        fprintf(stderr, "sd_log_append fallo en el registro %lu\n", (unsigned long) model->tail_seq);
+        return 0;
+    }
+    model->tail_seq++;
+    return 1;
+}
+
+
+/*  Recorre el log desde head: los registros deben ser exactamente
+    [model->head_seq, model->tail_seq) con su payload. Con commit_count >= 0
+    confirma los primeros commit_count registros */
+static int test_verify(sd_log_t* log, test_model_t* model, int commit_count){
+    static char buffer[TEST_BUFFER_SIZE];
+    static char expected[TEST_BUFFER_SIZE];
+    sd_log_iter_t iter;
+    sd_log_cursor_t commit = log->head;
+    uint32_t seq = model->head_seq;
+    size_t length;
+    esp_err_t ret;
+    int ok = 1;
+
+    if (log->head.seq != model->head_seq || log->tail.seq != model->tail_seq) {
+        fprintf(stderr, "head/tail = %lu/%lu, se esperaba %lu/%lu\n",
+                (unsigned long) log->head.seq, (unsigned long) log->tail.seq,
+                (unsigned long) model->head_seq, (unsigned long) model->tail_seq);
+        ok = 0;
+    }
+
+    sd_log_iter_begin(log, &iter);
+    while (ok && (ret = sd_log_iter_next(&iter, buffer, sizeof(buffer), &length)) == ESP_OK) {
+        size_t expected_length = test_payload(seq, expected);
+        if (iter.current.seq != seq || length != expected_length || memcmp(buffer, expected, length) != 0) {
+            fprintf(stderr, "Registro %lu leido donde se esperaba el %lu (%u bytes, se esperaban %u)\n",
+                    (unsigned long) iter.current.seq, (unsigned long) seq, (unsigned) length,
+                    (unsigned) expected_length);
+            ok = 0;
+            break;
+        }
+        seq++;
+        if (commit_count-- > 0) {
+            commit = iter.pos;
+        }
+    }
+    if (ok && ret != ESP_ERR_NOT_FOUND) {
+        fprintf(stderr, "sd_log_iter_next = %s en el registro %lu\n", esp_err_to_name(ret), (unsigned long) seq);
+        ok = 0;
+    }
+    if (ok && seq != model->tail_seq) {
+        fprintf(stderr, "Se leyeron hasta el registro %lu, se esperaba hasta el %lu\n",
+                (unsigned long) seq, (unsigned long) model->tail_seq);
+        ok = 0;
+    }
+    sd_log_iter_end(&iter);
+
+    if (ok && commit.seq != log->head.seq) {
+        if (sd_log_commit(log, &commit) != ESP_OK) {
+            fprintf(stderr, "sd_log_commit fallo\n");
+            return 0;
+        }
+        model->head_seq = commit.seq;
+    }
+    return ok;
+}
+
+
+// Reinicio sin corte: el log se cierra y se vuelve a abrir
+static int test_reopen(sd_log_t* log){
+    sd_log_close(log);
+    if (sd_log_open(log, TEST_PREFIX, TEST_INDEX) != ESP_OK) {
+        fprintf(stderr, "sd_log_open fallo\n");
+        return 0;
+    }
+    return 1;
+}
+
+
+// Corte en medio de un append: el registro nuevo no existe despues de abrir el log
+static int test_cut_append(sd_log_t* log, const test_model_t* model, enum test_cut cut){
+    test_model_t after = *model;
+    if (!test_append(log, &after)) {
+        return 0;
+    }
+    sd_log_close(log);
+
+    char path[SD_PATH_SIZE];
+    test_segment_path(log->tail.segment, path, sizeof(path));
+    long end   = log->tail.offset;
+    long start = end - (long) (sizeof(sd_log_record_t) + test_length(model->tail_seq));
+
+    switch (cut) {
+        case CUT_APPEND_TRUNCATED:
+            test_truncate(path, test_range(start, end - 1));
+            break;
+        case CUT_APPEND_HEADER:
+            test_overwrite(path, start, 0, sizeof(sd_log_record_t));
+            break;
+        case CUT_APPEND_PAYLOAD: {
+            long offset = test_range(start + sizeof(sd_log_record_t), end - 1);
+            test_damage(path, offset, test_range(1, end - offset));
+            break;
+        }
+        default:
+            test_truncate(path, start);
+            test_append_garbage(path, test_range(1, 2 * sizeof(sd_log_record_t) + 64));
+            break;
+    }
+    return 1;
+}
+
+
+/*  Corte en medio de sd_log_commit(): se guardan los segmentos que el commit
+    borra para dejarlos como estaban en el momento del corte */
+static int test_cut_commit(sd_log_t* log, test_model_t* model, enum test_cut cut){
+    static char buffer[TEST_BUFFER_SIZE];
+    sd_log_iter_t iter;
+    size_t length;
+    uint32_t count = test_range(0, model->tail_seq - model->head_seq);
+    sd_log_iter_begin(log, &iter);
+    for (uint32_t i = 0; i < count && sd_log_iter_next(&iter, buffer, sizeof(buffer), &length) == ESP_OK; i++) {
+    }
+    sd_log_cursor_t commit = iter.pos;
+    sd_log_iter_end(&iter);
+
+    char* saved[TEST_MAX_SEGMENTS] = { NULL };
+    long saved_size[TEST_MAX_SEGMENTS];
+    char path[SD_PATH_SIZE];
+    uint32_t first = log->head.segment;
+    uint32_t last = commit.segment;
+    for (uint32_t segment = first; segment < last && segment - first < TEST_MAX_SEGMENTS; segment++) {
+        test_segment_path(segment, path, sizeof(path));
+        saved[segment - first] = test_read_file(path, &saved_size[segment - first]);
+    }
+
+    if (sd_log_commit(log, &commit) != ESP_OK) {
+        fprintf(stderr, "sd_log_commit fallo\n");
+        return 0;
+    }
+
+    // El borrado va en orden: el corte deja los ultimos segmentos
+    uint32_t restore_from = (cut == CUT_INDEX_TORN) ? first : test_range(first, last);
+    for (uint32_t segment = first; segment < last && segment - first < TEST_MAX_SEGMENTS; segment++) {
+        if (segment >= restore_from && saved[segment - first] != NULL) {
+            test_segment_path(segment, path, sizeof(path));
+            test_write_file(path, saved[segment - first], saved_size[segment - first]);
+        }
+        free(saved[segment - first]);
+    }
+
+    if (cut == CUT_INDEX_TORN) {
+        // La copia que se acaba de escribir queda a medias: vale la anterior (o ninguna)
+        sd_path(path, sizeof(path), "%s.idx", TEST_INDEX);
+        long slot = (log->index_generation & 1) * SD_META_SLOT;
+        long copy = 2 * sizeof(uint32_t) + sizeof(sd_log_cursor_t) + sizeof(uint32_t);
+        long offset = test_range(slot, slot + copy - 1);
+        test_damage(path, offset, test_range(1, slot + copy - offset));
+    }
+    else {
+        model->head_seq = commit.seq;
+    }
+    return 1;
+}
+
+
+static int test_power_cut(uint32_t seed){
+    sd_log_t log;
+    test_model_t model = { 0, 0 };
+    s_rand = seed * 2654435761u + 1;
+    s_salt = seed;
+    test_clear_dir();
+    if (sd_log_open(&log, TEST_PREFIX, TEST_INDEX) != ESP_OK) {
+        fprintf(stderr, "sd_log_open fallo\n");
+        return 0;
+    }
+
+    // Historia antes del corte: appends, commits parciales y reinicios
+    int rounds = test_range(1, 6);
+    for (int round = 0; round < rounds; round++) {
+        int appends = test_range(0, 60);
+        for (int i = 0; i < appends; i++) {
+            if (!test_append(&log, &model)) {
+                return 0;
+            }
+        }
+        if (test_range(0, 1) && !test_verify(&log, &model, test_range(0, model.tail_seq - model.head_seq))) {
+            return 0;
+        }
+        if (test_range(0, 3) == 0 && !test_reopen(&log)) {
+            return 0;
+        }
+    }
+
+    enum test_cut cut = test_range(0, CUT_COUNT - 1);
+    int ok = (cut < CUT_INDEX_TORN) ? test_cut_append(&log, &model, cut) : test_cut_commit(&log, &model, cut);
+    sd_log_close(&log);
+    if (ok && sd_log_open(&log, TEST_PREFIX, TEST_INDEX) != ESP_OK) {
+        fprintf(stderr, "sd_log_open fallo\n");
+        ok = 0;
+    }
+
+    // Despues del corte: los segmentos ya confirmados no quedan, se puede seguir
+    // escribiendo con el seq siguiente y todo lo pendiente se confirma
+    if (ok && test_segments_before(log.head.segment) != 0) {
+        fprintf(stderr, "Quedan %d segmentos antes de head (segmento %lu)\n",
+                test_segments_before(log.head.segment), (unsigned long) log.head.segment);
+        ok = 0;
+    }
+    ok = ok && test_verify(&log, &model, 0) && test_append(&log, &model) &&
+         test_reopen(&log) && test_verify(&log, &model, model.tail_seq - model.head_seq) &&
+         test_reopen(&log) && test_verify(&log, &model, 0);
+    if (ok && test_segments_before(log.tail.segment) != 0) {
+        fprintf(stderr, "Con todo confirmado quedan %d segmentos antes de la cola\n",
+                test_segments_before(log.tail.segment));
+        ok = 0;
+    }
+    sd_log_close(&log);
+    if (!ok) {
+        fprintf(stderr, "  semilla %lu, corte: %s\n", (unsigned long) seed, s_cut_names[cut]);
+    }
+    return ok;
+}
+
+
+/*  Dana algunos segmentos y recorre el log con la cuarentena: no se entrega un
+    registro danado, no se pierde uno sano de un segmento intacto y cada error
+    de CRC deja un registro SD_LOG_FLAG_CORRUPT en la cuarentena */
+static int test_corrupt(uint32_t seed){
+    static char buffer[2 * SD_LOG_SEGMENT_SIZE];   // Ningun registro de un segmento da ESP_ERR_INVALID_SIZE
+    static char expected[TEST_BUFFER_SIZE];
+    static uint32_t record_segment[TEST_MAX_RECORDS];   // Segmento de cada seq
+    uint8_t damaged[TEST_MAX_SEGMENTS] = { 0 };
+    sd_log_t log, quarantine;
+    sd_log_iter_t iter;
+    test_model_t model = { 0, 0 };
+    char path[SD_PATH_SIZE];
+    size_t length;
+    int ok = 1;
+
+    s_rand = seed * 2246822519u + 7;
+    s_salt = ~seed;
+    test_clear_dir();
+    if (sd_log_open(&log, TEST_PREFIX, TEST_INDEX) != ESP_OK ||
+        sd_log_open(&quarantine, TEST_QUARANTINE, TEST_QUARANTINE_IDX) != ESP_OK) {
+        fprintf(stderr, "sd_log_open fallo\n");
+        return 0;
+    }
+
+    // Grupos de registros: cada iteracion cierra el segmento y el siguiente grupo va a otro
+    int groups = test_range(1, TEST_MAX_RECORDS / 64);
+    for (int group = 0; group < groups; group++) {
+        int appends = test_range(1, 60);
+        for (int i = 0; i < appends; i++) {
+            if (!test_append(&log, &model)) {
+                return 0;
+            }
+            record_segment[model.tail_seq - 1] = log.tail.segment;
+        }
+        sd_log_iter_begin(&log, &iter);
+        sd_log_iter_end(&iter);
+    }
+
+    enum test_damage damage = test_range(0, DAMAGE_COUNT - 1);
+    int segments = test_range(1, log.tail.segment - log.head.segment + 1);
+    for (int i = 0; i < segments; i++) {
+        uint32_t segment = test_range(log.head.segment, log.tail.segment);
+        test_segment_path(segment, path, sizeof(path));
+        long size = test_file_size(path);
+        damaged[segment] = 1;
+        switch (damage) {
+            case DAMAGE_BITS:
+                for (int bits = test_range(1, 8); bits > 0; bits--) {
+                    long offset = test_range(0, size - 1);
+                    test_flip_bit(path, offset, test_range(0, 7));
+                }
+                break;
+            case DAMAGE_RANGE: {
+                long offset = test_range(0, size - 1);
+                test_write_garbage(path, offset, test_range(1, (size - offset < 512) ? size - offset : 512));
+                break;
+            }
+            default:
+                test_truncate(path, 0);
+                test_append_garbage(path, test_range(1, size));
+                break;
+        }
+    }
+
+    // El recorrido tiene que terminar: cada paso avanza al menos un encabezado o un segmento
+    uint32_t seq = 0;
+    int corrupt = 0, steps = 0;
+    int max_steps = model.tail_seq + (log.tail.segment - log.head.segment + 1) + 1;
+    esp_err_t ret;
+    sd_log_iter_begin(&log, &iter);
+    iter.quarantine = &quarantine;
+    while ((ret = sd_log_iter_next(&iter, buffer, sizeof(buffer), &length)) != ESP_ERR_NOT_FOUND && ret != ESP_FAIL) {
+        if (++steps > max_steps) {
+            fprintf(stderr, "El recorrido no termina despues de %d pasos\n", steps);
+            ok = 0;
+            break;
+        }
+        if (ret == ESP_ERR_INVALID_CRC) {
+            corrupt++;
+            continue;
+        }
+        if (ret != ESP_OK) {
+            fprintf(stderr, "sd_log_iter_next = %s\n", esp_err_to_name(ret));
+            ok = 0;
+            break;
+        }
+
+        // Entregado: intacto, en orden y sin saltar registros sanos de segmentos intactos
+        uint32_t current = iter.current.seq;
+        if (current < seq || current >= model.tail_seq) {
+            fprintf(stderr, "Registro %lu fuera de orden (siguiente esperado %lu)\n",
+                    (unsigned long) current, (unsigned long) seq);
+            ok = 0;
+            break;
+        }
+        size_t expected_length = test_payload(current, expected);
+        if (length != expected_length || memcmp(buffer, expected, length) != 0) {
+            fprintf(stderr, "Registro %lu entregado con otro contenido\n", (unsigned long) current);
+            ok = 0;
+            break;
+        }
+        for (; seq < current; seq++) {
+            if (!damaged[record_segment[seq]]) {
+                fprintf(stderr, "Registro %lu de un segmento intacto perdido\n", (unsigned long) seq);
+                ok = 0;
+            }
+        }
+        seq = current + 1;
+    }
+    sd_log_iter_end(&iter);
+    for (; ok && seq < model.tail_seq; seq++) {
+        if (!damaged[record_segment[seq]]) {
+            fprintf(stderr, "Registro %lu de un segmento intacto perdido\n", (unsigned long) seq);
+            ok = 0;
+        }
+    }
+
+    // Un registro de cuarentena por cada error de CRC, marcado y con su propio CRC valido
+    int quarantined = 0;
+    sd_log_iter_begin(&quarantine, &iter);
+    while (ok && (ret = sd_log_iter_next(&iter, buffer, sizeof(buffer), &length)) == ESP_OK) {
+        if (!(iter.current.flags & SD_LOG_FLAG_CORRUPT) || length == 0) {
+            fprintf(stderr, "Registro %lu de la cuarentena sin SD_LOG_FLAG_CORRUPT\n",
+                    (unsigned long) iter.current.seq);
+            ok = 0;
+        }
+        quarantined++;
+    }
+    sd_log_iter_end(&iter);
+    if (ok && (ret != ESP_ERR_NOT_FOUND || quarantined != corrupt)) {
+        fprintf(stderr, "%d registros en cuarentena (%s al final), %d errores de CRC\n",
+                quarantined, esp_err_to_name(ret), corrupt);
+        ok = 0;
+    }
+
+    // Abrir otra vez un log danado no puede fallar
+    sd_log_close(&log);
+    sd_log_close(&quarantine);
+    if (ok && sd_log_open(&log, TEST_PREFIX, TEST_INDEX) != ESP_OK) {
+        fprintf(stderr, "sd_log_open fallo con el log danado\n");
+        ok = 0;
+    }
+    sd_log_close(&log);
+    if (!ok) {
+        fprintf(stderr, "  semilla %lu, dano: %s en %d segmentos\n", (unsigned long) seed,
+                s_damage_names[damage], segments);
+    }
+    return ok;
+}
+
+
+/*  Error de lectura de la SD y cuarentena que no se puede escribir: el registro
+    no se salta, el siguiente recorrido lo vuelve a leer */
+static void test_read_errors(void){
+    static const char* payloads[] = { "uno", "dos", "tres" };
+    const long header = sizeof(sd_log_record_t);
+    char buffer[64];
+    char path[SD_PATH_SIZE];
+    size_t length;
+    sd_log_t log, quarantine;
+    sd_log_iter_t iter;
+    sd_log_record_t record;
+    sd_log_cursor_t pos;
+
+    test_clear_dir();
+    CHECK_EQ(sd_log_open(&log, TEST_PREFIX, TEST_INDEX), ESP_OK, "%d");
+    CHECK_EQ(sd_log_open(&quarantine, TEST_QUARANTINE, TEST_QUARANTINE_IDX), ESP_OK, "%d");
+    for (int i = 0; i < 3; i++) {
+        CHECK_EQ(sd_log_append(&log, payloads[i], strlen(payloads[i])), ESP_OK, "%d");
+    }
+
+    // Falla la lectura del payload (la anterior es la del encabezado)
+    sd_log_iter_begin(&log, &iter);
+    iter.quarantine = &quarantine;
+    CHECK_EQ(sd_log_iter_next_record(&iter, &record), ESP_OK, "%d");
+    host_vfs_fail_read(0);
+    CHECK_EQ(sd_log_iter_read(&iter, buffer, sizeof(buffer)), SD_LOG_READ_FAIL, "%d");
+    CHECK_EQ(sd_log_iter_rewind_record(&iter), ESP_OK, "%d");
+    CHECK_EQ(sd_log_iter_read(&iter, buffer, sizeof(buffer)), 3, "%d");
+    sd_log_iter_end(&iter);
+
+    sd_log_iter_begin(&log, &iter);
+    iter.quarantine = &quarantine;
+    pos = iter.pos;
+    host_vfs_fail_read(1);
+    CHECK_EQ(sd_log_iter_next(&iter, buffer, sizeof(buffer), &length), ESP_FAIL, "%d");
+    CHECK(iter.pos.segment == pos.segment && iter.pos.offset == pos.offset && iter.pos.seq == pos.seq);
+    CHECK_EQ(sd_log_iter_next(&iter, buffer, sizeof(buffer), &length), ESP_OK, "%d");
+    CHECK(strcmp(buffer, "uno") == 0);
+    sd_log_iter_end(&iter);
+    CHECK_EQ((unsigned) sd_log_pending(&quarantine), 0u, "%u");
+
+    // CRC invalido en "dos" con la cuarentena sin lugar en la tabla de archivos
+    test_segment_path(log.head.segment, path, sizeof(path));
+    test_flip_bit(path, 2 * header + 3, 0);
+    sd_log_close(&quarantine);
+    sd_log_iter_begin(&log, &iter);
+    iter.quarantine = &quarantine;
+    CHECK_EQ(sd_log_iter_next(&iter, buffer, sizeof(buffer), &length), ESP_OK, "%d");
+    pos = iter.pos;
+    host_vfs_set_max(host_vfs_open_files());
+    CHECK_EQ(sd_log_iter_next(&iter, buffer, sizeof(buffer), &length), ESP_FAIL, "%d");
+    CHECK(iter.pos.segment == pos.segment && iter.pos.offset == pos.offset && iter.pos.seq == pos.seq);
+    CHECK_EQ((unsigned) sd_log_pending(&quarantine), 0u, "%u");
+
+    // Con lugar otra vez el mismo registro pasa a la cuarentena y se sigue
+    host_vfs_set_max(SD_MAX_FILES);
+    CHECK_EQ(sd_log_iter_next(&iter, buffer, sizeof(buffer), &length), ESP_ERR_INVALID_CRC, "%d");
+    CHECK_EQ((unsigned) sd_log_pending(&quarantine), 1u, "%u");
+    CHECK_EQ(sd_log_iter_next(&iter, buffer, sizeof(buffer), &length), ESP_OK, "%d");
+    CHECK(strcmp(buffer, "tres") == 0);
+    sd_log_iter_end(&iter);
+
+    // Encabezado de "tres" danado: el resto del segmento tampoco se salta si la copia falla
+    test_flip_bit(path, 2 * header + 6, 0);
+    sd_log_iter_begin(&log, &iter);
+    iter.quarantine = &quarantine;
+    CHECK_EQ(sd_log_iter_next(&iter, buffer, sizeof(buffer), &length), ESP_OK, "%d");
+    CHECK_EQ(sd_log_iter_next(&iter, buffer, sizeof(buffer), &length), ESP_ERR_INVALID_CRC, "%d");
+    sd_log_close(&quarantine);
+    pos = iter.pos;
+    host_vfs_set_max(host_vfs_open_files());
+    CHECK_EQ(sd_log_iter_next(&iter, buffer, sizeof(buffer), &length), ESP_FAIL, "%d");
+    CHECK(iter.pos.segment == pos.segment && iter.pos.offset == pos.offset && iter.pos.seq == pos.seq);
+    host_vfs_set_max(SD_MAX_FILES);
+    CHECK_EQ(sd_log_iter_next(&iter, buffer, sizeof(buffer), &length), ESP_ERR_INVALID_CRC, "%d");
+    CHECK_EQ((unsigned) sd_log_pending(&quarantine), 3u, "%u");
+    CHECK_EQ(sd_log_iter_next(&iter, buffer, sizeof(buffer), &length), ESP_ERR_NOT_FOUND, "%d");
+    sd_log_iter_end(&iter);
+
+    sd_log_close(&log);
+    sd_log_close(&quarantine);
+    test_clear_dir();
+}
+
+
+/*  Registros importados despues de sd_cursor_import(1) y un corte antes del
+    commit: al abrir de nuevo no mueven edge_seq, los descargados si */
+static void test_cursor_import(void){
+    sd_log_t log;
+    sd_cursor_t cursor;
+
+    test_clear_dir();
+    CHECK_EQ(sd_log_open(&log, TEST_PREFIX, TEST_INDEX), ESP_OK, "%d");
+    CHECK_EQ(sd_cursor_open(&cursor, TEST_CURSOR, &log), ESP_OK, "%d");
+    cursor.mode = 1;
+    for (int i = 0; i < 2; i++) {
+        CHECK_EQ(sd_log_append(&log, "edge", 4), ESP_OK, "%d");
+    }
+    cursor.edge_seq = 2;
+    cursor.log_seq  = log.tail.seq;
+    CHECK_EQ(sd_cursor_commit(&cursor), ESP_OK, "%d");
+
+    // Importacion cortada por la energia: sin sd_cursor_import(0)
+    CHECK_EQ(sd_cursor_import(&cursor, &log, 1), ESP_OK, "%d");
+    for (int i = 0; i < 3; i++) {
+        CHECK_EQ(sd_log_append(&log, "antiguo", 7), ESP_OK, "%d");
+    }
+    sd_log_close(&log);
+    for (int i = 0; i < 2; i++) {
+        CHECK_EQ(sd_log_open(&log, TEST_PREFIX, TEST_INDEX), ESP_OK, "%d");
+        CHECK_EQ(sd_cursor_open(&cursor, TEST_CURSOR, &log), ESP_OK, "%d");
+        CHECK_EQ((unsigned) cursor.mode, 1u, "%u");
+        CHECK_EQ((unsigned) cursor.edge_seq, 2u, "%u");
+        CHECK_EQ((unsigned) cursor.log_seq, (unsigned) log.tail.seq, "%u");
+        CHECK_EQ(cursor.importing, 0, "%d");
+        sd_log_close(&log);
+    }
+
+    // Importacion completa y despues un registro del Edge guardado sin commit
+    CHECK_EQ(sd_log_open(&log, TEST_PREFIX, TEST_INDEX), ESP_OK, "%d");
+    CHECK_EQ(sd_cursor_open(&cursor, TEST_CURSOR, &log), ESP_OK, "%d");
+    CHECK_EQ(sd_cursor_import(&cursor, &log, 1), ESP_OK, "%d");
+    CHECK_EQ(sd_log_append(&log, "antiguo", 7), ESP_OK, "%d");
+    CHECK_EQ(sd_cursor_import(&cursor, &log, 0), ESP_OK, "%d");
+    CHECK_EQ(sd_log_append(&log, "edge", 4), ESP_OK, "%d");
+    sd_log_close(&log);
+    CHECK_EQ(sd_log_open(&log, TEST_PREFIX, TEST_INDEX), ESP_OK, "%d");
+    CHECK_EQ(sd_cursor_open(&cursor, TEST_CURSOR, &log), ESP_OK, "%d");
+    CHECK_EQ((unsigned) cursor.edge_seq, 3u, "%u");
+    CHECK_EQ((unsigned) cursor.log_seq, (unsigned) log.tail.seq, "%u");
+
+    sd_cursor_close(&cursor);
+    sd_log_close(&log);
+    test_clear_dir();
+}
+
+
+int main(int argc, char** argv){
+    int iterations = 100;
+    uint32_t seed = 1;
+
+    static const struct option options[] = {
+        { "iterations", required_argument, NULL, 'i' },
+        { "seed",       required_argument, NULL, 's' },
+        { NULL, 0, NULL, 0 },
+    };
+    int option;
+    while ((option = getopt_long(argc, argv, "", options, NULL)) != -1) {
+        switch (option) {
+            case 'i': iterations = atoi(optarg); break;
+            case 's': seed = strtoul(optarg, NULL, 0); break;
+            default:
+                fprintf(stderr, "Uso: %s [--iterations N] [--seed S]\n", argv[0]);
+                return 2;
+        }
+    }
+
+    // Cada corte deja errores de recuperacion en el log: solo se muestran con NODO_LOG
+    setenv("NODO_LOG", "N", 0);
+
+    // La tarjeta SD es un directorio: MOUNT_POINT es "." en host/
+    char sd_dir[] = "/tmp/nodo_test_sd.XXXXXX";
+    if (mkdtemp(sd_dir) == NULL || chdir(sd_dir) != 0) {
+        perror(sd_dir);
+        return 1;
+    }
+    mem_init();
+
+    test_read_errors();
+    test_cursor_import();
+    for (int i = 0; i < iterations; i++) {
+        CHECK(test_power_cut(seed + i));
+        CHECK(test_corrupt(seed + i));
+    }
+    test_clear_dir();
+    if (chdir("/") == 0) {
+        rmdir(sd_dir);
+    }
+    return TEST_RESULT();
+}
@@ -0,0 +1,666 @@
+/*  Batch boundaries of esp32_upload.c against a server in the same process (one
+    thread per connection, keep-alive like the real ones):
+
+    lotes       : two logs sent one after another. No POST has more than
+                  UPLOAD_BATCH_SIZE records, an array body never passes
+                  UPLOAD_BATCH_BYTES and a batch never mixes records of two logs
+    bytes       : records sized so that three of them fill UPLOAD_BATCH_BYTES
+                  to the byte, with records bigger than a batch (sent alone)
+                  and bigger than UPLOAD_INLINE_MAX (streamed from the SD) in
+                  the middle
+    por registro: the server answers an array with one result per record
+                  (status, bool or object): exactly the rejected ones end in
+                  the failed log
+    4xx         : the server does not take arrays: after the first 400 every
+                  record goes alone, the records of the rejected batch included
+
+    In every scenario the server checks every record byte by byte, each record
+    is accepted exactly once and in the order of its log, and the logs are
+    empty at the end.
+
+    danado      : a record that fails its CRC holds the log when there is no
+                  quarantine to copy it to, and goes to the quarantine when
+                  there is one. "danado SD" is the same with a record streamed
+                  from the SD (bigger than UPLOAD_INLINE_MAX)
+    bateria     : a sample without a date from an earlier power-on is never
+                  sent, one of this power-on waits until sd_battery_date()
+                  gives it the time of the Edge and goes with its real date */
+#define _GNU_SOURCE                     // memmem(), strcasestr()
+#include "esp32_upload.h"
+#include "esp32_mem.h"
+#include "esp32_telem.h"
+#include "host_idf.h"
+#include "test.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#define TEST_HOST           "upload.test"
+#define TEST_MAX_RECORDS    1024
+#define TEST_MAX_REQUESTS   1024
+#define TEST_MAX_BATCH      64          // Records of a request seen by the server (more is already a failure)
+#define TEST_BODY_SIZE      (32 * 1024)
+#define TEST_BIG_RECORD     (UPLOAD_INLINE_MAX + 4000)
+#define TEST_BATTERY_PATH   "/bateria"
+#define TEST_MAX_SAMPLES    16
+
+enum _test_mode{
+    TEST_MODE_OK = 0,           // 200 "OK" to everything: the status counts for the whole batch
+    TEST_MODE_ITEMS,            // 200 + one result per record of an array
+    TEST_MODE_NO_ARRAY          // 400 to an array, 200 to an object
+};
+
+typedef struct {
+    char*       text;
+    size_t      length;
+    const char* path;           // Endpoint of its log
+    int         accepted;       // Times the server answered 200 for it
+} test_record_t;
+
+typedef struct {
+    char        path[16];
+    int         count;          // Records in the body, -1 = body not valid
+    int         is_array;
+    size_t      length;
+    int         status;
+    int         ids[TEST_MAX_BATCH];
+} test_request_t;
+
+static test_record_t    s_records[TEST_MAX_RECORDS];
+static int              s_record_count;
+static test_request_t   s_requests[TEST_MAX_REQUESTS];
+static int              s_request_count;
+static int              s_errors;           // Bodies the server could not match with a record
+static enum _test_mode  s_mode;
+static char             s_battery_dates[TEST_MAX_SAMPLES][24];   // Fecha de cada muestra de bateria recibida
+static int              s_battery_mv[TEST_MAX_SAMPLES];
+static int              s_battery_count;
+static pthread_mutex_t  s_lock = PTHREAD_MUTEX_INITIALIZER;
+
+
+/* ---------------------------- Registros ---------------------------- */
+
+// Registro JSON de exactamente length bytes: {"id":N,"pad":"..."}
+static int test_record(const char* path, size_t length){
+    int id = s_record_count++;
+    test_record_t* record = &s_records[id];
+    record->text = malloc(length + 1);
+    int head = snprintf(record->text, length + 1, "{\"id\":%d,\"pad\":\"", id);
+    for (size_t i = head; i < length - 2; i++) {
+        record->text[i] = 'a' + (id + i) % 26;
+    }
+    memcpy(record->text + length - 2, "\"}", 3);
+    record->length = length;
+    record->path = path;
+    record->accepted = 0;
+    return id;
+}
+
+
+/*  Resultado del servidor para un registro de un arreglo en TEST_MODE_ITEMS:
+    los ids 3, 5 y 6 (mod 7) se rechazan, en las cuatro formas que acepta upload */
+static int test_item_ok(int id){
+    return !(id % 7 == 3 || id % 7 == 5 || id % 7 == 6);
+}
+
+
+static const char* test_item_result(int id){
+    static const char* const accepted[] = { "200", "true", "{\"ok\":true}", "{\"status\":200}" };
+    static const char* const rejected[] = { "500", "false", "{\"ok\":false}", "{\"status\":409}" };
+    return test_item_ok(id) ? accepted[id % 4] : rejected[id % 4];
+}
+
+
+/* ----------------------------- Servidor ----------------------------- */
+
+// Un registro del cuerpo: id y bytes exactos del que se guardo en el log
+static int test_match(const char* text, size_t length, const char* path){
+    int id;
+    if (sscanf(text, "{\"id\":%d,", &id) != 1 || id < 0 || id >= s_record_count) {
+        return -1;
+    }
+    const test_record_t* record = &s_records[id];
+    if (record->length != length || memcmp(record->text, text, length) != 0 || strcmp(record->path, path) != 0) {
+        return -1;
+    }
+    return id;
+}
+
+
+// Ids de un cuerpo (objeto o arreglo de objetos). Retorna la cantidad o -1
+static int test_parse_body(const char* body, size_t length, const char* path, int* is_array, int* ids){
+    *is_array = (length > 0 && body[0] == '[');
+    if (!*is_array) {
+        ids[0] = test_match(body, length, path);
+        return (ids[0] >= 0) ? 1 : -1;
+    }
+    int count = 0;
+    size_t pos = 1;
+    while (pos < length && body[pos] == '{') {
+        // Los registros no tienen llaves adentro
+        const char* end = memchr(body + pos, '}', length - pos);
+        if (end == NULL || count == TEST_MAX_BATCH) {
+            return -1;
+        }
+        size_t item_length = end + 1 - (body + pos);
+        if ((ids[count++] = test_match(body + pos, item_length, path)) < 0) {
+            return -1;
+        }
+        pos += item_length;
+        if (pos < length && body[pos] == ',') {
+            pos++;
+        }
+    }
+    return (count > 0 && pos + 1 == length && body[pos] == ']') ? count : -1;
+}
+
+
+static int test_respond(int fd, int status, const char* body){
+    char response[1024];
+    int length = snprintf(response, sizeof(response), "HTTP/1.1 %d %s\r\nContent-Type: application/json\r\n"
+                          "Content-Length: %u\r\n\r\n%s", status, (status == 200) ? "OK" : "Error",
+                          (unsigned) strlen(body), body);
+    return send(fd, response, length, MSG_NOSIGNAL) == length ? 0 : -1;
+}
+
+
+// Documento de bateria: cada muestra es {"Valor":"V.VV","Identificador":"Voltaje","Fecha":"..."}
+static void test_battery_body(const char* body, size_t length){
+    static char text[TEST_BODY_SIZE + 1];
+    memcpy(text, body, length);
+    text[length] = '\0';
+    pthread_mutex_lock(&s_lock);
+    for (const char* entry = text; (entry = strstr(entry, "{\"Valor\":\"")) != NULL; entry++) {
+        float volts;
+        char date[24];
+        if (sscanf(entry, "{\"Valor\":\"%f\",\"Identificador\":\"Voltaje\",\"Fecha\":\"%23[^\"]\"}", &volts, date) == 2 &&
+            s_battery_count < TEST_MAX_SAMPLES) {
+            s_battery_mv[s_battery_count] = (int) (volts * 1000 + 0.5f);
+            snprintf(s_battery_dates[s_battery_count++], sizeof(s_battery_dates[0]), "%s", date);
+        }
+    }
+    pthread_mutex_unlock(&s_lock);
+}
+
+
+static void test_handle(int fd, const char* path, const char* body, size_t length){
+    if (strcmp(path, TEST_BATTERY_PATH) == 0) {
+        test_battery_body(body, length);
+        test_respond(fd, 200, "OK");
+        return;
+    }
+    test_request_t request = { .length = length };
+    snprintf(request.path, sizeof(request.path), "%s", path);
+    request.count = test_parse_body(body, length, path, &request.is_array, request.ids);
+
+    char response[UPLOAD_RESPONSE_SIZE] = "OK";
+    request.status = 200;
+    if (request.count < 0) {
+        request.status = 422;
+    }
+    else if (s_mode == TEST_MODE_NO_ARRAY && request.is_array) {
+        request.status = 400;
+    }
+    else if (s_mode == TEST_MODE_ITEMS && !request.is_array) {
+        request.status = test_item_ok(request.ids[0]) ? 200 : 500;
+    }
+    else if (s_mode == TEST_MODE_ITEMS) {
+        size_t used = snprintf(response, sizeof(response), "[");
+        for (int i = 0; i < request.count; i++) {
+            used += snprintf(response + used, sizeof(response) - used, "%s%s", i ? "," : "",
+                             test_item_result(request.ids[i]));
+        }
+        snprintf(response + used, sizeof(response) - used, "]");
+    }
+
+    pthread_mutex_lock(&s_lock);
+    s_errors += (request.count < 0);
+    for (int i = 0; i < request.count && request.status == 200; i++) {
+        int is_item = (s_mode == TEST_MODE_ITEMS && request.is_array);
+        s_records[request.ids[i]].accepted += !is_item || test_item_ok(request.ids[i]);
+    }
+    if (s_request_count < TEST_MAX_REQUESTS) {
+        s_requests[s_request_count++] = request;
+    }
+    pthread_mutex_unlock(&s_lock);
+    test_respond(fd, request.status, (request.status == 200) ? response : "{\"error\":\"rechazado\"}");
+}
+
+
+// Una conexion: peticiones con Content-Length una detras de otra hasta que el cliente cierra
+static void* test_connection(void* arg){
+    int fd = (int) (intptr_t) arg;
+    char* buffer = malloc(TEST_BODY_SIZE);
+    size_t used = 0;
+    while (buffer != NULL) {
+        char* end;
+        while ((end = memmem(buffer, used, "\r\n\r\n", 4)) == NULL) {
+            ssize_t n = (used < TEST_BODY_SIZE) ? recv(fd, buffer + used, TEST_BODY_SIZE - used, 0) : -1;
+            if (n <= 0) {
+                goto closed;
+            }
+            used += n;
+        }
+        *end = '\0';
+        char path[16] = "";
+        const char* length_header = strcasestr(buffer, "\r\nContent-Length:");
+        size_t length = (length_header != NULL) ? strtoul(length_header + 17, NULL, 10) : 0;
+        size_t header = end + 4 - buffer;
+        sscanf(buffer, "POST %15s", path);
+        if (strcasestr(buffer, "\r\nContent-Encoding:") != NULL || header + length > TEST_BODY_SIZE) {
+            break;
+        }
+        while (used < header + length) {
+            ssize_t n = recv(fd, buffer + used, header + length - used, 0);
+            if (n <= 0) {
+                goto closed;
+            }
+            used += n;
+        }
+        test_handle(fd, path, buffer + header, length);
+        memmove(buffer, buffer + header + length, used - header - length);
+        used -= header + length;
+    }
+closed:
+    free(buffer);
+    close(fd);
+    return NULL;
+}
+
+
+static void* test_server(void* arg){
+    int listener = (int) (intptr_t) arg;
+    int fd;
+    while ((fd = accept(listener, NULL, NULL)) >= 0) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, test_connection, (void*) (intptr_t) fd) == 0) {
+            pthread_detach(thread);
+        }
+        else {
+            close(fd);
+        }
+    }
+    return NULL;
+}
+
+
+// Servidor en 127.0.0.1 con un puerto libre; TEST_HOST apunta a el
+static int test_server_start(void){
+    struct sockaddr_in address = { .sin_family = AF_INET, .sin_addr.s_addr = htonl(INADDR_LOOPBACK) };
+    socklen_t address_length = sizeof(address);
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    if (listener < 0 || bind(listener, (struct sockaddr*) &address, sizeof(address)) != 0 ||
+        listen(listener, 8) != 0 || getsockname(listener, (struct sockaddr*) &address, &address_length) != 0) {
+        perror("servidor");
+        return -1;
+    }
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, test_server, (void*) (intptr_t) listener) != 0) {
+        return -1;
+    }
+    pthread_detach(thread);
+
+    char route[32];
+    snprintf(route, sizeof(route), "127.0.0.1:%u", (unsigned) ntohs(address.sin_port));
+    host_http_route(TEST_HOST, route);
+    return 0;
+}
+
+
+/* ----------------------------- Escenarios ----------------------------- */
+
+typedef struct {
+    const char*     name;
+    enum _test_mode mode;
+    int             streams;
+    const char*     paths[2];
+    int             first[2];       // Rango de ids de cada log
+    int             count[2];
+} test_scenario_t;
+
+
+// Ids de un log leidos con sd_log_iter_next(). Retorna la cantidad
+static int test_log_ids(sd_log_t* log, int* ids, int max){
+    static char buffer[TEST_BIG_RECORD + 1];
+    sd_log_iter_t iter;
+    size_t length;
+    int count = 0;
+    sd_log_iter_begin(log, &iter);
+    while (count < max && sd_log_iter_next(&iter, buffer, sizeof(buffer), &length) == ESP_OK) {
+        int id = -1;
+        buffer[length] = '\0';
+        sscanf(buffer, "{\"id\":%d,", &id);
+        ids[count++] = id;
+    }
+    sd_log_iter_end(&iter);
+    return count;
+}
+
+
+/*  Guarda los registros ya creados en logs nuevos, los envia con
+    upload_streams() y revisa lo que vio el servidor */
+static void test_run(const test_scenario_t* scenario){
+    static const upload_sink_config_t sink = { .name = "CST", .url = "http://" TEST_HOST "/a", .required = 1 };
+    static char urls[2][64];
+    static sd_log_t logs[2], failed_logs[2];
+    static int run = 0;
+    upload_stream_t streams[2];
+    char prefix[8], index[8];
+
+    pthread_mutex_lock(&s_lock);
+    s_mode = scenario->mode;
+    s_request_count = 0;
+    s_errors = 0;
+    pthread_mutex_unlock(&s_lock);
+
+    // Logs nuevos en cada escenario
+    memset(streams, 0, sizeof(streams));
+    run++;
+    for (int s = 0; s < scenario->streams; s++) {
+        snprintf(prefix, sizeof(prefix), "u%c%c_", 'a' + run, '0' + s);
+        snprintf(index, sizeof(index), "u%c%cidx", 'a' + run, '0' + s);
+        CHECK_EQ(sd_log_open(&logs[s], prefix, index), ESP_OK, "%d");
+        snprintf(prefix, sizeof(prefix), "e%c%c_", 'a' + run, '0' + s);
+        snprintf(index, sizeof(index), "e%c%cidx", 'a' + run, '0' + s);
+        CHECK_EQ(sd_log_open(&failed_logs[s], prefix, index), ESP_OK, "%d");
+        for (int id = scenario->first[s]; id < scenario->first[s] + scenario->count[s]; id++) {
+            CHECK_EQ(sd_log_append(&logs[s], s_records[id].text, s_records[id].length), ESP_OK, "%d");
+        }
+        snprintf(urls[s], sizeof(urls[s]), "http://" TEST_HOST "%s", scenario->paths[s]);
+        streams[s].name       = scenario->paths[s];
+        streams[s].log        = &logs[s];
+        streams[s].failed_log = &failed_logs[s];
+        streams[s].urls[0]    = urls[s];
+    }
+
+    int failed = -1;
+    if (upload_begin(&sink, 1) == ESP_OK) {
+        failed = upload_streams(streams, scenario->streams, NULL);
+        upload_end();
+    }
+
+    // Lo que vio el servidor
+    int too_many = 0, too_big = 0, mixed = 0, arrays = 0, records = 0, max_array = 0;
+    for (int r = 0; r < s_request_count; r++) {
+        const test_request_t* request = &s_requests[r];
+        too_many += request->count > UPLOAD_BATCH_SIZE;
+        too_big  += request->is_array && request->length > UPLOAD_BATCH_BYTES;
+        arrays   += request->is_array;
+        records  += request->count;
+        max_array = (request->is_array && (int) request->length > max_array) ? (int) request->length : max_array;
+        for (int i = 0; i < request->count; i++) {
+            mixed += strcmp(s_records[request->ids[i]].path, request->path) != 0;
+        }
+    }
+    printf("%-12s %4d registros en %3d POST (%3d arreglos), arreglo mas grande = %5d bytes\n",
+           scenario->name, records, s_request_count, arrays, max_array);
+    CHECK_EQ(s_errors, 0, "%d");
+    CHECK_EQ(too_many, 0, "%d");
+    CHECK_EQ(too_big, 0, "%d");
+    CHECK_EQ(mixed, 0, "%d");
+
+    // Cada registro aceptado una vez, en el orden de su log; los rechazados en el log de fallidos
+    int expected_failed = 0;
+    for (int s = 0; s < scenario->streams; s++) {
+        static int ids[TEST_MAX_RECORDS];
+        int last = -1, out_of_order = 0, wrong = 0;
+        for (int r = 0; r < s_request_count; r++) {
+            for (int i = 0; i < s_requests[r].count && s_requests[r].status == 200; i++) {
+                int id = s_requests[r].ids[i];
+                if (strcmp(s_records[id].path, scenario->paths[s]) == 0) {
+                    out_of_order += id <= last;
+                    last = id;
+                }
+            }
+        }
+        int failed_count = test_log_ids(&failed_logs[s], ids, TEST_MAX_RECORDS);
+        int next = 0;
+        for (int id = scenario->first[s]; id < scenario->first[s] + scenario->count[s]; id++) {
+            int rejected = (scenario->mode == TEST_MODE_ITEMS) && !test_item_ok(id);
+            wrong += s_records[id].accepted != !rejected;
+            if (rejected) {
+                wrong += next >= failed_count || ids[next] != id;
+                next++;
+            }
+        }
+        expected_failed += next;
+        CHECK_EQ(out_of_order, 0, "%d");
+        CHECK_EQ(wrong, 0, "%d");
+        CHECK_EQ(failed_count, next, "%d");
+        CHECK_EQ(sd_log_pending(&logs[s]), 0u, "%u");
+        sd_log_close(&logs[s]);
+        sd_log_close(&failed_logs[s]);
+    }
+    CHECK_EQ(failed, expected_failed, "%d");
+}
+
+
+static void test_batches(void){
+    test_scenario_t scenario = {
+        .name = "lotes", .mode = TEST_MODE_OK, .streams = 2, .paths = { "/a", "/b" },
+        .first = { s_record_count }, .count = { 95, 37 },
+    };
+    for (int i = 0; i < scenario.count[0]; i++) {
+        test_record("/a", 40 + (i * 37) % 300);
+    }
+    scenario.first[1] = s_record_count;
+    for (int i = 0; i < scenario.count[1]; i++) {
+        test_record("/b", 30 + (i * 53) % 200);
+    }
+    test_run(&scenario);
+
+    // Los registros llegan mas rapido que las respuestas: los lotes salen llenos
+    int full = (scenario.count[0] + UPLOAD_BATCH_SIZE - 1) / UPLOAD_BATCH_SIZE +
+               (scenario.count[1] + UPLOAD_BATCH_SIZE - 1) / UPLOAD_BATCH_SIZE;
+    CHECK(s_request_count <= full + 2);
+}
+
+
+static void test_bytes(void){
+    // Tres registros llenan un lote justo: 2 * short + last + "[" "," "," "]" = UPLOAD_BATCH_BYTES
+    const size_t short_length = (UPLOAD_BATCH_BYTES - 4) / 3;
+    const size_t last_length = UPLOAD_BATCH_BYTES - 4 - 2 * short_length;
+    test_scenario_t scenario = {
+        .name = "bytes", .mode = TEST_MODE_OK, .streams = 1, .paths = { "/bytes" },
+        .first = { s_record_count }, .count = { 0 },
+    };
+    for (int i = 0; i < 30; i++) {
+        if (i == 12) {
+            test_record("/bytes", UPLOAD_BATCH_BYTES - 10);       // Solo, como objeto
+        }
+        else if (i == 20) {
+            test_record("/bytes", TEST_BIG_RECORD);               // Directo desde la SD
+        }
+        else {
+            test_record("/bytes", (i % 3 == 2) ? last_length : short_length);
+        }
+        scenario.count[0]++;
+    }
+    test_run(&scenario);
+
+    int exact = 0, alone = 0;
+    for (int r = 0; r < s_request_count; r++) {
+        exact += s_requests[r].is_array && s_requests[r].length == UPLOAD_BATCH_BYTES;
+        alone += !s_requests[r].is_array && s_requests[r].length > UPLOAD_BATCH_BYTES / 2;
+    }
+    // Un lote que llena UPLOAD_BATCH_BYTES al byte todavia va junto
+    CHECK(exact > 0);
+    CHECK_EQ(alone, 2, "%d");
+}
+
+
+static void test_items(void){
+    test_scenario_t scenario = {
+        .name = "por registro", .mode = TEST_MODE_ITEMS, .streams = 1, .paths = { "/items" },
+        .first = { s_record_count }, .count = { 60 },
+    };
+    for (int i = 0; i < scenario.count[0]; i++) {
+        test_record("/items", 50 + i);
+    }
+    test_run(&scenario);
+}
+
+
+static void test_no_array(void){
+    test_scenario_t scenario = {
+        .name = "4xx", .mode = TEST_MODE_NO_ARRAY, .streams = 1, .paths = { "/objetos" },
+        .first = { s_record_count }, .count = { 25 },
+    };
+    for (int i = 0; i < scenario.count[0]; i++) {
+        test_record("/objetos", 60 + i);
+    }
+    test_run(&scenario);
+
+    // Un solo arreglo rechazado; despues todo va de a un registro
+    int arrays = 0, objects = 0;
+    for (int r = 0; r < s_request_count; r++) {
+        arrays  += s_requests[r].is_array;
+        objects += !s_requests[r].is_array && s_requests[r].status == 200;
+    }
+    CHECK_EQ(arrays, 1, "%d");
+    CHECK_EQ(objects, scenario.count[0], "%d");
+}
+
+
+/*  El tercero de seis registros (de damaged_length bytes) con un bit cambiado.
+    Mas grande que UPLOAD_INLINE_MAX se envia directo desde la SD */
+static void test_damaged(const char* name, char tag, size_t damaged_length){
+    static const upload_sink_config_t sink = { .name = "CST", .url = "http://" TEST_HOST "/danado", .required = 1 };
+    sd_log_t log, failed_log, quarantine;
+    upload_stream_t stream = { .name = "/danado", .log = &log, .failed_log = &failed_log };
+    char path[SD_PATH_SIZE], prefix[8], index[8];
+    int first = s_record_count;
+    long offset = 0;
+
+    pthread_mutex_lock(&s_lock);
+    s_mode = TEST_MODE_OK;
+    s_errors = 0;
+    pthread_mutex_unlock(&s_lock);
+    stream.urls[0] = sink.url;
+    snprintf(prefix, sizeof(prefix), "u%c_", tag);
+    snprintf(index, sizeof(index), "u%cidx", tag);
+    CHECK_EQ(sd_log_open(&log, prefix, index), ESP_OK, "%d");
+    snprintf(prefix, sizeof(prefix), "e%c_", tag);
+    snprintf(index, sizeof(index), "e%cidx", tag);
+    CHECK_EQ(sd_log_open(&failed_log, prefix, index), ESP_OK, "%d");
+    snprintf(prefix, sizeof(prefix), "q%c_", tag);
+    snprintf(index, sizeof(index), "q%cidx", tag);
+    CHECK_EQ(sd_log_open(&quarantine, prefix, index), ESP_OK, "%d");
+    for (int i = 0; i < 6; i++) {
+        int id = test_record("/danado", (i == 2) ? damaged_length : (size_t) (80 + i));
+        CHECK_EQ(sd_log_append(&log, s_records[id].text, s_records[id].length), ESP_OK, "%d");
+        offset += (i < 2) ? (long) (sizeof(sd_log_record_t) + s_records[id].length) : 0;
+    }
+
+    // Un bit del payload del tercer registro
+    sd_path(path, sizeof(path), "u%c_%05lX.log", tag, (unsigned long) log.head.segment);
+    FILE* f = fopen(path, "r+b");
+    CHECK(f != NULL);
+    if (f != NULL) {
+        fseek(f, offset + sizeof(sd_log_record_t) + 10, SEEK_SET);
+        int c = fgetc(f);
+        fseek(f, offset + sizeof(sd_log_record_t) + 10, SEEK_SET);
+        fputc(c ^ 1, f);
+        fclose(f);
+    }
+
+    // Sin cuarentena el log queda en el registro danado (los siguientes ya se enviaron)
+    CHECK_EQ(upload_begin(&sink, 1), ESP_OK, "%d");
+    CHECK_EQ(upload_streams(&stream, 1, NULL), 0, "%d");
+    unsigned held = sd_log_pending(&log);
+    CHECK_EQ(held, 4u, "%u");
+    for (int i = 0; i < 6; i++) {
+        CHECK_EQ(s_records[first + i].accepted, (i != 2), "%d");
+    }
+
+    // Con cuarentena el registro se copia alli y el log queda vacio
+    CHECK_EQ(upload_streams(&stream, 1, &quarantine), 0, "%d");
+    upload_end();
+    printf("%-12s %u registros retenidos sin cuarentena, %u en cuarentena\n",
+           name, held, (unsigned) sd_log_pending(&quarantine));
+    CHECK_EQ(sd_log_pending(&log), 0u, "%u");
+    CHECK_EQ(sd_log_pending(&quarantine), 1u, "%u");
+    CHECK_EQ(s_records[first + 2].accepted, 0, "%d");
+    CHECK_EQ(s_errors, 0, "%d");
+    sd_log_close(&log);
+    sd_log_close(&failed_log);
+    sd_log_close(&quarantine);
+}
+
+
+/*  Muestras de bateria sin fecha: la de un power-on anterior no se envia y la de
+    este espera a que el Edge ajuste el reloj (sd_battery_date) */
+static void test_battery(void){
+    sd_battery_t battery;
+    sd_battery_sample_t sample;
+    char expected[24];
+    struct tm tm_info;
+    const time_t edge_base = 1700000000;
+
+    CHECK_EQ(sd_battery_open(&battery), ESP_OK, "%d");
+    uint32_t first = battery.next_seq;
+    CHECK_EQ(sd_battery_append(&battery, 50, 3100, 0), ESP_OK, "%d");
+    CHECK_EQ(sd_battery_date(&battery, 0, 1), 1, "%d");
+    CHECK_EQ(sd_battery_append(&battery, 100, 3200, 0), ESP_OK, "%d");
+
+    s_battery_count = 0;
+    CHECK_EQ(upload_battery(&battery, NULL, "http://" TEST_HOST TEST_BATTERY_PATH), 0, "%d");
+    CHECK_EQ(s_battery_count, 0, "%d");
+    CHECK_EQ((unsigned) sd_battery_first_pending(&battery), (unsigned) (first + 1), "%u");
+
+    // El Edge ajusta el reloj: la muestra de 3200 mV queda con su fecha
+    CHECK_EQ(sd_battery_date(&battery, edge_base, 0), 1, "%d");
+    CHECK(sd_battery_read(&battery, first + 1, &sample) && sample.time == edge_base + 100 &&
+          (sample.flags & SD_BATTERY_DATED));
+    CHECK_EQ(sd_battery_append(&battery, (uint32_t) (edge_base + 700), 3300, SD_BATTERY_DATED), ESP_OK, "%d");
+    CHECK_EQ(upload_battery(&battery, NULL, "http://" TEST_HOST TEST_BATTERY_PATH), 2, "%d");
+    CHECK_EQ(s_battery_count, 2, "%d");
+    CHECK_EQ(s_battery_mv[0], 3200, "%d");
+    CHECK_EQ(s_battery_mv[1], 3300, "%d");
+    time_t sample_time = edge_base + 100;
+    localtime_r(&sample_time, &tm_info);
+    strftime(expected, sizeof(expected), "%Y-%m-%d %H:%M:%S", &tm_info);
+    CHECK(strcmp(s_battery_dates[0], expected) == 0);
+    CHECK_EQ((unsigned) sd_battery_first_pending(&battery), (unsigned) battery.next_seq, "%u");
+    sd_battery_close(&battery);
+}
+
+
+int main(void){
+    // Los rechazos del servidor son errores esperados
+    setenv("NODO_LOG", "N", 0);
+
+    // La tarjeta SD es un directorio: MOUNT_POINT es "." en host/
+    char sd_dir[] = "/tmp/nodo_test_upload.XXXXXX";
+    if (mkdtemp(sd_dir) == NULL || chdir(sd_dir) != 0 || test_server_start() != 0) {
+        perror(sd_dir);
+        return 1;
+    }
+    mem_init();
+    telem_init();
+
+    test_batches();
+    test_bytes();
+    test_items();
+    test_no_array();
+    test_damaged("danado", 'd', 90);
+    test_damaged("danado SD", 'g', TEST_BIG_RECORD);
+    test_battery();
+
+    http_pool_cleanup();
+    for (int i = 0; i < s_record_count; i++) {
+        free(s_records[i].text);
+    }
+    if (chdir("/") == 0) {
+        char command[64];
+        snprintf(command, sizeof(command), "rm -rf %s", sd_dir);
+        CHECK_EQ(system(command), 0, "%d");
+    }
+    return TEST_RESULT();
+}
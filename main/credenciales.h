@@ -1,5 +1,5 @@
-#ifndef __cred__.h
-#define __cred__.h
+#ifndef __cred__
+#define __cred__
 
 /* WIFI CREDENCIALES */
 
@@ -25,6 +25,18 @@
 #define edge_pesaje_size    "/pesaje/size"
 #define edge_localtime      "/datetime"
 
+// Modo por lotes: GET <edge_*_data>?from=N&count=K devuelve K registros (uno por linea, NDJSON)
+// N = indice entre los registros informados por <edge_*_size>
+#define edge_batch_query    "?from=%d&count=%d"
+
+// Modo cursor: GET <edge_*_data>?after=S&count=K devuelve hasta K registros con seq > S,
+// una linea "<seq>\t<registro>" por registro (seq creciente). GET <edge_*_ack>?seq=S
+// confirma los registros hasta S (el Edge ya puede borrarlos)
+#define edge_cursor_query   "?after=%lu&count=%d"
+#define edge_ack_query      "?seq=%lu"
+#define edge_salud_ack      "/salud/ack"
+#define edge_pesaje_ack     "/pesaje/ack"
+
 
 /* TPI ENDPOINTS */
 #define tpi_server          "https://omnicloud.sitech.com.pe/api/"
@@ -0,0 +1,155 @@
+#include "esp32_battery.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_timer.h"
+
+/* Li-ion discharge curve at rest: {mV, %} */
+static const uint16_t s_soc_curve[][2] = {
+  {3270,   0}, {3610,   5}, {3690,  10}, {3710,  15}, {3730,  20},
+  {3750,  25}, {3770,  30}, {3790,  35}, {3800,  40}, {3820,  45},
+  {3840,  50}, {3850,  55}, {3870,  60}, {3910,  65}, {3950,  70},
+  {3980,  75}, {4020,  80}, {4080,  85}, {4110,  90}, {4150,  95},
+  {4200, 100},
+};
+
+
+static int battery_compare(const void* a, const void* b){
+  return (int) *(const uint16_t*) a - (int) *(const uint16_t*) b;
+}
+
+
+uint16_t battery_filter(uint16_t* samples, size_t count){
+  if (count == 0) {
+    return 0;
+  }
+  qsort(samples, count, sizeof(uint16_t), battery_compare);
+
+  // Media de la mitad central: descarta los picos del DMA y del Wi-Fi
+  size_t trim = count / BAT_TRIM_DIV;
+  uint32_t sum = 0;
+  for (size_t i = trim; i < count - trim; i++) {
+    sum += samples[i];
+  }
+  size_t kept = count - 2 * trim;
+  return (uint16_t) ((sum + kept / 2) / kept);
+}
+
+
+uint8_t battery_soc(uint16_t millivolts){
+  const size_t points = sizeof(s_soc_curve) / sizeof(s_soc_curve[0]);
+  if (millivolts <= s_soc_curve[0][0]) {
+    return 0;
+  }
+  for (size_t i = 1; i < points; i++) {
+    if (millivolts <= s_soc_curve[i][0]) {
+      uint32_t dv = s_soc_curve[i][0] - s_soc_curve[i - 1][0];
+      uint32_t ds = s_soc_curve[i][1] - s_soc_curve[i - 1][1];
+      return s_soc_curve[i - 1][1] + (uint8_t) (((millivolts - s_soc_curve[i - 1][0]) * ds + dv / 2) / dv);
+    }
+  }
+  return 100;
+}
+
+
+// Toma BAT_SAMPLES muestras por DMA. Retorna cuantas se obtuvieron
+static int battery_sample(uint16_t* samples, esp_err_t* err){
+  adc_continuous_handle_t handle = NULL;
+  adc_continuous_handle_cfg_t handle_config = {
+    .max_store_buf_size = BAT_SAMPLES * SOC_ADC_DIGI_RESULT_BYTES * 2,
+    .conv_frame_size    = BAT_SAMPLES * SOC_ADC_DIGI_RESULT_BYTES,
+  };
+  *err = adc_continuous_new_handle(&handle_config, &handle);
+  if (*err != ESP_OK) {
+    return 0;
+  }
+
+  adc_digi_pattern_config_t pattern = {
+    .atten     = BAT_ADC_ATTEN,
+    .channel   = BAT_ADC_CHANNEL,
+    .unit      = BAT_ADC_UNIT,
+    .bit_width = SOC_ADC_DIGI_MAX_BITWIDTH,
+  };
+  adc_continuous_config_t config = {
+    .sample_freq_hz = BAT_SAMPLE_FREQ_HZ,
+    .conv_mode      = ADC_CONV_SINGLE_UNIT_1,
+    .format         = ADC_DIGI_OUTPUT_FORMAT_TYPE1,
+    .pattern_num    = 1,
+    .adc_pattern    = &pattern,
+  };
+  *err = adc_continuous_config(handle, &config);
+  if (*err == ESP_OK) {
+    *err = adc_continuous_start(handle);
+  }
+
+  int count = 0;
+  static uint8_t frame[BAT_SAMPLES * SOC_ADC_DIGI_RESULT_BYTES];
+  while (*err == ESP_OK && count < BAT_SAMPLES) {
+    uint32_t length = 0;
+    *err = adc_continuous_read(handle, frame, sizeof(frame), &length, BAT_READ_TIMEOUT_MS);
+    for (uint32_t i = 0; *err == ESP_OK && i + SOC_ADC_DIGI_RESULT_BYTES <= length && count < BAT_SAMPLES;
+         i += SOC_ADC_DIGI_RESULT_BYTES) {
+      adc_digi_output_data_t* data = (adc_digi_output_data_t*) &frame[i];
+      if (data->type1.channel == BAT_ADC_CHANNEL) {
+        samples[count++] = data->type1.data;
+      }
+    }
+  }
+  if (*err == ESP_OK || *err == ESP_ERR_TIMEOUT) {
+    adc_continuous_stop(handle);
+  }
+  adc_continuous_deinit(handle);
+  return count;
+}
+
+
+// Tension en el pin (mV) con la calibracion del eFuse. Retorna 0 si el chip no la tiene
+static int battery_calibrate(int raw, int* millivolts){
+  adc_cali_handle_t cali = NULL;
+  adc_cali_line_fitting_config_t cali_config = {
+    .unit_id  = BAT_ADC_UNIT,
+    .atten    = BAT_ADC_ATTEN,
+    .bitwidth = ADC_BITWIDTH_DEFAULT,
+  };
+  if (adc_cali_create_scheme_line_fitting(&cali_config, &cali) != ESP_OK) {
+    return 0;
+  }
+  esp_err_t err = adc_cali_raw_to_voltage(cali, raw, millivolts);
+  adc_cali_delete_scheme_line_fitting(cali);
+  return err == ESP_OK;
+}
+
+
+esp_err_t battery_measure(battery_reading_t* reading){
+  static uint16_t samples[BAT_SAMPLES];
+  int64_t start_us = esp_timer_get_time();
+  memset(reading, 0, sizeof(battery_reading_t));
+
+  esp_err_t err = ESP_OK;
+  int count = battery_sample(samples, &err);
+  if (count == 0) {
+    ESP_LOGE(TAG_BATTERY, "No se pudo leer el ADC: %s\n", esp_err_to_name(err));
+    return (err != ESP_OK) ? err : ESP_FAIL;
+  }
+
+  reading->samples = count;
+  reading->raw = battery_filter(samples, count);
+
+  int pin_mv = 0;
+  reading->calibrated = battery_calibrate(reading->raw, &pin_mv);
+  if (reading->calibrated) {
+    reading->voltage = pin_mv * BAT_DIVIDER / 1000.0f;
+  }
+  else {
+    reading->voltage = reading->raw * BAT_RAW_TO_V;
+  }
+  reading->millivolts  = (uint16_t) (reading->voltage * 1000.0f + 0.5f);
+  reading->soc         = battery_soc(reading->millivolts);
+  reading->duration_us = (uint32_t) (esp_timer_get_time() - start_us);
+
+  ESP_LOGI(TAG_BATTERY, "Bateria = %u mV (%u %%), raw = %u, %u muestras en %lu us%s\n",
+           reading->millivolts, reading->soc, reading->raw, reading->samples,
+           (unsigned long) reading->duration_us, reading->calibrated ? "" : " (sin calibracion eFuse)");
+  return ESP_OK;
+}
@@ -0,0 +1,68 @@
+#ifndef __BATTERY_ESP32_
+#define __BATTERY_ESP32_
+// ----------------------------------------------------------------- //
+#include <stdint.h>
+#include <stddef.h>
+
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_adc/adc_continuous.h"     // DMA sampling: hundreds of samples in a few ms
+#include "esp_adc/adc_cali.h"           // eFuse calibration (line fitting on the ESP32)
+#include "esp_adc/adc_cali_scheme.h"
+
+/* Define variables for the battery measurement */
+#define BAT_ADC_UNIT            ADC_UNIT_1
+#define BAT_ADC_CHANNEL         ADC_CHANNEL_4   // GPIO32
+#define BAT_ADC_ATTEN           ADC_ATTEN_DB_11
+#define BAT_SAMPLES             256             // Samples of a measurement
+#define BAT_SAMPLE_FREQ_HZ      40000           // 256 samples in 6.4 ms
+#define BAT_TRIM_DIV            4               // Trimmed mean: drop 1/4 of the samples at each end
+#define BAT_READ_TIMEOUT_MS     20
+#define BAT_DIVIDER             3.2f            // Battery / ADC pin (same ratio as the old raw * 1.6 / 620.61)
+#define BAT_RAW_TO_V            (1.6f / 620.61f) // Without eFuse calibration: the old formula
+
+#define TAG_BATTERY             "BATTERY_API"
+
+
+/* Result of a measurement */
+typedef struct {
+   float    voltage;          // Battery voltage (V)
+   uint16_t millivolts;
+   uint8_t  soc;              // Estimated state of charge (0-100 %)
+   uint8_t  calibrated;       // 1 = eFuse calibration was used
+   uint16_t samples;          // Samples used by the filter
+   uint16_t raw;              // Filtered raw value
+   uint32_t duration_us;
+} battery_reading_t;
+
+
+/**
+ * @brief This function samples the battery with the continuous (DMA) ADC driver,
+ *        filters the samples with a trimmed mean and converts the result with
+ *        the eFuse calibration when the chip has it
+ * @param reading: Result of the measurement
+ * @return ESP_OK, or an error of the ADC driver
+ */
+esp_err_t battery_measure(battery_reading_t* reading);
+
+
+/**
+ * @brief This function sorts the samples and returns the mean of the central
+ *        half (1/BAT_TRIM_DIV dropped at each end), robust against spikes.
+ *        It does not use the ADC, so it can be fed with recorded traces
+ * @param samples: Raw samples, sorted in place
+ * @param count: Number of samples
+ * @return Filtered raw value, 0 if count is 0
+ */
+uint16_t battery_filter(uint16_t* samples, size_t count);
+
+
+/**
+ * @brief This function estimates the state of charge of a Li-ion cell from its
+ *        resting voltage (piecewise linear discharge curve)
+ * @return State of charge in % (0-100)
+ */
+uint8_t battery_soc(uint16_t millivolts);
+
+// ----------------------------------------------------------------- //
+#endif /* __BATTERY_ESP32_ */
@@ -0,0 +1,106 @@
+#include "esp32_boot.h"
+
+static EventGroupHandle_t s_boot_event_group = NULL;
+static int64_t s_boot_start_us = 0;
+
+
+static uint32_t boot_elapsed_ms(int64_t start_us){
+  return (uint32_t) ((esp_timer_get_time() - start_us) / 1000);
+}
+
+
+/*  La sincronizacion empieza cuando Wi-Fi y SD estan listos (la bateria termina antes) */
+static void boot_task_done(boot_result_t* result, EventBits_t bit){
+  EventBits_t bits = xEventGroupSetBits(s_boot_event_group, bit);
+  if((bits & (BOOT_WIFI_READY | BOOT_SD_READY)) == (BOOT_WIFI_READY | BOOT_SD_READY) && result->ready_ms == 0){
+    result->ready_ms = boot_elapsed_ms(s_boot_start_us);
+  }
+}
+
+
+static void boot_battery_task(void* arg){
+  boot_result_t* result = (boot_result_t*) arg;
+  int64_t start_us = esp_timer_get_time();
+
+  PHASE_BEGIN(PHASE_BATTERY);
+  battery_reading_t reading;
+  if (battery_measure(&reading) == ESP_OK) {
+    result->battery_value = reading.voltage;
+    result->battery_soc   = reading.soc;
+  }
+  PHASE_END(PHASE_BATTERY);
+
+  result->battery_ms = boot_elapsed_ms(start_us);
+  boot_task_done(result, BOOT_BATTERY_READY);
+  telem_task_exit(TELEM_TASK_BOOT_BAT);
+  vTaskDelete(NULL);
+}
+
+
+static void boot_wifi_task(void* arg){
+  boot_result_t* result = (boot_result_t*) arg;
+  int64_t start_us = esp_timer_get_time();
+
+  PHASE_BEGIN(PHASE_WIFI);
+  wifi_scan(result->ssid, sizeof(result->ssid));
+  PHASE_END(PHASE_WIFI);
+
+  result->wifi_ms = boot_elapsed_ms(start_us);
+  boot_task_done(result, BOOT_WIFI_READY);
+  telem_task_exit(TELEM_TASK_BOOT_WIFI);
+  vTaskDelete(NULL);
+}
+
+
+static void boot_sd_task(void* arg){
+  boot_result_t* result = (boot_result_t*) arg;
+  int64_t start_us = esp_timer_get_time();
+
+  PHASE_BEGIN(PHASE_SD_MOUNT);
+  activate_pin(PinSD);
+  result->sd_status = init_SD(&result->card, &result->host);
+  PHASE_END(PHASE_SD_MOUNT);
+
+  result->sd_ms = boot_elapsed_ms(start_us);
+  boot_task_done(result, BOOT_SD_READY);
+  telem_task_exit(TELEM_TASK_BOOT_SD);
+  vTaskDelete(NULL);
+}
+
+
+esp_err_t boot_start(boot_result_t* result){
+  memset(result, 0, sizeof(boot_result_t));
+  strcpy(result->ssid, FAILED_WIFI_SCANNING);
+  result->sd_status = ESP_FAIL;
+
+  s_boot_event_group = xEventGroupCreate();
+  if(s_boot_event_group == NULL){
+    ESP_LOGE(TAG_BOOT, "No se pudo crear el event group\n");
+    return ESP_FAIL;
+  }
+  s_boot_start_us = esp_timer_get_time();
+
+  // Wi-Fi primero: es la tarea mas larga
+  if(xTaskCreate(boot_wifi_task, "boot_wifi", BOOT_WIFI_STACK, result, BOOT_TASK_PRIORITY, NULL) != pdPASS ||
+     xTaskCreate(boot_sd_task, "boot_sd", BOOT_SD_STACK, result, BOOT_TASK_PRIORITY, NULL) != pdPASS ||
+     xTaskCreate(boot_battery_task, "boot_bat", BOOT_BATTERY_STACK, result, BOOT_TASK_PRIORITY, NULL) != pdPASS){
+    ESP_LOGE(TAG_BOOT, "No se pudieron crear las tareas de arranque\n");
+    return ESP_FAIL;
+  }
+  return ESP_OK;
+}
+
+
+EventBits_t boot_wait(EventBits_t bits, int timeout_ms){
+  EventBits_t ready = xEventGroupWaitBits(s_boot_event_group, bits, pdFALSE, pdTRUE,
+                                          timeout_ms / portTICK_PERIOD_MS);
+  return ready & bits;
+}
+
+
+int32_t boot_saved_ms(const boot_result_t* result){
+  if(result->ready_ms == 0){
+    return 0;
+  }
+  return (int32_t) (result->battery_ms + result->wifi_ms + result->sd_ms) - (int32_t) result->ready_ms;
+}
@@ -0,0 +1,71 @@
+#ifndef __BOOT_ESP32_
+#define __BOOT_ESP32_
+// ----------------------------------------------------------------- //
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"  // It provides a framework for multitasking, task scheduling, and synchronization in embedded applications.
+#include "freertos/task.h"      // Header provides functions and macros for creating, starting, and managing tasks
+#include "freertos/event_groups.h" // Every boot task sets its bit when it finishes
+
+#include "esp32_general.h"
+#include "esp32_battery.h"
+#include "esp32_sd.h"
+#include "esp32_wifi.h"
+
+/* Define variables for the boot orchestrator */
+#define BOOT_BATTERY_READY      BIT0
+#define BOOT_WIFI_READY         BIT1
+#define BOOT_SD_READY           BIT2
+#define BOOT_ALL_READY          (BOOT_BATTERY_READY | BOOT_WIFI_READY | BOOT_SD_READY)
+
+#define BOOT_TIMEOUT_MS         60000       // Worst case of wifi_scan(): fast connect + channel scan + full scan
+#define BOOT_BATTERY_STACK      3072
+#define BOOT_WIFI_STACK         4096
+#define BOOT_SD_STACK           4096
+#define BOOT_TASK_PRIORITY      4
+
+#define TAG_BOOT                "BOOT_API"
+
+
+/* Results of the boot tasks, valid after boot_wait() returned its bit */
+typedef struct {
+   float          battery_value;    // 0 if the ADC failed
+   uint8_t        battery_soc;      // Estimated state of charge (%)
+   char           ssid[32];         // SSID of the AP, or FAILED_WIFI_SCANNING
+   esp_err_t      sd_status;        // Result of init_SD()
+   sdmmc_card_t*  card;
+   sdmmc_host_t   host;
+   uint32_t       battery_ms;       // Duration of every task
+   uint32_t       wifi_ms;
+   uint32_t       sd_ms;
+   uint32_t       ready_ms;         // boot_start() -> Wi-Fi and SD ready
+} boot_result_t;
+
+
+/**
+ * @brief This function starts the battery ADC sampling, the Wi-Fi scan/connect
+ *        and the SD power-up/mount as concurrent tasks. config_pin() must be
+ *        called before
+ * @param result: Filled by the tasks, must stay valid until boot_wait() returns
+ * @return ESP_OK or ESP_FAIL if a task could not be created
+ */
+esp_err_t boot_start(boot_result_t* result);
+
+
+/**
+ * @brief This function waits until every task in bits has finished
+ * @param bits: BOOT_BATTERY_READY, BOOT_WIFI_READY, BOOT_SD_READY
+ * @param timeout_ms: Maximum time to wait in milliseconds
+ * @return The bits of the finished tasks
+ */
+EventBits_t boot_wait(EventBits_t bits, int timeout_ms);
+
+
+/**
+ * @brief This function returns the time saved against running the tasks one after another
+ * @return Sum of the task durations minus ready_ms (0 if the tasks have not finished)
+ */
+int32_t boot_saved_ms(const boot_result_t* result);
+
+// ----------------------------------------------------------------- //
+#endif /* __BOOT_ESP32_ */
@@ -0,0 +1,557 @@
+#include "esp32_codec.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_rom_crc.h"
+
+// CBOR major types
+#define CBOR_UINT       0
+#define CBOR_NEGINT     1
+#define CBOR_TEXT       3
+#define CBOR_ARRAY      4
+#define CBOR_MAP        5
+#define CBOR_SIMPLE     7
+
+#define CBOR_FALSE      0xF4
+#define CBOR_TRUE       0xF5
+#define CBOR_NULL       0xF6
+#define CBOR_FLOAT32    0xFA
+#define CBOR_FLOAT64    0xFB
+
+#define CODEC_MAX_SAFE_INT  9007199254740992.0  // 2^53
+
+typedef struct {
+  uint8_t* data;
+  size_t   size;
+  size_t   pos;
+  int      overflow;
+} codec_buffer_t;
+
+#if CONFIG_NODO_STORE_CBOR
+static uint8_t  s_record_buffer[CODEC_MAX_RECORD];
+#endif
+
+
+// ------------------------------ CBOR -------------------------------- //
+
+static void buffer_put(codec_buffer_t* buffer, const void* data, size_t length){
+  if(buffer->overflow || buffer->size - buffer->pos < length){
+    buffer->overflow = 1;
+    return;
+  }
+  memcpy(buffer->data + buffer->pos, data, length);
+  buffer->pos += length;
+}
+
+
+static void buffer_put_byte(codec_buffer_t* buffer, uint8_t value){
+  buffer_put(buffer, &value, 1);
+}
+
+
+// Los enteros de CBOR van en big endian
+static void buffer_put_be(codec_buffer_t* buffer, uint64_t value, int bytes){
+  uint8_t tmp[8];
+  for(int i = bytes - 1; i >= 0; i--){
+    tmp[i] = value & 0xFF;
+    value >>= 8;
+  }
+  buffer_put(buffer, tmp, bytes);
+}
+
+
+static void cbor_put_head(codec_buffer_t* buffer, uint8_t major, uint64_t value){
+  major <<= 5;
+  if(value < 24){
+    buffer_put_byte(buffer, major | value);
+  }
+  else if(value <= 0xFF){
+    buffer_put_byte(buffer, major | 24);
+    buffer_put_be(buffer, value, 1);
+  }
+  else if(value <= 0xFFFF){
+    buffer_put_byte(buffer, major | 25);
+    buffer_put_be(buffer, value, 2);
+  }
+  else if(value <= 0xFFFFFFFF){
+    buffer_put_byte(buffer, major | 26);
+    buffer_put_be(buffer, value, 4);
+  }
+  else{
+    buffer_put_byte(buffer, major | 27);
+    buffer_put_be(buffer, value, 8);
+  }
+}
+
+
+static void cbor_put_text(codec_buffer_t* buffer, const char* text){
+  size_t length = strlen(text);
+  cbor_put_head(buffer, CBOR_TEXT, length);
+  buffer_put(buffer, text, length);
+}
+
+
+static int cbor_put_number(codec_buffer_t* buffer, double value){
+  if(isnan(value) || isinf(value)){
+    return -1;
+  }
+  if(value == floor(value)){
+    // Un entero que no entra en un double ya perdio precision en cJSON
+    if(fabs(value) >= CODEC_MAX_SAFE_INT){
+      return -1;
+    }
+    if(value >= 0){
+      cbor_put_head(buffer, CBOR_UINT, (uint64_t) value);
+    }
+    else{
+      cbor_put_head(buffer, CBOR_NEGINT, (uint64_t) (-1 - value));
+    }
+    return 0;
+  }
+
+  float value_f = (float) value;
+  if((double) value_f == value){
+    uint32_t bits;
+    memcpy(&bits, &value_f, sizeof(bits));
+    buffer_put_byte(buffer, CBOR_FLOAT32);
+    buffer_put_be(buffer, bits, 4);
+  }
+  else{
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    buffer_put_byte(buffer, CBOR_FLOAT64);
+    buffer_put_be(buffer, bits, 8);
+  }
+  return 0;
+}
+
+
+// Mismo limite de anidamiento que cbor_get_item(): lo que se guarda se puede leer
+static int cbor_put_item(codec_buffer_t* buffer, const cJSON* item, int depth){
+  if(depth > CODEC_MAX_DEPTH){
+    return -1;
+  }
+  if(cJSON_IsObject(item) || cJSON_IsArray(item)){
+    int is_object = cJSON_IsObject(item);
+    cbor_put_head(buffer, is_object ? CBOR_MAP : CBOR_ARRAY, cJSON_GetArraySize(item));
+    const cJSON* child;
+    cJSON_ArrayForEach(child, item){
+      if(is_object){
+        cbor_put_text(buffer, child->string);
+      }
+      if(cbor_put_item(buffer, child, depth + 1) != 0){
+        return -1;
+      }
+    }
+    return 0;
+  }
+  if(cJSON_IsString(item)){
+    cbor_put_text(buffer, item->valuestring);
+    return 0;
+  }
+  if(cJSON_IsNumber(item)){
+    return cbor_put_number(buffer, item->valuedouble);
+  }
+  if(cJSON_IsBool(item)){
+    buffer_put_byte(buffer, cJSON_IsTrue(item) ? CBOR_TRUE : CBOR_FALSE);
+    return 0;
+  }
+  if(cJSON_IsNull(item)){
+    buffer_put_byte(buffer, CBOR_NULL);
+    return 0;
+  }
+  return -1;
+}
+
+
+int codec_json_to_cbor(const char* json, size_t length, uint8_t* out, size_t out_size){
+  cJSON* root = cJSON_ParseWithLength(json, length);
+  if(root == NULL){
+    return -1;
+  }
+  codec_buffer_t buffer = { .data = out, .size = out_size };
+  int ret = cbor_put_item(&buffer, root, 0);
+  cJSON_Delete(root);
+  if(ret != 0 || buffer.overflow){
+    return -1;
+  }
+  return buffer.pos;
+}
+
+
+typedef struct {
+  const uint8_t* data;
+  size_t         length;
+  size_t         pos;
+} cbor_reader_t;
+
+
+static int cbor_get_be(cbor_reader_t* reader, int bytes, uint64_t* value){
+  if(reader->length - reader->pos < (size_t) bytes){
+    return -1;
+  }
+  *value = 0;
+  for(int i = 0; i < bytes; i++){
+    *value = (*value << 8) | reader->data[reader->pos++];
+  }
+  return 0;
+}
+
+
+static int cbor_get_head(cbor_reader_t* reader, uint8_t* major, uint8_t* info, uint64_t* value){
+  if(reader->pos >= reader->length){
+    return -1;
+  }
+  uint8_t initial = reader->data[reader->pos++];
+  *major = initial >> 5;
+  *info  = initial & 0x1F;
+  if(*info < 24){
+    *value = *info;
+    return 0;
+  }
+  if(*info > 27){
+    return -1;        // Indefinite length: codec_json_to_cbor() no lo usa
+  }
+  return cbor_get_be(reader, 1 << (*info - 24), value);
+}
+
+
+static void json_put_text(codec_buffer_t* buffer, const uint8_t* text, size_t length){
+  buffer_put_byte(buffer, '"');
+  for(size_t i = 0; i < length; i++){
+    uint8_t c = text[i];
+    if(c == '"' || c == '\\'){
+      buffer_put_byte(buffer, '\\');
+      buffer_put_byte(buffer, c);
+    }
+    else if(c < 0x20){
+      char escaped[7];
+      snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+      buffer_put(buffer, escaped, 6);
+    }
+    else{
+      buffer_put_byte(buffer, c);
+    }
+  }
+  buffer_put_byte(buffer, '"');
+}
+
+
+/*  Numero con la menor cantidad de digitos que vuelve al mismo double. Un float32
+    tambien se compara como double: con los digitos justos para el float el JSON
+    ya no es el original (0.30000001192092896 saldria como 0.3) */
+static void json_put_double(codec_buffer_t* buffer, double value){
+  char text[32];
+  if(isnan(value) || isinf(value)){
+    buffer_put(buffer, "null", 4);
+    return;
+  }
+  for(int precision = 6; precision <= 17; precision++){
+    snprintf(text, sizeof(text), "%.*g", precision, value);
+    double parsed = strtod(text, NULL);
+    if(parsed == value){
+      break;
+    }
+  }
+  buffer_put(buffer, text, strlen(text));
+}
+
+
+static int cbor_get_item(cbor_reader_t* reader, codec_buffer_t* buffer, int depth){
+  uint8_t major, info;
+  uint64_t value;
+  char text[24];
+
+  if(depth > CODEC_MAX_DEPTH || cbor_get_head(reader, &major, &info, &value) != 0){
+    return -1;
+  }
+
+  switch(major){
+    case CBOR_UINT:
+      snprintf(text, sizeof(text), "%llu", (unsigned long long) value);
+      buffer_put(buffer, text, strlen(text));
+      return 0;
+    case CBOR_NEGINT:
+      snprintf(text, sizeof(text), "-%llu", (unsigned long long) value + 1);
+      buffer_put(buffer, text, strlen(text));
+      return 0;
+    case CBOR_TEXT:
+      if(reader->length - reader->pos < value){
+        return -1;
+      }
+      json_put_text(buffer, reader->data + reader->pos, value);
+      reader->pos += value;
+      return 0;
+    case CBOR_ARRAY:
+    case CBOR_MAP:
+      buffer_put_byte(buffer, major == CBOR_MAP ? '{' : '[');
+      for(uint64_t i = 0; i < value; i++){
+        if(i > 0){
+          buffer_put_byte(buffer, ',');
+        }
+        if(major == CBOR_MAP){
+          // Las claves siempre son texto
+          if(reader->pos >= reader->length || (reader->data[reader->pos] >> 5) != CBOR_TEXT ||
+             cbor_get_item(reader, buffer, depth + 1) != 0){
+            return -1;
+          }
+          buffer_put_byte(buffer, ':');
+        }
+        if(cbor_get_item(reader, buffer, depth + 1) != 0){
+          return -1;
+        }
+        if(buffer->overflow){
+          return -1;
+        }
+      }
+      buffer_put_byte(buffer, major == CBOR_MAP ? '}' : ']');
+      return 0;
+    case CBOR_SIMPLE:
+      if(info == 20 || info == 21){
+        buffer_put(buffer, info == 21 ? "true" : "false", info == 21 ? 4 : 5);
+        return 0;
+      }
+      if(info == 22){
+        buffer_put(buffer, "null", 4);
+        return 0;
+      }
+      if(info == 26){
+        uint32_t bits = value;
+        float value_f;
+        memcpy(&value_f, &bits, sizeof(value_f));
+        json_put_double(buffer, value_f);
+        return 0;
+      }
+      if(info == 27){
+        double value_d;
+        memcpy(&value_d, &value, sizeof(value_d));
+        json_put_double(buffer, value_d);
+        return 0;
+      }
+      return -1;
+    default:
+      return -1;      // Byte strings y tags no se usan
+  }
+}
+
+
+int codec_cbor_to_json(const uint8_t* cbor, size_t length, char* out, size_t out_size){
+  cbor_reader_t reader = { .data = cbor, .length = length };
+  codec_buffer_t buffer = { .data = (uint8_t*) out, .size = out_size };
+  if(out_size == 0 || cbor_get_item(&reader, &buffer, 0) != 0 || reader.pos != length){
+    return -1;
+  }
+  buffer_put_byte(&buffer, '\0');
+  if(buffer.overflow){
+    return -1;
+  }
+  return buffer.pos - 1;
+}
+
+
+// ----------------------------- DEFLATE ------------------------------ //
+
+typedef struct {
+  codec_buffer_t out;
+  uint32_t       bits;
+  int            count;
+} bit_writer_t;
+
+static const uint16_t s_len_base[]  = {3,4,5,6,7,8,9,10,11,13,15,17,19,23,27,31,35,43,51,59,67,83,99,115,131,163,195,227,258};
+static const uint8_t  s_len_extra[] = {0,0,0,0,0,0,0,0,1,1,1,1,2,2,2,2,3,3,3,3,4,4,4,4,5,5,5,5,0};
+static const uint16_t s_dist_base[] = {1,2,3,4,5,7,9,13,17,25,33,49,65,97,129,193,257,385,513,769,
+                                       1025,1537,2049,3073,4097,6145,8193,12289,16385,24577};
+static const uint8_t  s_dist_extra[] = {0,0,0,0,1,1,2,2,3,3,4,4,5,5,6,6,7,7,8,8,9,9,10,10,11,11,12,12,13,13};
+
+
+// Deflate escribe los bits desde el menos significativo
+static void bits_put(bit_writer_t* writer, uint32_t value, int count){
+  writer->bits |= value << writer->count;
+  writer->count += count;
+  while(writer->count >= 8){
+    buffer_put_byte(&writer->out, writer->bits & 0xFF);
+    writer->bits >>= 8;
+    writer->count -= 8;
+  }
+}
+
+
+// Los codigos Huffman van desde el bit mas significativo
+static void bits_put_code(bit_writer_t* writer, uint32_t code, int length){
+  uint32_t reversed = 0;
+  for(int i = 0; i < length; i++){
+    reversed = (reversed << 1) | ((code >> i) & 1);
+  }
+  bits_put(writer, reversed, length);
+}
+
+
+// Codigos fijos de literal/longitud (RFC 1951, 3.2.6)
+static void deflate_put_symbol(bit_writer_t* writer, int symbol){
+  if(symbol < 144){
+    bits_put_code(writer, 0x30 + symbol, 8);
+  }
+  else if(symbol < 256){
+    bits_put_code(writer, 0x190 + symbol - 144, 9);
+  }
+  else if(symbol < 280){
+    bits_put_code(writer, symbol - 256, 7);
+  }
+  else{
+    bits_put_code(writer, 0xC0 + symbol - 280, 8);
+  }
+}
+
+
+static void deflate_put_match(bit_writer_t* writer, int length, int distance){
+  int code = 0;
+  while(code < 28 && s_len_base[code + 1] <= length){
+    code++;
+  }
+  deflate_put_symbol(writer, 257 + code);
+  bits_put(writer, length - s_len_base[code], s_len_extra[code]);
+
+  code = 0;
+  while(code < 29 && s_dist_base[code + 1] <= distance){
+    code++;
+  }
+  bits_put_code(writer, code, 5);
+  bits_put(writer, distance - s_dist_base[code], s_dist_extra[code]);
+}
+
+
+static uint32_t deflate_hash(const uint8_t* data){
+  uint32_t value = data[0] | (data[1] << 8) | (data[2] << 16);
+  return (value * 2654435761U) >> (32 - CODEC_HASH_BITS);
+}
+
+
+// Un solo bloque con codigos fijos, LZ77 greedy con un candidato por hash
+static void deflate_block(bit_writer_t* writer, const uint8_t* in, size_t length, uint16_t* hash_head){
+  // hash_head guarda posicion + 1 (0 = vacio), por eso la entrada es < 64 KB
+  memset(hash_head, 0, CODEC_HASH_SIZE * sizeof(uint16_t));
+  bits_put(writer, 1, 1);     // BFINAL
+  bits_put(writer, 1, 2);     // BTYPE = 01 (fixed Huffman)
+
+  size_t pos = 0;
+  while(pos < length){
+    int best_length = 0;
+    size_t best_distance = 0;
+    if(length - pos >= 3){
+      uint32_t hash = deflate_hash(in + pos);
+      size_t candidate = hash_head[hash];
+      hash_head[hash] = pos + 1;
+      if(candidate > 0 && pos - (candidate - 1) <= CODEC_WINDOW_SIZE){
+        candidate--;
+        size_t max_length = length - pos;
+        if(max_length > 258){
+          max_length = 258;
+        }
+        size_t match = 0;
+        while(match < max_length && in[candidate + match] == in[pos + match]){
+          match++;
+        }
+        if(match >= 3){
+          best_length = match;
+          best_distance = pos - candidate;
+        }
+      }
+    }
+
+    if(best_length == 0){
+      deflate_put_symbol(writer, in[pos]);
+      pos++;
+      continue;
+    }
+    deflate_put_match(writer, best_length, best_distance);
+    // Insertamos las posiciones saltadas para las siguientes coincidencias
+    for(size_t i = pos + 1; i < pos + best_length && length - i >= 3; i++){
+      hash_head[deflate_hash(in + i)] = i + 1;
+    }
+    pos += best_length;
+  }
+
+  deflate_put_symbol(writer, 256);    // End of block
+  if(writer->count > 0){
+    bits_put(writer, 0, 8 - writer->count);
+  }
+}
+
+
+static uint32_t adler32(const uint8_t* data, size_t length){
+  uint32_t a = 1, b = 0;
+  for(size_t i = 0; i < length; i++){
+    a = (a + data[i]) % 65521;
+    b = (b + a) % 65521;
+  }
+  return (b << 16) | a;
+}
+
+
+int codec_compress(const uint8_t* in, size_t length, uint8_t* out, size_t out_size,
+                   enum _codec_encoding encoding, uint16_t* hash_table){
+  if(length >= 0xFFFF || encoding == CODEC_ENCODING_NONE){
+    return -1;
+  }
+  bit_writer_t writer = { .out = { .data = out, .size = out_size } };
+
+  if(encoding == CODEC_ENCODING_GZIP){
+    // ID1 ID2 CM=deflate FLG MTIME(4) XFL OS=unknown
+    static const uint8_t gzip_header[] = {0x1F, 0x8B, 8, 0, 0, 0, 0, 0, 0, 0xFF};
+    buffer_put(&writer.out, gzip_header, sizeof(gzip_header));
+  }
+  else{
+    // CMF = deflate con ventana de 32 KB, FLG = nivel rapido (multiplo de 31)
+    static const uint8_t zlib_header[] = {0x78, 0x01};
+    buffer_put(&writer.out, zlib_header, sizeof(zlib_header));
+  }
+
+  deflate_block(&writer, in, length, hash_table);
+
+  if(encoding == CODEC_ENCODING_GZIP){
+    uint32_t crc = esp_rom_crc32_le(0, in, length);
+    for(int i = 0; i < 4; i++){
+      buffer_put_byte(&writer.out, (crc >> (8 * i)) & 0xFF);
+    }
+    for(int i = 0; i < 4; i++){
+      buffer_put_byte(&writer.out, (length >> (8 * i)) & 0xFF);
+    }
+  }
+  else{
+    buffer_put_be(&writer.out, adler32(in, length), 4);
+  }
+
+  if(writer.out.overflow){
+    return -1;
+  }
+  return writer.out.pos;
+}
+
+
+const char* codec_encoding_name(enum _codec_encoding encoding){
+  switch(encoding){
+    case CODEC_ENCODING_GZIP:
+      return "gzip";
+    case CODEC_ENCODING_DEFLATE:
+      return "deflate";
+    default:
+      return NULL;
+  }
+}
+
+
+esp_err_t codec_log_append(sd_log_t* log, const char* json, size_t length){
+#if CONFIG_NODO_STORE_CBOR
+  if(length <= CODEC_MAX_RECORD){
+    int cbor_length = codec_json_to_cbor(json, length, s_record_buffer, sizeof(s_record_buffer));
+    if(cbor_length > 0){
+      return sd_log_append_flags(log, (const char*) s_record_buffer, cbor_length, SD_LOG_FLAG_CBOR);
+    }
+    ESP_LOGW(TAG_CODEC, "Registro no codificado en CBOR, se guarda como texto\n");
+  }
+#endif
+  return sd_log_append(log, json, length);
+}
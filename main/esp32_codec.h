@@ -0,0 +1,74 @@
+#ifndef __CODEC_ESP32_
+#define __CODEC_ESP32_
+// ----------------------------------------------------------------- //
+#include <stdint.h>
+#include <stddef.h>
+
+#include "esp_err.h"
+#include "esp_log.h"
+#include "cJSON.h"              // JSON parser (IDF "json" component) used to encode records in CBOR
+
+#include "esp32_sd.h"
+
+/* Define variables for the record codec */
+#define CODEC_MAX_RECORD        (8 * 1024)  // Bigger JSON records are stored as text (streamed from SD)
+#define CODEC_MAX_DEPTH         16          // Nesting of objects/arrays accepted by the CBOR encoder and decoder
+#define CODEC_HASH_BITS         12          // LZ77 hash table: 4096 entries of 16 bits (8 KB)
+#define CODEC_HASH_SIZE         (1 << CODEC_HASH_BITS)
+#define CODEC_WINDOW_SIZE       32768       // Deflate window
+
+#define TAG_CODEC               "CODEC_API"
+
+// Content-Encoding of an uploaded body
+enum _codec_encoding{
+  CODEC_ENCODING_NONE    = 0,
+  CODEC_ENCODING_GZIP    = 1,   // RFC 1952
+  CODEC_ENCODING_DEFLATE = 2    // RFC 1950 (zlib), the "deflate" of HTTP
+};
+
+
+/**
+ * @brief This function encodes a JSON text in CBOR (RFC 8949). Objects keep
+ *        the order of their keys, integers up to 2^53 are stored as integers
+ *        and other numbers as float32 (if exact) or float64
+ * @return Length of the CBOR data, or -1 if the JSON is invalid, does not fit
+ *         in out_size, has an integer that a double can not hold or is nested
+ *         deeper than CODEC_MAX_DEPTH
+ */
+int codec_json_to_cbor(const char* json, size_t length, uint8_t* out, size_t out_size);
+
+
+/**
+ * @brief This function writes a CBOR item (as written by codec_json_to_cbor) as JSON text
+ * @return Length of the JSON text (null terminated), or -1 if it is invalid or does not fit
+ */
+int codec_cbor_to_json(const uint8_t* cbor, size_t length, char* out, size_t out_size);
+
+
+/**
+ * @brief This function compresses a buffer with deflate (fixed Huffman codes,
+ *        greedy LZ77) and wraps it as gzip or zlib
+ * @param encoding: CODEC_ENCODING_GZIP or CODEC_ENCODING_DEFLATE
+ * @param hash_table: Work area of CODEC_HASH_SIZE entries (one per task)
+ * @return Compressed length, or -1 if it does not fit in out_size
+ */
+int codec_compress(const uint8_t* in, size_t length, uint8_t* out, size_t out_size,
+                   enum _codec_encoding encoding, uint16_t* hash_table);
+
+
+/**
+ * @brief Value of the Content-Encoding header, NULL for CODEC_ENCODING_NONE
+ */
+const char* codec_encoding_name(enum _codec_encoding encoding);
+
+
+/**
+ * @brief This function appends a JSON record to a log, encoded in CBOR when
+ *        CONFIG_NODO_STORE_CBOR is set (SD_LOG_FLAG_CBOR). Records that can not
+ *        be encoded are stored as text
+ * @note  Not reentrant: it uses a static buffer of CODEC_MAX_RECORD bytes
+ */
+esp_err_t codec_log_append(sd_log_t* log, const char* json, size_t length);
+
+// ----------------------------------------------------------------- //
+#endif /* __CODEC_ESP32_ */
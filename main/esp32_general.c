@@ -17,20 +17,6 @@ void deactivate_pin(int pin_number){
 }
 
 
-void power_off_leds(){
-  led_set(BAT, OFF);
-  led_set(WIFI, OFF);
-  led_set(CHECK, OFF);
-}
-
-
-void power_on_leds(){
-  led_set(BAT,WHITE);
-  led_set(WIFI,WHITE);
-  led_set(CHECK,WHITE);
-}
-
-
 void config_pin(){
   gpio_reset_pin(ESP_LED_WIFI_R);
   gpio_reset_pin(ESP_LED_WIFI_G);
@@ -81,15 +67,20 @@ void config_pin(){
   gpio_pullup_dis(ESP_LED_WIFI_G);
 
   power_off_leds();
+  led_init();
 }
 
 
 void sleep_ESP32(int _time_to_sleep){
+  // Esperamos a que la tarea de LEDs aplique el ultimo color antes de congelar los pines
+  led_flush(100);
+  // Ultima muestra del ciclo: tiempo total despierto
+  PHASE_END(PHASE_AWAKE);
   gpio_deep_sleep_hold_en();
   esp_sleep_pd_config( ESP_PD_DOMAIN_RTC_SLOW_MEM, ESP_PD_OPTION_ON );
 
   ESP_LOGI("END PROCESS", "El sistema entrara a deep sleep por %d minutos\n", _time_to_sleep);
-  uint64_t time_to_sleep = _time_to_sleep * MIN_TO_S * S_TO_US;
+  uint64_t time_to_sleep = (uint64_t) _time_to_sleep * MIN_TO_S * S_TO_US;
     
   esp_sleep_enable_timer_wakeup(time_to_sleep);
   esp_deep_sleep_start();
@@ -97,104 +88,6 @@ void sleep_ESP32(int _time_to_sleep){
 }
 
 
-void led_set(enum _led pin_led, enum _color color){
-  int pin_R = 4;
-  int pin_G = 4;
-  int pin_B = 4;
-
-  // Seleccionamos el led a cambiar de estado
-  switch(pin_led){
-    case WIFI:
-      pin_R = ESP_LED_WIFI_R;
-      pin_G = ESP_LED_WIFI_G;
-      pin_B = ESP_LED_WIFI_B;
-      break;
-    case BAT:
-      pin_R = ESP_LED_BAT_R;
-      pin_G = ESP_LED_BAT_G;
-      pin_B = ESP_LED_BAT_B;
-      break;
-    case CHECK:
-      pin_R = ESP_LED_CHECK_R;
-      pin_G = ESP_LED_CHECK_G;
-      pin_B = ESP_LED_CHECK_B;
-      break;
-  }
-
-  switch (color)
-  {
-    case OFF:
-      deactivate_pin(pin_R);
-      deactivate_pin(pin_G);
-      deactivate_pin(pin_B);
-      break;
-    case RED:
-      activate_pin(pin_R);
-      deactivate_pin(pin_G);
-      deactivate_pin(pin_B);
-      break;
-    case BLUE:
-      deactivate_pin(pin_R);
-      deactivate_pin(pin_G);
-      activate_pin(pin_B);
-      break;
-    case GREEN:
-      deactivate_pin(pin_R);
-      activate_pin(pin_G);
-      deactivate_pin(pin_B);
-      break;
-    case PURPLE:
-      activate_pin(pin_R);
-      deactivate_pin(pin_G);
-      activate_pin(pin_B);
-      break;
-    case CIAN:
-      deactivate_pin(pin_R);
-      activate_pin(pin_G);
-      activate_pin(pin_B);
-      break;
-    case YELLOW:
-      activate_pin(pin_R);
-      activate_pin(pin_G);
-      deactivate_pin(pin_B);
-      break;
-    case WHITE:
-      activate_pin(pin_R);
-      activate_pin(pin_G);
-      activate_pin(pin_B);
-      break;
-    default:
-      deactivate_pin(pin_R);
-      deactivate_pin(pin_G);
-      deactivate_pin(pin_B);
-      break;
-  }
-
-  delay_ms(100);
-}
-
-
-void ADC_Channel_configure(int adc_channel){
-  ESP_ERROR_CHECK( adc1_config_width( ADC_WIDTH_BIT_DEFAULT ) );
-  ESP_ERROR_CHECK( adc1_config_channel_atten( adc_channel, ADC_ATTEN_DB_11 ) );
-}
-
-
-float adc_get_value(int adc_channel){
-  int value_bat   	= 0;
-  float repeat      = 8.0;
-  float _factor   	= 1.6;
-  float _offset   	= 0;
-
-	for(int i = 0; i < repeat; i++){
-        value_bat += adc1_get_raw(adc_channel);
-        vTaskDelay(50 / portTICK_PERIOD_MS);
-  }
-  float raw_volt = (float) value_bat/ repeat;
-  return (raw_volt*_factor + _offset) / 620.61;
-}
-
-
 void print_bytes(const char* string_to_display, size_t size_string){
   int i =0;
   int breaked = 0;
@@ -22,51 +22,24 @@
 #include "driver/uart.h"        // Allows you to configure and use UART peripherals on the ESP32, send and receive data over UART
 #include "esp_sleep.h"          // It allows you to put the ESP32 into deep sleep or other low-power modes to save power when the device is idle.
 
-#include "driver/adc.h"         // U can access the functions and features provided by this library to work with the ADC of the ESP32 microcontroller.
+#include "esp32_led.h"          // LED task: led_set(), led_set_pattern(), power_on/off_leds()
+#include "esp32_prof.h"         // Wake-cycle profiler: PHASE_BEGIN/PHASE_END
+#include "esp32_telem.h"        // Heap/stack/SD files at every phase boundary: telem_task_exit()
 
 
 // For Deep Sleep Mode
-#define TIME_TO_SLEEP   10
 #define S_TO_US         1000000
 #define MIN_TO_S        60
 
-// Define LEDs pinout
-#define ESP_LED_BAT_R       13
-#define ESP_LED_BAT_G       12 
-#define ESP_LED_BAT_B       14
-#define ESP_LED_WIFI_R      21
-#define ESP_LED_WIFI_G      17  
-#define ESP_LED_WIFI_B      16
-#define ESP_LED_CHECK_R     4
-#define ESP_LED_CHECK_G     2
-#define ESP_LED_CHECK_B     15
-
 // SD Card Slot
 #define PinSD               33
 
-// ADC for battery
-#define BAT_ADC_CHANNEL     ADC1_CHANNEL_4
-
 // SALUD_MODE = 0, PESAJE_MODE = 1, 
 enum _mode{
   SALUD_MODE  = 0,
   PESAJE_MODE = 1
 };
 
-// OFF=0, RED=1, GREEN=2, BLUE=3, PURPLE=4, CIAN=5, YELLOW=6, WHITE=7
-enum _color{
-  OFF = 0, RED = 1, GREEN = 2, BLUE = 3, PURPLE = 4,
-  CIAN = 5, YELLOW = 6, WHITE = 7
-};
-
-// BAT = 1, WIFIF = 2, CHECK = 3
-enum _led{
-  BAT = 1,
-  WIFI = 2,
-  CHECK = 3
-};
-
-
 /**
  * @brief This function introduces a delay of the desired duration in milliseconds.
  * @param time_in_ms The time to wait in milliseconds.
@@ -93,31 +66,11 @@ void deactivate_pin(int pin_number);
 
 
 /**
- * @brief This function turn off all leds: BAT, WIFI, CHECK
- */
-void power_off_leds();
-
-
-/**
- * @brief This function turn on all leds: BAT, WIFI, CHECK
- */
-void power_on_leds();
-
-
-/**
- * @brief This function configure the pins for GPIO Functions
+ * @brief This function configure the pins for GPIO Functions and starts the LED task
  */
 void config_pin();
 
 
-/**
- * @brief This function turn the led in the color desired
- * @param _led: WIFI, BAT, CHECK
- * @param _color: OFF, RED, GREEN, BLUE, PURPLE, CIAN, YELLOW, WHITE
- */
-void led_set(enum _led pin_led, enum _color color);
-
-
 /**
  * @brief This functions turn on the deep sleep mode of the ESP32
  * @param _time_to_sleep: Duration of deep sleep for ESP32 in minutes
@@ -125,20 +78,6 @@ void led_set(enum _led pin_led, enum _color color);
 void sleep_ESP32(int _time_to_sleep);
 
 
-/**
- * @brief This function configures the ADC Channel of ESP32
- * @param adc_channel : number of channel
- */
-void ADC_Channel_configure(int adc_channel);
-
-
-/**
- * @brief This function return the value of voltage of a ADC channel
- * @param adc_channel : number of channel
- */
-float adc_get_value(int adc_channel);
-
-
 /**
  * @brief This function print a string in its bytes format
  */
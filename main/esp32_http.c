@@ -0,0 +1,649 @@
+#include "esp32_http.h"
+#include "esp32_general.h"
+
+#include <sys/param.h>
+
+/* Clientes HTTP del ciclo, uno por destino */
+typedef struct {
+    const char*              name;
+    esp_http_client_handle_t client;
+    int                      kept;      // La ultima peticion dejo la conexion abierta
+} http_pool_entry_t;
+
+static http_pool_entry_t s_http_pool[HTTP_POOL_SIZE];
+
+
+/*              GET() REQUEST              */
+void http_get_data(char* url_path_get, char* response_buffer, size_t size_response_buffer){
+    int content_length = 0;
+    memset(response_buffer, 0, size_response_buffer);
+
+    ESP_LOGI(TAG_HTTP, "Nos conectamos a la URL : '%s'\n", url_path_get);
+
+    esp_http_client_config_t config = {
+        .url = url_path_get,
+        .timeout_ms = 5000,
+        //.event_handler = _http_event_handler,
+    };
+    esp_http_client_handle_t client = esp_http_client_init(&config);
+
+    esp_http_client_set_method(client, HTTP_METHOD_GET);
+    esp_err_t err = esp_http_client_open(client, 0);
+
+    if (err != ESP_OK) {
+        ESP_LOGE(TAG_HTTP, "Failed to open HTTP connection: %s", esp_err_to_name(err));
+        led_set(WIFI, YELLOW);
+        return;
+    }
+
+    content_length = esp_http_client_fetch_headers(client);
+    if (content_length < 0) {
+        ESP_LOGE(TAG_HTTP, "HTTP client fetch headers failed");
+        esp_http_client_close(client);
+        led_set(WIFI, YELLOW);
+        return;
+    }
+
+    if ((size_t) content_length >= size_response_buffer) {
+        ESP_LOGE(TAG_HTTP, "Buffer size insufficent:\n - Needed = %d\n - Available = %u\n", content_length, (unsigned) size_response_buffer);
+        esp_http_client_close(client);
+        led_set(WIFI, RED);
+        return;
+    }
+
+    int data_read = esp_http_client_read_response(client, response_buffer, size_response_buffer);
+    if (data_read < 0 ){
+        ESP_LOGE(TAG_HTTP, "Failed to read response");
+        esp_http_client_close(client);
+        led_set(WIFI, RED);
+        return;
+    }
+
+    int get_response = esp_http_client_get_status_code(client);
+    
+    if(get_response != 200){
+        ESP_LOGE(TAG_HTTP, "Fallo en el request GET(), HTTP Status = %d\n", get_response);
+        esp_http_client_close(client);
+        led_set(WIFI, RED);
+        return;
+    }
+
+    ESP_LOGI(TAG_HTTP, "HTTP GET Status = %d, content_length = %"PRId64,
+        esp_http_client_get_status_code(client),
+        esp_http_client_get_content_length(client));
+
+    esp_http_client_close(client);
+    led_set(WIFI, GREEN);
+}
+
+
+/*              POST() REQUEST              */
+int http_post_data(  char* url_path_post, char* data_to_send, size_t data_to_send_size, 
+                            char* response_buffer, size_t response_size ) {
+    ESP_LOGI(TAG_HTTP, "POST Request to:\n**%s\n", url_path_post);
+    int client_length_response = 0;
+    memset(response_buffer, 0, response_size);
+
+    esp_http_client_config_t config = {
+        .url                = url_path_post,
+        .timeout_ms         = 10000,
+        //.event_handler      = _http_event_handler,
+        .crt_bundle_attach  = esp_crt_bundle_attach,
+    };
+    ESP_LOGI(TAG_HTTP, "Clear the response buffer 101\n");
+    esp_http_client_handle_t client = esp_http_client_init(&config);
+    esp_http_client_set_method(client, HTTP_METHOD_POST);
+    // Set Content-Type header
+    esp_http_client_set_header(client, "Content-Type", tpi_format);
+    // Set ApiKey header
+    esp_http_client_set_header(client, "ApiKey", tpi_key);
+
+    esp_err_t err_post = esp_http_client_open(client, data_to_send_size);
+    if (err_post != ESP_OK) {
+        ESP_LOGE(TAG_HTTP, "Failed to open HTTP connection: %s", esp_err_to_name(err_post));
+        esp_http_client_cleanup(client);
+        led_set(WIFI, RED);
+        return -1;
+    }
+    client_length_response = esp_http_client_write(client, data_to_send, data_to_send_size);
+    client_length_response += esp_http_client_fetch_headers(client);
+
+    if (client_length_response < 0) {
+        ESP_LOGE(TAG_HTTP, "Failed writting data in endpoint\n");
+        esp_http_client_cleanup(client);
+        led_set(WIFI, RED);
+        return -1;
+    }
+
+    // Se deja lugar para el '\0': una respuesta mas grande que el buffer se corta, no se desborda
+    client_length_response = esp_http_client_read_response(client, response_buffer, response_size - 1);
+    if(client_length_response < 0){
+        esp_http_client_cleanup(client);
+        led_set(WIFI, RED);
+        return -1;
+    }
+    ESP_LOGI(TAG_HTTP, "Clear the response buffer 2\n");
+    int status_code = esp_http_client_get_status_code(client);
+    esp_http_client_cleanup(client);
+    
+    ESP_LOGI(TAG_HTTP, "HTTP POST Status = %d\nRespuesta:\n%s\n", status_code, response_buffer);
+    if(status_code != 200){
+        led_set(WIFI, RED);
+        return -1;
+    }
+    led_set(WIFI, BLUE);
+    return 1;
+}
+
+
+static http_pool_entry_t* http_pool_find(esp_http_client_handle_t client){
+    for (int i = 0; i < HTTP_POOL_SIZE; i++) {
+        if (s_http_pool[i].client == client) {
+            return &s_http_pool[i];
+        }
+    }
+    return NULL;
+}
+
+
+static void http_close(esp_http_client_handle_t client){
+    http_pool_entry_t* entry = http_pool_find(client);
+    if (entry != NULL) {
+        entry->kept = 0;
+    }
+    esp_http_client_close(client);
+}
+
+
+/*  Abre la peticion reutilizando la conexion TCP si sigue abierta. reused indica
+    si la conexion viene de la peticion anterior (solo los clientes del pool) */
+static esp_err_t http_open_keep_alive(esp_http_client_handle_t client, int write_len, int* reused){
+    http_pool_entry_t* entry = http_pool_find(client);
+    *reused = (entry != NULL && entry->kept);
+    esp_err_t esp_http_err = esp_http_client_open(client, write_len);
+    if (esp_http_err != ESP_OK) {
+        http_close(client);
+        *reused = 0;
+        esp_http_err = esp_http_client_open(client, write_len);
+    }
+    if (esp_http_err != ESP_OK) {
+        ESP_LOGE(TAG_HTTP, "Failed to open HTTP connection: %s", esp_err_to_name(esp_http_err));
+        http_close(client);
+        return esp_http_err;
+    }
+    if (entry != NULL) {
+        entry->kept = 1;
+    }
+    return ESP_OK;
+}
+
+
+/*  Envia la peticion y lee los headers de la respuesta. Una conexion keep-alive
+    que el servidor ya cerro (o cierra con la peticion en camino) recien falla al
+    escribir o al leer los headers: si la conexion venia de la peticion anterior
+    se reintenta una vez con una nueva, volviendo el cuerpo al inicio con rewind_body.
+    Retorna el Content-Length de la respuesta, -1 o HTTP_STREAM_ABORTED */
+static int http_request(esp_http_client_handle_t client, size_t content_length,
+                        http_body_reader_t read_body, http_body_rewind_t rewind_body, void* ctx,
+                        char* chunk, size_t chunk_size){
+    for (int attempt = 0; ; attempt++) {
+        int reused;
+        // Content-Length conocido: el cuerpo se envia por bloques sin copiarlo entero a RAM
+        if (http_open_keep_alive(client, content_length, &reused) != ESP_OK) {
+            return -1;
+        }
+
+        size_t sent = 0;
+        int written = 1;
+        while (sent < content_length && written > 0) {
+            int chunk_len = read_body(ctx, chunk, MIN(chunk_size, content_length - sent));
+            if (chunk_len <= 0) {
+                // Sin el cuerpo completo el servidor descarta la peticion
+                ESP_LOGE(TAG_HTTP, "Fallo al leer el cuerpo del POST (%u de %u bytes)\n", (unsigned) sent, (unsigned) content_length);
+                http_close(client);
+                return HTTP_STREAM_ABORTED;
+            }
+            int offset = 0;
+            while (offset < chunk_len && written > 0) {
+                written = esp_http_client_write(client, chunk + offset, chunk_len - offset);
+                offset += written;
+            }
+            sent += chunk_len;
+        }
+
+        if (written <= 0) {
+            ESP_LOGE(TAG_HTTP, "Failed writting data in endpoint\n");
+        } else {
+            int response_length = esp_http_client_fetch_headers(client);
+            if (response_length >= 0) {
+                return response_length;
+            }
+            ESP_LOGE(TAG_HTTP, "HTTP client fetch headers failed");
+        }
+        http_close(client);
+
+        if (!reused || attempt > 0 ||
+            (content_length > 0 && (rewind_body == NULL || rewind_body(ctx) != ESP_OK))) {
+            return -1;
+        }
+        ESP_LOGW(TAG_HTTP, "La conexion keep-alive ya estaba cerrada, se reintenta con una nueva\n");
+    }
+}
+
+
+int get_request(esp_http_client_handle_t client, char *response_buffer, size_t buffer_size) {
+    int status_code = -1;
+    esp_http_client_set_method(client, HTTP_METHOD_GET);
+    memset(response_buffer, 0, buffer_size);
+
+    if (http_request(client, 0, NULL, NULL, NULL, NULL, 0) >= 0) {
+        int data_read = esp_http_client_read_response(client, response_buffer, buffer_size - 1);
+        if (data_read >= 0) {
+            status_code = esp_http_client_get_status_code(client);
+            ESP_LOGI(TAG_HTTP, "- Server respondio = %d", status_code);
+        } else {
+            ESP_LOGE(TAG_HTTP, "Failed to read response");
+        }
+    }
+
+    // La conexion solo se mantiene abierta si la respuesta se leyo completa
+    if (status_code < 0 || !esp_http_client_is_complete_data_received(client)) {
+        http_close(client);
+    }
+    return status_code;
+}
+
+
+int get_request_records(esp_http_client_handle_t client, char *buffer, size_t buffer_size,
+                        http_record_cb_t on_record, void* ctx, int* status_code) {
+    int records = 0;
+    size_t used = 0;
+    *status_code = -1;
+    esp_http_client_set_method(client, HTTP_METHOD_GET);
+
+    if (http_request(client, 0, NULL, NULL, NULL, NULL, 0) < 0) {
+        return -1;
+    }
+
+    *status_code = esp_http_client_get_status_code(client);
+    if (*status_code != 200) {
+        ESP_LOGE(TAG_HTTP, "Fallo en el request GET(), HTTP Status = %d\n", *status_code);
+        http_close(client);
+        return -1;
+    }
+
+    // Leemos la respuesta por bloques y la separamos en registros (uno por linea)
+    while (1) {
+        int data_read = esp_http_client_read(client, buffer + used, buffer_size - 1 - used);
+        if (data_read < 0) {
+            ESP_LOGE(TAG_HTTP, "Failed to read response");
+            *status_code = HTTP_RESPONSE_INCOMPLETE;
+            http_close(client);
+            return records;
+        }
+        if (data_read == 0) {
+            break;
+        }
+        used += data_read;
+        buffer[used] = '\0';
+
+        char* start = buffer;
+        char* newline;
+        while ((newline = memchr(start, '\n', used - (start - buffer))) != NULL) {
+            size_t length = newline - start;
+            if (length > 0 && start[length - 1] == '\r') {
+                length--;
+            }
+            start[length] = '\0';
+            if (length > 0) {
+                if (on_record(start, length, ctx) != ESP_OK) {
+                    *status_code = HTTP_RESPONSE_INCOMPLETE;
+                    http_close(client);
+                    return records;
+                }
+                records++;
+            }
+            start = newline + 1;
+        }
+
+        used -= (start - buffer);
+        memmove(buffer, start, used);
+        if (used >= buffer_size - 1) {
+            ESP_LOGE(TAG_HTTP, "Buffer size insufficent para un registro de la respuesta\n");
+            *status_code = HTTP_RESPONSE_INCOMPLETE;
+            http_close(client);
+            return records;
+        }
+    }
+
+    // read() = 0 tambien cuando el servidor corta la conexion: sin la respuesta
+    // completa el ultimo registro esta a medias y faltan los que venian despues
+    if (!esp_http_client_is_complete_data_received(client)) {
+        ESP_LOGE(TAG_HTTP, "Respuesta cortada despues de %d registros\n", records);
+        *status_code = HTTP_RESPONSE_INCOMPLETE;
+        http_close(client);
+        return records;
+    }
+
+    // El ultimo registro puede no terminar en '\n'
+    if (used > 0) {
+        buffer[used] = '\0';
+        if (on_record(buffer, used, ctx) != ESP_OK) {
+            *status_code = HTTP_RESPONSE_INCOMPLETE;
+            return records;
+        }
+        records++;
+    }
+    return records;
+}
+
+
+int http_post_stream(esp_http_client_handle_t client, size_t content_length,
+                     http_body_reader_t read_body, http_body_rewind_t rewind_body, void* ctx,
+                     char* chunk, size_t chunk_size, char* response_buffer, size_t response_size) {
+    memset(response_buffer, 0, response_size);
+    esp_http_client_set_method(client, HTTP_METHOD_POST);
+
+    int response_length = http_request(client, content_length, read_body, rewind_body, ctx, chunk, chunk_size);
+    if (response_length < 0) {
+        return response_length;
+    }
+    int data_read = esp_http_client_read_response(client, response_buffer, response_size - 1);
+    int status_code = esp_http_client_get_status_code(client);
+
+    // Si la respuesta no entra en el buffer se descarta cerrando la conexion
+    if (data_read < 0 || !esp_http_client_is_complete_data_received(client)) {
+        http_close(client);
+    }
+    return status_code;
+}
+
+
+esp_err_t _http_event_handler(esp_http_client_event_t* evt){
+    http_sink_t* sink = (http_sink_t*) evt->user_data;
+    if (evt->event_id != HTTP_EVENT_ON_DATA || sink == NULL || sink->write == NULL) {
+        return ESP_OK;
+    }
+    // El cuerpo de un error (404, 500...) no es un registro
+    if (sink->error != ESP_OK || esp_http_client_get_status_code(evt->client) != 200) {
+        return ESP_OK;
+    }
+    sink->error = sink->write(sink->ctx, (const char*) evt->data, evt->data_len);
+    if (sink->error == ESP_OK) {
+        sink->length += evt->data_len;
+    }
+    return ESP_OK;
+}
+
+
+int get_request_sink(esp_http_client_handle_t client, http_sink_write_t write, void* ctx, size_t* length) {
+    char drain[HTTP_SINK_DRAIN_SIZE];
+    http_sink_t* sink = NULL;
+    int status_code = -1;
+    *length = 0;
+
+    esp_http_client_get_user_data(client, (void**) &sink);
+    if (sink == NULL) {
+        ESP_LOGE(TAG_HTTP, "El cliente no tiene un sink en user_data\n");
+        return -1;
+    }
+    esp_http_client_set_method(client, HTTP_METHOD_GET);
+
+    // Desde aqui cada bloque recibido (tambien el que llega junto a los headers)
+    // pasa por _http_event_handler() directo desde el buffer del cliente
+    sink->write  = write;
+    sink->ctx    = ctx;
+    sink->length = 0;
+    sink->error  = ESP_OK;
+
+    if (http_request(client, 0, NULL, NULL, NULL, NULL, 0) >= 0) {
+        int data_read;
+        do {
+            // read() solo hace avanzar al cliente: lo que deja en drain ya se entrego
+            data_read = esp_http_client_read(client, drain, sizeof(drain));
+        } while (data_read > 0 && sink->error == ESP_OK);
+        if (data_read < 0) {
+            ESP_LOGE(TAG_HTTP, "Failed to read response");
+        } else if (sink->error != ESP_OK) {
+            ESP_LOGE(TAG_HTTP, "Fallo al guardar la respuesta (%u bytes)\n", (unsigned) sink->length);
+            status_code = HTTP_STREAM_ABORTED;
+        } else if (!esp_http_client_is_complete_data_received(client)) {
+            ESP_LOGE(TAG_HTTP, "Respuesta cortada (%u bytes)\n", (unsigned) sink->length);
+        } else {
+            status_code = esp_http_client_get_status_code(client);
+            ESP_LOGI(TAG_HTTP, "- Server respondio = %d (%u bytes)", status_code, (unsigned) sink->length);
+        }
+    }
+    *length = sink->length;
+    sink->write = NULL;
+
+    // La conexion solo se mantiene abierta si la respuesta se leyo completa
+    if (status_code < 0 || !esp_http_client_is_complete_data_received(client)) {
+        http_close(client);
+    }
+    return status_code;
+}
+
+
+esp_http_client_handle_t http_pool_get(const char* name, const esp_http_client_config_t* config){
+    http_pool_entry_t* entry = NULL;
+    for (int i = 0; i < HTTP_POOL_SIZE; i++) {
+        if (s_http_pool[i].client != NULL && strcmp(s_http_pool[i].name, name) == 0) {
+            return s_http_pool[i].client;
+        }
+        if (s_http_pool[i].client == NULL && entry == NULL) {
+            entry = &s_http_pool[i];
+        }
+    }
+    if (entry == NULL) {
+        ESP_LOGE(TAG_HTTP, "Pool de clientes HTTP lleno, no se pudo agregar '%s'\n", name);
+        return NULL;
+    }
+    entry->client = esp_http_client_init(config);
+    if (entry->client == NULL) {
+        ESP_LOGE(TAG_HTTP, "No se pudo crear el cliente HTTP '%s'\n", name);
+        return NULL;
+    }
+    entry->name = name;
+    return entry->client;
+}
+
+
+void http_pool_cleanup(){
+    for (int i = 0; i < HTTP_POOL_SIZE; i++) {
+        if (s_http_pool[i].client != NULL) {
+            esp_http_client_cleanup(s_http_pool[i].client);
+            s_http_pool[i].client = NULL;
+            s_http_pool[i].name   = NULL;
+            s_http_pool[i].kept   = 0;
+        }
+    }
+}
+
+
+/*              SESIONES TLS ENTRE CICLOS              */
+#if CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+/* Sesion guardada de un host (se pierde con un power-on) */
+typedef struct {
+    char     host[HTTP_TLS_HOST_SIZE];      // "" = libre
+    uint32_t used;                          // Reloj del ultimo handshake, se reemplaza la mas vieja
+    uint16_t length;
+    uint8_t  data[HTTP_TLS_SESSION_SIZE];   // mbedtls_ssl_session_save()
+} http_tls_session_t;
+
+static RTC_DATA_ATTR uint32_t           s_tls_magic;
+static RTC_DATA_ATTR uint32_t           s_tls_clock;
+static RTC_DATA_ATTR http_tls_session_t s_tls_sessions[HTTP_TLS_SESSION_SLOTS];
+// Las tareas de CST y TPI hacen sus handshakes al mismo tiempo
+static portMUX_TYPE s_tls_lock = portMUX_INITIALIZER_UNLOCKED;
+
+
+/* Sesion de host (host_length bytes, sin '\0'), con la memoria RTC ya validada */
+static http_tls_session_t* http_tls_session_find(const char* host, int host_length){
+    if (s_tls_magic != HTTP_TLS_SESSION_MAGIC) {
+        s_tls_magic = HTTP_TLS_SESSION_MAGIC;
+        s_tls_clock = 0;
+        memset(s_tls_sessions, 0, sizeof(s_tls_sessions));
+    }
+    if (host_length >= HTTP_TLS_HOST_SIZE) {
+        return NULL;
+    }
+    for (int i = 0; i < HTTP_TLS_SESSION_SLOTS; i++) {
+        if (strncmp(s_tls_sessions[i].host, host, host_length) == 0 &&
+            s_tls_sessions[i].host[host_length] == '\0') {
+            return &s_tls_sessions[i];
+        }
+    }
+    return NULL;
+}
+
+
+/* Borra la sesion de host: su ticket ya no sirve para reanudar */
+static void http_tls_session_forget(const char* host, int host_length){
+    portENTER_CRITICAL(&s_tls_lock);
+    http_tls_session_t* session = http_tls_session_find(host, host_length);
+    if (session != NULL) {
+        memset(session, 0, sizeof(http_tls_session_t));
+    }
+    portEXIT_CRITICAL(&s_tls_lock);
+}
+
+
+/*  Copia la sesion de host en data. Retorna sus bytes, 0 si no hay */
+static size_t http_tls_session_get(const char* host, int host_length, uint8_t* data){
+    size_t length = 0;
+    portENTER_CRITICAL(&s_tls_lock);
+    http_tls_session_t* session = http_tls_session_find(host, host_length);
+    if (session != NULL && session->length <= HTTP_TLS_SESSION_SIZE) {
+        length = session->length;
+        memcpy(data, session->data, length);
+    }
+    portEXIT_CRITICAL(&s_tls_lock);
+    return length;
+}
+
+
+/*  Guarda la sesion de host en su lugar, o en el libre / mas viejo */
+static void http_tls_session_put(const char* host, int host_length, const uint8_t* data, size_t length){
+    portENTER_CRITICAL(&s_tls_lock);
+    http_tls_session_t* session = http_tls_session_find(host, host_length);
+    for (int i = 0; session == NULL && i < HTTP_TLS_SESSION_SLOTS; i++) {
+        if (s_tls_sessions[i].host[0] == '\0') {
+            session = &s_tls_sessions[i];
+        }
+    }
+    if (session == NULL) {
+        session = &s_tls_sessions[0];
+        for (int i = 1; i < HTTP_TLS_SESSION_SLOTS; i++) {
+            if (s_tls_sessions[i].used < session->used) {
+                session = &s_tls_sessions[i];
+            }
+        }
+    }
+    memcpy(session->host, host, host_length);
+    session->host[host_length] = '\0';
+    session->used   = ++s_tls_clock;
+    session->length = length;
+    memcpy(session->data, data, length);
+    portEXIT_CRITICAL(&s_tls_lock);
+}
+
+
+int http_tls_sessions(){
+    int count = 0;
+    portENTER_CRITICAL(&s_tls_lock);
+    for (int i = 0; s_tls_magic == HTTP_TLS_SESSION_MAGIC && i < HTTP_TLS_SESSION_SLOTS; i++) {
+        count += (s_tls_sessions[i].host[0] != '\0');
+    }
+    portEXIT_CRITICAL(&s_tls_lock);
+    return count;
+}
+
+
+/*  esp_http_client no expone la sesion de su transporte: el componente se enlaza
+    con -Wl,--wrap=esp_tls_conn_new_sync y todos los handshakes pasan por aca */
+int __real_esp_tls_conn_new_sync(const char* hostname, int hostlen, int port, const esp_tls_cfg_t* cfg, esp_tls_t* tls);
+
+
+/*  Sesion de host leida de la memoria RTC, NULL si no hay o no se puede cargar */
+static esp_tls_client_session_t* http_tls_session_load(const char* host, int host_length){
+    uint8_t data[HTTP_TLS_SESSION_SIZE];
+    size_t length = http_tls_session_get(host, host_length, data);
+    if (length == 0) {
+        return NULL;
+    }
+    esp_tls_client_session_t* session = calloc(1, sizeof(esp_tls_client_session_t));
+    if (session == NULL) {
+        return NULL;
+    }
+    mbedtls_ssl_session_init(&session->saved_session);
+    if (mbedtls_ssl_session_load(&session->saved_session, data, length) != 0) {
+        ESP_LOGW(TAG_HTTP, "Sesion TLS de %.*s invalida, se borra\n", host_length, host);
+        esp_tls_free_client_session(session);
+        http_tls_session_forget(host, host_length);
+        return NULL;
+    }
+    return session;
+}
+
+
+/*  Guarda en la memoria RTC la sesion del handshake que termino (nueva o reanudada) */
+static void http_tls_session_save(const char* host, int host_length, esp_tls_t* tls){
+    if (host_length >= HTTP_TLS_HOST_SIZE) {
+        return;
+    }
+    esp_tls_client_session_t* session = esp_tls_get_client_session(tls);
+    if (session == NULL) {
+        return;
+    }
+    uint8_t data[HTTP_TLS_SESSION_SIZE];
+    size_t length = 0;
+    int err = mbedtls_ssl_session_save(&session->saved_session, data, sizeof(data), &length);
+    esp_tls_free_client_session(session);
+    if (err != 0) {
+        // Un ticket mas grande que HTTP_TLS_SESSION_SIZE: el siguiente ciclo hace el handshake completo
+        ESP_LOGW(TAG_HTTP, "No se pudo guardar la sesion TLS de %.*s (-0x%04x)\n", host_length, host, (unsigned) -err);
+        http_tls_session_forget(host, host_length);
+        return;
+    }
+    http_tls_session_put(host, host_length, data, length);
+}
+
+
+int __wrap_esp_tls_conn_new_sync(const char* hostname, int hostlen, int port, const esp_tls_cfg_t* cfg, esp_tls_t* tls){
+    esp_tls_cfg_t resume_cfg;
+    esp_tls_client_session_t* session = NULL;
+    // Despues del primer handshake del ciclo el cliente ofrece su propia sesion (save_client_session)
+    if (cfg->client_session == NULL) {
+        session = http_tls_session_load(hostname, hostlen);
+        if (session != NULL) {
+            resume_cfg = *cfg;
+            resume_cfg.client_session = session;
+            cfg = &resume_cfg;
+        }
+    }
+
+    int ret = __real_esp_tls_conn_new_sync(hostname, hostlen, port, cfg, tls);
+    if (ret == 1) {
+        // Un ticket rechazado termina en un handshake completo: se guarda la sesion nueva
+        http_tls_session_save(hostname, hostlen, tls);
+    }
+    else {
+        // Solo un fallo del handshake borra la sesion (sin red el ticket sigue sirviendo)
+        esp_tls_error_handle_t error = NULL;
+        if (esp_tls_get_error_handle(tls, &error) == ESP_OK && error != NULL &&
+            error->last_error == ESP_ERR_MBEDTLS_SSL_HANDSHAKE_FAILED) {
+            ESP_LOGW(TAG_HTTP, "Fallo el handshake con %.*s, se borra su sesion TLS\n", hostlen, hostname);
+            http_tls_session_forget(hostname, hostlen);
+        }
+    }
+    if (session != NULL) {
+        esp_tls_free_client_session(session);
+    }
+    return ret;
+}
+#else
+int http_tls_sessions(){
+    return 0;
+}
+#endif
@@ -0,0 +1,154 @@
+#ifndef __HTTP_ESP32_
+#define __HTTP_ESP32_
+// ----------------------------------------------------------------- //
+#include <stddef.h>
+
+#include "credenciales.h"
+#include "esp_http_client.h"    // API for creating and configuring HTTP/HTTPS clients.
+#include "esp_tls.h"            // Transport Layer Security for ESP-IDF - HTTPS
+#include "esp_attr.h"           // RTC_DATA_ATTR: the TLS sessions are kept during deep sleep
+
+#if CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+#include "mbedtls/ssl.h"        // mbedtls_ssl_session_save/load: the session is copied to RTC memory
+#endif
+
+#if CONFIG_MBEDTLS_CERTIFICATE_BUNDLE
+#include "esp_crt_bundle.h"
+#endif
+
+/* Define variables for the HTTP requests (they do not depend on the Wi-Fi driver,
+   host/ builds them against a stand-in of esp_http_client) */
+#define HTTP_STREAM_ABORTED             -2      // The body reader/writer failed, nothing was delivered
+#define HTTP_RESPONSE_INCOMPLETE        -3      // get_request_records(): the response was cut, only the records delivered are valid
+#define HTTP_SINK_DRAIN_SIZE            128     // get_request_sink(): read() only drives the client, the data goes by ON_DATA
+#define HTTP_POOL_SIZE                  4       // HTTP clients kept for the whole cycle (CST, TPI, bateria, edge)
+#define HTTP_TLS_SESSION_SLOTS          3       // TLS sessions kept in RTC memory across deep sleep (one per host)
+#define HTTP_TLS_SESSION_SIZE           512     // Serialized session with its ticket (without the peer certificate)
+#define HTTP_TLS_HOST_SIZE              64
+#define HTTP_TLS_SESSION_MAGIC          0x544C5331  // "TLS1"
+
+#define TAG_HTTP                        "HTTP_API"
+
+
+void http_get_data(char* url_path_get, char* response_buffer, size_t size_response_buffer);
+
+
+int http_post_data(  char* url_path_post, char* data_to_send, size_t data_to_send_size, 
+                            char* response_buffer, size_t response_size);
+
+
+/* Callback for every record of a batched response, return ESP_OK to continue */
+typedef esp_err_t (*http_record_cb_t)(const char* record, size_t length, void* ctx);
+
+
+/**
+ * @brief GET request with an already configured client. The connection is kept
+ *        open (HTTP keep-alive) when the whole response was read, so the next
+ *        request with the same client of the pool reuses it; if the server had
+ *        already closed it the request is sent once more on a new connection
+ * @return HTTP status code, or -1 on connection/read error
+ */
+int get_request(esp_http_client_handle_t client, char *response_buffer, size_t buffer_size);
+
+
+/**
+ * @brief GET request that returns several records, one per line (NDJSON).
+ *        The response is read in blocks of buffer_size and on_record is called
+ *        for every line, so the response can be bigger than the buffer
+ * @param buffer: Working buffer, must fit the biggest record
+ * @param status_code: HTTP status code of the response (-1 on connection error),
+ *        HTTP_RESPONSE_INCOMPLETE if the 200 response was not read to the end
+ *        (connection cut, read error, record too big or on_record failed)
+ * @return Number of records delivered to on_record, or -1 on error
+ */
+int get_request_records(esp_http_client_handle_t client, char *buffer, size_t buffer_size,
+                        http_record_cb_t on_record, void* ctx, int* status_code);
+
+
+/* Writes a block of a response body, return ESP_OK to continue */
+typedef esp_err_t (*http_sink_write_t)(void* ctx, const char* data, size_t length);
+
+
+/* Destination of a streamed response body, set as .user_data of the client */
+typedef struct {
+    http_sink_write_t write;    // NULL: the body is read by the caller (get_request, ...)
+    void*             ctx;
+    size_t            length;   // Bytes delivered to write()
+    esp_err_t         error;    // First error returned by write()
+} http_sink_t;
+
+
+/**
+ * @brief Event handler for clients that stream their responses: every
+ *        HTTP_EVENT_ON_DATA block of a 200 response is handed to the
+ *        http_sink_t in .user_data, straight from the receive buffer of the client
+ */
+esp_err_t _http_event_handler(esp_http_client_event_t* evt);
+
+
+/**
+ * @brief GET request whose body goes to write() as it arrives, without holding
+ *        it in a buffer: memory use does not depend on the size of the response,
+ *        which may contain NUL bytes. The client must have been created with
+ *        .event_handler = _http_event_handler and .user_data = &sink
+ * @param length: Bytes delivered to write()
+ * @return HTTP status code, -1 on connection/read error or HTTP_STREAM_ABORTED if write() failed
+ */
+int get_request_sink(esp_http_client_handle_t client, http_sink_write_t write, void* ctx, size_t* length);
+
+
+
+/* Reads the next block of a POST body, returns bytes read or -1 on error */
+typedef int (*http_body_reader_t)(void* ctx, char* buffer, size_t size);
+
+
+/* Moves the reader back to the start of the body, return ESP_OK if it can be read again */
+typedef esp_err_t (*http_body_rewind_t)(void* ctx);
+
+
+/**
+ * @brief POST request that streams the body in blocks of chunk_size. The body
+ *        is never held entirely in RAM, so its size is not limited by a buffer
+ * @param client: Client configured with URL and headers (method is set to POST)
+ * @param content_length: Total body size, sent as Content-Length
+ * @param read_body: Called until content_length bytes are read
+ * @param rewind_body: If a reused keep-alive connection turns out to be closed
+ *        (write or response headers fail) the body is rewound and sent once more
+ *        on a new connection. NULL: no retry
+ * @param response_buffer: Start of the response, a bigger response closes the connection
+ * @return HTTP status code, -1 on connection error or HTTP_STREAM_ABORTED if read_body failed
+ */
+int http_post_stream(esp_http_client_handle_t client, size_t content_length,
+                     http_body_reader_t read_body, http_body_rewind_t rewind_body, void* ctx,
+                     char* chunk, size_t chunk_size, char* response_buffer, size_t response_size);
+
+
+/**
+ * @brief Client of one destination for the whole wake cycle. The first call
+ *        creates it with config, the next ones return the same client (and its
+ *        keep-alive connection) and ignore config: set the URL before using it
+ * @param name: Destination ("CST", "edge", ...), the string must stay valid
+ * @return The client, or NULL if the pool is full or the client can not be created
+ */
+esp_http_client_handle_t http_pool_get(const char* name, const esp_http_client_config_t* config);
+
+
+/**
+ * @brief This function closes and frees every client of the pool (before esp_wifi_stop)
+ */
+void http_pool_cleanup();
+
+
+/**
+ * @brief TLS sessions that survive deep sleep. Every HTTPS handshake goes through
+ *        esp32_http.c (esp_tls_conn_new_sync is linked with --wrap, see
+ *        CMakeLists.txt): the session of the server is saved in RTC memory and
+ *        the first connection of the next cycle to the same host offers its
+ *        ticket, so it is resumed instead of a full handshake. A handshake that
+ *        fails forgets the session of its host
+ * @return Sessions saved now (for the logs)
+ */
+int http_tls_sessions();
+
+// ----------------------------------------------------------------- //
+#endif /* __HTTP_ESP32_ */
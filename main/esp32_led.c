@@ -0,0 +1,264 @@
+#include "esp32_led.h"
+#include "soc/gpio_reg.h"       // GPIO_OUT_W1TS_REG / GPIO_OUT_W1TC_REG for writing all LED pins at once
+#include "esp32_telem.h"        // The LED task lives all the cycle: its stack is sampled at every phase
+
+// SET = apply s_led_pending, TICK = pattern timer, FLUSH = notify the caller
+enum _led_cmd_type{
+  LED_CMD_SET   = 0,
+  LED_CMD_TICK  = 1,
+  LED_CMD_FLUSH = 2
+};
+
+typedef struct {
+  uint8_t       type;
+  TaskHandle_t  notify;           // Only for LED_CMD_FLUSH
+} led_cmd_t;
+
+// Ultimo color/patron pedido por LED: la cola solo despierta a la tarea, asi un
+// comando nunca se pierde aunque la cola este llena (el ultimo OFF antes de dormir)
+typedef struct {
+  uint8_t color;
+  uint8_t pattern;
+  uint8_t dirty;
+} led_pending_t;
+
+typedef struct {
+  uint8_t pin_R;
+  uint8_t pin_G;
+  uint8_t pin_B;
+  uint8_t color;
+  uint8_t pattern;
+} led_state_t;
+
+// Index 0 = BAT, 1 = WIFI, 2 = CHECK (enum _led - 1)
+// Every LED pin is < 32, so the whole state fits in the GPIO_OUT register
+static led_state_t s_leds[] = {
+  {ESP_LED_BAT_R,   ESP_LED_BAT_G,   ESP_LED_BAT_B,   OFF, LED_SOLID},
+  {ESP_LED_WIFI_R,  ESP_LED_WIFI_G,  ESP_LED_WIFI_B,  OFF, LED_SOLID},
+  {ESP_LED_CHECK_R, ESP_LED_CHECK_G, ESP_LED_CHECK_B, OFF, LED_SOLID},
+};
+#define LED_COUNT   ((int) (sizeof(s_leds) / sizeof(led_state_t)))
+
+static led_pending_t      s_led_pending[LED_COUNT];
+static portMUX_TYPE       s_led_lock = portMUX_INITIALIZER_UNLOCKED;
+static QueueHandle_t      s_led_queue = NULL;
+static esp_timer_handle_t s_led_timer = NULL;
+static uint32_t           s_led_ticks = 0;
+
+
+// Bits R, G, B for every color of enum _color
+static const uint8_t s_color_rgb[] = {
+  [OFF]    = 0b000,
+  [RED]    = 0b100,
+  [GREEN]  = 0b010,
+  [BLUE]   = 0b001,
+  [PURPLE] = 0b101,
+  [CIAN]   = 0b011,
+  [YELLOW] = 0b110,
+  [WHITE]  = 0b111,
+};
+
+
+static int led_pattern_is_on(uint8_t pattern){
+  uint32_t elapsed_ms = s_led_ticks * LED_TICK_MS;
+  switch(pattern){
+    case LED_BLINK:
+      return ((elapsed_ms / LED_BLINK_MS) % 2) == 0;
+    case LED_PULSE:
+      return (elapsed_ms % LED_PULSE_PERIOD_MS) < LED_PULSE_ON_MS;
+    default:
+      return 1;
+  }
+}
+
+
+static void led_add_pin(uint8_t pin, int on, uint32_t* set_mask, uint32_t* clr_mask){
+  if(on){
+    *set_mask |= (1UL << pin);
+  }
+  else{
+    *clr_mask |= (1UL << pin);
+  }
+}
+
+
+// Escribimos los 9 pines con dos escrituras de registro (sin delays)
+static void led_write_all(){
+  uint32_t set_mask = 0;
+  uint32_t clr_mask = 0;
+
+  for(int i = 0; i < LED_COUNT; i++){
+    uint8_t rgb = 0;
+    if(s_leds[i].color <= WHITE && led_pattern_is_on(s_leds[i].pattern)){
+      rgb = s_color_rgb[s_leds[i].color];
+    }
+    led_add_pin(s_leds[i].pin_R, rgb & 0b100, &set_mask, &clr_mask);
+    led_add_pin(s_leds[i].pin_G, rgb & 0b010, &set_mask, &clr_mask);
+    led_add_pin(s_leds[i].pin_B, rgb & 0b001, &set_mask, &clr_mask);
+  }
+
+  REG_WRITE(GPIO_OUT_W1TC_REG, clr_mask);
+  REG_WRITE(GPIO_OUT_W1TS_REG, set_mask);
+}
+
+
+static void led_apply_pending(){
+  portENTER_CRITICAL(&s_led_lock);
+  for(int i = 0; i < LED_COUNT; i++){
+    if(s_led_pending[i].dirty){
+      s_leds[i].color   = s_led_pending[i].color;
+      s_leds[i].pattern = s_led_pending[i].pattern;
+      s_led_pending[i].dirty = 0;
+    }
+  }
+  portEXIT_CRITICAL(&s_led_lock);
+}
+
+
+static int led_any_pattern_active(){
+  for(int i = 0; i < LED_COUNT; i++){
+    if(s_leds[i].pattern != LED_SOLID && s_leds[i].color != OFF){
+      return 1;
+    }
+  }
+  return 0;
+}
+
+
+static void led_timer_callback(void* arg){
+  (void) arg;
+  led_cmd_t cmd = { .type = LED_CMD_TICK };
+  // Si la cola esta llena el tick se pierde, el siguiente lo corrige
+  xQueueSend(s_led_queue, &cmd, 0);
+}
+
+
+static void led_task(void* arg){
+  (void) arg;
+  led_cmd_t cmd;
+  while(1){
+    if(xQueueReceive(s_led_queue, &cmd, portMAX_DELAY) != pdTRUE){
+      continue;
+    }
+
+    // Cualquier comando aplica lo pendiente: un SET que no entro en la cola llega con el siguiente
+    led_apply_pending();
+    if(cmd.type == LED_CMD_TICK){
+      s_led_ticks++;
+    }
+    led_write_all();
+
+    // El timer solo corre mientras algun LED tenga un patron
+    int active = led_any_pattern_active();
+    if(active && !esp_timer_is_active(s_led_timer)){
+      s_led_ticks = 0;
+      esp_timer_start_periodic(s_led_timer, LED_TICK_MS * 1000);
+    }
+    else if(!active && esp_timer_is_active(s_led_timer)){
+      esp_timer_stop(s_led_timer);
+    }
+
+    if(cmd.type == LED_CMD_FLUSH){
+      xTaskNotifyGive(cmd.notify);
+    }
+  }
+}
+
+
+esp_err_t led_init(){
+  if(s_led_queue != NULL){
+    return ESP_OK;
+  }
+
+  s_led_queue = xQueueCreate(LED_QUEUE_LENGTH, sizeof(led_cmd_t));
+  if(s_led_queue == NULL){
+    ESP_LOGE(TAG_LED, "No se pudo crear la cola de LEDs\n");
+    return ESP_FAIL;
+  }
+
+  esp_timer_create_args_t timer_args = {
+    .callback = &led_timer_callback,
+    .name     = "led_pattern",
+  };
+  if(esp_timer_create(&timer_args, &s_led_timer) != ESP_OK){
+    ESP_LOGE(TAG_LED, "No se pudo crear el timer de LEDs\n");
+    vQueueDelete(s_led_queue);
+    s_led_queue = NULL;
+    return ESP_FAIL;
+  }
+
+  TaskHandle_t led_task_handle = NULL;
+  if(xTaskCreate(led_task, "led_task", LED_TASK_STACK, NULL, LED_TASK_PRIORITY, &led_task_handle) != pdPASS){
+    ESP_LOGE(TAG_LED, "No se pudo crear la tarea de LEDs\n");
+    // Sin esto el siguiente led_init() crea un segundo timer
+    esp_timer_delete(s_led_timer);
+    s_led_timer = NULL;
+    vQueueDelete(s_led_queue);
+    s_led_queue = NULL;
+    return ESP_FAIL;
+  }
+  telem_watch(TELEM_TASK_LED, led_task_handle);
+
+  led_write_all();
+  return ESP_OK;
+}
+
+
+void led_set_pattern(enum _led pin_led, enum _color color, enum _pattern pattern){
+  if(pin_led < BAT || pin_led > CHECK){
+    return;
+  }
+
+  // Antes de led_init() escribimos directamente los pines
+  if(s_led_queue == NULL){
+    s_leds[pin_led - 1].color   = color;
+    s_leds[pin_led - 1].pattern = pattern;
+    led_write_all();
+    return;
+  }
+
+  portENTER_CRITICAL(&s_led_lock);
+  s_led_pending[pin_led - 1].color   = color;
+  s_led_pending[pin_led - 1].pattern = pattern;
+  s_led_pending[pin_led - 1].dirty   = 1;
+  portEXIT_CRITICAL(&s_led_lock);
+
+  // Con la cola llena la tarea ya tiene comandos por procesar y aplica este estado con ellos
+  led_cmd_t cmd = { .type = LED_CMD_SET };
+  xQueueSend(s_led_queue, &cmd, 0);
+}
+
+
+void led_set(enum _led pin_led, enum _color color){
+  led_set_pattern(pin_led, color, LED_SOLID);
+}
+
+
+bool led_flush(int timeout_ms){
+  if(s_led_queue == NULL){
+    return true;
+  }
+
+  led_cmd_t cmd = {
+    .type   = LED_CMD_FLUSH,
+    .notify = xTaskGetCurrentTaskHandle(),
+  };
+  if(xQueueSend(s_led_queue, &cmd, timeout_ms / portTICK_PERIOD_MS) != pdTRUE){
+    return false;
+  }
+  return ulTaskNotifyTake(pdTRUE, timeout_ms / portTICK_PERIOD_MS) > 0;
+}
+
+
+void power_off_leds(){
+  led_set(BAT, OFF);
+  led_set(WIFI, OFF);
+  led_set(CHECK, OFF);
+}
+
+
+void power_on_leds(){
+  led_set(BAT,WHITE);
+  led_set(WIFI,WHITE);
+  led_set(CHECK,WHITE);
+}
@@ -0,0 +1,107 @@
+#ifndef __LED_ESP32_
+//--------------------------------------------------
+#define __LED_ESP32_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "esp_err.h"            // Defines esp_err_t, ESP_OK and ESP_FAIL
+#include "freertos/FreeRTOS.h"  // It provides a framework for multitasking, task scheduling, and synchronization in embedded applications.
+#include "freertos/task.h"      // Header provides functions and macros for creating, starting, and managing tasks
+#include "freertos/queue.h"     // Queues used to pass commands to the LED task without blocking the caller
+#include "esp_timer.h"          // High resolution timer that drives the blink/pulse patterns
+#include "esp_log.h"            // For logs functions like ESP_LOGE, LOGI, etc
+
+// Define LEDs pinout
+#define ESP_LED_BAT_R       13
+#define ESP_LED_BAT_G       12
+#define ESP_LED_BAT_B       14
+#define ESP_LED_WIFI_R      21
+#define ESP_LED_WIFI_G      17
+#define ESP_LED_WIFI_B      16
+#define ESP_LED_CHECK_R     4
+#define ESP_LED_CHECK_G     2
+#define ESP_LED_CHECK_B     15
+
+// LED task parameters
+#define LED_QUEUE_LENGTH    16          // Commands waiting for the LED task (the color of every LED is kept apart)
+#define LED_TASK_STACK      2048
+#define LED_TASK_PRIORITY   2
+#define LED_TICK_MS         50          // Resolution of the blink/pulse patterns
+#define LED_BLINK_MS        250         // Half period of LED_BLINK
+#define LED_PULSE_PERIOD_MS 1000        // Period of LED_PULSE
+#define LED_PULSE_ON_MS     50          // Time ON inside every LED_PULSE period
+
+#define TAG_LED             "LED_API"
+
+// OFF=0, RED=1, GREEN=2, BLUE=3, PURPLE=4, CIAN=5, YELLOW=6, WHITE=7
+enum _color{
+  OFF = 0, RED = 1, GREEN = 2, BLUE = 3, PURPLE = 4,
+  CIAN = 5, YELLOW = 6, WHITE = 7
+};
+
+// BAT = 1, WIFIF = 2, CHECK = 3
+enum _led{
+  BAT = 1,
+  WIFI = 2,
+  CHECK = 3
+};
+
+// SOLID = always on, BLINK = 50% duty cycle, PULSE = short flash every second
+enum _pattern{
+  LED_SOLID = 0,
+  LED_BLINK = 1,
+  LED_PULSE = 2
+};
+
+
+/**
+ * @brief This function creates the LED queue, the pattern timer and the LED task.
+ *        The LED pins must be configured as outputs before (see config_pin)
+ * @return ESP_OK or ESP_FAIL if the task/queue/timer could not be created
+ */
+esp_err_t led_init();
+
+
+/**
+ * @brief This function turn the led in the color desired
+ * @param _led: WIFI, BAT, CHECK
+ * @param _color: OFF, RED, GREEN, BLUE, PURPLE, CIAN, YELLOW, WHITE
+ * @note  It only queues the command, the LED task writes the pins
+ */
+void led_set(enum _led pin_led, enum _color color);
+
+
+/**
+ * @brief This function turn the led in the color and pattern desired
+ * @param _led: WIFI, BAT, CHECK
+ * @param _color: OFF, RED, GREEN, BLUE, PURPLE, CIAN, YELLOW, WHITE
+ * @param _pattern: LED_SOLID, LED_BLINK, LED_PULSE
+ * @note  It never blocks. Only the last color/pattern of every LED is kept, so
+ *        a full queue never drops it: the LED task applies it with the next command
+ */
+void led_set_pattern(enum _led pin_led, enum _color color, enum _pattern pattern);
+
+
+/**
+ * @brief This function waits until the LED task has applied every queued command
+ * @param timeout_ms: Maximum time to wait in milliseconds
+ * @return true if the queue was flushed, false on timeout
+ * @note  Call it before deep sleep so the last color is the one held by the pins
+ */
+bool led_flush(int timeout_ms);
+
+
+/**
+ * @brief This function turn off all leds: BAT, WIFI, CHECK
+ */
+void power_off_leds();
+
+
+/**
+ * @brief This function turn on all leds: BAT, WIFI, CHECK
+ */
+void power_on_leds();
+
+//--------------------------------------------------
+#endif /* __LED_ESP32_ */
@@ -0,0 +1,197 @@
+#include "esp32_mem.h"
+
+#include <string.h>
+#include <stdlib.h>
+
+#define MEM_ROUND(size)   (((size) + MEM_ALIGN - 1) & ~(size_t) (MEM_ALIGN - 1))
+
+/* Header of every block of a ring */
+typedef struct {
+   uint32_t size;          // Header + data, rounded to MEM_ALIGN
+   uint32_t freed;
+} mem_ring_block_t;
+
+// Un solo bloque estatico por ciclo: lo que se toma de aqui no fragmenta el heap
+static DMA_ATTR uint8_t s_arena[MEM_ARENA_SIZE] __attribute__((aligned(MEM_ALIGN)));
+static size_t           s_arena_used = 0;
+static size_t           s_arena_peak = 0;
+static int              s_arena_full_logged = 0;
+static portMUX_TYPE     s_mem_lock = portMUX_INITIALIZER_UNLOCKED;
+
+#if CONFIG_NODO_HEAP_TRACE
+static heap_trace_record_t s_trace_records[MEM_TRACE_RECORDS];
+static int                 s_trace_ready = 0;
+#endif
+
+
+void mem_init(){
+  s_arena_used = 0;
+  s_arena_peak = 0;
+  s_arena_full_logged = 0;
+}
+
+
+void* mem_alloc(size_t size){
+  size = MEM_ROUND(size);
+  void* ptr = NULL;
+
+  portENTER_CRITICAL(&s_mem_lock);
+  if(size <= MEM_ARENA_SIZE - s_arena_used){
+    ptr = s_arena + s_arena_used;
+    s_arena_used += size;
+    if(s_arena_used > s_arena_peak){
+      s_arena_peak = s_arena_used;
+    }
+  }
+  portEXIT_CRITICAL(&s_mem_lock);
+
+  if(ptr == NULL && !s_arena_full_logged){
+    s_arena_full_logged = 1;
+    ESP_LOGW(TAG_MEM, "Arena llena (%u de %u bytes), se usa el heap\n",
+             (unsigned) s_arena_used, (unsigned) MEM_ARENA_SIZE);
+  }
+  return ptr;
+}
+
+
+void* mem_calloc(size_t size){
+  void* ptr = mem_alloc(size);
+  if(ptr != NULL){
+    memset(ptr, 0, size);
+  }
+  return ptr;
+}
+
+
+int mem_owns(const void* ptr){
+  return (const uint8_t*) ptr >= s_arena && (const uint8_t*) ptr < s_arena + MEM_ARENA_SIZE;
+}
+
+
+void mem_free(void* ptr){
+  if(ptr != NULL && !mem_owns(ptr)){
+    free(ptr);
+  }
+}
+
+
+size_t mem_used(){
+  return s_arena_used;
+}
+
+
+void mem_ring_init(mem_ring_t* ring, void* block, size_t capacity){
+  memset(ring, 0, sizeof(mem_ring_t));
+  ring->base     = (uint8_t*) block;
+  ring->capacity = capacity & ~(size_t) (MEM_ALIGN - 1);
+}
+
+
+void* mem_ring_alloc(mem_ring_t* ring, size_t size){
+  size_t need = sizeof(mem_ring_block_t) + MEM_ROUND(size);
+  if(ring->count == 0){
+    ring->head = ring->tail = 0;
+    ring->wrapped = 0;
+  }
+
+  size_t offset;
+  if(ring->wrapped){
+    // Ya se volvio al inicio: el espacio libre va de head a tail
+    if(ring->head + need > ring->tail){
+      return NULL;
+    }
+    offset = ring->head;
+  }
+  else if(ring->head + need <= ring->capacity){
+    offset = ring->head;
+  }
+  else if(need <= ring->tail){
+    // No entra al final: el resto queda sin usar hasta que tail llegue ahi
+    ring->wrap    = ring->head;
+    ring->wrapped = 1;
+    offset = 0;
+  }
+  else{
+    return NULL;
+  }
+
+  mem_ring_block_t* block = (mem_ring_block_t*) (ring->base + offset);
+  block->size  = need;
+  block->freed = 0;
+  ring->head  = offset + need;
+  ring->last  = offset;
+  ring->count++;
+  return block + 1;
+}
+
+
+esp_err_t mem_ring_resize(mem_ring_t* ring, void* ptr, size_t size){
+  mem_ring_block_t* block = (mem_ring_block_t*) ptr - 1;
+  size_t offset = (uint8_t*) block - ring->base;
+  if(ring->count == 0 || offset != ring->last){
+    return ESP_ERR_NO_MEM;
+  }
+  size_t need  = sizeof(mem_ring_block_t) + MEM_ROUND(size);
+  size_t limit = ring->wrapped ? ring->tail : ring->capacity;
+  if(offset + need > limit){
+    return ESP_ERR_NO_MEM;
+  }
+  block->size = need;
+  ring->head  = offset + need;
+  return ESP_OK;
+}
+
+
+void mem_ring_free(mem_ring_t* ring, void* ptr){
+  if(ptr == NULL){
+    return;
+  }
+  mem_ring_block_t* block = (mem_ring_block_t*) ptr - 1;
+  block->freed = 1;
+
+  // Se recupera el espacio desde el bloque mas antiguo
+  while(ring->count > 0){
+    if(ring->wrapped && ring->tail == ring->wrap){
+      ring->tail = 0;
+      ring->wrapped = 0;
+    }
+    mem_ring_block_t* oldest = (mem_ring_block_t*) (ring->base + ring->tail);
+    if(!oldest->freed){
+      break;
+    }
+    ring->tail += oldest->size;
+    ring->count--;
+  }
+  if(ring->count == 0){
+    ring->head = ring->tail = 0;
+    ring->wrapped = 0;
+  }
+}
+
+
+void mem_trace_begin(){
+#if CONFIG_NODO_HEAP_TRACE
+  if(!s_trace_ready){
+    s_trace_ready = (heap_trace_init_standalone(s_trace_records, MEM_TRACE_RECORDS) == ESP_OK);
+  }
+  if(s_trace_ready){
+    heap_trace_start(HEAP_TRACE_ALL);
+  }
+#endif
+}
+
+
+void mem_trace_end(const char* label){
+#if CONFIG_NODO_HEAP_TRACE
+  if(!s_trace_ready){
+    return;
+  }
+  heap_trace_stop();
+  // HEAP_TRACE_ALL guarda tambien las que ya se liberaron: es el numero de malloc()
+  size_t count = heap_trace_get_count();
+  ESP_LOGI(TAG_MEM, "Asignaciones en %s = %u%s (arena = %u bytes, pico = %u)\n", label, (unsigned) count,
+           (count >= MEM_TRACE_RECORDS) ? " o mas" : "", (unsigned) s_arena_used, (unsigned) s_arena_peak);
+#else
+  (void) label;
+#endif
+}
@@ -0,0 +1,109 @@
+#ifndef __MEM_ESP32_
+#define __MEM_ESP32_
+// ----------------------------------------------------------------- //
+#include <stdint.h>
+#include <stddef.h>
+
+#include "esp_err.h"
+#include "esp_attr.h"           // DMA_ATTR: the arena is internal RAM, SD buffers can live in it
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"  // portMUX: the arena can be used by several tasks
+
+#if CONFIG_NODO_HEAP_TRACE
+#include "esp_heap_trace.h"     // Allocation counts of the sync loops (CONFIG_HEAP_TRACING_STANDALONE)
+#endif
+
+/* Define variables for the wake-cycle memory */
+#define MEM_ARENA_SIZE          (CONFIG_NODO_CYCLE_ARENA_KB * 1024)
+#define MEM_ALIGN               8           // Alignment of every block of the arena and of the rings
+#define MEM_TRACE_RECORDS       200         // Allocations kept by mem_trace_begin()
+
+#define TAG_MEM                 "MEM_API"
+
+/* Ring of blocks freed in any order: the space is reused when the oldest ones are freed.
+   Only one task may use a ring */
+typedef struct {
+   uint8_t*  base;
+   size_t    capacity;
+   size_t    head;         // Next block
+   size_t    tail;         // Oldest block still in use
+   size_t    wrap;         // End of the used space before head went back to 0
+   int       wrapped;      // head is behind tail: the free space goes from head to tail
+   size_t    last;         // Offset of the newest block (mem_ring_resize)
+   int       count;        // Blocks in use
+} mem_ring_t;
+
+
+/**
+ * @brief This function empties the arena of the wake cycle (call it once in app_main).
+ *        The arena is a static block: what is allocated from it stays until the next
+ *        cycle, so only buffers that live for the whole cycle go there
+ */
+void mem_init();
+
+
+/**
+ * @brief Block of the wake-cycle arena (MEM_ALIGN aligned, DMA capable)
+ * @return NULL when the arena is full, the caller decides whether to use the heap
+ */
+void* mem_alloc(size_t size);
+void* mem_calloc(size_t size);
+
+
+/**
+ * @brief 1 if ptr is a block of the arena (it must not be passed to free())
+ */
+int mem_owns(const void* ptr);
+
+
+/**
+ * @brief This function frees a block of the arena or of the heap. Arena blocks are
+ *        only released with the arena (mem_init), so they should be kept for reuse
+ */
+void mem_free(void* ptr);
+
+
+/**
+ * @brief Bytes of the arena in use
+ */
+size_t mem_used();
+
+
+/**
+ * @brief This function builds a ring over a block (normally taken from the arena)
+ */
+void mem_ring_init(mem_ring_t* ring, void* block, size_t capacity);
+
+
+/**
+ * @brief Block of the ring, NULL if there is not enough contiguous space until
+ *        older blocks are freed. With the ring empty any block up to capacity fits
+ */
+void* mem_ring_alloc(mem_ring_t* ring, size_t size);
+
+
+/**
+ * @brief This function resizes the newest block of the ring in place. Shrinking
+ *        always works: a block can be taken for the worst case and then adjusted
+ * @return ESP_OK, or ESP_ERR_NO_MEM (the block keeps its size)
+ */
+esp_err_t mem_ring_resize(mem_ring_t* ring, void* ptr, size_t size);
+
+
+void mem_ring_free(mem_ring_t* ring, void* ptr);
+
+
+/**
+ * @brief Counts the heap allocations between begin and end with the heap tracing
+ *        API (CONFIG_NODO_HEAP_TRACE). Without it both do nothing
+ * @code
+ * mem_trace_begin();
+ * sync_upload(&streams);
+ * mem_trace_end("upload");     // "Asignaciones en upload = N"
+ * @endcode
+ */
+void mem_trace_begin();
+void mem_trace_end(const char* label);
+
+// ----------------------------------------------------------------- //
+#endif /* __MEM_ESP32_ */
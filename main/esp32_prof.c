@@ -0,0 +1,115 @@
+#include "esp32_prof.h"
+#include "esp32_telem.h"
+
+#include <string.h>
+#include <unistd.h>
+
+static const char* s_phase_names[PHASE_COUNT] = {
+  [PHASE_AWAKE]         = "awake",
+  [PHASE_NVS]           = "nvs",
+  [PHASE_BATTERY]       = "battery",
+  [PHASE_WIFI]          = "wifi",
+  [PHASE_SD_MOUNT]      = "sd_mount",
+  [PHASE_SD_OPEN]       = "sd_open",
+  [PHASE_EDGE_QUERY]    = "edge_query",
+  [PHASE_EDGE_DOWNLOAD] = "edge_download",
+  [PHASE_UPLOAD]        = "upload",
+  [PHASE_SHUTDOWN]      = "shutdown",
+  [PHASE_BOOT]          = "boot",
+};
+
+// Sobreviven al deep sleep: las muestras se escriben en la SD cuando este montada
+static RTC_DATA_ATTR uint32_t       s_prof_magic;
+static RTC_DATA_ATTR uint32_t       s_prof_cycle;
+static RTC_DATA_ATTR uint32_t       s_prof_head;     // Next free slot
+static RTC_DATA_ATTR uint32_t       s_prof_count;
+static RTC_DATA_ATTR prof_sample_t  s_prof_ring[PROF_RING_SIZE];
+
+static int64_t s_phase_start[PHASE_COUNT];
+static portMUX_TYPE s_prof_lock = portMUX_INITIALIZER_UNLOCKED;
+
+
+void prof_init(){
+  // En el primer arranque (power-on) la memoria RTC no tiene datos validos
+  if(s_prof_magic != PROF_MAGIC){
+    s_prof_magic = PROF_MAGIC;
+    s_prof_cycle = 0;
+    s_prof_head  = 0;
+    s_prof_count = 0;
+  }
+  s_prof_cycle++;
+
+  memset(s_phase_start, 0, sizeof(s_phase_start));
+  // PHASE_AWAKE empieza con el arranque (esp_timer_get_time() = 0)
+}
+
+
+void prof_phase_begin(enum _phase phase){
+  if(phase >= PHASE_COUNT){
+    return;
+  }
+  s_phase_start[phase] = esp_timer_get_time();
+}
+
+
+void prof_phase_end(enum _phase phase){
+  if(phase >= PHASE_COUNT){
+    return;
+  }
+  int64_t now = esp_timer_get_time();
+
+  prof_sample_t sample = {
+    .cycle       = s_prof_cycle,
+    .start_us    = (uint32_t) s_phase_start[phase],
+    .duration_us = (uint32_t) (now - s_phase_start[phase]),
+    .phase       = phase,
+  };
+
+  // Si el anillo esta lleno se pisa la muestra mas antigua
+  portENTER_CRITICAL(&s_prof_lock);
+  s_prof_ring[s_prof_head] = sample;
+  s_prof_head = (s_prof_head + 1) % PROF_RING_SIZE;
+  if(s_prof_count < PROF_RING_SIZE){
+    s_prof_count++;
+  }
+  portEXIT_CRITICAL(&s_prof_lock);
+
+  ESP_LOGI(TAG_PROF, "Fase '%s' = %lu ms\n", s_phase_names[phase],
+           (unsigned long) (sample.duration_us / 1000));
+
+  // Heap, stacks y archivos abiertos en cada limite de fase
+  telem_phase_end(phase);
+}
+
+
+int prof_flush_sd(const char* mount_point){
+  if(s_prof_count == 0){
+    return 0;
+  }
+
+  char file_path[50];
+  snprintf(file_path, sizeof(file_path), "%s/%s", mount_point, PROF_FILE);
+  FILE* f = fopen(file_path, "ab");
+  if(f == NULL){
+    ESP_LOGE(TAG_PROF, "No se pudo abrir %s\n", file_path);
+    return -1;
+  }
+
+  // Desde la muestra mas antigua hasta la mas nueva
+  uint32_t first = (s_prof_head + PROF_RING_SIZE - s_prof_count) % PROF_RING_SIZE;
+  int written = 0;
+  for(uint32_t i = 0; i < s_prof_count; i++){
+    const prof_sample_t* sample = &s_prof_ring[(first + i) % PROF_RING_SIZE];
+    if(fwrite(sample, 1, sizeof(prof_sample_t), f) != sizeof(prof_sample_t)){
+      break;
+    }
+    written++;
+  }
+  fflush(f);
+  fsync(fileno(f));
+  fclose(f);
+
+  s_prof_count -= written;
+  ESP_LOGI(TAG_PROF, "Se escribieron %d muestras en %s\n", written, PROF_FILE);
+  return written;
+}
@@ -0,0 +1,77 @@
+#ifndef __PROF_ESP32_
+#define __PROF_ESP32_
+// ----------------------------------------------------------------- //
+#include <stdint.h>
+#include <stdio.h>
+
+#include "esp_timer.h"          // esp_timer_get_time(): microseconds since boot
+#include "esp_attr.h"           // RTC_DATA_ATTR: the samples survive deep sleep
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"  // portMUX: the boot tasks end their phases at the same time
+
+/* Define variables for the wake-cycle profiler */
+#define PROF_RING_SIZE          64          // Samples kept in RTC memory until they are written to SD
+#define PROF_FILE               "prof.bin"  // Binary file in the SD card (see tools/prof_report.py)
+#define PROF_MAGIC              0x50524F46  // "PROF"
+
+#define TAG_PROF                "PROF_API"
+
+// Phases of a wake cycle. WARNING: keep the order, tools/prof_report.py uses the same ids
+enum _phase{
+  PHASE_AWAKE         = 0,    // Boot -> deep sleep
+  PHASE_NVS           = 1,
+  PHASE_BATTERY       = 2,    // ADC sampling
+  PHASE_WIFI          = 3,    // Scan + connect + IP
+  PHASE_SD_MOUNT      = 4,
+  PHASE_SD_OPEN       = 5,    // Open logs / import legacy files
+  PHASE_EDGE_QUERY    = 6,    // Local time + number of records
+  PHASE_EDGE_DOWNLOAD = 7,
+  PHASE_UPLOAD        = 8,    // CST + TPI
+  PHASE_SHUTDOWN      = 9,    // Wi-Fi stop + SD eject + LEDs
+  PHASE_BOOT          = 10,   // boot_start() -> Wi-Fi and SD ready (battery/wifi/sd_mount run inside it)
+  PHASE_COUNT
+};
+
+/* Sample stored in RTC memory and in prof.bin (16 bytes, little endian) */
+typedef struct {
+   uint32_t cycle;         // Wake cycle number
+   uint32_t start_us;      // Start of the phase, microseconds since boot
+   uint32_t duration_us;
+   uint8_t  phase;         // enum _phase
+   uint8_t  reserved[3];
+} prof_sample_t;
+
+
+/**
+ * @brief Marks the begin/end of a phase of the wake cycle
+ * @code
+ * PHASE_BEGIN(PHASE_WIFI);
+ * wifi_scan(ssid_buffer, sizeof(ssid_buffer));
+ * PHASE_END(PHASE_WIFI);
+ * @endcode
+ */
+#define PHASE_BEGIN(phase)      prof_phase_begin(phase)
+#define PHASE_END(phase)        prof_phase_end(phase)
+
+
+/**
+ * @brief This function starts a new wake cycle (call it first in app_main)
+ */
+void prof_init();
+
+
+void prof_phase_begin(enum _phase phase);
+
+
+void prof_phase_end(enum _phase phase);
+
+
+/**
+ * @brief This function appends the samples of the RTC ring to prof.bin and empties the ring
+ * @param mount_point: Mount point of the SD card
+ * @return Number of samples written, -1 if the file could not be opened
+ */
+int prof_flush_sd(const char* mount_point);
+
+// ----------------------------------------------------------------- //
+#endif /* __PROF_ESP32_ */
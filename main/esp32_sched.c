@@ -0,0 +1,82 @@
+#include "esp32_sched.h"
+#include "esp32_general.h"
+
+// Historial entre ciclos (se pierde con un power-on)
+static RTC_DATA_ATTR uint32_t s_sched_magic;
+static RTC_DATA_ATTR uint8_t  s_sched_failures[SCHED_LINK_COUNT];
+static RTC_DATA_ATTR uint32_t s_sched_last_minutes;
+
+
+static const char* sched_link_name(uint8_t link){
+  switch (link) {
+    case SCHED_LINK_EDGE:  return "edge";
+    case SCHED_LINK_MODEM: return "modem";
+    default:               return "sin red";
+  }
+}
+
+
+int sched_next_minutes(const sched_cycle_t* cycle){
+  if (s_sched_magic != SCHED_MAGIC) {
+    s_sched_magic = SCHED_MAGIC;
+    memset(s_sched_failures, 0, sizeof(s_sched_failures));
+    s_sched_last_minutes = SCHED_DEFAULT_MINUTES;
+  }
+  uint8_t link = (cycle->link < SCHED_LINK_COUNT) ? cycle->link : SCHED_LINK_NONE;
+  int minutes = SCHED_DEFAULT_MINUTES;
+
+  if (link == SCHED_LINK_NONE || cycle->failed) {
+    // Backoff exponencial por enlace
+    if (s_sched_failures[link] < SCHED_MAX_BACKOFF) {
+      s_sched_failures[link]++;
+    }
+    minutes = SCHED_DEFAULT_MINUTES << s_sched_failures[link];
+  }
+  else {
+    // Con un enlace logrado el nodo volvio a zona: tambien termina el backoff de "sin red"
+    s_sched_failures[link] = 0;
+    s_sched_failures[SCHED_LINK_NONE] = 0;
+    if (link == SCHED_LINK_EDGE) {
+      // Un Edge con muchos registros nuevos se vacia antes; sin registros se espera mas.
+      // Tras un intervalo corto cuenta el ritmo: lo descargado llevado a SCHED_DEFAULT_MINUTES
+      if (cycle->fetched >= SCHED_BUSY_RECORDS ||
+          cycle->fetched * SCHED_DEFAULT_MINUTES >= SCHED_BUSY_RECORDS * s_sched_last_minutes) {
+        minutes = SCHED_MIN_MINUTES;
+      }
+      else if (cycle->fetched == 0) {
+        minutes = 2 * SCHED_DEFAULT_MINUTES;
+      }
+    }
+    else if (cycle->backlog > 0) {
+      // En el modem con registros pendientes: volvemos pronto a terminar el envio
+      minutes = SCHED_MIN_MINUTES;
+    }
+  }
+
+  uint32_t battery_mv = (uint32_t) (cycle->battery * 1000);
+  if (battery_mv > 0 && battery_mv < SCHED_CRITICAL_BATTERY_MV) {
+    minutes = SCHED_MAX_MINUTES;
+  }
+  else if (battery_mv > 0 && battery_mv < SCHED_LOW_BATTERY_MV) {
+    minutes *= 2;
+  }
+
+  if (minutes < SCHED_MIN_MINUTES) {
+    minutes = SCHED_MIN_MINUTES;
+  }
+  if (minutes > SCHED_MAX_MINUTES) {
+    minutes = SCHED_MAX_MINUTES;
+  }
+
+  ESP_LOGI(TAG_SCHED, "Enlace = %s%s, descargados = %lu, pendientes = %lu, bateria = %lu mV, fallos = %u -> %d min (antes %lu)\n",
+           sched_link_name(link), cycle->failed ? " (fallo)" : "", (unsigned long) cycle->fetched,
+           (unsigned long) cycle->backlog, (unsigned long) battery_mv, s_sched_failures[link],
+           minutes, (unsigned long) s_sched_last_minutes);
+  s_sched_last_minutes = minutes;
+  return minutes;
+}
+
+
+void sched_sleep(const sched_cycle_t* cycle){
+  sleep_ESP32(sched_next_minutes(cycle));
+}
@@ -0,0 +1,61 @@
+#ifndef __SCHED_ESP32_
+#define __SCHED_ESP32_
+// ----------------------------------------------------------------- //
+#include <stdint.h>
+
+#include "esp_attr.h"           // RTC_DATA_ATTR: the history survives deep sleep
+#include "esp_log.h"
+
+/* Define variables for the sleep scheduler (see Kconfig "Nodo Portable Configuration") */
+#define SCHED_MIN_MINUTES       CONFIG_NODO_SLEEP_MIN_MINUTES
+#define SCHED_DEFAULT_MINUTES   CONFIG_NODO_SLEEP_DEFAULT_MINUTES
+#define SCHED_MAX_MINUTES       CONFIG_NODO_SLEEP_MAX_MINUTES
+#define SCHED_BUSY_RECORDS      CONFIG_NODO_SLEEP_BUSY_RECORDS
+#define SCHED_LOW_BATTERY_MV    CONFIG_NODO_SLEEP_LOW_BATTERY_MV
+#define SCHED_CRITICAL_BATTERY_MV CONFIG_NODO_SLEEP_CRITICAL_BATTERY_MV
+#define SCHED_MAX_BACKOFF       6           // The backoff doubles up to 2^6 times the default interval
+#define SCHED_MAGIC             0x53434844  // "SCHD"
+
+#define TAG_SCHED               "SCHED_API"
+
+// Link reached in a wake cycle
+enum _sched_link{
+  SCHED_LINK_NONE  = 0,   // No AP (or the cycle ended before the Wi-Fi)
+  SCHED_LINK_EDGE  = 1,
+  SCHED_LINK_MODEM = 2,
+  SCHED_LINK_COUNT
+};
+
+
+/* What happened in this wake cycle (filled by app_main) */
+typedef struct {
+   uint8_t  link;          // enum _sched_link
+   uint8_t  failed;        // 1 = the work of the cycle could not be finished
+   uint32_t fetched;       // Records downloaded from the edge
+   uint32_t backlog;       // Records still pending in the SD card
+   float    battery;       // Battery voltage (0 = unknown)
+} sched_cycle_t;
+
+
+/**
+ * @brief This function picks the next sleep interval from this cycle and the
+ *        history kept in RTC memory:
+ *        - consecutive failures of a link double the interval (backoff); the
+ *          backoff of cycles without AP ends with the first link that works
+ *        - a busy edge (SCHED_BUSY_RECORDS or more, or that rate per
+ *          SCHED_DEFAULT_MINUTES after a shorter sleep) or an upload backlog
+ *          at the modem bring the next wake to the minimum; an idle edge doubles it
+ *        - a low battery doubles it, a critical battery sets the maximum
+ *        The result is kept between SCHED_MIN_MINUTES and SCHED_MAX_MINUTES
+ * @return Minutes to sleep
+ */
+int sched_next_minutes(const sched_cycle_t* cycle);
+
+
+/**
+ * @brief This function calls sched_next_minutes() and enters deep sleep
+ */
+void sched_sleep(const sched_cycle_t* cycle);
+
+// ----------------------------------------------------------------- //
+#endif /* __SCHED_ESP32_ */
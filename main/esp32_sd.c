@@ -1,102 +1,96 @@
 #include "esp32_sd.h"
+#include "esp32_mem.h"
 #include "credenciales.h"
 
-esp_err_t init_SD(sdmmc_card_t **out_card, sdmmc_host_t *out_host) {
-    esp_err_t ret_sd;
-
-    esp_vfs_fat_sdmmc_mount_config_t mount_config = {
-#ifdef CONFIG_EXAMPLE_FORMAT_IF_MOUNT_FAILED
-        .format_if_mount_failed = true,
-#else
-        .format_if_mount_failed = false,
-#endif // EXAMPLE_FORMAT_IF_MOUNT_FAILED
-        .max_files = 10,
-        .allocation_unit_size = 8 * 1024
-    };
-    sdmmc_card_t *card;
-    const char mount_point[] = MOUNT_POINT;
-    ESP_LOGI(TAG_SD, "Initializing SD card");
-    ESP_LOGI(TAG_SD, "Using SPI peripheral");
-
-    sdmmc_host_t host = SDSPI_HOST_DEFAULT();
-    *out_host = host;
-    host.max_freq_khz = 5000;   // Default freqz = 20 MHz (this value causes an issues with SD detector)
-    //host.max_freq_khz = 10000;
-
-    spi_bus_config_t bus_cfg = {
-        .mosi_io_num = PIN_SD_MOSI,
-        .miso_io_num = PIN_SD_MISO,
-        .sclk_io_num = PIN_SD_CLK,
-        .quadwp_io_num = -1,
-        .quadhd_io_num = -1,
-        .max_transfer_sz = 4092,
-    };
-    ret_sd = spi_bus_initialize(host.slot, &bus_cfg, SDSPI_DEFAULT_DMA);
-    if (ret_sd != ESP_OK) {
-        ESP_LOGE(TAG_SD, "Failed to initialize bus.");
-        return ret_sd;
-    }
+#include <stdarg.h>
+#include <stddef.h>
+#include <strings.h>
+#include <sys/param.h>
 
-    sdspi_device_config_t slot_config = SDSPI_DEVICE_CONFIG_DEFAULT();
-    slot_config.gpio_cs = PIN_SD_CS;
-    slot_config.host_id = host.slot;
+#include "esp_timer.h"
+#include "esp_random.h"
 
-    ESP_LOGI(TAG_SD, "Mounting filesystem");
-    ret_sd = esp_vfs_fat_sdspi_mount(mount_point, &host, &slot_config, &mount_config, &card);
+/*  Buffers de stdio de los logs e iteradores cerrados: el siguiente segmento que
+    se abre reutiliza uno en vez de pedirlo al heap. Solo la tarea principal usa los logs */
+static char* s_io_pool[SD_IO_POOL_SIZE];
+static int   s_io_pool_count = 0;
 
-    if (ret_sd != ESP_OK) {
-        if (ret_sd == ESP_FAIL) {
-            ESP_LOGE(TAG_SD, "Failed to mount filesystem. "
-                     "If you want the card to be formatted, set the CONFIG_EXAMPLE_FORMAT_IF_MOUNT_FAILED menuconfig option.");
-        } else {
-            ESP_LOGE(TAG_SD, "Failed to initialize the card (%s). "
-                     "Make sure SD card lines have pull-up resistors in place.", esp_err_to_name(ret_sd));
-        }
-        return ret_sd;
-    }
-    ESP_LOGI(TAG_SD, "Tarjeta SD conectada exitosamente\n");
 
-    // Card has been initialized, print its properties
-    sdmmc_card_print_info(stdout, card);
+// De la arena del ciclo (es memoria DMA) y si ya no entra, del heap
+static char* sd_io_buffer_get(){
+    if (s_io_pool_count > 0) {
+        return s_io_pool[--s_io_pool_count];
+    }
+    char* buffer = mem_alloc(SD_IO_BUFFER_SIZE);
+    return (buffer != NULL) ? buffer : heap_caps_malloc(SD_IO_BUFFER_SIZE, MALLOC_CAP_DMA);
+}
 
-    // Set the card pointer in the calling function
-    *out_card = card;
 
-    return ESP_OK;
+static void sd_io_buffer_put(char* buffer){
+    if (buffer == NULL) {
+        return;
+    }
+    if (s_io_pool_count < SD_IO_POOL_SIZE) {
+        s_io_pool[s_io_pool_count++] = buffer;
+        return;
+    }
+    mem_free(buffer);
 }
 
 
-esp_err_t eject_SD(sdmmc_card_t *card, sdmmc_host_t *host) {
-    const char mount_point[] = MOUNT_POINT;
-
-    esp_err_t unmount_result = esp_vfs_fat_sdcard_unmount(mount_point, card);
-    if (unmount_result != ESP_OK) {
-        ESP_LOGE(TAG_SD, "Failed to unmount SD card");
-        return unmount_result; // Return ESP_ERR with the specific error code
+/*  Abre un archivo con un buffer de stdio de SD_IO_BUFFER_SIZE en memoria DMA:
+    las escrituras/lecturas llegan a FatFs en bloques de varios sectores */
+static FILE* sd_fopen_buffered(const char* file_path, const char* mode, char** buffer){
+    FILE* f = fopen(file_path, mode);
+    if (f == NULL) {
+        return NULL;
     }
+    if (*buffer == NULL) {
+        *buffer = sd_io_buffer_get();
+    }
+    // Sin memoria se queda con el buffer por defecto
+    if (*buffer != NULL) {
+        setvbuf(f, *buffer, _IOFBF, SD_IO_BUFFER_SIZE);
+    }
+    return f;
+}
 
-    // Deinitialize the bus after all devices are removed
-    esp_err_t bus_free_result = spi_bus_free(host->slot);
-    if (bus_free_result != ESP_OK) {
-        ESP_LOGE(TAG_SD, "Failed to free SPI bus");
-        return bus_free_result; // Return ESP_ERR with the specific error code
+
+esp_err_t sd_path(char* path, size_t size, const char* format, ...){
+    int prefix = snprintf(path, size, "%s/", MOUNT_POINT);
+    int length = -1;
+    if (prefix >= 0 && (size_t) prefix < size) {
+        va_list args;
+        va_start(args, format);
+        length = vsnprintf(path + prefix, size - prefix, format, args);
+        va_end(args);
     }
-    
-    return ESP_OK; // Return ESP_OK when everything is successful
+    if (length < 0 || (size_t) (prefix + length) >= size) {
+        ESP_LOGE(TAG_SD, "Nombre demasiado largo para %u bytes (formato '%s')\n", (unsigned) size, format);
+        if (size > 0) {
+            path[0] = '\0';
+        }
+        return ESP_ERR_INVALID_SIZE;
+    }
+    return ESP_OK;
 }
 
 
 int file_exists(const char* file_name){
-    char file_path[50];
-    sprintf(file_path, "%s/%s", MOUNT_POINT, file_name);
+    char file_path[SD_PATH_SIZE];
+    if (sd_path(file_path, sizeof(file_path), "%s", file_name) != ESP_OK) {
+        return 0;
+    }
     return (access(file_path, F_OK) == 0 ? 1 : 0);
 }
 
 
 
 esp_err_t guardar_file_sd(char* buffer, char* name_file){
-    char new_file_name[50];
-    sprintf(new_file_name, "%s/%s",MOUNT_POINT, name_file);
+    char new_file_name[SD_PATH_SIZE];
+    if (sd_path(new_file_name, sizeof(new_file_name), "%s", name_file) != ESP_OK) {
+        return ESP_FAIL;
+    }
     FILE* f = fopen(new_file_name, "w");
     if (f == NULL) {
         ESP_LOGE(TAG_SD, "No se pudo escribir el archivo: %s\n", name_file);
@@ -110,8 +104,10 @@ esp_err_t guardar_file_sd(char* buffer, char* name_file){
 
 
 esp_err_t append_file_sd(char* buffer, char* name_file){
-    char new_file_name[50];
-    sprintf(new_file_name, "%s%s", MOUNT_POINT, name_file);
+    char new_file_name[SD_PATH_SIZE];
+    if (sd_path(new_file_name, sizeof(new_file_name), "%s", name_file) != ESP_OK) {
+        return ESP_FAIL;
+    }
     FILE* f = fopen(new_file_name, "a"); // Open in append mode ("a")
     if (f == NULL) {
         ESP_LOGE(TAG_SD, "No se pudo escribir el archivo: %s\n", name_file);
@@ -126,9 +122,11 @@ esp_err_t append_file_sd(char* buffer, char* name_file){
 
 size_t leer_file_sd(const char *name_file, char* buffer_read, size_t size_buffer)
 {
-    char new_file_name[50];
+    char new_file_name[SD_PATH_SIZE];
     memset(buffer_read, 0, size_buffer);
-    sprintf(new_file_name, "%s/%s",MOUNT_POINT, name_file);
+    if (sd_path(new_file_name, sizeof(new_file_name), "%s", name_file) != ESP_OK) {
+        return 0;
+    }
 
     ESP_LOGI(TAG_SD, "Reading file %s", name_file);
     FILE* f = fopen(new_file_name, "r");
@@ -138,21 +136,22 @@ size_t leer_file_sd(const char *name_file, char* buffer_read, size_t size_buffer
         return 0;
     }
 
+    // Un solo fopen y un fclose en cada salida: los handles de FatFs son pocos (max_files)
     fseek(f, 0, SEEK_END); // Move the file pointer to the end of the file
-    size_t file_size = ftell(f);
-    if( file_size >= size_buffer ){
-        ESP_LOGE(TAG_SD, "Size of data readed [%d] >= size buffer [%d]\n", file_size, size_buffer);
+    long file_size = ftell(f);
+    if (file_size < 0) {
+        ESP_LOGE(TAG_SD, "Failed to get file size: %s", name_file);
+        fclose(f);
         return 0;
     }
-    if (file_size == -1) {
-        ESP_LOGE(TAG_SD, "Failed to get file size: %s", name_file);
+    if( (size_t) file_size >= size_buffer ){
+        ESP_LOGE(TAG_SD, "Size of data readed [%ld] >= size buffer [%u]\n", file_size, (unsigned) size_buffer);
+        fclose(f);
         return 0;
     }
-    fclose(f);
 
-    f = fopen(new_file_name, "r");
-    size_t bytes_read;
-    bytes_read = fread(buffer_read, 1, size_buffer, f);
+    fseek(f, 0, SEEK_SET);
+    size_t bytes_read = fread(buffer_read, 1, file_size, f);
     fclose(f);
 
     if (bytes_read == 0) {
@@ -165,8 +164,10 @@ size_t leer_file_sd(const char *name_file, char* buffer_read, size_t size_buffer
 
 
 esp_err_t delete_file_sd(const char *name_file) {
-    char file_path[50];
-    sprintf(file_path, "%s/%s", MOUNT_POINT, name_file);
+    char file_path[SD_PATH_SIZE];
+    if (sd_path(file_path, sizeof(file_path), "%s", name_file) != ESP_OK) {
+        return ESP_FAIL;
+    }
 
     // Use the remove() function to delete the file
     int result = remove(file_path);
@@ -183,8 +184,10 @@ esp_err_t delete_file_sd(const char *name_file) {
 // This function create a new file with initial content
 // WARNING: name_file can NOT exceed 8 characters
 esp_err_t create_file(const char *name_file, const char* initial_content){
-    char file_path[50];
-    sprintf(file_path, "%s/%s", MOUNT_POINT, name_file);
+    char file_path[SD_PATH_SIZE];
+    if (sd_path(file_path, sizeof(file_path), "%s", name_file) != ESP_OK) {
+        return ESP_FAIL;
+    }
 
     ESP_LOGI(TAG_SD, "Creating the folder: %s", name_file);
 
@@ -202,3 +205,1207 @@ esp_err_t create_file(const char *name_file, const char* initial_content){
 }
 
 
+
+
+/* ----------------------------------------------------------------- */
+/*                          RECORD LOG                                */
+/* ----------------------------------------------------------------- */
+
+/*  Metadata files keep two copies in separate sectors, written alternately.
+    Each copy is: magic, generation, payload, CRC32. A write cut by a reset
+    only damages the copy being written, the other one stays valid */
+#define SD_META_HEADER      (2 * sizeof(uint32_t))
+#define SD_META_PAYLOAD_MAX 32
+
+
+// Abre un archivo de metadatos; al crearlo se reservan las dos copias para no volver a crecer
+static FILE* sd_meta_open(const char* file_path){
+    FILE* f = fopen(file_path, "r+b");
+    if (f == NULL) {
+        f = fopen(file_path, "w+b");
+        if (f != NULL) {
+            static const uint8_t zeros[2 * SD_META_SLOT];
+            fwrite(zeros, 1, sizeof(zeros), f);
+        }
+    }
+    return f;
+}
+
+
+// Escribe la siguiente generacion en la copia que no es la mas nueva
+static esp_err_t sd_meta_write(FILE* f, uint32_t magic, uint32_t* generation, const void* payload, size_t size){
+    uint8_t copy[SD_META_HEADER + SD_META_PAYLOAD_MAX + sizeof(uint32_t)];
+    uint32_t next = *generation + 1;
+    memcpy(copy, &magic, sizeof(uint32_t));
+    memcpy(copy + sizeof(uint32_t), &next, sizeof(uint32_t));
+    memcpy(copy + SD_META_HEADER, payload, size);
+    uint32_t crc = esp_rom_crc32_le(0, copy, SD_META_HEADER + size);
+    memcpy(copy + SD_META_HEADER + size, &crc, sizeof(uint32_t));
+
+    size_t length = SD_META_HEADER + size + sizeof(uint32_t);
+    if (fseek(f, (next & 1) * SD_META_SLOT, SEEK_SET) != 0 || fwrite(copy, 1, length, f) != length) {
+        return ESP_FAIL;
+    }
+    fflush(f);
+    fsync(fileno(f));
+    *generation = next;
+    return ESP_OK;
+}
+
+
+// Lee la copia valida mas nueva. Retorna 0 si ninguna es valida
+static int sd_meta_read(FILE* f, uint32_t magic, uint32_t* generation, void* payload, size_t size){
+    uint8_t copies[2][SD_META_HEADER + SD_META_PAYLOAD_MAX + sizeof(uint32_t)];
+    uint32_t generations[2];
+    int valid[2] = { 0, 0 };
+    int written[2] = { 0, 0 };    // Con el magic: la copia se escribio alguna vez
+    size_t length = SD_META_HEADER + size + sizeof(uint32_t);
+    for (int i = 0; i < 2; i++) {
+        if (fseek(f, i * SD_META_SLOT, SEEK_SET) != 0 || fread(copies[i], 1, length, f) != length) {
+            continue;
+        }
+        uint32_t copy_magic, crc;
+        memcpy(&copy_magic, copies[i], sizeof(uint32_t));
+        memcpy(&generations[i], copies[i] + sizeof(uint32_t), sizeof(uint32_t));
+        memcpy(&crc, copies[i] + SD_META_HEADER + size, sizeof(uint32_t));
+        written[i] = (copy_magic == magic);
+        valid[i] = written[i] && crc == esp_rom_crc32_le(0, copies[i], SD_META_HEADER + size);
+    }
+    if (!valid[0] && !valid[1]) {
+        return 0;
+    }
+
+    // La resta tolera el desborde de la generacion
+    int newest = !valid[0] ? 1 : !valid[1] ? 0 :
+                 ((int32_t) (generations[1] - generations[0]) > 0) ? 1 : 0;
+    if (written[!newest] && !valid[!newest]) {
+        ESP_LOGW(TAG_SD, "Metadatos: copia %d danada, se usa la copia %d\n", !newest, newest);
+    }
+    *generation = generations[newest];
+    memcpy(payload, copies[newest] + SD_META_HEADER, size);
+    return 1;
+}
+
+
+/* Index file of older firmware: one copy of the head */
+typedef struct {
+    uint32_t          magic;
+    sd_log_cursor_t   head;
+    uint32_t          crc;
+} sd_log_index_v1_t;
+
+
+// Segment number in hexadecimal: "sa_" + 5 digits = 8 characters (FAT 8.3)
+static void sd_log_segment_path(const sd_log_t* log, uint32_t segment, char* path, size_t size){
+    sd_path(path, size, "%s%05lX.log", log->prefix, (unsigned long) segment);
+}
+
+
+/* Index file: only the head is stored, the tail is recovered from the segments */
+static esp_err_t sd_log_write_index(sd_log_t* log){
+    char file_path[SD_PATH_SIZE];
+    sd_path(file_path, sizeof(file_path), "%s.idx", log->index_name);
+
+    // Sobrescribimos el mismo archivo para no crear/borrar entradas en el directorio
+    FILE* f = sd_meta_open(file_path);
+    if (f == NULL) {
+        ESP_LOGE(TAG_SD, "No se pudo escribir el indice: %s\n", file_path);
+        return ESP_FAIL;
+    }
+    esp_err_t ret = sd_meta_write(f, SD_LOG_INDEX_MAGIC, &log->index_generation, &log->head, sizeof(log->head));
+    fclose(f);
+    return ret;
+}
+
+
+static int sd_log_read_index(sd_log_t* log, sd_log_cursor_t* head){
+    char file_path[SD_PATH_SIZE];
+    sd_path(file_path, sizeof(file_path), "%s.idx", log->index_name);
+
+    FILE* f = fopen(file_path, "rb");
+    if (f == NULL) {
+        return 0;
+    }
+    if (sd_meta_read(f, SD_LOG_INDEX_MAGIC, &log->index_generation, head, sizeof(*head))) {
+        fclose(f);
+        return 1;
+    }
+
+    // Indice de una version anterior: se reescribe en el formato nuevo en el siguiente commit
+    sd_log_index_v1_t old;
+    int has_old = fseek(f, 0, SEEK_SET) == 0 && fread(&old, 1, sizeof(old), f) == sizeof(old) &&
+                  old.magic == SD_LOG_INDEX_MAGIC_V1 &&
+                  old.crc == esp_rom_crc32_le(0, (const uint8_t*) &old, offsetof(sd_log_index_v1_t, crc));
+    fclose(f);
+    if (!has_old) {
+        ESP_LOGE(TAG_SD, "Indice invalido: %s\n", file_path);
+        return 0;
+    }
+    log->index_generation = 0;
+    *head = old.head;
+    return 1;
+}
+
+
+// Busca el primer y ultimo segmento del log en el directorio raiz
+static int sd_log_find_segments(const sd_log_t* log, uint32_t* first, uint32_t* last){
+    DIR* dir = opendir(MOUNT_POINT);
+    if (dir == NULL) {
+        ESP_LOGE(TAG_SD, "No se pudo abrir el directorio %s\n", MOUNT_POINT);
+        return 0;
+    }
+
+    int count = 0;
+    size_t prefix_len = strlen(log->prefix);
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        // Sin LFN los nombres se devuelven en mayusculas
+        if (strncasecmp(entry->d_name, log->prefix, prefix_len) != 0) {
+            continue;
+        }
+        const char* extension = strchr(entry->d_name, '.');
+        if (extension == NULL || strcasecmp(extension, ".log") != 0) {
+            continue;
+        }
+        char* end_number;
+        uint32_t segment = strtoul(entry->d_name + prefix_len, &end_number, 16);
+        if (end_number != extension) {
+            continue;
+        }
+        if (count == 0 || segment < *first) {
+            *first = segment;
+        }
+        if (count == 0 || segment > *last) {
+            *last = segment;
+        }
+        count++;
+    }
+    closedir(dir);
+    return count;
+}
+
+
+// CRC32 del registro = CRC del payload seguido del encabezado (con crc = 0).
+// Asi se puede calcular mientras se escribe/lee el payload por bloques
+static uint32_t sd_log_record_crc_end(uint32_t payload_crc, const sd_log_record_t* record){
+    sd_log_record_t header = *record;
+    header.crc = 0;
+    return esp_rom_crc32_le(payload_crc, (const uint8_t*) &header, sizeof(header));
+}
+
+
+// Calcula el CRC de un registro leyendo el payload por bloques desde el archivo
+static uint32_t sd_log_record_crc_file(FILE* f, const sd_log_record_t* record){
+    uint8_t chunk[128];
+    uint32_t crc = 0;
+    uint32_t remaining = record->length;
+    while (remaining > 0) {
+        size_t to_read = MIN(remaining, sizeof(chunk));
+        if (fread(chunk, 1, to_read, f) != to_read) {
+            return ~record->crc;
+        }
+        crc = esp_rom_crc32_le(crc, chunk, to_read);
+        remaining -= to_read;
+    }
+    return sd_log_record_crc_end(crc, record);
+}
+
+
+/*  Recorre los registros del ultimo segmento para encontrar la cola. Si el
+    ultimo registro quedo incompleto (corte de energia) se trunca el archivo */
+static esp_err_t sd_log_recover_tail(sd_log_t* log, uint32_t segment, int* records_found){
+    char file_path[SD_PATH_SIZE];
+    sd_log_segment_path(log, segment, file_path, sizeof(file_path));
+    *records_found = 0;
+
+    FILE* f = fopen(file_path, "r+b");
+    if (f == NULL) {
+        ESP_LOGE(TAG_SD, "No se pudo abrir el segmento: %s\n", file_path);
+        return ESP_FAIL;
+    }
+    fseek(f, 0, SEEK_END);
+    long file_size = ftell(f);
+
+    sd_log_record_t record;
+    sd_log_record_t last_record;
+    long offset = 0;
+    long last_offset = -1;
+    while (offset + (long) sizeof(record) <= file_size) {
+        fseek(f, offset, SEEK_SET);
+        if (fread(&record, 1, sizeof(record), f) != sizeof(record) ||
+            record.magic != SD_LOG_RECORD_MAGIC ||
+            offset + (long) sizeof(record) + (long) record.length > file_size) {
+            break;
+        }
+        last_offset = offset;
+        last_record = record;
+        offset += sizeof(record) + record.length;
+        (*records_found)++;
+    }
+
+    // Solo el ultimo registro puede haber quedado a medias, verificamos su CRC
+    uint32_t next_seq = log->tail.seq;
+    if (last_offset >= 0) {
+        fseek(f, last_offset + sizeof(last_record), SEEK_SET);
+        if (sd_log_record_crc_file(f, &last_record) != last_record.crc) {
+            ESP_LOGE(TAG_SD, "Registro %lu incompleto en %s, se descarta\n",
+                     (unsigned long) last_record.seq, file_path);
+            offset = last_offset;
+            (*records_found)--;
+        }
+        next_seq = last_record.seq + (offset == last_offset ? 0 : 1);
+    }
+
+    if (offset < file_size) {
+        ESP_LOGE(TAG_SD, "Truncando %s de %ld a %ld bytes\n", file_path, file_size, offset);
+        fflush(f);
+        ftruncate(fileno(f), offset);
+    }
+    fclose(f);
+
+    log->tail.segment = segment;
+    log->tail.offset  = offset;
+    log->tail.seq     = next_seq;
+    return ESP_OK;
+}
+
+
+// Lee el numero de secuencia del primer registro de un segmento
+static int sd_log_first_seq(const sd_log_t* log, uint32_t segment, uint32_t* seq){
+    char file_path[SD_PATH_SIZE];
+    sd_log_segment_path(log, segment, file_path, sizeof(file_path));
+    FILE* f = fopen(file_path, "rb");
+    if (f == NULL) {
+        return 0;
+    }
+    sd_log_record_t record;
+    size_t bytes_read = fread(&record, 1, sizeof(record), f);
+    fclose(f);
+    if (bytes_read != sizeof(record) || record.magic != SD_LOG_RECORD_MAGIC) {
+        return 0;
+    }
+    *seq = record.seq;
+    return 1;
+}
+
+
+esp_err_t sd_log_open(sd_log_t* log, const char* prefix, const char* index_name){
+    memset(log, 0, sizeof(sd_log_t));
+    strncpy(log->prefix, prefix, sizeof(log->prefix) - 1);
+    strncpy(log->index_name, index_name, sizeof(log->index_name) - 1);
+
+    sd_log_cursor_t index_head;
+    int has_index = sd_log_read_index(log, &index_head);
+    if (has_index) {
+        log->tail.seq = index_head.seq;
+    }
+
+    uint32_t first_segment = 0;
+    uint32_t last_segment = 0;
+    if (sd_log_find_segments(log, &first_segment, &last_segment) == 0) {
+        // Log vacio: la siguiente escritura crea el segmento
+        log->tail.segment = has_index ? index_head.segment : 0;
+        log->tail.offset  = 0;
+        log->head = log->tail;
+        ESP_LOGI(TAG_SD, "Log '%s' vacio\n", log->prefix);
+        return ESP_OK;
+    }
+
+    // Los segmentos vacios al final (creados justo antes de un corte) se eliminan
+    int records_found = 0;
+    while (1) {
+        if (sd_log_recover_tail(log, last_segment, &records_found) != ESP_OK) {
+            return ESP_FAIL;
+        }
+        if (records_found > 0 || last_segment == first_segment) {
+            break;
+        }
+        char file_path[SD_PATH_SIZE];
+        sd_log_segment_path(log, last_segment, file_path, sizeof(file_path));
+        remove(file_path);
+        last_segment--;
+    }
+
+    if (has_index && index_head.segment >= first_segment &&
+        (index_head.segment < log->tail.segment ||
+        (index_head.segment == log->tail.segment && index_head.offset <= log->tail.offset))) {
+        log->head = index_head;
+
+        // Segmentos ya confirmados: el corte llego entre el indice y el borrado de sd_log_commit()
+        char file_path[SD_PATH_SIZE];
+        for (uint32_t segment = first_segment; segment < log->head.segment; segment++) {
+            sd_log_segment_path(log, segment, file_path, sizeof(file_path));
+            remove(file_path);
+        }
+    }
+    else {
+        // Sin indice valido volvemos al primer segmento: se reenvian registros pero no se pierden.
+        // Sin indice es normal: todavia no se confirmo ningun registro del log
+        if (has_index) {
+            ESP_LOGE(TAG_SD, "Log '%s' sin indice valido, se reinicia desde el segmento %lu\n",
+                     log->prefix, (unsigned long) first_segment);
+        }
+        log->head.segment = first_segment;
+        log->head.offset  = 0;
+        if (!sd_log_first_seq(log, first_segment, &log->head.seq)) {
+            log->head.seq = log->tail.seq;
+        }
+    }
+
+    ESP_LOGI(TAG_SD, "Log '%s': segmentos %lu-%lu, registros pendientes = %lu\n", log->prefix,
+             (unsigned long) log->head.segment, (unsigned long) log->tail.segment,
+             (unsigned long) sd_log_pending(log));
+    return ESP_OK;
+}
+
+
+void sd_log_close(sd_log_t* log){
+    if (log->writer != NULL) {
+        fclose(log->writer);
+        log->writer = NULL;
+    }
+    // El buffer se devuelve despues de fclose(): stdio lo usa hasta el ultimo flush
+    sd_io_buffer_put(log->writer_buffer);
+    log->writer_buffer = NULL;
+}
+
+
+esp_err_t sd_log_append_begin(sd_log_t* log){
+    // Abrimos (o rotamos) el segmento de escritura
+    if (log->writer == NULL || log->sealed || log->tail.offset >= SD_LOG_SEGMENT_SIZE) {
+        sd_log_close(log);
+        if ((log->sealed || log->tail.offset >= SD_LOG_SEGMENT_SIZE) && log->tail.offset > 0) {
+            log->tail.segment++;
+            log->tail.offset = 0;
+        }
+        log->sealed = 0;
+
+        char file_path[SD_PATH_SIZE];
+        sd_log_segment_path(log, log->tail.segment, file_path, sizeof(file_path));
+        log->writer = sd_fopen_buffered(file_path, "r+b", &log->writer_buffer);
+        if (log->writer == NULL) {
+            log->writer = sd_fopen_buffered(file_path, "w+b", &log->writer_buffer);
+        }
+        if (log->writer == NULL) {
+            ESP_LOGE(TAG_SD, "No se pudo abrir el segmento: %s\n", file_path);
+            return ESP_FAIL;
+        }
+    }
+
+    // Encabezado provisional con magic = 0: si se corta la energia antes de
+    // sd_log_append_end() el registro se descarta al abrir el log
+    sd_log_record_t record = { 0 };
+    fseek(log->writer, log->tail.offset, SEEK_SET);
+    if (fwrite(&record, 1, sizeof(record), log->writer) != sizeof(record)) {
+        ESP_LOGE(TAG_SD, "Fallo al escribir el encabezado en '%s'\n", log->prefix);
+        sd_log_close(log);
+        return ESP_FAIL;
+    }
+    log->pending_length = 0;
+    log->pending_crc    = 0;
+    log->pending_flags  = 0;
+    return ESP_OK;
+}
+
+
+esp_err_t sd_log_append_write(sd_log_t* log, const char* data, size_t length){
+    if (log->writer == NULL) {
+        return ESP_FAIL;
+    }
+    if (fwrite(data, 1, length, log->writer) != length) {
+        ESP_LOGE(TAG_SD, "Fallo al escribir el registro %lu en '%s'\n",
+                 (unsigned long) log->tail.seq, log->prefix);
+        return ESP_FAIL;
+    }
+    log->pending_crc = esp_rom_crc32_le(log->pending_crc, (const uint8_t*) data, length);
+    log->pending_length += length;
+    return ESP_OK;
+}
+
+
+esp_err_t sd_log_append_end(sd_log_t* log){
+    if (log->writer == NULL) {
+        return ESP_FAIL;
+    }
+    sd_log_record_t record = {
+        .magic  = SD_LOG_RECORD_MAGIC,
+        .flags  = log->pending_flags,
+        .seq    = log->tail.seq,
+        .length = log->pending_length,
+    };
+    record.crc = sd_log_record_crc_end(log->pending_crc, &record);
+
+    // El registro solo es valido cuando el encabezado definitivo llega a la SD
+    fseek(log->writer, log->tail.offset, SEEK_SET);
+    size_t written = fwrite(&record, 1, sizeof(record), log->writer);
+    fflush(log->writer);
+    if (written != sizeof(record) || fsync(fileno(log->writer)) != 0) {
+        ESP_LOGE(TAG_SD, "Fallo al cerrar el registro %lu en '%s'\n",
+                 (unsigned long) record.seq, log->prefix);
+        sd_log_append_abort(log);
+        return ESP_FAIL;
+    }
+
+    log->tail.offset += sizeof(record) + record.length;
+    log->tail.seq++;
+    return ESP_OK;
+}
+
+
+void sd_log_append_abort(sd_log_t* log){
+    if (log->writer == NULL) {
+        return;
+    }
+    // Quitamos lo que se haya escrito para no dejar un registro a medias
+    fflush(log->writer);
+    ftruncate(fileno(log->writer), log->tail.offset);
+    sd_log_close(log);
+}
+
+
+esp_err_t sd_log_append(sd_log_t* log, const char* data, size_t length){
+    return sd_log_append_flags(log, data, length, 0);
+}
+
+
+esp_err_t sd_log_append_flags(sd_log_t* log, const char* data, size_t length, uint16_t flags){
+    if (sd_log_append_begin(log) != ESP_OK) {
+        return ESP_FAIL;
+    }
+    log->pending_flags = flags;
+    if (sd_log_append_write(log, data, length) != ESP_OK) {
+        sd_log_append_abort(log);
+        return ESP_FAIL;
+    }
+    return sd_log_append_end(log);
+}
+
+
+uint32_t sd_log_pending(const sd_log_t* log){
+    return log->tail.seq - log->head.seq;
+}
+
+
+void sd_log_iter_begin(sd_log_t* log, sd_log_iter_t* iter){
+    // FatFs no permite leer y escribir el mismo archivo a la vez:
+    // lo que se agregue durante la iteracion va a un segmento nuevo
+    sd_log_close(log);
+    log->sealed = 1;
+
+    iter->log            = log;
+    iter->pos            = log->head;
+    iter->end            = log->tail;
+    iter->reader         = NULL;
+    iter->reader_buffer  = NULL;
+    iter->reader_segment = 0;
+    iter->reader_size    = 0;
+    iter->quarantine     = NULL;
+}
+
+
+static void sd_log_iter_next_segment(sd_log_iter_t* iter){
+    iter->pos.segment++;
+    iter->pos.offset = 0;
+}
+
+
+/*  Copia length bytes del segmento abierto (desde offset, tal cual estan) a la
+    cuarentena del iterador. El lector queda en cualquier posicion: quien llama
+    vuelve a hacer fseek antes de leer. Retorna ESP_ERR_INVALID_STATE sin cuarentena
+    y ESP_FAIL si la copia no quedo completa en la SD: los bytes no se pueden saltar */
+static esp_err_t sd_log_quarantine(sd_log_iter_t* iter, uint32_t offset, uint32_t length, uint16_t flags){
+    if (iter->quarantine == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (length == 0) {
+        return ESP_OK;
+    }
+    char chunk[256];
+    sd_log_t* quarantine = iter->quarantine;
+    if (fseek(iter->reader, offset, SEEK_SET) != 0 || sd_log_append_begin(quarantine) != ESP_OK) {
+        ESP_LOGE(TAG_SD, "No se pudo copiar '%s' segmento %lu offset %lu a la cuarentena\n",
+                 iter->log->prefix, (unsigned long) iter->reader_segment, (unsigned long) offset);
+        return ESP_FAIL;
+    }
+    quarantine->pending_flags = flags | SD_LOG_FLAG_CORRUPT;
+    while (length > 0) {
+        size_t to_read = MIN(length, sizeof(chunk));
+        size_t read = fread(chunk, 1, to_read, iter->reader);
+        if (read == 0 || sd_log_append_write(quarantine, chunk, read) != ESP_OK) {
+            break;
+        }
+        length -= read;
+    }
+    // Una copia a medias no sirve: se descarta y los bytes quedan en el log
+    if (length > 0) {
+        sd_log_append_abort(quarantine);
+    }
+    if (length > 0 || sd_log_append_end(quarantine) != ESP_OK) {
+        ESP_LOGE(TAG_SD, "No se pudo copiar '%s' segmento %lu offset %lu a la cuarentena\n",
+                 iter->log->prefix, (unsigned long) iter->reader_segment, (unsigned long) offset);
+        return ESP_FAIL;
+    }
+    ESP_LOGW(TAG_SD, "Bytes danados de '%s' segmento %lu offset %lu en cuarentena (registro %lu de '%s')\n",
+             iter->log->prefix, (unsigned long) iter->reader_segment, (unsigned long) offset,
+             (unsigned long) (quarantine->tail.seq - 1), quarantine->prefix);
+    return ESP_OK;
+}
+
+
+esp_err_t sd_log_iter_next_record(sd_log_iter_t* iter, sd_log_record_t* record){
+    iter->remaining = 0;
+
+    while (1) {
+        if (iter->pos.segment > iter->end.segment ||
+           (iter->pos.segment == iter->end.segment && iter->pos.offset >= iter->end.offset)) {
+            return ESP_ERR_NOT_FOUND;
+        }
+
+        if (iter->reader == NULL || iter->reader_segment != iter->pos.segment) {
+            sd_log_iter_end(iter);
+            char file_path[SD_PATH_SIZE];
+            sd_log_segment_path(iter->log, iter->pos.segment, file_path, sizeof(file_path));
+            iter->reader = sd_fopen_buffered(file_path, "rb", &iter->reader_buffer);
+            if (iter->reader == NULL) {
+                ESP_LOGE(TAG_SD, "No se pudo abrir el segmento: %s\n", file_path);
+                if (iter->pos.segment == iter->end.segment) {
+                    return ESP_FAIL;
+                }
+                sd_log_iter_next_segment(iter);
+                continue;
+            }
+            iter->reader_segment = iter->pos.segment;
+            fseek(iter->reader, 0, SEEK_END);
+            long reader_size = ftell(iter->reader);
+            iter->reader_size = (reader_size > 0) ? (uint32_t) reader_size : 0;
+        }
+
+        fseek(iter->reader, iter->pos.offset, SEEK_SET);
+        if (fread(record, 1, sizeof(sd_log_record_t), iter->reader) != sizeof(sd_log_record_t)) {
+            // Fin del segmento
+            if (iter->pos.segment == iter->end.segment) {
+                return ESP_FAIL;
+            }
+            sd_log_iter_next_segment(iter);
+            continue;
+        }
+        break;
+    }
+
+    uint32_t payload_offset = iter->pos.offset + sizeof(sd_log_record_t);
+    if (record->magic != SD_LOG_RECORD_MAGIC || record->length > iter->reader_size - payload_offset) {
+        // Sin un encabezado valido no se puede saber donde empieza el siguiente registro
+        ESP_LOGE(TAG_SD, "Encabezado corrupto en '%s' segmento %lu offset %lu, se salta el segmento\n",
+                 iter->log->prefix, (unsigned long) iter->pos.segment, (unsigned long) iter->pos.offset);
+        if (sd_log_quarantine(iter, iter->pos.offset, iter->reader_size - iter->pos.offset, 0) == ESP_FAIL) {
+            // El iterador no avanza: el resto del segmento se vuelve a leer en otro recorrido
+            return ESP_FAIL;
+        }
+        if (iter->pos.segment == iter->end.segment) {
+            iter->pos = iter->end;
+        }
+        else {
+            sd_log_iter_next_segment(iter);
+        }
+        return ESP_ERR_INVALID_CRC;
+    }
+
+    // El cursor avanza aunque el payload no se lea (registro saltado)
+    iter->current        = *record;
+    iter->payload_offset = payload_offset;
+    iter->remaining      = record->length;
+    iter->crc            = 0;
+    iter->pos.offset    += sizeof(sd_log_record_t) + record->length;
+    iter->pos.seq        = record->seq + 1;
+    return ESP_OK;
+}
+
+
+int sd_log_iter_read(sd_log_iter_t* iter, char* buffer, size_t size_buffer){
+    if (iter->remaining == 0) {
+        return 0;
+    }
+    size_t to_read = MIN(iter->remaining, size_buffer);
+    if (fread(buffer, 1, to_read, iter->reader) != to_read) {
+        ESP_LOGE(TAG_SD, "No se pudo leer el registro %lu\n", (unsigned long) iter->current.seq);
+        iter->remaining = 0;
+        return SD_LOG_READ_FAIL;
+    }
+    iter->crc = esp_rom_crc32_le(iter->crc, (const uint8_t*) buffer, to_read);
+    iter->remaining -= to_read;
+
+    // Se valida el CRC antes de entregar el ultimo bloque
+    if (iter->remaining == 0 && sd_log_record_crc_end(iter->crc, &iter->current) != iter->current.crc) {
+        ESP_LOGE(TAG_SD, "CRC invalido en el registro %lu\n", (unsigned long) iter->current.seq);
+        if (sd_log_quarantine(iter, iter->payload_offset, iter->current.length, iter->current.flags) == ESP_FAIL) {
+            return SD_LOG_READ_FAIL;
+        }
+        return SD_LOG_READ_CORRUPT;
+    }
+    return to_read;
+}
+
+
+esp_err_t sd_log_iter_rewind_record(sd_log_iter_t* iter){
+    if (iter->reader == NULL || fseek(iter->reader, iter->payload_offset, SEEK_SET) != 0) {
+        return ESP_FAIL;
+    }
+    iter->remaining = iter->current.length;
+    iter->crc       = 0;
+    return ESP_OK;
+}
+
+
+esp_err_t sd_log_iter_next(sd_log_iter_t* iter, char* buffer, size_t size_buffer, size_t* out_length){
+    sd_log_record_t record;
+    sd_log_cursor_t pos = iter->pos;
+    *out_length = 0;
+
+    esp_err_t ret_log = sd_log_iter_next_record(iter, &record);
+    if (ret_log != ESP_OK) {
+        return ret_log;
+    }
+
+    if (record.length >= size_buffer) {
+        ESP_LOGE(TAG_SD, "Registro %lu de %lu bytes >= size buffer [%u]\n",
+                 (unsigned long) record.seq, (unsigned long) record.length, (unsigned) size_buffer);
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    buffer[0] = '\0';
+    int read = (record.length > 0) ? sd_log_iter_read(iter, buffer, size_buffer) : 0;
+    if (read == SD_LOG_READ_FAIL) {
+        // El registro no se leyo ni se copio: un commit de iter->pos no lo puede saltar
+        iter->pos = pos;
+        return ESP_FAIL;
+    }
+    if (read != (int) record.length) {
+        return ESP_ERR_INVALID_CRC;
+    }
+    buffer[record.length] = '\0';
+
+    *out_length = record.length;
+    return ESP_OK;
+}
+
+
+esp_err_t sd_log_copy_record(sd_log_t* log, sd_log_iter_t* iter, char* chunk, size_t chunk_size){
+    if (sd_log_iter_rewind_record(iter) != ESP_OK || sd_log_append_begin(log) != ESP_OK) {
+        return ESP_FAIL;
+    }
+    log->pending_flags = iter->current.flags;
+    int chunk_len;
+    while ((chunk_len = sd_log_iter_read(iter, chunk, chunk_size)) > 0) {
+        if (sd_log_append_write(log, chunk, chunk_len) != ESP_OK) {
+            break;
+        }
+    }
+    if (chunk_len != 0) {
+        sd_log_append_abort(log);
+        return ESP_FAIL;
+    }
+    return sd_log_append_end(log);
+}
+
+
+void sd_log_iter_end(sd_log_iter_t* iter){
+    if (iter->reader != NULL) {
+        fclose(iter->reader);
+        iter->reader = NULL;
+    }
+    sd_io_buffer_put(iter->reader_buffer);
+    iter->reader_buffer = NULL;
+}
+
+
+esp_err_t sd_log_commit(sd_log_t* log, const sd_log_cursor_t* cursor){
+    sd_log_cursor_t old_head = log->head;
+    uint32_t old_segment = old_head.segment;
+    log->head = *cursor;
+
+    // Primero el indice: si se corta la energia antes de borrar, solo quedan segmentos de mas
+    if (sd_log_write_index(log) != ESP_OK) {
+        log->head = old_head;
+        return ESP_FAIL;
+    }
+
+    char file_path[SD_PATH_SIZE];
+    for (uint32_t segment = old_segment; segment < cursor->segment; segment++) {
+        sd_log_segment_path(log, segment, file_path, sizeof(file_path));
+        remove(file_path);
+    }
+    return ESP_OK;
+}
+
+
+// Una sola lectura del directorio: bitmap de los <file_prefix>N.txt presentes (N < qty_files)
+static int sd_log_scan_files(const char* file_prefix, int qty_files, uint8_t* present){
+    DIR* dir = opendir(MOUNT_POINT);
+    if (dir == NULL) {
+        return 0;
+    }
+    int count = 0;
+    size_t prefix_len = strlen(file_prefix);
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        // Sin LFN los nombres se devuelven en mayusculas
+        if (strncasecmp(entry->d_name, file_prefix, prefix_len) != 0) {
+            continue;
+        }
+        char* end;
+        const char* number = entry->d_name + prefix_len;
+        unsigned long n = strtoul(number, &end, 10);
+        if (end == number || strcasecmp(end, ".txt") != 0 || n >= (unsigned long) qty_files) {
+            continue;
+        }
+        present[n / 8] |= 1 << (n % 8);
+        count++;
+    }
+    closedir(dir);
+    return count;
+}
+
+
+/*  Copia un archivo legacy al log por bloques del buffer, asi su tamano no esta
+    limitado por el buffer. ESP_OK solo si se leyo completo y el registro quedo
+    guardado; ESP_ERR_NOT_FOUND si esta vacio */
+static esp_err_t sd_log_import_file(sd_log_t* log, const char* name_file, char* buffer, size_t size_buffer){
+    char file_path[SD_PATH_SIZE];
+    if (sd_path(file_path, sizeof(file_path), "%s", name_file) != ESP_OK) {
+        return ESP_FAIL;
+    }
+    FILE* f = fopen(file_path, "r");
+    if (f == NULL) {
+        ESP_LOGE(TAG_SD, "No se pudo abrir el archivo para lectura: %s\n", name_file);
+        return ESP_FAIL;
+    }
+    if (sd_log_append_begin(log) != ESP_OK) {
+        fclose(f);
+        return ESP_FAIL;
+    }
+
+    size_t length = 0;
+    size_t bytes_read;
+    esp_err_t ret = ESP_OK;
+    while ((bytes_read = fread(buffer, 1, size_buffer, f)) > 0) {
+        if (sd_log_append_write(log, buffer, bytes_read) != ESP_OK) {
+            ret = ESP_FAIL;
+            break;
+        }
+        length += bytes_read;
+    }
+    if (ret == ESP_OK && ferror(f)) {
+        ESP_LOGE(TAG_SD, "Error de lectura en %s\n", name_file);
+        ret = ESP_FAIL;
+    }
+    fclose(f);
+
+    if (ret != ESP_OK || length == 0) {
+        sd_log_append_abort(log);
+        return (ret != ESP_OK) ? ret : ESP_ERR_NOT_FOUND;
+    }
+    return sd_log_append_end(log);
+}
+
+
+int sd_log_import_files(sd_log_t* log, const char* count_file, const char* file_prefix,
+                        char* buffer, size_t size_buffer){
+    char name_file[30];
+    if (snprintf(name_file, sizeof(name_file), "%s.txt", count_file) >= (int) sizeof(name_file) ||
+        file_exists(name_file) == 0) {
+        return 0;
+    }
+    leer_file_sd(name_file, buffer, size_buffer);
+    int qty_files = atoi(buffer);
+    int imported = 0;
+    int kept = 0;
+
+    // Sin un file_exists() por indice: cada uno recorre el directorio completo
+    uint8_t* present = calloc((MAX(qty_files, 0) + 7) / 8 + 1, 1);
+    if (present == NULL) {
+        ESP_LOGE(TAG_SD, "Sin memoria para importar '%s'\n", file_prefix);
+        return 0;
+    }
+    int found = sd_log_scan_files(file_prefix, qty_files, present);
+
+    for (int n = 0, visited = 0; n < qty_files && visited < found; n++) {
+        if (!(present[n / 8] & (1 << (n % 8)))) {
+            continue;
+        }
+        visited++;
+        if (snprintf(name_file, sizeof(name_file), "%s%d.txt", file_prefix, n) >= (int) sizeof(name_file)) {
+            continue;
+        }
+        // Solo se borra lo que quedo completo en el log (o un archivo vacio)
+        esp_err_t ret = sd_log_import_file(log, name_file, buffer, size_buffer);
+        if (ret == ESP_FAIL) {
+            kept++;
+            continue;
+        }
+        delete_file_sd(name_file);
+        imported += (ret == ESP_OK);
+    }
+    free(present);
+
+    // El contador se mantiene mientras queden archivos: se reintentan en el siguiente ciclo
+    if (kept > 0) {
+        ESP_LOGW(TAG_SD, "Quedan %d archivos '%s' sin importar\n", kept, file_prefix);
+    }
+    else {
+        snprintf(name_file, sizeof(name_file), "%s.txt", count_file);
+        delete_file_sd(name_file);
+    }
+    ESP_LOGI(TAG_SD, "Se movieron %d archivos '%s' al log '%s'\n", imported, file_prefix, log->prefix);
+    return imported;
+}
+
+
+
+
+/* ----------------------------------------------------------------- */
+/*                          BATTERY RING                              */
+/* ----------------------------------------------------------------- */
+
+/* Header payload (sd_meta): capacity + first sample not uploaded */
+typedef struct {
+    uint32_t capacity;
+    uint32_t sent_seq;
+} sd_battery_header_t;
+
+
+static uint32_t sd_battery_crc(const sd_battery_sample_t* sample){
+    return esp_rom_crc32_le(0, (const uint8_t*) sample, offsetof(sd_battery_sample_t, crc));
+}
+
+
+static long sd_battery_offset(const sd_battery_t* battery, uint32_t seq){
+    return 2 * SD_META_SLOT + (long) (seq % battery->capacity) * sizeof(sd_battery_sample_t);
+}
+
+
+static int sd_battery_valid(const sd_battery_t* battery, const sd_battery_sample_t* sample, uint32_t slot){
+    return sample->crc == sd_battery_crc(sample) && (sample->seq % battery->capacity) == slot;
+}
+
+
+esp_err_t sd_battery_open(sd_battery_t* battery){
+    char file_path[SD_PATH_SIZE];
+    sd_path(file_path, sizeof(file_path), "%s.bin", file_bateria_data);
+    memset(battery, 0, sizeof(sd_battery_t));
+
+    battery->file = sd_meta_open(file_path);
+    if (battery->file == NULL) {
+        ESP_LOGE(TAG_SD, "No se pudo abrir %s\n", file_path);
+        return ESP_FAIL;
+    }
+
+    sd_battery_header_t header;
+    if (!sd_meta_read(battery->file, SD_BATTERY_MAGIC, &battery->generation, &header, sizeof(header)) ||
+        header.capacity == 0) {
+        // Archivo nuevo: reservamos todos los slots de una vez
+        header.capacity = SD_BATTERY_CAPACITY;
+        header.sent_seq = 0;
+        static const uint8_t zeros[SD_META_SLOT];
+        fseek(battery->file, 2 * SD_META_SLOT, SEEK_SET);
+        for (size_t written = 0; written < SD_BATTERY_CAPACITY * sizeof(sd_battery_sample_t); written += sizeof(zeros)) {
+            fwrite(zeros, 1, sizeof(zeros), battery->file);
+        }
+        if (sd_meta_write(battery->file, SD_BATTERY_MAGIC, &battery->generation, &header, sizeof(header)) != ESP_OK) {
+            ESP_LOGE(TAG_SD, "No se pudo crear %s\n", file_path);
+            sd_battery_close(battery);
+            return ESP_FAIL;
+        }
+    }
+    battery->capacity = header.capacity;
+    battery->sent_seq = header.sent_seq;
+
+    // El siguiente seq sale de la muestra valida mas nueva (un sector por lectura)
+    sd_battery_sample_t samples[SD_META_SLOT / sizeof(sd_battery_sample_t)];
+    int found = 0;
+    uint32_t newest = 0;
+    fseek(battery->file, 2 * SD_META_SLOT, SEEK_SET);
+    for (uint32_t slot = 0; slot < battery->capacity; ) {
+        size_t count = fread(samples, sizeof(sd_battery_sample_t),
+                             MIN(battery->capacity - slot, sizeof(samples) / sizeof(samples[0])), battery->file);
+        if (count == 0) {
+            break;
+        }
+        for (size_t i = 0; i < count; i++, slot++) {
+            if (sd_battery_valid(battery, &samples[i], slot) &&
+                (!found || (int32_t) (samples[i].seq - newest) > 0)) {
+                newest = samples[i].seq;
+                found = 1;
+            }
+        }
+    }
+    battery->next_seq = found ? newest + 1 : battery->sent_seq;
+    if ((int32_t) (battery->sent_seq - battery->next_seq) > 0) {
+        battery->sent_seq = battery->next_seq;
+    }
+
+    ESP_LOGI(TAG_SD, "Bateria: %lu muestras pendientes\n",
+             (unsigned long) (battery->next_seq - sd_battery_first_pending(battery)));
+    return ESP_OK;
+}
+
+
+/* Escribe una muestra en su lugar del anillo: una sola escritura dentro de un sector ya reservado */
+static esp_err_t sd_battery_write(sd_battery_t* battery, sd_battery_sample_t* sample){
+    sample->crc = sd_battery_crc(sample);
+    if (fseek(battery->file, sd_battery_offset(battery, sample->seq), SEEK_SET) != 0 ||
+        fwrite(sample, 1, sizeof(sd_battery_sample_t), battery->file) != sizeof(sd_battery_sample_t)) {
+        ESP_LOGE(TAG_SD, "No se pudo guardar la muestra de bateria\n");
+        return ESP_FAIL;
+    }
+    fflush(battery->file);
+    fsync(fileno(battery->file));
+    return ESP_OK;
+}
+
+
+esp_err_t sd_battery_append(sd_battery_t* battery, uint32_t time, uint16_t millivolts, uint16_t flags){
+    sd_battery_sample_t sample = {
+        .seq        = battery->next_seq,
+        .time       = time,
+        .millivolts = millivolts,
+        .flags      = flags,
+    };
+    if (sd_battery_write(battery, &sample) != ESP_OK) {
+        return ESP_FAIL;
+    }
+    battery->next_seq++;
+    return ESP_OK;
+}
+
+
+int sd_battery_date(sd_battery_t* battery, int64_t offset, int orphan){
+    int count = 0;
+    for (uint32_t seq = sd_battery_first_pending(battery); seq != battery->next_seq; seq++) {
+        sd_battery_sample_t sample;
+        if (!sd_battery_read(battery, seq, &sample) || (sample.flags & (SD_BATTERY_DATED | SD_BATTERY_ORPHAN))) {
+            continue;
+        }
+        if (orphan) {
+            sample.flags |= SD_BATTERY_ORPHAN;
+        }
+        else {
+            sample.time  = (uint32_t) (sample.time + offset);
+            sample.flags |= SD_BATTERY_DATED;
+        }
+        if (sd_battery_write(battery, &sample) != ESP_OK) {
+            return -1;
+        }
+        count++;
+    }
+    if (count > 0) {
+        ESP_LOGI(TAG_SD, "Muestras de bateria %s = %d\n", orphan ? "sin fecha (power-on)" : "fechadas", count);
+    }
+    return count;
+}
+
+
+uint32_t sd_battery_first_pending(const sd_battery_t* battery){
+    // Las muestras mas viejas que la capacidad ya se sobrescribieron
+    if (battery->next_seq - battery->sent_seq > battery->capacity) {
+        return battery->next_seq - battery->capacity;
+    }
+    return battery->sent_seq;
+}
+
+
+int sd_battery_read(sd_battery_t* battery, uint32_t seq, sd_battery_sample_t* sample){
+    if (fseek(battery->file, sd_battery_offset(battery, seq), SEEK_SET) != 0 ||
+        fread(sample, 1, sizeof(sd_battery_sample_t), battery->file) != sizeof(sd_battery_sample_t)) {
+        return 0;
+    }
+    return sd_battery_valid(battery, sample, seq % battery->capacity) && sample->seq == seq;
+}
+
+
+esp_err_t sd_battery_commit(sd_battery_t* battery, uint32_t seq){
+    sd_battery_header_t header = {
+        .capacity = battery->capacity,
+        .sent_seq = seq,
+    };
+    if (sd_meta_write(battery->file, SD_BATTERY_MAGIC, &battery->generation, &header, sizeof(header)) != ESP_OK) {
+        ESP_LOGE(TAG_SD, "No se pudo actualizar el encabezado de bateria\n");
+        return ESP_FAIL;
+    }
+    battery->sent_seq = seq;
+    return ESP_OK;
+}
+
+
+void sd_battery_close(sd_battery_t* battery){
+    if (battery->file != NULL) {
+        fclose(battery->file);
+        battery->file = NULL;
+    }
+}
+
+
+
+
+/* ----------------------------------------------------------------- */
+/*                          BENCHMARK                                 */
+/* ----------------------------------------------------------------- */
+
+#define SD_BENCH_RANDOM_OPS   64
+
+
+static void sd_bench_report(const char* name, size_t bytes, int64_t start_us){
+    int64_t elapsed_us = esp_timer_get_time() - start_us;
+    ESP_LOGI(TAG_SD, "Bench %-16s %6lu KB en %6lu ms = %lu KB/s\n", name,
+             (unsigned long) (bytes / 1024), (unsigned long) (elapsed_us / 1000),
+             (unsigned long) (elapsed_us > 0 ? (int64_t) bytes * 1000000 / 1024 / elapsed_us : 0));
+}
+
+
+esp_err_t sd_bench(int size_kb){
+    char file_path[SD_PATH_SIZE];
+    sd_path(file_path, sizeof(file_path), "bench.bin");
+    char* stdio_buffer = NULL;
+    uint8_t* block = heap_caps_malloc(SD_IO_BUFFER_SIZE, MALLOC_CAP_DMA);
+    if (block == NULL) {
+        return ESP_FAIL;
+    }
+    memset(block, 0xA5, SD_IO_BUFFER_SIZE);
+    size_t size = (size_t) size_kb * 1024;
+    size_t blocks = size / SD_IO_BUFFER_SIZE;
+
+    // Escritura secuencial
+    int64_t start_us = esp_timer_get_time();
+    FILE* f = sd_fopen_buffered(file_path, "w+b", &stdio_buffer);
+    if (f == NULL) {
+        ESP_LOGE(TAG_SD, "No se pudo crear %s\n", file_path);
+        free(block);
+        return ESP_FAIL;
+    }
+    for (size_t i = 0; i < blocks; i++) {
+        fwrite(block, 1, SD_IO_BUFFER_SIZE, f);
+    }
+    fflush(f);
+    fsync(fileno(f));
+    sd_bench_report("escritura sec.", blocks * SD_IO_BUFFER_SIZE, start_us);
+
+    // Lectura secuencial
+    start_us = esp_timer_get_time();
+    fseek(f, 0, SEEK_SET);
+    for (size_t i = 0; i < blocks; i++) {
+        fread(block, 1, SD_IO_BUFFER_SIZE, f);
+    }
+    sd_bench_report("lectura sec.", blocks * SD_IO_BUFFER_SIZE, start_us);
+
+    // Escritura aleatoria de un sector (con fsync, como un registro)
+    size_t sectors = size / 512;
+    start_us = esp_timer_get_time();
+    for (int i = 0; i < SD_BENCH_RANDOM_OPS && sectors > 0; i++) {
+        fseek(f, (long) (esp_random() % sectors) * 512, SEEK_SET);
+        fwrite(block, 1, 512, f);
+        fflush(f);
+        fsync(fileno(f));
+    }
+    sd_bench_report("escritura aleat.", SD_BENCH_RANDOM_OPS * 512, start_us);
+
+    // Lectura aleatoria de un sector
+    start_us = esp_timer_get_time();
+    for (int i = 0; i < SD_BENCH_RANDOM_OPS && sectors > 0; i++) {
+        fseek(f, (long) (esp_random() % sectors) * 512, SEEK_SET);
+        fread(block, 1, 512, f);
+    }
+    sd_bench_report("lectura aleat.", SD_BENCH_RANDOM_OPS * 512, start_us);
+
+    fclose(f);
+    remove(file_path);
+    sd_io_buffer_put(stdio_buffer);
+    free(block);
+    return ESP_OK;
+}
+
+
+/* Copias del cursor en "<name>.cur" */
+typedef struct {
+    uint32_t mode;          // Con SD_CURSOR_IMPORT mientras se importan registros
+    uint32_t edge_seq;
+    uint32_t acked_seq;
+    uint32_t log_seq;
+} sd_cursor_header_t;
+
+
+esp_err_t sd_cursor_open(sd_cursor_t* cursor, const char* name, const sd_log_t* log){
+    memset(cursor, 0, sizeof(sd_cursor_t));
+    sd_path(cursor->path, sizeof(cursor->path), "%s.cur", name);
+
+    // Como el indice del log, el archivo solo esta abierto mientras se lee o se escribe
+    FILE* f = sd_meta_open(cursor->path);
+    if (f == NULL) {
+        ESP_LOGE(TAG_SD, "No se pudo abrir %s\n", cursor->path);
+        return ESP_FAIL;
+    }
+    sd_cursor_header_t header;
+    int found = sd_meta_read(f, SD_CURSOR_MAGIC, &cursor->generation, &header, sizeof(header));
+    fclose(f);
+    cursor->ready = 1;
+
+    if (!found) {
+        // Cursor nuevo: los registros que ya estan en el log no vienen del protocolo por cursor
+        cursor->log_seq = log->tail.seq;
+        return sd_cursor_commit(cursor);
+    }
+    cursor->mode      = header.mode & ~SD_CURSOR_IMPORT;
+    cursor->edge_seq  = header.edge_seq;
+    cursor->acked_seq = header.acked_seq;
+    cursor->log_seq   = header.log_seq;
+
+    // Registros guardados despues del ultimo commit (corte de energia o de conexion)
+    uint32_t stored = log->tail.seq - cursor->log_seq;
+    if (header.mode & SD_CURSOR_IMPORT) {
+        // La importacion se corto: lo que siguio a log_seq no vino del Edge
+        ESP_LOGW(TAG_SD, "Cursor '%s': importacion cortada, %lu registros importados no mueven el cursor\n",
+                 name, (unsigned long) stored);
+        cursor->log_seq = log->tail.seq;
+        return sd_cursor_commit(cursor);
+    }
+    if (stored != 0) {
+        if (cursor->mode && (int32_t) stored > 0) {
+            cursor->edge_seq += stored;
+            ESP_LOGW(TAG_SD, "Cursor '%s': %lu registros guardados sin commit, se sigue desde %lu\n",
+                     name, (unsigned long) stored, (unsigned long) cursor->edge_seq);
+        }
+        cursor->log_seq = log->tail.seq;
+        return sd_cursor_commit(cursor);
+    }
+    return ESP_OK;
+}
+
+
+esp_err_t sd_cursor_commit(sd_cursor_t* cursor){
+    sd_cursor_header_t header = {
+        .mode      = cursor->mode | (cursor->importing ? SD_CURSOR_IMPORT : 0),
+        .edge_seq  = cursor->edge_seq,
+        .acked_seq = cursor->acked_seq,
+        .log_seq   = cursor->log_seq,
+    };
+    FILE* f = cursor->ready ? sd_meta_open(cursor->path) : NULL;
+    esp_err_t ret = (f != NULL) ?
+        sd_meta_write(f, SD_CURSOR_MAGIC, &cursor->generation, &header, sizeof(header)) : ESP_FAIL;
+    if (f != NULL) {
+        fclose(f);
+    }
+    if (ret != ESP_OK) {
+        ESP_LOGE(TAG_SD, "No se pudo guardar el cursor\n");
+    }
+    return ret;
+}
+
+
+void sd_cursor_close(sd_cursor_t* cursor){
+    cursor->ready = 0;
+}
+
+
+esp_err_t sd_cursor_import(sd_cursor_t* cursor, const sd_log_t* log, int importing){
+    cursor->importing = importing;
+    cursor->log_seq   = log->tail.seq;
+    return sd_cursor_commit(cursor);
+}
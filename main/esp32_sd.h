@@ -18,6 +18,9 @@
 #include "sdmmc_cmd.h"     // It provides command definitions for interacting with SD cards, issuing commands, and reading and writing data to and from SD cards.
 
 #include <errno.h>
+#include <dirent.h>
+#include "esp_rom_crc.h"   // CRC32 from the ESP32 ROM for the record headers
+#include "esp_heap_caps.h" // DMA-capable stdio buffers: FatFs moves whole sectors straight from them
 
 
 // Define variables for SD CARD functions
@@ -26,7 +29,16 @@
 #define PIN_SD_CLK          18
 #define PIN_SD_CS           5
 
-#define MOUNT_POINT           "/sdcard"
+#ifndef MOUNT_POINT
+#define MOUNT_POINT           "/sdcard"      // host/ points it to the directory that stands in for the card
+#endif
+
+#define SD_MOUNT_FREQ_KHZ     5000           // Card detection/mount (20 MHz causes issues with the SD detector)
+#define SD_FREQ_KHZ           CONFIG_NODO_SD_FREQ_KHZ  // Clock once the card is mounted
+#define SD_IO_BUFFER_SIZE     4096           // stdio buffer of the log streams: 8 sectors per transfer
+#define SD_IO_POOL_SIZE       8              // stdio buffers kept for reuse after a log/iterator is closed
+#define SD_PATH_SIZE          32             // "/sdcard/" + 8.3 name, built with sd_path()
+#define SD_MAX_FILES          10             // Files open at the same time (max_files of the FAT VFS)
 
 #define file_salud_size       "salud"
 #define file_salud_data       "sa_"
@@ -41,6 +53,134 @@
 
 #define TAG_SD                "SD_API"
 
+// Record logs (segment files "<prefix>NNNNN.log" + "<name>.idx")
+// WARNING: prefix + 5 digits can NOT exceed 8 characters (FAT 8.3 names)
+#define log_salud_prefix      "sa_"
+#define log_salud_index       "salud"
+#define log_err_salud_prefix  "es_"
+#define log_err_salud_index   "e_salud"
+#define log_pesaje_prefix     "pe_"
+#define log_pesaje_index      "pesaje"
+#define log_err_pesaje_prefix "ep_"
+#define log_err_pesaje_index  "e_pesaje"
+#define log_telem_prefix      "tm_"          // Resources of every wake cycle (esp32_telem.h), sent with the battery samples
+#define log_telem_index       "telem"
+#define log_quarantine_prefix "qt_"
+#define log_quarantine_index  "quarant"
+
+#define SD_LOG_SEGMENT_SIZE   (128 * 1024)   // A new segment is started after this size
+#define SD_LOG_RECORD_MAGIC   0xA55A
+#define SD_LOG_INDEX_MAGIC_V1 0x4C4F4731     // "LOG1": single copy (older firmware)
+#define SD_LOG_INDEX_MAGIC    0x4C4F4732     // "LOG2": two copies, the newest valid one is used
+#define SD_LOG_NAME_SIZE      8
+#define SD_META_SLOT          512            // Metadata files: one sector per copy, a cut write only damages one of them
+
+// Battery samples: ring file "bateria.bin" (2 header copies + SD_BATTERY_CAPACITY samples)
+#define SD_BATTERY_MAGIC      0x42415431     // "BAT1"
+#define SD_BATTERY_CAPACITY   1024           // Samples kept (16 KB); older ones are overwritten
+
+// Battery samples: the clock only has the date after the edge sets it (sync_set_clock)
+#define SD_BATTERY_DATED      0x0001         // time is a date
+#define SD_BATTERY_ORPHAN     0x0002         // Seconds since an earlier power-on: the date can not be known
+
+// Edge download cursors: "<log index>.cur" (2 copies, like the .idx)
+#define SD_CURSOR_MAGIC       0x43555231     // "CUR1"
+#define SD_CURSOR_IMPORT      0x80000000     // Bit of the stored mode: records not from the edge are being appended
+
+// Record flags (sd_log_record_t.flags)
+#define SD_LOG_FLAG_CBOR      0x0001         // Payload encoded in CBOR (see esp32_codec.h), otherwise JSON text
+#define SD_LOG_FLAG_CORRUPT   0x0002         // Quarantine: bytes of a record that failed its CRC or header check
+#define SD_LOG_FLAG_SENT(n)   (0x0100 << (n)) // Destination n of upload_begin() already acknowledged it
+#define SD_LOG_FLAG_SENT_MASK 0xFF00
+
+// Errors of sd_log_iter_read()
+#define SD_LOG_READ_CORRUPT   -1             // CRC error: the record is in the quarantine (or there is none), it can be skipped
+#define SD_LOG_READ_FAIL      -2             // Read error or failed quarantine copy: the record must not be skipped
+
+
+/* Position inside a record log */
+typedef struct {
+   uint32_t segment;       // Segment number (file <prefix>NNNNN.log)
+   uint32_t offset;        // Byte offset inside the segment
+   uint32_t seq;           // Sequence number of the record at this position
+} sd_log_cursor_t;
+
+
+/* Header written in front of every record */
+typedef struct {
+   uint16_t magic;         // SD_LOG_RECORD_MAGIC
+   uint16_t flags;         // SD_LOG_FLAG_*
+   uint32_t seq;           // Sequence number of the record
+   uint32_t length;        // Payload length in bytes
+   uint32_t crc;           // CRC32 of the header (crc = 0) + payload
+} sd_log_record_t;
+
+
+/* Record log: head = first record not committed, tail = next append */
+typedef struct {
+   char              prefix[SD_LOG_NAME_SIZE];
+   char              index_name[SD_LOG_NAME_SIZE + 1];
+   sd_log_cursor_t   head;
+   sd_log_cursor_t   tail;
+   FILE*             writer;       // Open tail segment (NULL until the first append)
+   int               sealed;       // 1 = next append starts a new segment
+   uint32_t          pending_length;  // Record being written (sd_log_append_begin/end)
+   uint32_t          pending_crc;
+   uint16_t          pending_flags;
+   uint32_t          index_generation;  // Generation of the newest index copy
+   char*             writer_buffer;     // SD_IO_BUFFER_SIZE, DMA capable
+} sd_log_t;
+
+
+/* Battery sample: 16 bytes, so a sample never spans two sectors */
+typedef struct {
+   uint32_t seq;           // Sequence number, the slot is seq % capacity
+   uint32_t time;          // time() when it was measured: a date only with SD_BATTERY_DATED
+   uint16_t millivolts;
+   uint16_t flags;         // SD_BATTERY_DATED, SD_BATTERY_ORPHAN (0 = seconds since power-on)
+   uint32_t crc;           // CRC32 of the previous fields
+} sd_battery_sample_t;
+
+
+/* Battery ring file: next_seq is recovered from the samples, sent_seq from the header */
+typedef struct {
+   FILE*             file;
+   uint32_t          capacity;
+   uint32_t          next_seq;     // Sequence number of the next sample
+   uint32_t          sent_seq;     // First sample not uploaded
+   uint32_t          generation;   // Generation of the newest header copy
+} sd_battery_t;
+
+
+/* Download cursor of an edge stream: what was stored and what was acknowledged */
+typedef struct {
+   char              path[SD_PATH_SIZE]; // "<name>.cur", opened only while it is read or written
+   int               ready;        // 1 = opened by sd_cursor_open()
+   uint32_t          generation;   // Generation of the newest copy
+   uint32_t          mode;         // 1 = edge_seq is valid (cursor protocol of the edge)
+   uint32_t          edge_seq;     // Last edge record stored in the log
+   uint32_t          acked_seq;    // Last edge record acknowledged to the edge
+   uint32_t          log_seq;      // Log tail when the cursor was committed
+   int               importing;    // 1 = the records after log_seq are imported, not downloaded
+} sd_cursor_t;
+
+
+/* Iterator over the records between head and the tail at sd_log_iter_begin() */
+typedef struct {
+   sd_log_t*         log;
+   sd_log_cursor_t   pos;          // Next record to read
+   sd_log_cursor_t   end;          // Tail snapshot, records appended later are not visited
+   FILE*             reader;
+   char*             reader_buffer;     // SD_IO_BUFFER_SIZE, DMA capable
+   uint32_t          reader_segment;
+   uint32_t          reader_size;  // Size of the open segment, longer records are corrupt
+   sd_log_t*         quarantine;   // Optional (NULL after sd_log_iter_begin), damaged records are copied here
+   sd_log_record_t   current;      // Header of the last record returned
+   uint32_t          payload_offset;
+   uint32_t          remaining;    // Payload bytes of the current record not read yet
+   uint32_t          crc;          // Running CRC of the current payload
+} sd_log_iter_t;
+
 /*
    Description:
    This function make available the read and write operations with the SD Card
@@ -97,6 +237,22 @@ size_t leer_file_sd(const char *name_file, char* buffer_read, size_t size_buffer
 esp_err_t delete_file_sd(const char *name_file);
 
 
+/*
+   Description:
+   This function builds the full path of a file of the SD card: MOUNT_POINT "/"
+   followed by the formatted name. A name that does not fit is not truncated
+
+   Parameters:
+   char*       path   : Output buffer (normally SD_PATH_SIZE bytes)
+   size_t      size   : The size of path
+   const char* format : printf format of the name (ex. "%s.idx")
+
+   Returns:
+   esp_err_t response = ESP_OK or ESP_ERR_INVALID_SIZE (path is left empty)
+*/
+esp_err_t sd_path(char* path, size_t size, const char* format, ...) __attribute__((format(printf, 3, 4)));
+
+
 int file_exists(const char* file_path);
 
 
@@ -106,5 +262,314 @@ esp_err_t append_file_sd(char* buffer, char* name_file);
 esp_err_t create_file(const char *name_file, const char* initial_content);
 
 
+/*
+   Description:
+   This function opens a record log, recovers its tail and drops any record
+   left incomplete by a power loss in the middle of an append
+
+   Parameters:
+   sd_log_t*   log         : The log to initialize
+   const char* prefix      : Prefix of the segment files (ex. log_salud_prefix)
+   const char* index_name  : Name (without extension) of the index file
+
+   Returns:
+   esp_err_t response = ESP_OK or ESP_FAIL
+*/
+esp_err_t sd_log_open(sd_log_t* log, const char* prefix, const char* index_name);
+
+
+/*
+   Description:
+   This function closes the segment opened for appends
+
+   Returns:
+   Nothing
+*/
+void sd_log_close(sd_log_t* log);
+
+
+/*
+   Description:
+   This function appends one record (header + payload) at the tail of the log.
+   The record is synced to the SD card before returning
+
+   Parameters:
+   sd_log_t*   log   : The log
+   const char* data  : Record payload
+   size_t      length: Payload length in bytes
+
+   Returns:
+   esp_err_t response = ESP_OK or ESP_FAIL
+*/
+esp_err_t sd_log_append(sd_log_t* log, const char* data, size_t length);
+esp_err_t sd_log_append_flags(sd_log_t* log, const char* data, size_t length, uint16_t flags);
+
+
+/*
+   Description:
+   Streaming version of sd_log_append(): begin writes a provisional header,
+   write adds payload bytes and end writes the final header (length + CRC)
+   and syncs the SD card. Until end returns the record does not exist: after
+   a power loss it is dropped when the log is opened. abort removes it.
+   The flags of the record (SD_LOG_FLAG_*) can be set in log->pending_flags
+   between begin and end
+
+   Returns:
+   esp_err_t response = ESP_OK or ESP_FAIL
+*/
+esp_err_t sd_log_append_begin(sd_log_t* log);
+esp_err_t sd_log_append_write(sd_log_t* log, const char* data, size_t length);
+esp_err_t sd_log_append_end(sd_log_t* log);
+void sd_log_append_abort(sd_log_t* log);
+
+
+/*
+   Description:
+   Number of records between head and tail (not committed yet)
+*/
+uint32_t sd_log_pending(const sd_log_t* log);
+
+
+/*
+   Description:
+   This function starts an iteration from the head of the log. Records appended
+   while iterating go to a new segment and are not visited by this iterator.
+   If iter->quarantine is set after this call (another log), the bytes of every
+   record that fails its CRC, and the rest of a segment with a damaged header,
+   are copied there with SD_LOG_FLAG_CORRUPT before the iteration moves on. If
+   the copy fails the record is reported as a read error. Without a quarantine
+   the damaged records are skipped
+*/
+void sd_log_iter_begin(sd_log_t* log, sd_log_iter_t* iter);
+
+
+/*
+   Description:
+   This function reads the next record of the iteration into a buffer (null terminated)
+
+   Parameters:
+   sd_log_iter_t* iter       : The iterator
+   char*          buffer     : Buffer for the payload
+   size_t         size_buffer: The size of the buffer (for avoid overflow in the buffer)
+   size_t*        out_length : Length of the payload read
+
+   Returns:
+   ESP_OK                = record read
+   ESP_ERR_NOT_FOUND     = no more records
+   ESP_ERR_INVALID_SIZE  = record bigger than the buffer (skipped)
+   ESP_ERR_INVALID_CRC   = corrupted record (skipped, in the quarantine if the iterator has one)
+   ESP_FAIL              = SD read error or the quarantine copy failed: iter->pos
+                           stays before the record, so a commit keeps it
+*/
+esp_err_t sd_log_iter_next(sd_log_iter_t* iter, char* buffer, size_t size_buffer, size_t* out_length);
+
+
+/*
+   Description:
+   Streaming read: sd_log_iter_next_record() returns the header of the next
+   record and sd_log_iter_read() its payload in blocks. The CRC is checked
+   before the last block is returned, so a corrupted record fails before the
+   caller uses its last bytes. A header whose length goes past the end of the
+   segment is treated as damaged. sd_log_iter_rewind_record() reads the current
+   payload again from the beginning
+
+   Returns:
+   sd_log_iter_next_record: same codes as sd_log_iter_next()
+   sd_log_iter_read: bytes read, 0 at the end of the payload, SD_LOG_READ_CORRUPT
+   (CRC error, the record is in the quarantine) or SD_LOG_READ_FAIL (read error,
+   or the quarantine copy failed: the caller must keep the record)
+*/
+esp_err_t sd_log_iter_next_record(sd_log_iter_t* iter, sd_log_record_t* record);
+int sd_log_iter_read(sd_log_iter_t* iter, char* buffer, size_t size_buffer);
+esp_err_t sd_log_iter_rewind_record(sd_log_iter_t* iter);
+
+
+/*
+   Description:
+   This function appends the current record of an iterator to another log,
+   copying it (and its flags) in blocks of chunk_size
+
+   Returns:
+   esp_err_t response = ESP_OK or ESP_FAIL
+*/
+esp_err_t sd_log_copy_record(sd_log_t* log, sd_log_iter_t* iter, char* chunk, size_t chunk_size);
+
+
+/*
+   Description:
+   This function closes the file used by the iterator
+*/
+void sd_log_iter_end(sd_log_iter_t* iter);
+
+
+/*
+   Description:
+   This function moves the head of the log to a cursor (usually iter.pos) and
+   deletes the segments that were fully consumed. End the iterators of the log
+   first. If the index can not be written the head is not moved
+
+   Returns:
+   esp_err_t response = ESP_OK or ESP_FAIL
+*/
+esp_err_t sd_log_commit(sd_log_t* log, const sd_log_cursor_t* cursor);
+
+
+/*
+   Description:
+   This function moves the legacy one-file-per-record storage (<file_prefix>N.txt
+   + <count_file>.txt) into a record log. Every file is copied in blocks of the
+   buffer (any size) and deleted only once its record is in the log; the files
+   that could not be read or appended, and the counter, stay for the next call
+
+   Parameters:
+   sd_log_t*   log         : Destination log
+   const char* count_file  : Counter file name without extension (ex. file_salud_size)
+   const char* file_prefix : Record file prefix (ex. file_salud_data)
+   char*       buffer      : Buffer used to copy every file
+   size_t      size_buffer : The size of the buffer
+
+   Returns:
+   Number of records imported
+*/
+int sd_log_import_files(sd_log_t* log, const char* count_file, const char* file_prefix,
+                        char* buffer, size_t size_buffer);
+
+
+/*
+   Description:
+   This function opens (or creates with its full size) the battery ring file.
+   Appending a sample only rewrites one sector, the file never grows
+
+   Parameters:
+   sd_battery_t* battery : Ring to initialize
+
+   Returns:
+   esp_err_t response = ESP_OK or ESP_FAIL
+*/
+esp_err_t sd_battery_open(sd_battery_t* battery);
+
+
+/*
+   Description:
+   This function stores a battery sample in the next slot of the ring
+
+   Parameters:
+   sd_battery_t* battery    : Open ring
+   uint32_t      time       : time() of the sample
+   uint16_t      millivolts : Battery voltage
+   uint16_t      flags      : SD_BATTERY_DATED if the clock was set, 0 if time
+                              counts from the power-on
+
+   Returns:
+   esp_err_t response = ESP_OK or ESP_FAIL
+*/
+esp_err_t sd_battery_append(sd_battery_t* battery, uint32_t time, uint16_t millivolts, uint16_t flags);
+
+
+/*
+   Description:
+   This function dates the pending samples taken before the clock was set:
+   offset (seconds) is added to their time and they are marked SD_BATTERY_DATED.
+   With orphan = 1 (after a power-on, the offset of their clock is lost) they
+   are marked SD_BATTERY_ORPHAN instead
+
+   Returns:
+   Samples rewritten, or -1 on a write error
+*/
+int sd_battery_date(sd_battery_t* battery, int64_t offset, int orphan);
+
+
+/*
+   Description:
+   First sample not uploaded yet (samples overwritten by the ring are skipped)
+*/
+uint32_t sd_battery_first_pending(const sd_battery_t* battery);
+
+
+/*
+   Description:
+   This function reads the sample with a sequence number
+
+   Returns:
+   1 if the sample is valid, 0 if it was overwritten or damaged
+*/
+int sd_battery_read(sd_battery_t* battery, uint32_t seq, sd_battery_sample_t* sample);
+
+
+/*
+   Description:
+   This function marks the samples before seq as uploaded (header with two copies)
+
+   Returns:
+   esp_err_t response = ESP_OK or ESP_FAIL
+*/
+esp_err_t sd_battery_commit(sd_battery_t* battery, uint32_t seq);
+
+
+/*
+   Description:
+   This function closes the battery ring file
+*/
+void sd_battery_close(sd_battery_t* battery);
+
+
+/*
+   Description:
+   This function measures the card: sequential write/read of size_kb in blocks
+   of SD_IO_BUFFER_SIZE and random 512 byte writes/reads, and logs the KB/s.
+   It uses a temporary file (bench.bin) that is deleted at the end
+
+   Parameters:
+   int size_kb : Size of the sequential test
+
+   Returns:
+   esp_err_t response = ESP_OK or ESP_FAIL
+*/
+esp_err_t sd_bench(int size_kb);
+
+
+/*
+   Description:
+   This function opens (or creates) the download cursor "<name>.cur". The
+   records stored after the last commit are counted from the log tail: with
+   mode = 1 the edge sequence numbers since the last commit are consecutive
+   (the caller commits before a gap), so edge_seq is moved forward by the
+   records found after log_seq and no record is downloaded twice. If the
+   cursor was committed by sd_cursor_import() (import cut by a power loss)
+   those records are not counted
+
+   Parameters:
+   sd_cursor_t* cursor : Cursor to initialize
+   const char*  name   : File name without extension (ex. log_salud_index)
+   const sd_log_t* log : Open log the records are appended to
+
+   Returns:
+   esp_err_t response = ESP_OK or ESP_FAIL
+*/
+esp_err_t sd_cursor_open(sd_cursor_t* cursor, const char* name, const sd_log_t* log);
+
+
+/*
+   Description:
+   This function writes the cursor (the older copy, like the .idx). The file is
+   opened and closed in every commit, so an open cursor holds no file
+*/
+esp_err_t sd_cursor_commit(sd_cursor_t* cursor);
+void sd_cursor_close(sd_cursor_t* cursor);
+
+
+/*
+   Description:
+   This function commits the cursor at the log tail before (importing = 1) or
+   after (importing = 0) appending records that do not come from the edge,
+   like the files of older firmware. Between the two commits the cursor file
+   says so, and edge_seq does not move if the import is cut
+
+   Returns:
+   esp_err_t response = ESP_OK or ESP_FAIL
+*/
+esp_err_t sd_cursor_import(sd_cursor_t* cursor, const sd_log_t* log, int importing);
+
+
 // ----------------------------------------------------------------- //
 #endif /* __SD_ESP32_ */
\ No newline at end of file
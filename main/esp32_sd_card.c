@@ -0,0 +1,118 @@
+#include "esp32_sd.h"
+
+/*  Driver de la tarjeta (bus SPI + FatFs). Los logs y archivos de esp32_sd.c solo
+    usan stdio sobre MOUNT_POINT, asi tambien compilan fuera del ESP32 (host/) */
+
+/*  Con la tarjeta ya montada se sube el reloj del bus. Si la lectura de prueba
+    falla a la frecuencia alta se vuelve a la del montaje */
+static void sd_raise_clock(sdmmc_card_t* card){
+    if (SD_FREQ_KHZ <= SD_MOUNT_FREQ_KHZ || card->host.set_card_clk == NULL) {
+        return;
+    }
+    uint8_t* sector = heap_caps_malloc(512, MALLOC_CAP_DMA);
+    if (sector == NULL) {
+        return;
+    }
+    esp_err_t ret = card->host.set_card_clk(card->host.slot, SD_FREQ_KHZ);
+    if (ret == ESP_OK) {
+        ret = sdmmc_read_sectors(card, sector, 0, 1);
+    }
+    if (ret == ESP_OK) {
+        card->max_freq_khz = SD_FREQ_KHZ;
+        ESP_LOGI(TAG_SD, "Reloj de la SD: %d kHz\n", SD_FREQ_KHZ);
+    }
+    else {
+        ESP_LOGW(TAG_SD, "La SD no responde a %d kHz (%s), se queda en %d kHz\n",
+                 SD_FREQ_KHZ, esp_err_to_name(ret), SD_MOUNT_FREQ_KHZ);
+        card->host.set_card_clk(card->host.slot, SD_MOUNT_FREQ_KHZ);
+    }
+    free(sector);
+}
+
+
+esp_err_t init_SD(sdmmc_card_t **out_card, sdmmc_host_t *out_host) {
+    esp_err_t ret_sd;
+
+    esp_vfs_fat_sdmmc_mount_config_t mount_config = {
+#ifdef CONFIG_EXAMPLE_FORMAT_IF_MOUNT_FAILED
+        .format_if_mount_failed = true,
+#else
+        .format_if_mount_failed = false,
+#endif // EXAMPLE_FORMAT_IF_MOUNT_FAILED
+        .max_files = SD_MAX_FILES,
+        .allocation_unit_size = 8 * 1024
+    };
+    sdmmc_card_t *card;
+    const char mount_point[] = MOUNT_POINT;
+    ESP_LOGI(TAG_SD, "Initializing SD card");
+    ESP_LOGI(TAG_SD, "Using SPI peripheral");
+
+    sdmmc_host_t host = SDSPI_HOST_DEFAULT();
+    *out_host = host;
+    // La deteccion y el montaje van lentos; la frecuencia se sube despues (sd_raise_clock)
+    host.max_freq_khz = SD_MOUNT_FREQ_KHZ;
+
+    spi_bus_config_t bus_cfg = {
+        .mosi_io_num = PIN_SD_MOSI,
+        .miso_io_num = PIN_SD_MISO,
+        .sclk_io_num = PIN_SD_CLK,
+        .quadwp_io_num = -1,
+        .quadhd_io_num = -1,
+        // Un buffer de stdio (SD_IO_BUFFER_SIZE) entero en una sola transferencia DMA
+        .max_transfer_sz = SD_IO_BUFFER_SIZE,
+    };
+    ret_sd = spi_bus_initialize(host.slot, &bus_cfg, SDSPI_DEFAULT_DMA);
+    if (ret_sd != ESP_OK) {
+        ESP_LOGE(TAG_SD, "Failed to initialize bus.");
+        return ret_sd;
+    }
+
+    sdspi_device_config_t slot_config = SDSPI_DEVICE_CONFIG_DEFAULT();
+    slot_config.gpio_cs = PIN_SD_CS;
+    slot_config.host_id = host.slot;
+
+    ESP_LOGI(TAG_SD, "Mounting filesystem");
+    ret_sd = esp_vfs_fat_sdspi_mount(mount_point, &host, &slot_config, &mount_config, &card);
+
+    if (ret_sd != ESP_OK) {
+        if (ret_sd == ESP_FAIL) {
+            ESP_LOGE(TAG_SD, "Failed to mount filesystem. "
+                     "If you want the card to be formatted, set the CONFIG_EXAMPLE_FORMAT_IF_MOUNT_FAILED menuconfig option.");
+        } else {
+            ESP_LOGE(TAG_SD, "Failed to initialize the card (%s). "
+                     "Make sure SD card lines have pull-up resistors in place.", esp_err_to_name(ret_sd));
+        }
+        return ret_sd;
+    }
+    ESP_LOGI(TAG_SD, "Tarjeta SD conectada exitosamente\n");
+
+    sd_raise_clock(card);
+
+    // Card has been initialized, print its properties
+    sdmmc_card_print_info(stdout, card);
+
+    // Set the card pointer in the calling function
+    *out_card = card;
+
+    return ESP_OK;
+}
+
+
+esp_err_t eject_SD(sdmmc_card_t *card, sdmmc_host_t *host) {
+    const char mount_point[] = MOUNT_POINT;
+
+    esp_err_t unmount_result = esp_vfs_fat_sdcard_unmount(mount_point, card);
+    if (unmount_result != ESP_OK) {
+        ESP_LOGE(TAG_SD, "Failed to unmount SD card");
+        return unmount_result; // Return ESP_ERR with the specific error code
+    }
+
+    // Deinitialize the bus after all devices are removed
+    esp_err_t bus_free_result = spi_bus_free(host->slot);
+    if (bus_free_result != ESP_OK) {
+        ESP_LOGE(TAG_SD, "Failed to free SPI bus");
+        return bus_free_result; // Return ESP_ERR with the specific error code
+    }
+    
+    return ESP_OK; // Return ESP_OK when everything is successful
+}
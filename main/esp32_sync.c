@@ -0,0 +1,553 @@
+#include "esp32_sync.h"
+#include "esp32_general.h"
+#include "esp32_codec.h"
+
+#include <sys/param.h>
+
+/* Servidores de destino, en el orden de enum _sync_sink */
+static const upload_sink_config_t s_sync_sinks[SYNC_SINK_COUNT] = {
+  [SYNC_SINK_CST] = { .name = "CST", .url = cst_server, .required = 0 },
+  [SYNC_SINK_TPI] = { .name = "TPI", .url = tpi_server, .required = 1 },
+};
+
+/* Destino de get_request_sink() para el cliente del Edge */
+static http_sink_t s_edge_sink;
+
+/* El reloj del RTC vuelve a 0 con un power-on (sobrevive al deep sleep) */
+static RTC_DATA_ATTR uint32_t s_sync_clock_magic;
+
+/* Tabla de streams: agregar uno es agregar una fila */
+static const sync_stream_desc_t s_sync_table[] = {
+  {
+    .name             = "salud",
+    .kind             = SYNC_KIND_LOG,
+    .edge_size        = edge_salud_size,
+    .edge_data        = edge_salud_data,
+    .edge_ack         = edge_salud_ack,
+    .log_prefix       = log_salud_prefix,
+    .log_index        = log_salud_index,
+    .err_prefix       = log_err_salud_prefix,
+    .err_index        = log_err_salud_index,
+    .legacy_count     = file_salud_size,
+    .legacy_data      = file_salud_data,
+    .legacy_err_count = file_err_salud_size,
+    .legacy_err_data  = file_err_salud_dat,
+    .paths            = { [SYNC_SINK_CST] = cst_salud, [SYNC_SINK_TPI] = tpi_salud },
+  },
+  {
+    .name             = "pesaje",
+    .kind             = SYNC_KIND_LOG,
+    .edge_size        = edge_pesaje_size,
+    .edge_data        = edge_pesaje_data,
+    .edge_ack         = edge_pesaje_ack,
+    .log_prefix       = log_pesaje_prefix,
+    .log_index        = log_pesaje_index,
+    .err_prefix       = log_err_pesaje_prefix,
+    .err_index        = log_err_pesaje_index,
+    .legacy_count     = file_pesaje_size,
+    .legacy_data      = file_pesaje_data,
+    .paths            = { [SYNC_SINK_CST] = cst_pesaje, [SYNC_SINK_TPI] = tpi_pesaje },
+  },
+  {
+    .name             = "bateria",
+    .kind             = SYNC_KIND_BATTERY,
+    .paths            = { [SYNC_SINK_CST] = cst_bateria },
+  },
+};
+
+
+#if CONFIG_NODO_EDGE_BATCH_SIZE > 0
+/*  Callback de get_request_records(): agrega cada registro recibido al log (ctx) */
+static esp_err_t sync_append_record(const char* record, size_t length, void* ctx){
+    return codec_log_append((sd_log_t*) ctx, record, length);
+}
+#endif
+
+
+/*  Sink de get_request_sink(): el cuerpo de la respuesta va directo al registro
+    abierto con sd_log_append_begin(), a traves del buffer DMA del log */
+static esp_err_t sync_log_write(void* ctx, const char* data, size_t length){
+    return sd_log_append_write((sd_log_t*) ctx, data, length);
+}
+
+
+/*  Callback del protocolo por cursor: "<seq>\t<registro>". Un seq ya guardado
+    se ignora (respuesta repetida). Antes de un salto de seq se hace commit del
+    cursor, asi lo guardado despues del commit siempre tiene seq consecutivos */
+static esp_err_t sync_append_cursor_record(const char* record, size_t length, void* ctx){
+    sync_stream_t* stream = (sync_stream_t*) ctx;
+    sd_cursor_t* cursor = &stream->cursor;
+    char* end;
+    uint32_t seq = strtoul(record, &end, 10);
+    if (end == record || end >= record + length || *end != '\t') {
+        if (cursor->mode) {
+            ESP_LOGE(TAG_SYNC, "[%s] Registro sin seq, se corta el lote\n", stream->desc->name);
+            return ESP_FAIL;
+        }
+        // Un Edge antiguo ignora ?after= y entrega (y borra) un registro sin seq: se guarda
+        // igual y el stream sigue con el protocolo por indice
+        ESP_LOGW(TAG_SYNC, "[%s] El Edge no usa el cursor, se sigue por indice\n", stream->desc->name);
+        stream->mode = (CONFIG_NODO_EDGE_BATCH_SIZE > 0) ? SYNC_EDGE_BATCH : SYNC_EDGE_SINGLE;
+        if (codec_log_append(&stream->log, record, length) == ESP_OK) {
+            stream->fetched++;
+        }
+        stream->next++;
+        return ESP_OK;
+    }
+    cursor->mode = 1;
+    if ((int32_t) (seq - cursor->edge_seq) <= 0) {
+        return ESP_OK;
+    }
+    if (seq != cursor->edge_seq + 1) {
+        cursor->edge_seq = seq - 1;
+        cursor->log_seq  = stream->log.tail.seq;
+        sd_cursor_commit(cursor);
+    }
+
+    const char* data = end + 1;
+    if (codec_log_append(&stream->log, data, length - (data - record)) != ESP_OK) {
+        return ESP_FAIL;
+    }
+    cursor->edge_seq = seq;
+    stream->fetched++;
+    return ESP_OK;
+}
+
+
+/*  Mueve los archivos <prefijo>N.txt de versiones anteriores al log. Con cursor,
+    lo importado queda marcado en el .cur hasta el commit: un corte de energia a
+    mitad no lo cuenta como registros del Edge */
+static void sync_import(sd_log_t* log, sd_cursor_t* cursor, const char* count_file, const char* data_prefix,
+                        char* buffer, size_t size_buffer){
+    char name_file[30];
+    if (count_file == NULL) {
+        return;
+    }
+    snprintf(name_file, sizeof(name_file), "%s.txt", count_file);
+    if (file_exists(name_file)) {
+        led_set(CHECK, YELLOW);
+        if (cursor != NULL && cursor->ready && sd_cursor_import(cursor, log, 1) != ESP_OK) {
+            // Sin la marca no se importa: el siguiente ciclo lo intenta de nuevo
+            return;
+        }
+        sd_log_import_files(log, count_file, data_prefix, buffer, size_buffer);
+        if (cursor != NULL && cursor->ready) {
+            sd_cursor_import(cursor, log, 0);
+        }
+    }
+}
+
+
+esp_err_t sync_open(sync_t* sync, char* buffer, size_t size_buffer){
+    esp_err_t ret = ESP_OK;
+    memset(sync, 0, sizeof(sync_t));
+
+    if (sd_log_open(&sync->quarantine, log_quarantine_prefix, log_quarantine_index) != ESP_OK) {
+        ret = ESP_FAIL;
+    }
+    else if (sd_log_pending(&sync->quarantine) > 0) {
+        ESP_LOGW(TAG_SYNC, "Registros danados en cuarentena (%s*.log) = %lu\n",
+                 log_quarantine_prefix, (unsigned long) sd_log_pending(&sync->quarantine));
+    }
+
+    for (int i = 0; i < (int) (sizeof(s_sync_table) / sizeof(s_sync_table[0])) && i < SYNC_MAX_STREAMS; i++) {
+        const sync_stream_desc_t* desc = &s_sync_table[i];
+        sync_stream_t* stream = &sync->streams[sync->count++];
+        stream->desc       = desc;
+        stream->mode       = (desc->edge_ack != NULL) ? SYNC_EDGE_CURSOR :
+                             (CONFIG_NODO_EDGE_BATCH_SIZE > 0) ? SYNC_EDGE_BATCH : SYNC_EDGE_SINGLE;
+
+        for (int j = 0; j < SYNC_SINK_COUNT; j++) {
+            if (desc->paths[j] != NULL) {
+                snprintf(stream->urls[j], SYNC_URL_SIZE, "%s%s", s_sync_sinks[j].url, desc->paths[j]);
+            }
+        }
+
+        if (desc->kind == SYNC_KIND_BATTERY) {
+            // Sin anillo no hay muestras que enviar, los demas streams siguen
+            sd_battery_open(&sync->battery);
+            if (s_sync_clock_magic != SYNC_CLOCK_MAGIC) {
+                // Power-on: las muestras sin fecha contaban desde un reloj que ya no existe
+                s_sync_clock_magic = SYNC_CLOCK_MAGIC;
+                if (sync->battery.file != NULL) {
+                    sd_battery_date(&sync->battery, 0, 1);
+                }
+            }
+            // La telemetria de cada ciclo viaja con las muestras de bateria
+            sync->telemetry_ready = (sd_log_open(&sync->telemetry, log_telem_prefix, log_telem_index) == ESP_OK);
+            if (sync->telemetry_ready) {
+                telem_flush(&sync->telemetry);
+            }
+            continue;
+        }
+        if (sd_log_open(&stream->log, desc->log_prefix, desc->log_index) != ESP_OK ||
+            sd_log_open(&stream->err_log, desc->err_prefix, desc->err_index) != ESP_OK) {
+            ESP_LOGE(TAG_SYNC, "No se pudieron abrir los logs de %s\n", desc->name);
+            ret = ESP_FAIL;
+            continue;
+        }
+        stream->ready = 1;
+        // El cursor se recupera antes de importar: lo importado no viene del Edge
+        if (desc->edge_data != NULL && sd_cursor_open(&stream->cursor, desc->log_index, &stream->log) != ESP_OK) {
+            ret = ESP_FAIL;
+        }
+        // Archivos <prefijo>N.txt de versiones anteriores
+        sync_import(&stream->err_log, NULL, desc->legacy_err_count, desc->legacy_err_data, buffer, size_buffer);
+        sync_import(&stream->log, &stream->cursor, desc->legacy_count, desc->legacy_data, buffer, size_buffer);
+        // FatFs tiene un maximo de SD_MAX_FILES abiertos: los escritores se abren de nuevo al escribir
+        sd_log_close(&stream->err_log);
+        sd_log_close(&stream->log);
+    }
+    return ret;
+}
+
+
+int sync_clock_valid(){
+    return time(NULL) >= SYNC_CLOCK_VALID;
+}
+
+
+esp_err_t sync_set_clock(sync_t* sync, const char* datetime){
+    struct tm tm_edge = { 0 };
+    const char* start = datetime;
+    while (*start != '\0' && !isdigit((unsigned char) *start)) {
+        start++;
+    }
+    if (sscanf(start, "%d-%d-%d%*c%d:%d:%d", &tm_edge.tm_year, &tm_edge.tm_mon, &tm_edge.tm_mday,
+               &tm_edge.tm_hour, &tm_edge.tm_min, &tm_edge.tm_sec) != 6) {
+        ESP_LOGW(TAG_SYNC, "Hora del Edge no valida: '%s'\n", datetime);
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+    tm_edge.tm_year -= 1900;
+    tm_edge.tm_mon  -= 1;
+    tm_edge.tm_isdst = -1;
+    time_t edge_time = mktime(&tm_edge);
+    if (edge_time < SYNC_CLOCK_VALID) {
+        ESP_LOGW(TAG_SYNC, "Hora del Edge no valida: '%s'\n", datetime);
+        return ESP_ERR_INVALID_RESPONSE;
+    }
+
+    // El RTC deriva durante el deep sleep: se corrige en cada visita al Edge
+    time_t now = time(NULL);
+    int64_t offset = (int64_t) edge_time - (int64_t) now;
+    int was_valid = sync_clock_valid();
+    if (was_valid && offset >= -SYNC_CLOCK_DRIFT_S && offset <= SYNC_CLOCK_DRIFT_S) {
+        return ESP_OK;
+    }
+    struct timeval tv = { .tv_sec = edge_time };
+    if (settimeofday(&tv, NULL) != 0) {
+        ESP_LOGE(TAG_SYNC, "No se pudo ajustar el reloj\n");
+        return ESP_FAIL;
+    }
+    ESP_LOGI(TAG_SYNC, "Reloj ajustado con el Edge: '%s' (%lld s)\n", datetime, (long long) offset);
+    // Las muestras de este power-on se tomaron con el reloj en 0: se les suma lo que se movio
+    if (!was_valid && sync->battery.file != NULL) {
+        sd_battery_date(&sync->battery, offset, 0);
+    }
+    return ESP_OK;
+}
+
+
+esp_http_client_handle_t sync_edge_client(){
+    esp_http_client_config_t config = {
+        .url           = "http://" edge_server,
+        .timeout_ms    = SYNC_EDGE_TIMEOUT_MS,
+        .event_handler = _http_event_handler,       // Descarga de un registro: get_request_sink()
+        .user_data     = &s_edge_sink,
+    };
+    return http_pool_get(SYNC_EDGE_CLIENT, &config);
+}
+
+
+int sync_edge_query(sync_t* sync){
+    char url[SYNC_URL_SIZE];
+    char response[30];
+    int total = 0;
+    esp_http_client_handle_t client = sync_edge_client();
+    if (client == NULL) {
+        return 0;
+    }
+
+    for (int i = 0; i < sync->count; i++) {
+        sync_stream_t* stream = &sync->streams[i];
+        if (stream->desc->edge_size == NULL || !stream->ready) {
+            stream->done = 1;
+            continue;
+        }
+        snprintf(url, sizeof(url), "http://%s%s", edge_server, stream->desc->edge_size);
+        esp_http_client_set_url(client, url);
+        get_request(client, response, sizeof(response));
+        stream->edge_records = MAX(atoi(response), 0);
+        // Con registros guardados y sin confirmar todavia hay que enviar el ack
+        stream->done = (stream->edge_records == 0 &&
+                        (!stream->cursor.mode || stream->cursor.acked_seq == stream->cursor.edge_seq));
+        total += stream->edge_records;
+        ESP_LOGI(TAG_SYNC, "[%s] Cantidad de nuevos datos = '%d' (pendientes en SD = '%lu')\n",
+                 stream->desc->name, stream->edge_records, (unsigned long) sd_log_pending(&stream->log));
+    }
+    return total;
+}
+
+
+/*  Confirma al Edge los registros guardados hasta el cursor */
+static void sync_edge_ack(sync_stream_t* stream, esp_http_client_handle_t client, char* buffer, size_t size_buffer){
+    char url[SYNC_URL_SIZE];
+    sd_cursor_t* cursor = &stream->cursor;
+    if (cursor->acked_seq == cursor->edge_seq) {
+        return;
+    }
+    snprintf(url, sizeof(url), "http://%s%s" edge_ack_query, edge_server, stream->desc->edge_ack,
+             (unsigned long) cursor->edge_seq);
+    esp_http_client_set_url(client, url);
+    int status_code = get_request(client, buffer, size_buffer);
+    if (status_code != 200) {
+        // Se reintenta en el siguiente lote o ciclo; el Edge solo guarda los registros un tiempo mas
+        ESP_LOGW(TAG_SYNC, "[%s] Ack %lu no confirmado (HTTP %d)\n", stream->desc->name,
+                 (unsigned long) cursor->edge_seq, status_code);
+        return;
+    }
+    cursor->acked_seq = cursor->edge_seq;
+    sd_cursor_commit(cursor);
+}
+
+
+/*  Protocolo por cursor: los registros despues del ultimo guardado */
+static int sync_edge_cursor_turn(sync_stream_t* stream, esp_http_client_handle_t client, char* buffer, size_t size_buffer){
+    char url[SYNC_URL_SIZE];
+    sd_cursor_t* cursor = &stream->cursor;
+    int status_code = 0;
+
+    snprintf(url, sizeof(url), "http://%s%s" edge_cursor_query, edge_server, stream->desc->edge_data,
+             (unsigned long) cursor->edge_seq, SYNC_CURSOR_COUNT);
+    esp_http_client_set_url(client, url);
+    int records = get_request_records(client, buffer, size_buffer, sync_append_cursor_record, stream, &status_code);
+    stream->requests++;
+
+    if (records < 0 && stream->requests == 1 && status_code >= 400 && status_code < 500) {
+        ESP_LOGW(TAG_SYNC, "[%s] El Edge no soporta el cursor (HTTP %d)\n", stream->desc->name, status_code);
+        stream->mode = (CONFIG_NODO_EDGE_BATCH_SIZE > 0) ? SYNC_EDGE_BATCH : SYNC_EDGE_SINGLE;
+        stream->requests = 0;
+        return 1;
+    }
+
+    if (stream->mode != SYNC_EDGE_CURSOR) {
+        return (stream->next < stream->edge_records);
+    }
+
+    // Lo guardado queda confirmado localmente aunque la respuesta se haya cortado:
+    // edge_seq solo avanza con los registros escritos en el log
+    int more = (records == SYNC_CURSOR_COUNT && status_code == 200);
+    cursor->mode    = 1;
+    cursor->log_seq = stream->log.tail.seq;
+    sd_cursor_commit(cursor);
+    stream->failed = (records < 0 || status_code != 200);
+    if (!stream->failed) {
+        stream->retries = 0;
+    }
+    else if (stream->retries < SYNC_EDGE_RETRIES) {
+        // Se pide de nuevo desde el cursor, sin esperar al siguiente ciclo
+        stream->retries++;
+        ESP_LOGW(TAG_SYNC, "[%s] Descarga interrumpida en el seq %lu (HTTP %d), reintento %d\n",
+                 stream->desc->name, (unsigned long) cursor->edge_seq, status_code, stream->retries);
+        more = 1;
+    }
+    else {
+        ESP_LOGW(TAG_SYNC, "[%s] Descarga interrumpida en el seq %lu, se sigue en el siguiente ciclo\n",
+                 stream->desc->name, (unsigned long) cursor->edge_seq);
+    }
+    if (!more || cursor->edge_seq - cursor->acked_seq >= SYNC_ACK_EVERY) {
+        sync_edge_ack(stream, client, buffer, size_buffer);
+    }
+    return more;
+}
+
+
+/*  Un turno de un stream: un lote (o un registro si el Edge no soporta lotes).
+    Retorna 0 cuando el stream termino */
+static int sync_edge_turn(sync_stream_t* stream, esp_http_client_handle_t client, char* buffer, size_t size_buffer){
+    char url[SYNC_URL_SIZE];
+    const sync_stream_desc_t* desc = stream->desc;
+
+    if (stream->mode == SYNC_EDGE_CURSOR) {
+        return sync_edge_cursor_turn(stream, client, buffer, size_buffer);
+    }
+
+#if CONFIG_NODO_EDGE_BATCH_SIZE > 0
+    if (stream->mode == SYNC_EDGE_BATCH) {
+        int status_code = 0;
+        int count = MIN(CONFIG_NODO_EDGE_BATCH_SIZE, stream->edge_records - stream->next);
+        snprintf(url, sizeof(url), "http://%s%s" edge_batch_query, edge_server, desc->edge_data, stream->next, count);
+        esp_http_client_set_url(client, url);
+        int records = get_request_records(client, buffer, size_buffer, sync_append_record, &stream->log, &status_code);
+        if (records > 0) {
+            stream->next    += records;
+            stream->fetched += records;
+        }
+        if (status_code == 200 && records > 0) {
+            stream->retries = 0;
+            return (stream->next < stream->edge_records);
+        }
+        // Respuesta cortada: se pide de nuevo desde el siguiente registro no guardado
+        if (status_code == HTTP_RESPONSE_INCOMPLETE && stream->retries < SYNC_EDGE_RETRIES) {
+            stream->retries++;
+            ESP_LOGW(TAG_SYNC, "[%s] Lote interrumpido en el registro %d, reintento %d\n",
+                     desc->name, stream->next, stream->retries);
+            return (stream->next < stream->edge_records);
+        }
+        // Un Edge sin el modo por lotes responde 4xx al primer pedido
+        if (stream->next == 0 && status_code >= 400 && status_code < 500) {
+            ESP_LOGW(TAG_SYNC, "[%s] El Edge no soporta pedidos por lotes (HTTP %d)\n", desc->name, status_code);
+            stream->mode = SYNC_EDGE_SINGLE;
+            return 1;
+        }
+        return 0;
+    }
+#endif
+
+    // Un registro por peticion: se escribe en la SD a medida que llega, sin
+    // pasar por buffer (su tamano no esta limitado y puede tener bytes NUL)
+    snprintf(url, sizeof(url), "http://%s%s", edge_server, desc->edge_data);
+    esp_http_client_set_url(client, url);
+    if (sd_log_append_begin(&stream->log) != ESP_OK) {
+        return 0;
+    }
+    size_t length = 0;
+    int status_code = get_request_sink(client, sync_log_write, &stream->log, &length);
+    if (status_code == 200 && length > 0) {
+        if (sd_log_append_end(&stream->log) == ESP_OK) {
+            stream->fetched++;
+        }
+    }
+    else {
+        sd_log_append_abort(&stream->log);
+        if (status_code == 200) {
+            ESP_LOGE(TAG_SYNC, " \t- [%s] Registro %d vacio, no se guarda\n", desc->name, stream->next);
+        }
+    }
+    stream->next++;
+    delay_ms(SYNC_RECORD_DELAY_MS);
+    return (stream->next < stream->edge_records);
+}
+
+
+int sync_edge_download(sync_t* sync, char* buffer, size_t size_buffer){
+    int fetched = 0;
+    // Todas las peticiones usan el mismo cliente y la misma conexion (keep-alive)
+    esp_http_client_handle_t client = sync_edge_client();
+    if (client == NULL) {
+        sync->edge_failed = 1;
+        return 0;
+    }
+
+    int active = 1;
+    while (active) {
+        active = 0;
+        for (int i = 0; i < sync->count; i++) {
+            sync_stream_t* stream = &sync->streams[i];
+            if (stream->done) {
+                continue;
+            }
+            stream->done = !sync_edge_turn(stream, client, buffer, size_buffer);
+            active |= !stream->done;
+        }
+    }
+
+    sync->edge_failed = 0;
+    for (int i = 0; i < sync->count; i++) {
+        sync_stream_t* stream = &sync->streams[i];
+        if (stream->mode != SYNC_EDGE_CURSOR) {
+            // Protocolos por indice: el Edge no sabe que se guardo, falta lo que no se pidio
+            stream->failed = (stream->next < stream->edge_records);
+            if (stream->cursor.ready) {
+                stream->cursor.mode    = 0;
+                stream->cursor.log_seq = stream->log.tail.seq;
+                sd_cursor_commit(&stream->cursor);
+            }
+        }
+        if (stream->ready) {
+            sd_log_close(&stream->log);
+        }
+        if (stream->edge_records > 0 || stream->fetched > 0) {
+            ESP_LOGI(TAG_SYNC, "[%s] Registros descargados = %d de %d (seq %lu, ack %lu)\n",
+                     stream->desc->name, stream->fetched, stream->edge_records,
+                     (unsigned long) stream->cursor.edge_seq, (unsigned long) stream->cursor.acked_seq);
+        }
+        sync->edge_failed += stream->failed;
+        fetched += stream->fetched;
+    }
+    return fetched;
+}
+
+
+int sync_upload(sync_t* sync){
+    upload_stream_t streams[UPLOAD_MAX_STREAMS];
+    int count = 0;
+
+    // Por cada log: primero los fallidos de ciclos anteriores, luego los nuevos
+    for (int i = 0; i < sync->count && count + 2 <= UPLOAD_MAX_STREAMS; i++) {
+        sync_stream_t* stream = &sync->streams[i];
+        if (!stream->ready) {
+            continue;
+        }
+        ESP_LOGI(TAG_SYNC, "[%s] Registros: %lu, con error: %lu\n", stream->desc->name,
+                 (unsigned long) sd_log_pending(&stream->log), (unsigned long) sd_log_pending(&stream->err_log));
+        upload_stream_t* up = &streams[count++];
+        memset(up, 0, sizeof(upload_stream_t));
+        up->name       = stream->desc->name;
+        up->log        = &stream->err_log;
+        up->failed_log = &stream->err_log;
+        for (int j = 0; j < SYNC_SINK_COUNT; j++) {
+            up->urls[j] = (stream->desc->paths[j] != NULL) ? stream->urls[j] : NULL;
+        }
+        streams[count] = *up;
+        streams[count++].log = &stream->log;
+    }
+
+    int failed = -1;
+    if (upload_begin(s_sync_sinks, SYNC_SINK_COUNT) == ESP_OK) {
+        failed = upload_streams(streams, count, &sync->quarantine);
+        upload_end();
+        ESP_LOGI(TAG_SYNC, "Registros fallidos para el siguiente ciclo = %d\n", failed);
+    }
+    else {
+        ESP_LOGE(TAG_SYNC, "No se pudo iniciar el envio de datos\n");
+    }
+
+    // Muestras de bateria: el documento JSON se arma mientras se envia
+    for (int i = 0; i < sync->count; i++) {
+        sync_stream_t* stream = &sync->streams[i];
+        if (stream->desc->kind == SYNC_KIND_BATTERY && sync->battery.file != NULL &&
+            stream->desc->paths[SYNC_SINK_CST] != NULL) {
+            upload_battery(&sync->battery, sync->telemetry_ready ? &sync->telemetry : NULL,
+                           stream->urls[SYNC_SINK_CST]);
+        }
+    }
+    return failed;
+}
+
+
+uint32_t sync_pending(sync_t* sync){
+    uint32_t pending = 0;
+    for (int i = 0; i < sync->count; i++) {
+        if (sync->streams[i].ready) {
+            pending += sd_log_pending(&sync->streams[i].log) + sd_log_pending(&sync->streams[i].err_log);
+        }
+    }
+    return pending;
+}
+
+
+void sync_close(sync_t* sync){
+    for (int i = 0; i < sync->count; i++) {
+        if (sync->streams[i].ready) {
+            sd_log_close(&sync->streams[i].log);
+            sd_log_close(&sync->streams[i].err_log);
+            sd_cursor_close(&sync->streams[i].cursor);
+        }
+    }
+    sd_log_close(&sync->quarantine);
+    sd_battery_close(&sync->battery);
+    if (sync->telemetry_ready) {
+        sd_log_close(&sync->telemetry);
+    }
+}
@@ -0,0 +1,175 @@
+#ifndef __SYNC_ESP32_
+#define __SYNC_ESP32_
+// ----------------------------------------------------------------- //
+#include <stdint.h>
+
+#include "esp32_sd.h"
+#include "esp32_http.h"
+#include "esp32_upload.h"
+
+/* Define variables for the sync engine */
+#define SYNC_MAX_STREAMS        4           // Data streams of the table (salud, pesaje, bateria)
+#define SYNC_URL_SIZE           100
+#define SYNC_EDGE_TIMEOUT_MS    5000
+#define SYNC_RECORD_DELAY_MS    100         // Pause between single record requests (edge without batches)
+#define SYNC_CURSOR_COUNT       MAX(CONFIG_NODO_EDGE_BATCH_SIZE, 1) // Records per cursor request
+#define SYNC_ACK_EVERY          100         // Records stored before acknowledging them to the edge
+#define SYNC_EDGE_RETRIES       3           // Cut responses in a row repeated in the same cycle
+#define SYNC_EDGE_CLIENT        "edge"      // Name of the edge client in the HTTP pool
+#define SYNC_CLOCK_VALID        1672531200  // 2023-01-01: an earlier time() counts from the power-on
+#define SYNC_CLOCK_DRIFT_S      2           // The clock is set again when it is further from the edge
+#define SYNC_CLOCK_MAGIC        0x434C4B31  // "CLK1"
+
+#define TAG_SYNC                "SYNC_API"
+
+// Upload destinations: the index is the bit of the destination in SD_LOG_FLAG_SENT()
+enum _sync_sink{
+  SYNC_SINK_CST = 0,
+  SYNC_SINK_TPI = 1,
+  SYNC_SINK_COUNT
+};
+
+// Download protocol of a stream, from the newest to the oldest edge
+enum _sync_edge_mode{
+  SYNC_EDGE_CURSOR  = 0,    // ?after=<seq>&count=K + acknowledgements (resumable)
+  SYNC_EDGE_BATCH   = 1,    // ?from=<index>&count=K
+  SYNC_EDGE_SINGLE  = 2,    // One record per request
+};
+
+// Where the records of a stream are kept in the SD card
+enum _sync_kind{
+  SYNC_KIND_LOG     = 0,    // Record log + log of failed records (JSON/CBOR records)
+  SYNC_KIND_BATTERY = 1,    // Battery ring (samples taken by the node itself)
+};
+
+
+/* Data stream: edge endpoints, SD namespace and upload endpoints */
+typedef struct {
+   const char* name;
+   uint8_t     kind;                        // enum _sync_kind
+   const char* edge_size;                   // Edge endpoints (NULL = not downloaded from the edge)
+   const char* edge_data;
+   const char* edge_ack;                    // Acknowledgements of the cursor protocol (NULL = index protocol)
+   const char* log_prefix;                  // SYNC_KIND_LOG: segment prefix + index of both logs
+   const char* log_index;
+   const char* err_prefix;
+   const char* err_index;
+   const char* legacy_count;                // Legacy <legacy_data>N.txt files imported to the logs (NULL = none)
+   const char* legacy_data;
+   const char* legacy_err_count;
+   const char* legacy_err_data;
+   const char* paths[SYNC_SINK_COUNT];      // Path on every server (NULL = not sent there)
+} sync_stream_desc_t;
+
+
+/* State of a stream during the wake cycle */
+typedef struct {
+   const sync_stream_desc_t* desc;
+   sd_log_t          log;
+   sd_log_t          err_log;
+   sd_cursor_t       cursor;                // Edge records stored / acknowledged ("<log_index>.cur")
+   int               edge_records;          // Reported by edge_size
+   int               next;                  // Next edge record to request (index protocols)
+   int               fetched;               // Records stored in the log
+   int               mode;                  // enum _sync_edge_mode, the next one after a 4xx to the first request
+   int               requests;
+   int               retries;               // Cut responses in a row, repeated from the cursor (or next)
+   int               done;                  // Nothing else to download this cycle
+   int               failed;                // The download stopped on an error
+   int               ready;                 // Logs open
+   char              urls[SYNC_SINK_COUNT][SYNC_URL_SIZE];
+} sync_stream_t;
+
+
+/* Every stream of the table + the SD areas they share */
+typedef struct {
+   sync_stream_t     streams[SYNC_MAX_STREAMS];
+   int               count;
+   sd_log_t          quarantine;            // Damaged records of every log
+   sd_battery_t      battery;               // Ring of SYNC_KIND_BATTERY
+   sd_log_t          telemetry;             // Resources of every wake cycle (esp32_telem.h), sent with the battery
+   int               telemetry_ready;
+   int               edge_failed;           // Streams whose download stopped on an error
+} sync_t;
+
+
+/**
+ * @brief This function opens the SD area of every stream of the table (logs,
+ *        battery ring, telemetry, quarantine), imports the legacy files and
+ *        stores the telemetry record of the previous cycle
+ * @param buffer: Buffer used to read the legacy files
+ * @return ESP_OK, or ESP_FAIL if a log could not be opened
+ */
+esp_err_t sync_open(sync_t* sync, char* buffer, size_t size_buffer);
+
+
+/**
+ * @brief 1 if the clock has the date (set by the edge in this power-on),
+ *        0 if time() counts the seconds since the power-on
+ */
+int sync_clock_valid();
+
+
+/**
+ * @brief Sets the clock with the date of the edge (/datetime, "YYYY-MM-DD HH:MM:SS").
+ *        The RTC keeps it during deep sleep. The battery samples taken before,
+ *        in this power-on, get their date (sd_battery_date)
+ * @return ESP_OK, or ESP_ERR_INVALID_RESPONSE if datetime is not a date
+ */
+esp_err_t sync_set_clock(sync_t* sync, const char* datetime);
+
+
+/**
+ * @brief Client of the edge for the whole cycle (HTTP pool), created with the
+ *        event handler of get_request_sink(). It also serves plain get_request()
+ */
+esp_http_client_handle_t sync_edge_client();
+
+
+/**
+ * @brief This function asks the edge how many records every stream has
+ * @return Records reported by the edge (all streams)
+ */
+int sync_edge_query(sync_t* sync);
+
+
+/**
+ * @brief This function downloads the records reported by sync_edge_query().
+ *        The streams take turns (one batch of CONFIG_NODO_EDGE_BATCH_SIZE
+ *        each) over one keep-alive connection and the same buffer, so a big
+ *        stream does not delay the others.
+ *        With the cursor protocol every record carries its edge sequence
+ *        number: the batch asks for the records after the local cursor, the
+ *        cursor is committed after the records are in the log and the edge
+ *        gets an acknowledgement every SYNC_ACK_EVERY records and at the end.
+ *        A cut connection or a reboot resumes after the last stored record.
+ *        An edge that answers 4xx to the first request is downloaded with
+ *        the index protocol (?from=N), then one record per request
+ * @param buffer: Working buffer, must fit the biggest record
+ * @return Records stored in the SD card (all streams)
+ */
+int sync_edge_download(sync_t* sync, char* buffer, size_t size_buffer);
+
+
+/**
+ * @brief This function sends every log stream to its servers in one upload
+ *        session (upload_streams(): the streams share the clients and the
+ *        in-flight limits), then the battery samples
+ * @return Records copied to the failed logs, or -1 if the session could not start
+ */
+int sync_upload(sync_t* sync);
+
+
+/**
+ * @brief Records not sent yet (all log streams)
+ */
+uint32_t sync_pending(sync_t* sync);
+
+
+/**
+ * @brief This function closes every log and the battery ring
+ */
+void sync_close(sync_t* sync);
+
+// ----------------------------------------------------------------- //
+#endif /* __SYNC_ESP32_ */
@@ -0,0 +1,174 @@
+#include "esp32_telem.h"
+
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+
+static const char* s_task_values[TELEM_TASK_COUNT] = {
+  [TELEM_TASK_MAIN]      = "Stack_main",
+  [TELEM_TASK_BOOT_WIFI] = "Stack_boot_wifi",
+  [TELEM_TASK_BOOT_SD]   = "Stack_boot_sd",
+  [TELEM_TASK_BOOT_BAT]  = "Stack_boot_bat",
+  [TELEM_TASK_UPLOAD]    = "Stack_upload",
+  [TELEM_TASK_LED]       = "Stack_led",
+};
+
+// Sobreviven al deep sleep: el registro de un ciclo se guarda en la SD en el siguiente
+static RTC_DATA_ATTR uint32_t       s_telem_magic;
+static RTC_DATA_ATTR int            s_telem_last_valid;
+static RTC_DATA_ATTR telem_record_t s_telem_last;      // Ciclo anterior, hasta telem_flush()
+static RTC_DATA_ATTR telem_record_t s_telem_current;
+static RTC_DATA_ATTR int            s_telem_current_valid;  // Termino alguna fase del ciclo
+
+static TaskHandle_t s_watched[TELEM_TASK_COUNT];
+static portMUX_TYPE s_telem_lock = portMUX_INITIALIZER_UNLOCKED;
+
+
+static void telem_record_reset(telem_record_t* record){
+  memset(record, 0, sizeof(telem_record_t));
+  record->min_largest_block = UINT32_MAX;
+  for(int i = 0; i < TELEM_TASK_COUNT; i++){
+    record->stack_free[i] = TELEM_STACK_NOT_RUN;
+  }
+}
+
+
+void telem_init(){
+  // En el primer arranque (power-on) la memoria RTC no tiene datos validos
+  if(s_telem_magic != TELEM_MAGIC){
+    s_telem_magic      = TELEM_MAGIC;
+    s_telem_last_valid = 0;
+  }
+  else if(s_telem_current_valid){
+    if(s_telem_last_valid){
+      ESP_LOGW(TAG_TELEM, "La telemetria de un ciclo no llego a la SD, se descarta\n");
+    }
+    s_telem_last       = s_telem_current;
+    s_telem_last_valid = 1;
+  }
+  telem_record_reset(&s_telem_current);
+  s_telem_current_valid = 0;
+
+  memset(s_watched, 0, sizeof(s_watched));
+  s_watched[TELEM_TASK_MAIN] = xTaskGetCurrentTaskHandle();
+}
+
+
+void telem_watch(enum _telem_task task, TaskHandle_t handle){
+  if(task >= TELEM_TASK_COUNT){
+    return;
+  }
+  s_watched[task] = handle;
+}
+
+
+static void telem_stack_update(enum _telem_task task, UBaseType_t stack_free){
+  if(stack_free < s_telem_current.stack_free[task]){
+    s_telem_current.stack_free[task] = (stack_free < TELEM_STACK_NOT_RUN) ? stack_free : TELEM_STACK_NOT_RUN - 1;
+  }
+}
+
+
+void telem_task_exit(enum _telem_task task){
+  if(task >= TELEM_TASK_COUNT){
+    return;
+  }
+  UBaseType_t stack_free = uxTaskGetStackHighWaterMark(NULL);
+
+  portENTER_CRITICAL(&s_telem_lock);
+  telem_stack_update(task, stack_free);
+  portEXIT_CRITICAL(&s_telem_lock);
+}
+
+
+/*  Archivos abiertos en la SD: la FAT es el unico sistema de archivos con
+    archivos regulares (UART y sockets no son S_IFREG) */
+static int telem_sd_files(){
+  int files = 0;
+  struct stat st;
+  for(int fd = 0; fd < TELEM_MAX_FDS; fd++){
+    if(fstat(fd, &st) == 0 && S_ISREG(st.st_mode)){
+      files++;
+    }
+  }
+  return files;
+}
+
+
+void telem_phase_end(enum _phase phase){
+  // Fuera de la seccion critica: estas consultas toman sus propios locks
+  uint32_t free_heap     = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+  uint32_t min_free_heap = heap_caps_get_minimum_free_size(MALLOC_CAP_8BIT);
+  uint32_t largest_block = heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+  int      sd_files      = telem_sd_files();
+  UBaseType_t stack_free[TELEM_TASK_COUNT];
+  for(int i = 0; i < TELEM_TASK_COUNT; i++){
+    stack_free[i] = (s_watched[i] != NULL) ? uxTaskGetStackHighWaterMark(s_watched[i]) : UINT32_MAX;
+  }
+
+  portENTER_CRITICAL(&s_telem_lock);
+  telem_record_t* record = &s_telem_current;
+  record->time          = (uint32_t) time(NULL);
+  record->free_heap     = free_heap;
+  record->min_free_heap = min_free_heap;
+  if(largest_block < record->min_largest_block){
+    record->min_largest_block = largest_block;
+    record->block_phase       = phase;
+  }
+  if(sd_files > record->max_sd_files){
+    record->max_sd_files = (sd_files < UINT8_MAX) ? sd_files : UINT8_MAX;
+    record->files_phase  = phase;
+  }
+  for(int i = 0; i < TELEM_TASK_COUNT; i++){
+    if(s_watched[i] != NULL){
+      telem_stack_update(i, stack_free[i]);
+    }
+  }
+  s_telem_current_valid = 1;
+  portEXIT_CRITICAL(&s_telem_lock);
+}
+
+
+esp_err_t telem_flush(sd_log_t* log){
+  if(!s_telem_last_valid){
+    return ESP_ERR_NOT_FOUND;
+  }
+  // Un registro por ciclo: el escritor no se queda abierto ocupando uno de los SD_MAX_FILES
+  esp_err_t ret = sd_log_append(log, (const char*) &s_telem_last, sizeof(telem_record_t));
+  sd_log_close(log);
+  if(ret != ESP_OK){
+    ESP_LOGE(TAG_TELEM, "No se pudo guardar la telemetria del ciclo anterior\n");
+    return ESP_FAIL;
+  }
+  s_telem_last_valid = 0;
+
+  ESP_LOGI(TAG_TELEM, "Ciclo anterior: heap min = %lu, bloque min = %lu (fase %u), archivos SD = %u, stack main = %u\n",
+           (unsigned long) s_telem_last.min_free_heap, (unsigned long) s_telem_last.min_largest_block,
+           s_telem_last.block_phase, s_telem_last.max_sd_files, s_telem_last.stack_free[TELEM_TASK_MAIN]);
+  return ESP_OK;
+}
+
+
+int telem_record_value(const telem_record_t* record, int index, const char** name, uint32_t* value){
+  switch(index){
+    case 0: *name = "HeapMin";        *value = record->min_free_heap;     return 1;
+    case 1: *name = "HeapBloque";     *value = record->min_largest_block; return 1;
+    case 2: *name = "HeapBloqueFase"; *value = record->block_phase;       return 1;
+    case 3: *name = "HeapLibre";      *value = record->free_heap;         return 1;
+    case 4: *name = "ArchivosSD";     *value = record->max_sd_files;      return 1;
+    case 5: *name = "ArchivosSDFase"; *value = record->files_phase;       return 1;
+  }
+  // Despues, un valor por cada tarea que corrio en el ciclo
+  index -= 6;
+  for(int i = 0; i < TELEM_TASK_COUNT; i++){
+    if(record->stack_free[i] == TELEM_STACK_NOT_RUN){
+      continue;
+    }
+    if(index-- == 0){
+      *name  = s_task_values[i];
+      *value = record->stack_free[i];
+      return 1;
+    }
+  }
+  return 0;
+}
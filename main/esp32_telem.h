@@ -0,0 +1,90 @@
+#ifndef __TELEM_ESP32_
+#define __TELEM_ESP32_
+// ----------------------------------------------------------------- //
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"  // portMUX: phases end in several tasks at the same time
+#include "freertos/task.h"      // uxTaskGetStackHighWaterMark(): stack never used by a task (bytes)
+#include "esp_heap_caps.h"      // Free heap, minimum free heap and largest free block
+#include "esp_attr.h"           // RTC_DATA_ATTR: the record of a cycle is stored in the SD in the next one
+#include "esp_log.h"
+
+#include "esp32_prof.h"         // enum _phase: the resources are sampled when a phase ends
+#include "esp32_sd.h"           // Telemetry log (log_telem_prefix)
+
+/* Define variables for the resource monitor */
+#define TELEM_MAGIC             0x54454C4D  // "TELM"
+#define TELEM_MAX_FDS           64          // VFS descriptors probed for open SD files (MAX_FDS of esp_vfs)
+#define TELEM_STACK_NOT_RUN     0xFFFF      // The task did not run in the cycle
+
+#define TAG_TELEM               "TELEM_API"
+
+// Tasks whose stack is watched. WARNING: keep the order, it is the layout of telem_record_t
+enum _telem_task{
+  TELEM_TASK_MAIN      = 0,
+  TELEM_TASK_BOOT_WIFI = 1,
+  TELEM_TASK_BOOT_SD   = 2,
+  TELEM_TASK_BOOT_BAT  = 3,
+  TELEM_TASK_UPLOAD    = 4,   // Every destination task of esp32_upload.c
+  TELEM_TASK_LED       = 5,
+  TELEM_TASK_COUNT
+};
+
+/* Resources of one wake cycle: one record of the telemetry log (32 bytes, little endian) */
+typedef struct {
+   uint32_t time;                          // time() at the last phase boundary of the cycle
+   uint32_t min_free_heap;                 // Lowest free heap since boot (bytes)
+   uint32_t min_largest_block;             // Smallest "largest free block" seen at a phase boundary
+   uint32_t free_heap;                     // Free heap at the last phase boundary
+   uint16_t stack_free[TELEM_TASK_COUNT];  // Lowest stack high-water mark (bytes) or TELEM_STACK_NOT_RUN
+   uint8_t  max_sd_files;                  // Most files open in the SD at a phase boundary
+   uint8_t  block_phase;                   // enum _phase where min_largest_block was seen
+   uint8_t  files_phase;                   // enum _phase where max_sd_files was seen
+   uint8_t  reserved;
+} telem_record_t;
+
+
+/**
+ * @brief This function starts the record of a new wake cycle (call it after
+ *        prof_init). The record of the previous cycle is kept for telem_flush()
+ */
+void telem_init();
+
+
+/**
+ * @brief Long-lived task: its stack is sampled at every phase boundary
+ */
+void telem_watch(enum _telem_task task, TaskHandle_t handle);
+
+
+/**
+ * @brief Short-lived task: samples the stack of the calling task, call it right
+ *        before vTaskDelete(NULL)
+ */
+void telem_task_exit(enum _telem_task task);
+
+
+/**
+ * @brief Samples heap, stacks and open SD files (called by prof_phase_end)
+ */
+void telem_phase_end(enum _phase phase);
+
+
+/**
+ * @brief This function appends the record of the previous cycle to the telemetry
+ *        log and closes its writer. It is sent with the battery samples (upload_battery)
+ * @return ESP_OK, ESP_ERR_NOT_FOUND if there is no record or ESP_FAIL
+ */
+esp_err_t telem_flush(sd_log_t* log);
+
+
+/**
+ * @brief Value number index of a record, for the JSON document of cst_bateria.
+ *        Tasks that did not run in the cycle are skipped
+ * @param name: "Identificador" of the value
+ * @return 1 if the value exists, 0 after the last one
+ */
+int telem_record_value(const telem_record_t* record, int index, const char** name, uint32_t* value);
+
+// ----------------------------------------------------------------- //
+#endif /* __TELEM_ESP32_ */
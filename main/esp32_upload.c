@@ -0,0 +1,1082 @@
+#include "esp32_upload.h"
+#include "esp32_general.h"
+
+#include <sys/param.h>
+
+#include "esp_wifi.h"          // esp_wifi_get_mac(): idDispositivo of the battery document
+
+#if CONFIG_MBEDTLS_CERTIFICATE_BUNDLE
+#include "esp_crt_bundle.h"
+#endif
+
+/* Record read once from the SD card and shared by every destination */
+typedef struct {
+   uint32_t    seq;
+   uint32_t    length;
+   uint16_t    flags;                       // SD_LOG_FLAG_* of the stored record
+   sd_log_cursor_t pos;                     // Position of the record in its log (upload_hold)
+   upload_stream_t* stream;                 // Log the record comes from (endpoint + failed log)
+   uint8_t     done;                        // Destinations that finished (only the reader task)
+   int8_t      status[UPLOAD_MAX_SINKS];    // Ledger: HTTP status per destination (each task writes its own slot)
+   const char* body;                        // JSON that is sent: data itself or the copy decoded from CBOR
+   uint32_t    body_length;
+   char        data[];                      // Record as stored in the SD card
+} upload_item_t;
+
+/* Destination: client + task + queue of records */
+typedef struct {
+   upload_sink_config_t       config;
+   int                        index;
+   esp_http_client_handle_t   client;
+   const char*                url;              // URL the client points to (changes with the stream)
+   QueueHandle_t              queue;
+   int                        sent;
+   int                        failed;
+   int                        requests;
+   int64_t                    busy_us;          // Time inside http_post_stream()
+   int64_t                    post_start_us;    // Start of the current POST (for the connect time)
+   int                        connects;         // New connections (TCP + TLS handshake)
+   int64_t                    first_connect_us; // First handshake of the cycle (resumed if the session survived the deep sleep)
+   int64_t                    reconnect_us;     // Later handshakes (resumed with the session ticket)
+   int                        batch_mode;       // 0 after a 4xx to a batch: one record per request
+   upload_item_t*             batch[UPLOAD_BATCH_SIZE];
+   char*                      body;             // Only with compression: request assembled in RAM
+   uint8_t*                   compressed;
+   uint16_t*                  hash_table;
+   char                       chunk[UPLOAD_CHUNK_SIZE];
+   char                       response[UPLOAD_RESPONSE_SIZE];
+} upload_sink_t;
+
+/* Reader of a batch body: "[" item "," item ... "]" */
+typedef struct {
+   upload_item_t* const* items;
+   int                   count;
+   int                   part;         // 0 = "[", odd = item (part - 1) / 2, even = "," or "]"
+   size_t                offset;       // Bytes of the part already copied
+} upload_batch_reader_t;
+
+/* Records read and not finished by every destination */
+typedef struct {
+   int    count;
+   size_t bytes;
+} upload_flight_t;
+
+/* Reader of the battery document, rendered piece by piece from the ring */
+typedef struct {
+   sd_battery_t* battery;
+   const char*   device;
+   uint32_t      first;        // First sample of the document
+   uint32_t      seq;          // Next sample
+   uint32_t      end;
+   const telem_record_t* telem;  // Telemetry records of the document
+   int           telem_count;
+   int           telem_index;  // Next record
+   int           telem_value;  // Next value of the record (telem_record_value)
+   int           part;         // 0 = envelope, 1 = samples + telemetry, 2 = "]}", 3 = end
+   int           samples;      // Entries of registro[] rendered
+   char          text[160];
+   size_t        length;
+   size_t        offset;
+} upload_battery_reader_t;
+
+/* Reader of a record streamed from the SD */
+typedef struct {
+   sd_log_iter_t* iter;
+   int            result;       // Last sd_log_iter_read() result (SD_LOG_READ_* after a failure)
+} upload_log_reader_t;
+
+/* Reader of a body that is already in RAM */
+typedef struct {
+   const char* data;
+   size_t      length;
+   size_t      offset;
+} upload_memory_reader_t;
+
+static upload_sink_t*      s_sinks[UPLOAD_MAX_SINKS];
+static int                 s_sink_count = 0;
+static QueueHandle_t       s_done_queue = NULL;     // Records finished by a destination
+static SemaphoreHandle_t   s_sinks_stopped = NULL;  // Given by every task when it ends
+static char                s_chunk[UPLOAD_CHUNK_SIZE];
+static char*               s_json = NULL;           // CBOR -> JSON (only the reader task)
+static mem_ring_t          s_ring;                  // Records in flight (only the reader task)
+static void*               s_ring_block = NULL;
+static upload_sink_t*      s_sink_blocks[UPLOAD_MAX_SINKS];  // Kept for the whole cycle
+
+
+/*  Buffers de la sesion: de la arena del ciclo, o del heap si ya no entran.
+    No se liberan, el siguiente upload_begin() del ciclo los reutiliza */
+static void* upload_alloc(size_t size){
+    void* ptr = mem_alloc(size);
+    return (ptr != NULL) ? ptr : malloc(size);
+}
+
+
+static int read_memory_chunk(void* ctx, char* buffer, size_t size){
+    upload_memory_reader_t* reader = (upload_memory_reader_t*) ctx;
+    size_t to_copy = MIN(size, reader->length - reader->offset);
+    memcpy(buffer, reader->data + reader->offset, to_copy);
+    reader->offset += to_copy;
+    return to_copy;
+}
+
+
+static esp_err_t rewind_memory_chunk(void* ctx){
+    ((upload_memory_reader_t*) ctx)->offset = 0;
+    return ESP_OK;
+}
+
+
+static int read_log_chunk(void* ctx, char* buffer, size_t size){
+    upload_log_reader_t* reader = (upload_log_reader_t*) ctx;
+    reader->result = sd_log_iter_read(reader->iter, buffer, size);
+    return reader->result;
+}
+
+
+static esp_err_t rewind_log_chunk(void* ctx){
+    return sd_log_iter_rewind_record(((upload_log_reader_t*) ctx)->iter);
+}
+
+
+static void upload_batch_part(const upload_batch_reader_t* reader, const char** data, size_t* length){
+    if (reader->part % 2 == 1) {
+        const upload_item_t* item = reader->items[reader->part / 2];
+        *data   = item->body;
+        *length = item->body_length;
+        return;
+    }
+    *data   = (reader->part == 0) ? "[" : (reader->part == 2 * reader->count) ? "]" : ",";
+    *length = 1;
+}
+
+
+static int read_batch_chunk(void* ctx, char* buffer, size_t size){
+    upload_batch_reader_t* reader = (upload_batch_reader_t*) ctx;
+    size_t written = 0;
+    while (written < size && reader->part <= 2 * reader->count) {
+        const char* data;
+        size_t length;
+        upload_batch_part(reader, &data, &length);
+        size_t to_copy = MIN(size - written, length - reader->offset);
+        memcpy(buffer + written, data + reader->offset, to_copy);
+        written += to_copy;
+        reader->offset += to_copy;
+        if (reader->offset == length) {
+            reader->part++;
+            reader->offset = 0;
+        }
+    }
+    return written;
+}
+
+
+static esp_err_t rewind_batch_chunk(void* ctx){
+    upload_batch_reader_t* reader = (upload_batch_reader_t*) ctx;
+    reader->part = 0;
+    reader->offset = 0;
+    return ESP_OK;
+}
+
+
+static size_t upload_batch_length(upload_item_t* const* items, int count){
+    // Corchetes + comas
+    size_t length = count + 1;
+    for (int i = 0; i < count; i++) {
+        length += items[i]->body_length;
+    }
+    return length;
+}
+
+
+/*  HTTP_EVENT_ON_CONNECTED llega al terminar el handshake: el tiempo desde el
+    inicio del POST es lo que costo abrir la conexion */
+static esp_err_t upload_http_event(esp_http_client_event_t* evt){
+    upload_sink_t* sink = (upload_sink_t*) evt->user_data;
+    if (evt->event_id == HTTP_EVENT_ON_CONNECTED && sink != NULL) {
+        int64_t elapsed_us = esp_timer_get_time() - sink->post_start_us;
+        if (sink->connects == 0) {
+            sink->first_connect_us = elapsed_us;
+        }
+        else {
+            sink->reconnect_us += elapsed_us;
+        }
+        sink->connects++;
+    }
+    return ESP_OK;
+}
+
+
+static void upload_set_encoding(upload_sink_t* sink, uint8_t encoding){
+    const char* name = codec_encoding_name(encoding);
+    if (name != NULL) {
+        esp_http_client_set_header(sink->client, "Content-Encoding", name);
+    }
+    else {
+        esp_http_client_delete_header(sink->client, "Content-Encoding");
+    }
+}
+
+
+/*  Prepara el cuerpo del POST: los registros CBOR se pasan a JSON (los servidores
+    solo aceptan JSON). La copia va despues de los datos originales, que se
+    mantienen para el log de fallidos */
+static esp_err_t upload_prepare_body(upload_item_t* item){
+    const char* body = item->data;
+    size_t body_length = item->length;
+
+    if (item->flags & SD_LOG_FLAG_CBOR) {
+        int json_length = codec_cbor_to_json((const uint8_t*) item->data, item->length, s_json, UPLOAD_WIRE_SIZE);
+        if (json_length < 0) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        body = s_json;
+        body_length = json_length;
+    }
+
+    if (body == item->data) {
+        item->body = item->data;
+        item->body_length = body_length;
+        return ESP_OK;
+    }
+    memcpy(item->data + item->length, body, body_length);
+    item->body = item->data + item->length;
+    item->body_length = body_length;
+    // El bloque se reservo para el JSON mas grande: se devuelve lo que sobra al anillo
+    mem_ring_resize(&s_ring, item, sizeof(upload_item_t) + item->length + body_length);
+    return ESP_OK;
+}
+
+
+// El status se guarda en un int8_t: 1 = 200 OK, 0 = fallo
+static int8_t upload_result(upload_sink_t* sink, uint32_t seq, int status_code){
+    if (status_code == 200) {
+        sink->sent++;
+        led_set(CHECK, GREEN);
+        ESP_LOGI(TAG_UPLOAD, " \t- [%s] El registro %lu se envio correctamente\n",
+                 sink->config.name, (unsigned long) seq);
+        return 1;
+    }
+    sink->failed++;
+    led_set(CHECK, RED);
+    ESP_LOGE(TAG_UPLOAD, " \t- [%s] Fallo al enviar el registro %lu (HTTP %d)\n",
+             sink->config.name, (unsigned long) seq, status_code);
+    return 0;
+}
+
+
+/*  Los streams comparten el cliente del destino: la URL solo se cambia cuando
+    el lote es de otro stream (misma conexion si el host es el mismo) */
+static void upload_set_url(upload_sink_t* sink, const char* url){
+    if (sink->url != url) {
+        esp_http_client_set_url(sink->client, url);
+        sink->url = url;
+    }
+}
+
+
+/*  Un POST con uno (objeto) o varios registros (arreglo JSON). Con compresion
+    el cuerpo se arma en RAM; si no entra o no se reduce se envia tal cual */
+static int upload_post(upload_sink_t* sink, upload_item_t* const* items, int count){
+    upload_memory_reader_t memory = { 0 };
+    upload_batch_reader_t batch = { .items = items, .count = count };
+    http_body_reader_t read_body = read_memory_chunk;
+    http_body_rewind_t rewind_body = rewind_memory_chunk;
+    void* ctx = &memory;
+    size_t length;
+    uint8_t encoding = CODEC_ENCODING_NONE;
+
+    if (count == 1) {
+        memory.data = items[0]->body;
+        memory.length = items[0]->body_length;
+    }
+    else {
+        read_body = read_batch_chunk;
+        rewind_body = rewind_batch_chunk;
+        ctx = &batch;
+    }
+    length = (count == 1) ? memory.length : upload_batch_length(items, count);
+
+    if (sink->body != NULL && length <= UPLOAD_BODY_SIZE) {
+        if (count > 1) {
+            read_batch_chunk(&batch, sink->body, length);
+        }
+        else {
+            memcpy(sink->body, memory.data, length);
+        }
+        int compressed = codec_compress((const uint8_t*) sink->body, length, sink->compressed,
+                                        UPLOAD_BODY_SIZE, UPLOAD_ENCODING, sink->hash_table);
+        if (compressed > 0 && (size_t) compressed < length) {
+            memory.data = (const char*) sink->compressed;
+            memory.length = compressed;
+            memory.offset = 0;
+            read_body = read_memory_chunk;
+            rewind_body = rewind_memory_chunk;
+            ctx = &memory;
+            length = compressed;
+            encoding = UPLOAD_ENCODING;
+        }
+        else {
+            // El lector del arreglo ya se consumio
+            rewind_batch_chunk(&batch);
+        }
+    }
+
+    upload_set_url(sink, items[0]->stream->urls[sink->index]);
+    upload_set_encoding(sink, encoding);
+    sink->post_start_us = esp_timer_get_time();
+    int status_code = http_post_stream(sink->client, length, read_body, rewind_body, ctx,
+                                       sink->chunk, sizeof(sink->chunk),
+                                       sink->response, sizeof(sink->response));
+    sink->busy_us += esp_timer_get_time() - sink->post_start_us;
+    sink->requests++;
+    return status_code;
+}
+
+
+/*  Resultado por registro en la respuesta de un lote: un arreglo con un elemento
+    por registro, cada uno un status HTTP, un booleano o un objeto con "status"/"ok".
+    Retorna 0 si la respuesta no tiene ese formato (el status aplica a todo el lote) */
+static int upload_batch_results(const char* response, int count, int* results){
+    cJSON* root = cJSON_Parse(response);
+    if (!cJSON_IsArray(root) || cJSON_GetArraySize(root) != count) {
+        cJSON_Delete(root);
+        return 0;
+    }
+    int i = 0;
+    const cJSON* element;
+    cJSON_ArrayForEach(element, root) {
+        const cJSON* value = element;
+        if (cJSON_IsObject(element)) {
+            value = cJSON_GetObjectItem(element, "status");
+            if (value == NULL) {
+                value = cJSON_GetObjectItem(element, "ok");
+            }
+        }
+        if (cJSON_IsNumber(value)) {
+            results[i] = value->valueint;
+        }
+        else if (cJSON_IsBool(value)) {
+            results[i] = cJSON_IsTrue(value) ? 200 : 500;
+        }
+        else {
+            results[i] = -1;
+        }
+        i++;
+    }
+    cJSON_Delete(root);
+    return 1;
+}
+
+
+static void upload_send_batch(upload_sink_t* sink, int count){
+    int results[UPLOAD_BATCH_SIZE];
+    int status_code = upload_post(sink, sink->batch, count);
+
+    if (count > 1 && status_code >= 400 && status_code < 500) {
+        // El servidor no acepta arreglos: seguimos de a un registro
+        ESP_LOGW(TAG_UPLOAD, "[%s] Lote rechazado (HTTP %d), se envia de a un registro\n",
+                 sink->config.name, status_code);
+        sink->batch_mode = 0;
+        for (int i = 0; i < count; i++) {
+            results[i] = upload_post(sink, &sink->batch[i], 1);
+        }
+    }
+    else if (count == 1 || status_code != 200 || !upload_batch_results(sink->response, count, results)) {
+        for (int i = 0; i < count; i++) {
+            results[i] = status_code;
+        }
+    }
+
+    for (int i = 0; i < count; i++) {
+        sink->batch[i]->status[sink->index] = upload_result(sink, sink->batch[i]->seq, results[i]);
+    }
+}
+
+
+static void upload_sink_task(void* arg){
+    upload_sink_t* sink = (upload_sink_t*) arg;
+    upload_item_t* item;
+
+    while (xQueueReceive(sink->queue, &item, portMAX_DELAY) == pdTRUE) {
+        // NULL = no hay mas registros
+        if (item == NULL) {
+            break;
+        }
+
+        // Juntamos los registros del mismo stream que llegan mientras tanto (hasta N registros o M bytes)
+        int count = 0;
+        size_t bytes = item->body_length + 2;
+        sink->batch[count++] = item;
+        while (sink->batch_mode && count < UPLOAD_BATCH_SIZE) {
+            upload_item_t* next;
+            if (xQueuePeek(sink->queue, &next, pdMS_TO_TICKS(UPLOAD_BATCH_WAIT_MS)) != pdTRUE ||
+                next == NULL || next->stream != item->stream ||
+                bytes + next->body_length + 1 > UPLOAD_BATCH_BYTES) {
+                break;
+            }
+            xQueueReceive(sink->queue, &next, 0);
+            sink->batch[count++] = next;
+            bytes += next->body_length + 1;
+        }
+
+        upload_send_batch(sink, count);
+        for (int i = 0; i < count; i++) {
+            xQueueSend(s_done_queue, &sink->batch[i], portMAX_DELAY);
+        }
+    }
+
+    telem_task_exit(TELEM_TASK_UPLOAD);
+    xSemaphoreGive(s_sinks_stopped);
+    vTaskDelete(NULL);
+}
+
+
+static int upload_required_acked(const int8_t* status){
+    for (int i = 0; i < s_sink_count; i++) {
+        if (s_sinks[i]->config.required && status[i] != 1) {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+
+/* RAM que ocupa un registro en vuelo (datos + copia JSON) */
+static size_t upload_item_size(const upload_item_t* item){
+    return item->length + ((item->body != item->data) ? item->body_length : 0);
+}
+
+
+/*  Flags de un registro que vuelve al log de fallidos: se marcan los destinos
+    que ya lo confirmaron para no reenviarselo en el siguiente ciclo */
+static uint16_t upload_sent_flags(uint16_t flags, const int8_t* status){
+    flags &= ~SD_LOG_FLAG_SENT_MASK;
+    for (int i = 0; i < s_sink_count; i++) {
+        if (status[i] == 1) {
+            flags |= SD_LOG_FLAG_SENT(i);
+        }
+    }
+    return flags;
+}
+
+
+/*  Un registro que no se pudo guardar en el log de fallidos (o en la cuarentena)
+    no se puede dar por terminado: el head del log se queda en el primero de ellos */
+static void upload_hold(upload_stream_t* stream, const sd_log_cursor_t* pos, uint32_t seq){
+    if (!stream->held) {
+        ESP_LOGE(TAG_UPLOAD, "No se pudo guardar el registro %lu de %s, el log no avanza desde aqui\n",
+                 (unsigned long) seq, stream->name);
+    }
+    if (!stream->held || pos->segment < stream->hold.segment ||
+        (pos->segment == stream->hold.segment && pos->offset < stream->hold.offset)) {
+        stream->hold = *pos;
+        stream->held = 1;
+    }
+}
+
+
+/*  Espera a que un destino termine un registro. Cuando todos lo terminaron
+    se decide con el ledger si se descarta o se copia al log de fallidos de su stream */
+static int upload_wait_done(upload_flight_t* in_flight, TickType_t wait){
+    upload_item_t* item;
+    int failed = 0;
+    while (in_flight->count > 0 && xQueueReceive(s_done_queue, &item, wait) == pdTRUE) {
+        item->done++;
+        if (item->done < s_sink_count) {
+            continue;
+        }
+        if (!upload_required_acked(item->status)) {
+            if (sd_log_append_flags(item->stream->failed_log, item->data, item->length,
+                                    upload_sent_flags(item->flags, item->status)) != ESP_OK) {
+                upload_hold(item->stream, &item->pos, item->seq);
+            }
+            item->stream->failed++;
+            failed++;
+        }
+        in_flight->count--;
+        in_flight->bytes -= upload_item_size(item);
+        mem_ring_free(&s_ring, item);
+        // Despues del primero ya no se bloquea, solo se recogen los terminados
+        wait = 0;
+    }
+    return failed;
+}
+
+
+/*  Registros grandes o sin memoria: se envian desde la SD a un destino a la vez.
+    Solo se llama sin registros en vuelo, asi las tareas no usan sus clientes */
+static int upload_record_direct(upload_stream_t* stream, sd_log_iter_t* iter, const sd_log_record_t* record,
+                                const sd_log_cursor_t* pos){
+    int8_t status[UPLOAD_MAX_SINKS] = { 0 };
+    sd_log_t* failed_log = stream->failed_log;
+    upload_log_reader_t reader = { .iter = iter };
+    if (record->flags & SD_LOG_FLAG_CBOR) {
+        // Sin memoria no se puede pasar a JSON: se intenta en el siguiente ciclo
+        ESP_LOGW(TAG_UPLOAD, "Sin memoria para el registro CBOR %lu\n", (unsigned long) record->seq);
+        if (sd_log_copy_record(failed_log, iter, s_chunk, sizeof(s_chunk)) != ESP_OK) {
+            upload_hold(stream, pos, record->seq);
+        }
+        stream->failed++;
+        return 1;
+    }
+    for (int i = 0; i < s_sink_count; i++) {
+        upload_sink_t* sink = s_sinks[i];
+        if ((record->flags & SD_LOG_FLAG_SENT(i)) || stream->urls[i] == NULL) {
+            status[i] = 1;
+            continue;
+        }
+        if (sd_log_iter_rewind_record(iter) != ESP_OK) {
+            // No se puede volver a leer: queda en el log para el siguiente ciclo
+            upload_hold(stream, pos, record->seq);
+            return 0;
+        }
+        upload_set_url(sink, stream->urls[i]);
+        upload_set_encoding(sink, CODEC_ENCODING_NONE);
+        int status_code = http_post_stream(sink->client, record->length, read_log_chunk, rewind_log_chunk,
+                                           &reader, s_chunk, sizeof(s_chunk),
+                                           sink->response, sizeof(sink->response));
+        if (status_code == HTTP_STREAM_ABORTED) {
+            // Registro corrupto: sd_log_iter_read() ya lo copio a la cuarentena.
+            // Un error de lectura o de la copia lo deja en el log
+            if (reader.result != SD_LOG_READ_CORRUPT || iter->quarantine == NULL) {
+                upload_hold(stream, pos, record->seq);
+            }
+            return 0;
+        }
+        status[i] = upload_result(sink, record->seq, status_code);
+    }
+    if (upload_required_acked(status)) {
+        return 0;
+    }
+    // sd_log_copy_record() copia los flags del registro actual del iterador
+    iter->current.flags = upload_sent_flags(record->flags, status);
+    if (sd_log_copy_record(failed_log, iter, s_chunk, sizeof(s_chunk)) != ESP_OK) {
+        upload_hold(stream, pos, record->seq);
+    }
+    stream->failed++;
+    return 1;
+}
+
+
+esp_err_t upload_begin(const upload_sink_config_t* sinks, int sink_count){
+    if (sink_count > UPLOAD_MAX_SINKS) {
+        ESP_LOGE(TAG_UPLOAD, "Demasiados destinos: %d\n", sink_count);
+        return ESP_FAIL;
+    }
+
+    s_done_queue    = xQueueCreate(UPLOAD_MAX_IN_FLIGHT * UPLOAD_MAX_SINKS, sizeof(upload_item_t*));
+    s_sinks_stopped = xSemaphoreCreateCounting(UPLOAD_MAX_SINKS, 0);
+    if (s_json == NULL) {
+        s_json = upload_alloc(UPLOAD_WIRE_SIZE);
+    }
+    if (s_ring_block == NULL) {
+        s_ring_block = upload_alloc(UPLOAD_RING_SIZE);
+    }
+    if (s_done_queue == NULL || s_sinks_stopped == NULL || s_json == NULL || s_ring_block == NULL) {
+        ESP_LOGE(TAG_UPLOAD, "No se pudieron crear las colas o los buffers\n");
+        upload_end();
+        return ESP_FAIL;
+    }
+    mem_ring_init(&s_ring, s_ring_block, UPLOAD_RING_SIZE);
+
+    s_sink_count = 0;
+    for (int i = 0; i < sink_count; i++) {
+        upload_sink_t* sink = s_sink_blocks[i];
+        if (sink == NULL) {
+            sink = upload_alloc(sizeof(upload_sink_t));
+            if (sink == NULL) {
+                ESP_LOGE(TAG_UPLOAD, "Sin memoria para el destino %s\n", sinks[i].name);
+                upload_end();
+                return ESP_FAIL;
+            }
+            memset(sink, 0, sizeof(upload_sink_t));
+            s_sink_blocks[i] = sink;
+        }
+        // Los buffers de compresion de una sesion anterior se mantienen
+        char*     body       = sink->body;
+        uint8_t*  compressed = sink->compressed;
+        uint16_t* hash_table = sink->hash_table;
+        memset(sink, 0, sizeof(upload_sink_t));
+        sink->body       = body;
+        sink->compressed = compressed;
+        sink->hash_table = hash_table;
+        sink->config = sinks[i];
+        sink->index  = i;
+        sink->batch_mode = (UPLOAD_BATCH_SIZE > 1);
+        s_sinks[s_sink_count++] = sink;
+
+        if (UPLOAD_ENCODING != CODEC_ENCODING_NONE) {
+            if (sink->body == NULL) {
+                sink->body = upload_alloc(UPLOAD_BODY_SIZE);
+            }
+            if (sink->compressed == NULL) {
+                sink->compressed = upload_alloc(UPLOAD_BODY_SIZE);
+            }
+            if (sink->hash_table == NULL) {
+                sink->hash_table = upload_alloc(CODEC_HASH_SIZE * sizeof(uint16_t));
+            }
+            if (sink->body == NULL || sink->compressed == NULL || sink->hash_table == NULL) {
+                ESP_LOGE(TAG_UPLOAD, "Sin memoria para comprimir en %s\n", sinks[i].name);
+                upload_end();
+                return ESP_FAIL;
+            }
+        }
+
+        // Un cliente por destino durante todo el ciclo (el pool lo crea en el primer upload_begin)
+        esp_http_client_config_t config = {
+            .url                   = sinks[i].url,
+            .timeout_ms            = 10000,
+            .disable_auto_redirect = true,
+            .crt_bundle_attach     = esp_crt_bundle_attach,
+            .event_handler         = upload_http_event,
+            .user_data             = sink,
+#if CONFIG_ESP_TLS_CLIENT_SESSION_TICKETS
+            // Si el servidor cierra la conexion, el siguiente handshake reanuda la sesion
+            // (la del ciclo anterior la ofrece esp32_http.c desde la memoria RTC)
+            .save_client_session   = true,
+#endif
+        };
+        sink->client = http_pool_get(sinks[i].name, &config);
+        sink->queue  = xQueueCreate(UPLOAD_MAX_IN_FLIGHT, sizeof(upload_item_t*));
+        if (sink->client == NULL || sink->queue == NULL) {
+            ESP_LOGE(TAG_UPLOAD, "No se pudo crear el cliente %s\n", sinks[i].name);
+            // upload_end() libera el destino, sin cola no espera su tarea
+            if (sink->queue != NULL) {
+                vQueueDelete(sink->queue);
+                sink->queue = NULL;
+            }
+            upload_end();
+            return ESP_FAIL;
+        }
+        // Un cliente del pool puede venir apuntando al ultimo stream de la sesion anterior
+        upload_set_url(sink, sinks[i].url);
+        // Set Content-Type header
+        esp_http_client_set_header(sink->client, "Content-Type", tpi_format);
+        // Set ApiKey header
+        esp_http_client_set_header(sink->client, "ApiKey", tpi_key);
+
+        if (xTaskCreate(upload_sink_task, sinks[i].name, UPLOAD_TASK_STACK, sink,
+                        UPLOAD_TASK_PRIORITY, NULL) != pdPASS) {
+            ESP_LOGE(TAG_UPLOAD, "No se pudo crear la tarea %s\n", sinks[i].name);
+            // El destino queda registrado sin cola: upload_end() no espera su tarea
+            vQueueDelete(sink->queue);
+            sink->queue = NULL;
+            upload_end();
+            return ESP_FAIL;
+        }
+        ESP_LOGI(TAG_UPLOAD, "Destino %s: '%s'\n", sinks[i].name, sinks[i].url);
+    }
+    return ESP_OK;
+}
+
+
+/*  Lee el siguiente registro de un stream y lo entrega a sus destinos.
+    Retorna los registros que pasaron al log de fallidos, -1 al terminar el stream */
+static int upload_stream_next(upload_stream_t* stream, sd_log_iter_t* iter, sd_log_t* quarantine_log,
+                              upload_flight_t* in_flight){
+    sd_log_record_t record;
+    sd_log_cursor_t pos = iter->pos;
+    int failed = 0;
+
+    esp_err_t ret_log = sd_log_iter_next_record(iter, &record);
+    if (ret_log == ESP_ERR_NOT_FOUND || ret_log == ESP_FAIL) {
+        return -1;
+    }
+    if (ret_log != ESP_OK || record.length == 0) {
+        // Registro corrupto (ya copiado a la cuarentena) o vacio: el lote sigue.
+        // Sin cuarentena los bytes danados solo quedan en el log
+        if (ret_log != ESP_OK && quarantine_log == NULL) {
+            upload_hold(stream, &pos, pos.seq);
+        }
+        return 0;
+    }
+    led_set(CHECK, BLUE);
+
+    upload_item_t* item = NULL;
+    if (record.length <= UPLOAD_INLINE_MAX) {
+        // Un registro CBOR reserva tambien su copia JSON (se ajusta despues de convertirlo).
+        // Con el anillo lleno se espera a que los destinos terminen los mas antiguos
+        size_t size = sizeof(upload_item_t) + record.length +
+                      ((record.flags & SD_LOG_FLAG_CBOR) ? UPLOAD_WIRE_SIZE : 0);
+        while ((item = mem_ring_alloc(&s_ring, size)) == NULL && in_flight->count > 0) {
+            failed += upload_wait_done(in_flight, portMAX_DELAY);
+        }
+    }
+    if (item == NULL) {
+        while (in_flight->count > 0) {
+            failed += upload_wait_done(in_flight, portMAX_DELAY);
+        }
+        return failed + upload_record_direct(stream, iter, &record, &pos);
+    }
+
+    // Una sola lectura de la SD para todos los destinos
+    memset(item, 0, sizeof(upload_item_t));
+    item->seq    = record.seq;
+    item->length = record.length;
+    item->flags  = record.flags;
+    item->pos    = pos;
+    item->stream = stream;
+    size_t offset = 0;
+    int chunk_len;
+    while ((chunk_len = sd_log_iter_read(iter, item->data + offset, record.length - offset)) > 0) {
+        offset += chunk_len;
+    }
+    if (chunk_len < 0) {
+        // CRC invalido: sd_log_iter_read() ya lo copio a la cuarentena. Si no se
+        // pudo leer o copiar, el registro se vuelve a leer en el siguiente ciclo
+        if (chunk_len == SD_LOG_READ_FAIL || quarantine_log == NULL) {
+            upload_hold(stream, &pos, record.seq);
+        }
+        mem_ring_free(&s_ring, item);
+        return failed;
+    }
+    if (upload_prepare_body(item) != ESP_OK) {
+        ESP_LOGE(TAG_UPLOAD, "Registro %lu de %s no se pudo pasar a JSON, pasa a cuarentena\n",
+                 (unsigned long) record.seq, stream->name);
+        if (quarantine_log == NULL ||
+            sd_log_append_flags(quarantine_log, item->data, item->length, item->flags | SD_LOG_FLAG_CORRUPT) != ESP_OK) {
+            upload_hold(stream, &pos, record.seq);
+        }
+        mem_ring_free(&s_ring, item);
+        return failed;
+    }
+
+    // Los destinos que ya lo confirmaron en otro ciclo, o que no reciben este stream, no lo reciben
+    for (int i = 0; i < s_sink_count; i++) {
+        if ((item->flags & SD_LOG_FLAG_SENT(i)) || stream->urls[i] == NULL) {
+            item->status[i] = 1;
+            item->done++;
+        }
+    }
+    if (item->done == s_sink_count) {
+        mem_ring_free(&s_ring, item);
+        return failed;
+    }
+    for (int i = 0; i < s_sink_count; i++) {
+        if (item->status[i] == 0) {
+            xQueueSend(s_sinks[i]->queue, &item, portMAX_DELAY);
+        }
+    }
+    in_flight->count++;
+    in_flight->bytes += upload_item_size(item);
+    return failed;
+}
+
+
+/*  Envia un stream completo y confirma lo terminado. Los streams van uno detras
+    de otro: en la SD solo hay un lector y un log de fallidos abiertos a la vez, y
+    el lector se cierra antes del commit (que borra los segmentos enviados).
+    Cada destino tiene una sola conexion, asi que en paralelo no habria menos
+    peticiones por destino: solo se ahorraria la pausa entre streams (< 2 % del
+    envio con sync_bench) */
+static int upload_stream_run(upload_stream_t* stream, sd_log_t* quarantine_log, upload_flight_t* in_flight){
+    static sd_log_iter_t iter;
+    int failed = 0;
+
+    stream->failed = 0;
+    stream->held   = 0;
+    sd_log_iter_begin(stream->log, &iter);
+    iter.quarantine = quarantine_log;
+
+    while (1) {
+        // Recogemos lo terminado, y si ya hay demasiados registros en vuelo esperamos
+        int full = (in_flight->count >= UPLOAD_MAX_IN_FLIGHT || in_flight->bytes >= UPLOAD_MAX_IN_FLIGHT_BYTES);
+        failed += upload_wait_done(in_flight, full ? portMAX_DELAY : 0);
+
+        int ret = upload_stream_next(stream, &iter, quarantine_log, in_flight);
+        if (ret < 0) {
+            break;
+        }
+        failed += ret;
+    }
+    while (in_flight->count > 0) {
+        failed += upload_wait_done(in_flight, portMAX_DELAY);
+    }
+
+    // Lo que no se pudo guardar en el log de fallidos se vuelve a leer en el siguiente ciclo
+    sd_log_cursor_t end = stream->held ? stream->hold : iter.pos;
+    sd_log_iter_end(&iter);
+    if (sd_log_commit(stream->log, &end) != ESP_OK) {
+        ESP_LOGE(TAG_UPLOAD, "Stream %s: no se pudo confirmar el envio, se repite en el siguiente ciclo\n", stream->name);
+    }
+    sd_log_close(stream->failed_log);
+    ESP_LOGI(TAG_UPLOAD, "Stream %s: registros fallidos = %d\n", stream->name, stream->failed);
+    return failed;
+}
+
+
+int upload_streams(upload_stream_t* streams, int count, sd_log_t* quarantine_log){
+    upload_flight_t in_flight = { 0 };
+    int failed = 0;
+
+    if (count > UPLOAD_MAX_STREAMS) {
+        ESP_LOGE(TAG_UPLOAD, "Demasiados streams: %d\n", count);
+        count = UPLOAD_MAX_STREAMS;
+    }
+    for (int s = 0; s < count; s++) {
+        failed += upload_stream_run(&streams[s], quarantine_log, &in_flight);
+    }
+    return failed;
+}
+
+
+/*  Siguiente pedazo del documento de bateria. Las muestras sobrescritas o
+    danadas se saltan. Retorna 0 al terminar */
+static int upload_battery_next(upload_battery_reader_t* reader){
+    reader->offset = 0;
+    if (reader->part == 0) {
+        reader->length = snprintf(reader->text, sizeof(reader->text),
+                                  "{\"idEmpresa\":%d,\"idDispositivo\":\"%s\",\"Cargadora\":\"%s\",\"registro\":[",
+                                  UPLOAD_ID_EMPRESA, reader->device, UPLOAD_CARGADORA);
+        reader->part = 1;
+        return 1;
+    }
+    char date[24];
+    struct tm tm_info;
+    while (reader->part == 1 && reader->seq != reader->end) {
+        sd_battery_sample_t sample;
+        // Sin fecha conocida (reloj de un power-on anterior) la muestra no sirve en la serie
+        if (!sd_battery_read(reader->battery, reader->seq++, &sample) || !(sample.flags & SD_BATTERY_DATED)) {
+            continue;
+        }
+        time_t sample_time = sample.time;
+        localtime_r(&sample_time, &tm_info);
+        strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", &tm_info);
+        reader->length = snprintf(reader->text, sizeof(reader->text),
+                                  "%s{\"Valor\":\"%.2f\",\"Identificador\":\"Voltaje\",\"Fecha\":\"%s\"}",
+                                  (reader->samples > 0) ? "," : "", sample.millivolts / 1000.0, date);
+        reader->samples++;
+        return 1;
+    }
+    // Despues de las muestras, un registro por cada valor de la telemetria
+    while (reader->part == 1 && reader->telem_index < reader->telem_count) {
+        const telem_record_t* record = &reader->telem[reader->telem_index];
+        const char* name;
+        uint32_t value;
+        if (!telem_record_value(record, reader->telem_value++, &name, &value)) {
+            reader->telem_index++;
+            reader->telem_value = 0;
+            continue;
+        }
+        time_t record_time = record->time;
+        localtime_r(&record_time, &tm_info);
+        strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", &tm_info);
+        reader->length = snprintf(reader->text, sizeof(reader->text),
+                                  "%s{\"Valor\":\"%lu\",\"Identificador\":\"%s\",\"Fecha\":\"%s\"}",
+                                  (reader->samples > 0) ? "," : "", (unsigned long) value, name, date);
+        reader->samples++;
+        return 1;
+    }
+    if (reader->part == 1) {
+        reader->length = snprintf(reader->text, sizeof(reader->text), "]}");
+        reader->part = 2;
+        return 1;
+    }
+    reader->part = 3;
+    reader->length = 0;
+    return 0;
+}
+
+
+static int read_battery_chunk(void* ctx, char* buffer, size_t size){
+    upload_battery_reader_t* reader = (upload_battery_reader_t*) ctx;
+    size_t written = 0;
+    while (written < size) {
+        if (reader->offset == reader->length && !upload_battery_next(reader)) {
+            break;
+        }
+        size_t to_copy = MIN(size - written, reader->length - reader->offset);
+        memcpy(buffer + written, reader->text + reader->offset, to_copy);
+        written += to_copy;
+        reader->offset += to_copy;
+    }
+    return written;
+}
+
+
+static esp_err_t rewind_battery_chunk(void* ctx){
+    upload_battery_reader_t* reader = (upload_battery_reader_t*) ctx;
+    reader->seq         = reader->first;
+    reader->telem_index = 0;
+    reader->telem_value = 0;
+    reader->part        = 0;
+    reader->samples     = 0;
+    reader->length      = 0;
+    reader->offset      = 0;
+    return ESP_OK;
+}
+
+
+/*  Siguientes registros del log de telemetria. Los que no son un telem_record_t
+    (otro tamano o danados) se saltan. Retorna cuantos se leyeron */
+static int upload_telem_read(sd_log_iter_t* iter, telem_record_t* records, int max_records){
+    char buffer[sizeof(telem_record_t) + 1];
+    size_t length;
+    int count = 0;
+    while (count < max_records) {
+        esp_err_t err = sd_log_iter_next(iter, buffer, sizeof(buffer), &length);
+        if (err == ESP_ERR_NOT_FOUND || err == ESP_FAIL) {
+            break;
+        }
+        if (err == ESP_OK && length == sizeof(telem_record_t)) {
+            memcpy(&records[count++], buffer, sizeof(telem_record_t));
+        }
+    }
+    return count;
+}
+
+
+/*  Primera muestra desde seq que espera su fecha (tomada en este power-on antes
+    de que el Edge ajustara el reloj): las siguientes quedan pendientes con ella */
+static uint32_t upload_battery_dated_end(sd_battery_t* battery, uint32_t seq){
+    for (; seq != battery->next_seq; seq++) {
+        sd_battery_sample_t sample;
+        if (sd_battery_read(battery, seq, &sample) && !(sample.flags & (SD_BATTERY_DATED | SD_BATTERY_ORPHAN))) {
+            ESP_LOGW(TAG_UPLOAD, "%lu muestras de bateria esperan la hora del Edge\n",
+                     (unsigned long) (battery->next_seq - seq));
+            break;
+        }
+    }
+    return seq;
+}
+
+
+int upload_battery(sd_battery_t* battery, sd_log_t* telemetry, const char* url){
+    uint32_t seq = sd_battery_first_pending(battery);
+    uint32_t last = upload_battery_dated_end(battery, seq);
+    int telem_more = (telemetry != NULL && sd_log_pending(telemetry) > 0);
+    if (seq == last && !telem_more) {
+        return 0;
+    }
+
+    uint8_t mac[6];
+    char device[13];
+    esp_wifi_get_mac(WIFI_IF_STA, mac);
+    snprintf(device, sizeof(device), "%02x%02x%02x%02x%02x%02x", mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+
+    esp_http_client_config_t config = {
+        .url                   = url,
+        .timeout_ms            = 10000,
+        .disable_auto_redirect = true,
+        .crt_bundle_attach     = esp_crt_bundle_attach,
+    };
+    esp_http_client_handle_t client = http_pool_get(UPLOAD_BATTERY_CLIENT, &config);
+    if (client == NULL) {
+        return -1;
+    }
+    esp_http_client_set_url(client, url);
+    esp_http_client_set_header(client, "Content-Type", tpi_format);
+    esp_http_client_set_header(client, "ApiKey", tpi_key);
+
+    sd_log_iter_t iter;
+    int telem_open = telem_more;
+    if (telem_open) {
+        sd_log_iter_begin(telemetry, &iter);
+    }
+
+    static char chunk[UPLOAD_CHUNK_SIZE];
+    static char response[UPLOAD_RESPONSE_SIZE];
+    static telem_record_t telem[UPLOAD_TELEM_BATCH];
+    int sent = 0;
+    int telem_sent = 0;
+    int failed = 0;
+    while (seq != last || telem_more) {
+        uint32_t end = (last - seq > UPLOAD_BATTERY_BATCH) ? seq + UPLOAD_BATTERY_BATCH : last;
+        int telem_count = telem_more ? upload_telem_read(&iter, telem, UPLOAD_TELEM_BATCH) : 0;
+        telem_more = (telem_count == UPLOAD_TELEM_BATCH);
+        upload_battery_reader_t reader = {
+            .battery     = battery,
+            .device      = device,
+            .first       = seq,
+            .seq         = seq,
+            .end         = end,
+            .telem       = telem,
+            .telem_count = telem_count,
+        };
+
+        // Primera pasada solo para el Content-Length (lee las mismas muestras)
+        upload_battery_reader_t counter = reader;
+        size_t length = 0;
+        while (upload_battery_next(&counter)) {
+            length += counter.length;
+        }
+        if (counter.samples == 0) {
+            // Todas danadas o sobrescritas: no hay nada que enviar
+            if (end != seq) {
+                sd_battery_commit(battery, end);
+            }
+            if (telem_open) {
+                sd_log_commit(telemetry, &iter.pos);
+            }
+            seq = end;
+            continue;
+        }
+
+        int status_code = http_post_stream(client, length, read_battery_chunk, rewind_battery_chunk,
+                                           &reader, chunk, sizeof(chunk), response, sizeof(response));
+        if (status_code != 200) {
+            ESP_LOGE(TAG_UPLOAD, "Fallo al enviar las muestras de bateria %lu-%lu (HTTP %d)\n",
+                     (unsigned long) seq, (unsigned long) end, status_code);
+            failed = 1;
+            break;
+        }
+        if (sd_battery_commit(battery, end) != ESP_OK ||
+            (telem_open && sd_log_commit(telemetry, &iter.pos) != ESP_OK)) {
+            failed = 1;
+            break;
+        }
+        sent += counter.samples;
+        telem_sent += telem_count;
+        seq = end;
+    }
+    if (telem_open) {
+        sd_log_iter_end(&iter);
+    }
+
+    ESP_LOGI(TAG_UPLOAD, "Registros de bateria enviados = %d (telemetria de %d ciclos)\n", sent, telem_sent);
+    return (sent == 0 && failed) ? -1 : sent;
+}
+
+
+void upload_end(){
+    upload_item_t* end_item = NULL;
+    int running = 0;
+    for (int i = 0; i < s_sink_count; i++) {
+        if (s_sinks[i]->queue != NULL) {
+            xQueueSend(s_sinks[i]->queue, &end_item, portMAX_DELAY);
+            running++;
+        }
+    }
+    for (int i = 0; i < running; i++) {
+        xSemaphoreTake(s_sinks_stopped, portMAX_DELAY);
+    }
+
+    for (int i = 0; i < s_sink_count; i++) {
+        upload_sink_t* sink = s_sinks[i];
+        // Registros por segundo dentro de los POST (para elegir el tamano de lote)
+        int rate = (sink->busy_us > 0) ? (int) ((int64_t) sink->sent * 1000000 / sink->busy_us) : 0;
+        ESP_LOGI(TAG_UPLOAD, "Destino %s: enviados = %d, fallidos = %d, peticiones = %d, %d registros/s\n",
+                 sink->config.name, sink->sent, sink->failed, sink->requests, rate);
+        if (sink->connects > 0) {
+            ESP_LOGI(TAG_UPLOAD, "Destino %s: conexiones = %d, primera = %lld ms, reconexiones = %lld ms promedio, sesiones TLS guardadas = %d\n",
+                     sink->config.name, sink->connects, (long long) (sink->first_connect_us / 1000),
+                     (long long) ((sink->connects > 1) ? sink->reconnect_us / 1000 / (sink->connects - 1) : 0),
+                     http_tls_sessions());
+        }
+        // El cliente queda en el pool y el destino en s_sink_blocks para la siguiente sesion
+        if (sink->queue != NULL) {
+            vQueueDelete(sink->queue);
+        }
+        s_sinks[i] = NULL;
+    }
+    s_sink_count = 0;
+
+    if (s_done_queue != NULL) {
+        vQueueDelete(s_done_queue);
+        s_done_queue = NULL;
+    }
+    if (s_sinks_stopped != NULL) {
+        vSemaphoreDelete(s_sinks_stopped);
+        s_sinks_stopped = NULL;
+    }
+}
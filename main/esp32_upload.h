@@ -0,0 +1,138 @@
+#ifndef __UPLOAD_ESP32_
+#define __UPLOAD_ESP32_
+// ----------------------------------------------------------------- //
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "freertos/FreeRTOS.h"  // It provides a framework for multitasking, task scheduling, and synchronization in embedded applications.
+#include "freertos/task.h"      // Header provides functions and macros for creating, starting, and managing tasks
+#include "freertos/queue.h"     // Bounded queues between the SD reader and every destination task
+#include "freertos/semphr.h"    // Used to wait until every destination task has finished
+
+#include "esp32_sd.h"
+#include "esp32_http.h"
+#include "esp32_codec.h"
+#include "esp32_mem.h"
+
+/* Define variables for the fan-out uploader */
+#define UPLOAD_MAX_SINKS        3           // Destinations served at the same time
+#define UPLOAD_MAX_STREAMS      8           // Logs sent (one after another) by upload_streams()
+#define UPLOAD_BATCH_SIZE       CONFIG_NODO_UPLOAD_BATCH_SIZE   // Records per POST (1 = one object per request)
+#define UPLOAD_BATCH_BYTES      CONFIG_NODO_UPLOAD_BATCH_BYTES  // Max JSON bytes of a batch
+#define UPLOAD_BATCH_WAIT_MS    20          // Wait for more records before sending an incomplete batch
+#define UPLOAD_MAX_IN_FLIGHT    (2 * UPLOAD_BATCH_SIZE + 2)     // Records read from SD and not finished by every destination
+#define UPLOAD_MAX_IN_FLIGHT_BYTES (2 * UPLOAD_BATCH_BYTES + 2 * UPLOAD_WIRE_SIZE)
+#define UPLOAD_INLINE_MAX       (8 * 1024)  // Bigger records are streamed to one destination at a time
+#define UPLOAD_CHUNK_SIZE       2048        // Block size for streaming from SD/RAM to the POST() Request
+#define UPLOAD_RESPONSE_SIZE    512         // For response from server after a POST() Request (one result per record of a batch)
+#define UPLOAD_TASK_STACK       8192        // HTTPS handshake needs a big stack
+#define UPLOAD_TASK_PRIORITY    5
+#define UPLOAD_WIRE_SIZE        (2 * CODEC_MAX_RECORD)  // JSON decoded from CBOR
+#define UPLOAD_BODY_SIZE        (UPLOAD_BATCH_BYTES + UPLOAD_WIRE_SIZE) // Request compressed in RAM
+#define UPLOAD_RING_SIZE        UPLOAD_MAX_IN_FLIGHT_BYTES      // Records in flight (taken once from the arena)
+
+#if CONFIG_NODO_HTTP_ENCODING_GZIP
+#define UPLOAD_ENCODING         CODEC_ENCODING_GZIP
+#elif CONFIG_NODO_HTTP_ENCODING_DEFLATE
+#define UPLOAD_ENCODING         CODEC_ENCODING_DEFLATE
+#else
+#define UPLOAD_ENCODING         CODEC_ENCODING_NONE
+#endif
+
+#define UPLOAD_BATTERY_BATCH    100         // Battery samples per POST
+#define UPLOAD_TELEM_BATCH      8           // Telemetry records (one per wake cycle) per POST, with the battery samples
+#define UPLOAD_ID_EMPRESA       1           // Envelope of the battery samples
+#define UPLOAD_CARGADORA        "EQP44"
+#define UPLOAD_BATTERY_CLIENT   "bateria"   // Name of the battery client in the HTTP pool
+
+#define TAG_UPLOAD              "UPLOAD_API"
+
+
+/* Destination of the records */
+typedef struct {
+   const char* name;       // For logs: "CST", "TPI"
+   const char* url;        // POST endpoint
+   int         required;   // 1 = a record is removed only if this destination acknowledged it
+} upload_sink_config_t;
+
+
+/* Log sent in an upload session, with its own endpoint on every destination */
+typedef struct {
+   const char* name;                     // For logs: "salud", "pesaje"
+   sd_log_t*   log;
+   sd_log_t*   failed_log;               // Records rejected by a required destination (can be log)
+   const char* urls[UPLOAD_MAX_SINKS];   // One per destination of upload_begin(), NULL = not sent there
+   int         failed;                   // Output: records copied to failed_log
+   int         held;                     // Output: 1 = a record could not be saved, head stops at hold
+   sd_log_cursor_t hold;                 // First record that could not be saved in failed_log
+} upload_stream_t;
+
+
+/**
+ * @brief This function creates one task per destination. The HTTP clients come
+ *        from the pool of esp32_wifi (one per destination for the whole cycle) and
+ *        the buffers from the arena of the cycle: they are reused by the next
+ *        upload_begin(), so the upload loop does not use the heap
+ * @param sinks: Destinations, the url strings must stay valid until upload_end().
+ *               The index of a destination is its bit in SD_LOG_FLAG_SENT()
+ * @param sink_count: Number of destinations (max UPLOAD_MAX_SINKS)
+ * @return ESP_OK or ESP_FAIL
+ */
+esp_err_t upload_begin(const upload_sink_config_t* sinks, int sink_count);
+
+
+/**
+ * @brief This function sends every pending record of several logs to all
+ *        destinations at the same time. The logs are read in turns (one record
+ *        each) and share the in-flight limits (UPLOAD_MAX_IN_FLIGHT records,
+ *        UPLOAD_MAX_IN_FLIGHT_BYTES), so one busy log does not starve the
+ *        others and the RAM used does not grow with the number of logs.
+ *        Every record is read once from the SD card and shared by the
+ *        destination tasks through bounded queues; a destination switches its
+ *        URL to the endpoint of the log of each batch. CBOR records
+ *        are sent as JSON, compressed if CONFIG_NODO_HTTP_ENCODING_* is set.
+ *        Each destination sends up to UPLOAD_BATCH_SIZE records per POST as a
+ *        JSON array (records of the same log); the server may answer an array
+ *        with one status per record.
+ *        A 4xx to a batch switches that destination to one record per POST.
+ *        A record is dropped when all required destinations acknowledged it,
+ *        otherwise it is copied to failed_log. Records that fail their CRC or
+ *        can not be turned into JSON go to quarantine_log and the batch goes on.
+ *        The logs are sent one after another: only one reader and one failed
+ *        log are open at a time. The head of every log is committed after its
+ *        reader is closed; it stops before the first record that could not be
+ *        saved in failed_log or quarantine_log, and stays where it was if the
+ *        index can not be written, so nothing is lost.
+ * @param streams: Logs to send (max UPLOAD_MAX_STREAMS), failed is filled per log
+ * @param count: Number of logs
+ * @param quarantine_log: Log for the damaged records (NULL = they stay in their log)
+ * @return Number of records copied to the failed logs
+ */
+int upload_streams(upload_stream_t* streams, int count, sd_log_t* quarantine_log);
+
+
+/**
+ * @brief This function sends the battery samples not uploaded yet, up to
+ *        UPLOAD_BATTERY_BATCH per POST. The JSON document (idEmpresa,
+ *        idDispositivo, Cargadora, registro[]) is rendered while it is sent.
+ *        Up to UPLOAD_TELEM_BATCH telemetry records go in the same document,
+ *        one registro per value (HeapMin, Stack_main, ...). The samples and
+ *        records are marked as uploaded after every HTTP 200. Samples taken
+ *        before the edge set the clock wait for their date (sd_battery_date),
+ *        the ones of an earlier power-on (SD_BATTERY_ORPHAN) are skipped
+ * @param battery: Open battery ring
+ * @param telemetry: Telemetry log (telem_record_t), NULL = only battery samples
+ * @param url: POST endpoint
+ * @return Number of registro[] entries sent, or -1 if the first POST failed
+ */
+int upload_battery(sd_battery_t* battery, sd_log_t* telemetry, const char* url);
+
+
+/**
+ * @brief This function stops the destination tasks. The clients stay in the pool
+ *        until http_pool_cleanup()
+ */
+void upload_end();
+
+// ----------------------------------------------------------------- //
+#endif /* __UPLOAD_ESP32_ */
@@ -1,20 +1,40 @@
 #include "esp32_wifi.h"
 #include "esp32_general.h"
 
+#include <sys/param.h>
+
 static int s_retry_num = 0;
+static int s_max_retry = ESP_MAXIMUM_RETRY_CONNECTION;
 static EventGroupHandle_t s_wifi_event_group;
+static int64_t s_wifi_start_us = 0;
+static uint32_t s_ip_addr = 0;
+static esp_netif_t* s_sta_netif = NULL;
+static int s_net_mode = WIFI_NET_DHCP;
+
+/* Ultimo AP al que nos conectamos, sobrevive al deep sleep */
+typedef struct {
+    uint32_t magic;
+    uint8_t  ap_index;      // Indice en myListAP
+    uint8_t  channel;
+    uint8_t  bssid[6];
+    uint32_t ip_addr;       // Ultima IP asignada (network byte order)
+} wifi_cache_t;
+
+static RTC_DATA_ATTR wifi_cache_t s_wifi_cache;
+static RTC_DATA_ATTR wifi_stats_t s_stats;
 
 typedef struct 
 {   const char* ssid;
     const char* password;
+    const char* static_ip;      // "" = DHCP
+    const char* gateway;
 } StructAP;
 
 StructAP myListAP[] = {
-    {EDGE_AP, EDGE_PASS},
-    {MODEM_AP, MODEM_PASS},
+    {EDGE_AP, EDGE_PASS, CONFIG_NODO_WIFI_EDGE_STATIC_IP, CONFIG_NODO_WIFI_EDGE_GATEWAY},
+    {MODEM_AP, MODEM_PASS, CONFIG_NODO_WIFI_MODEM_STATIC_IP, CONFIG_NODO_WIFI_MODEM_GATEWAY},
 };
 
-
 /* This handler is just for get connection and IP value  */
 void _wifi_event_handler(void* arg, esp_event_base_t event_base,
                                 int32_t event_id, void* event_data)
@@ -22,7 +42,7 @@ void _wifi_event_handler(void* arg, esp_event_base_t event_base,
     if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START) {
         //esp_wifi_connect();
     } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
-        if (s_retry_num < ESP_MAXIMUM_RETRY_CONNECTION) {
+        if (s_retry_num < s_max_retry) {
             esp_wifi_connect();
             s_retry_num++;
             ESP_LOGI(my_tag, "retry to connect to the AP");
@@ -33,286 +53,292 @@ void _wifi_event_handler(void* arg, esp_event_base_t event_base,
     } else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
         ip_event_got_ip_t* event = (ip_event_got_ip_t*) event_data;
         ESP_LOGI(my_tag, "Ip asignada = " IPSTR, IP2STR(&event->ip_info.ip));
+        s_ip_addr = event->ip_info.ip.addr;
+        s_stats.last_time_to_ip_ms = (uint32_t) ((esp_timer_get_time() - s_wifi_start_us) / 1000);
         s_retry_num = 0;
         xEventGroupSetBits(s_wifi_event_group, WIFI_CONNECTED_BIT);
     }
 }
 
 
-/* Initialize Wi-Fi as STA and set scan method */
-void wifi_scan(char* ssid_buffer, size_t buffer_size)
+/*  Busca en los AP escaneados (ordenados por RSSI) el primero que este en myListAP.
+    Retorna el indice en myListAP y en record_index la posicion en ap_info, o -1 */
+static int wifi_select_ap(const wifi_ap_record_t* ap_info, uint16_t ap_count, int* record_index)
 {
-    s_wifi_event_group = xEventGroupCreate();
-    
-    ESP_LOGI(my_tag, " - Preconfiguramos el Wifi\n");
-    ESP_ERROR_CHECK(esp_netif_init());
-    ESP_ERROR_CHECK(esp_event_loop_create_default());
-    esp_netif_t *sta_netif = esp_netif_create_default_wifi_sta();
-    //assert(sta_netif);
+    for (int i = 0; (i < DEFAULT_SCAN_LIST_SIZE) && (i < ap_count); i++) {
+        for (int ap_index = 0; ap_index < sizeof(myListAP) / sizeof(StructAP); ap_index++) {
+            // Buscamos entre la lista de los AP, los AP deseados ESP-AP y WIFILOCAL
+            if ( strcmp( (const char*)ap_info[i].ssid, myListAP[ap_index].ssid ) == 0 ){
+                *record_index = i;
+                return ap_index;
+            }
+        }
+    }
+    return -1;
+}
 
-    /* Configure the RX and TX buffers for Wi-Fi communication */
-    wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
-    ESP_ERROR_CHECK(esp_wifi_init(&cfg));
 
-    /*  Setemoas las banderas a usar para verificar la conexion hacia el 
-        Access Point */
-    ESP_LOGI(my_tag, " - Creamos los hanlders segun evento\n");    
-    esp_event_handler_instance_t instance_any_id;
-    esp_event_handler_instance_t instance_got_ip;
-    ESP_ERROR_CHECK(esp_event_handler_instance_register(WIFI_EVENT,
-                                                        ESP_EVENT_ANY_ID,
-                                                        &_wifi_event_handler,
-                                                        NULL,
-                                                        &instance_any_id));
-    ESP_ERROR_CHECK(esp_event_handler_instance_register(IP_EVENT,
-                                                        IP_EVENT_STA_GOT_IP,
-                                                        &_wifi_event_handler,
-                                                        NULL,
-                                                        &instance_got_ip));
-
-    /* Set the maximum number of APs to scan */
+/*  Escaneo bloqueante: channel = 0 recorre todos los canales */
+static int wifi_scan_for_ap(uint8_t channel, wifi_ap_record_t* ap_record)
+{
     uint16_t number = DEFAULT_SCAN_LIST_SIZE;
     wifi_ap_record_t ap_info[DEFAULT_SCAN_LIST_SIZE];
     uint16_t ap_count = 0;
     memset(ap_info, 0, sizeof(ap_info));
 
-    ESP_LOGI(my_tag, " - Iniciamos el ESP32 Wifi Module\n");
-    /* Start Wi-Fi in station mode */
-    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
-    ESP_ERROR_CHECK(esp_wifi_start());
-
-    ESP_LOGI(my_tag, " - Escaneamos redes cercanas\n");
-
-    /* Scan for APs in the surroundings */
-    esp_wifi_scan_start(NULL, true);
+    wifi_scan_config_t scan_config = {
+        .channel = channel,
+    };
+    if (esp_wifi_scan_start(&scan_config, true) != ESP_OK) {
+        return -1;
+    }
 
     /* Get the scanned AP records */
     ESP_ERROR_CHECK(esp_wifi_scan_get_ap_records(&number, ap_info));
     /* Get the number of scanned APs */
     ESP_ERROR_CHECK(esp_wifi_scan_get_ap_num(&ap_count));
-    //ESP_LOGI(TAG, "\t TOTAL APs scanned = %u\n", ap_count);
-    
-    int ap_index;
-    for (int i = 0; (i < DEFAULT_SCAN_LIST_SIZE) && (i < ap_count); i++) {
-        int ap_found = 0;
-        for(ap_index = 0; ap_index < sizeof(myListAP) / sizeof(StructAP); ap_index++){
-            // Buscamos entre la lista de los AP, los AP deseados ESP-AP y WIFILOCAL
-            if ( strcmp( (const char*)ap_info[i].ssid, myListAP[ap_index].ssid ) != 0 ){
-                continue;
-                }
-            ap_found = 1;
-            break;
-        }
-        if(ap_found != 0){
-            break;
-        }
-        ap_index = -1;
+
+    int record_index = 0;
+    int ap_index = wifi_select_ap(ap_info, MIN(ap_count, number), &record_index);
+    if (ap_index >= 0) {
+        *ap_record = ap_info[record_index];
     }
+    return ap_index;
+}
 
-    /* Si no hay AP de la lista, no nos conectamos y nos vamos a dormir*/
-    if (ap_index < 0){
-        ESP_LOGE(my_tag, " No se encontraron redes cercanas\n");
-        strncpy(ssid_buffer, FAILED_WIFI_SCANNING, buffer_size - 1);
-        ssid_buffer[buffer_size - 1] = '\0';
-        return;
+
+/*  IP fija en la interfaz: al asociarse se publica IP_EVENT_STA_GOT_IP sin DHCP */
+static esp_err_t wifi_netif_set_static(uint32_t ip, uint32_t netmask, uint32_t gw, uint32_t dns)
+{
+    esp_err_t err = esp_netif_dhcpc_stop(s_sta_netif);
+    if (err != ESP_OK && err != ESP_ERR_ESP_NETIF_DHCP_ALREADY_STOPPED) {
+        ESP_LOGE(my_tag, "No se pudo detener el cliente DHCP: %s\n", esp_err_to_name(err));
+        return err;
     }
+    esp_netif_ip_info_t ip_info = {
+        .ip      = { .addr = ip },
+        .netmask = { .addr = netmask },
+        .gw      = { .addr = gw },
+    };
+    err = esp_netif_set_ip_info(s_sta_netif, &ip_info);
+    if (err != ESP_OK) {
+        ESP_LOGE(my_tag, "No se pudo fijar la IP: %s\n", esp_err_to_name(err));
+        return err;
+    }
+    if (dns != 0) {
+        esp_netif_dns_info_t dns_info = { 0 };
+        dns_info.ip.type = ESP_IPADDR_TYPE_V4;
+        dns_info.ip.u_addr.ip4.addr = dns;
+        esp_netif_set_dns_info(s_sta_netif, ESP_NETIF_DNS_MAIN, &dns_info);
+    }
+    return ESP_OK;
+}
 
-    /* Si hay una AP, nos conectamos */
-    // Copiamos el nombre del AP encontrado
-    char ssid_password[20];
-    size_t ssidpassword_len = sizeof(ssid_password);
 
-    // SSID name copy
-    strncpy(ssid_buffer, (const char*)myListAP[ap_index].ssid, buffer_size - 1);
-    ssid_buffer[buffer_size - 1] = '\0';    // add a null-terminated for robust
+/*  Perfil de red del AP: IP fija (Kconfig) o DHCP. El cliente DHCP pide primero
+    la ultima IP (INIT-REBOOT, CONFIG_LWIP_DHCP_RESTORE_LAST_IP): si el servidor la
+    confirma basta un REQUEST/ACK, y el lease queda en lwIP, que lo renueva solo */
+static int wifi_netif_prepare(int ap_index)
+{
+    const StructAP* ap = &myListAP[ap_index];
+    esp_ip4_addr_t ip, netmask, gw;
+    if (ap->static_ip[0] != '\0' &&
+        esp_netif_str_to_ip4(ap->static_ip, &ip) == ESP_OK &&
+        esp_netif_str_to_ip4(CONFIG_NODO_WIFI_STATIC_NETMASK, &netmask) == ESP_OK &&
+        esp_netif_str_to_ip4(ap->gateway, &gw) == ESP_OK) {
+        ESP_LOGI(my_tag, "IP fija en '%s': %s\n", ap->ssid, ap->static_ip);
+        if (wifi_netif_set_static(ip.addr, netmask.addr, gw.addr, gw.addr) == ESP_OK) {
+            return WIFI_NET_STATIC;
+        }
+        ESP_LOGW(my_tag, "Se usa DHCP en '%s'\n", ap->ssid);
+    }
 
-    // Password copy
-    strncpy(ssid_password, (const char*)myListAP[ap_index].password, ssidpassword_len -1 );
-    ssid_password[ssidpassword_len - 1] = '\0';
+    esp_err_t err = esp_netif_dhcpc_start(s_sta_netif);
+    if (err != ESP_OK && err != ESP_ERR_ESP_NETIF_DHCP_ALREADY_STARTED) {
+        ESP_LOGE(my_tag, "No se pudo iniciar el cliente DHCP: %s\n", esp_err_to_name(err));
+    }
+    return WIFI_NET_DHCP;
+}
 
 
-    // Configuramos los parametros para conectarnos al AP
-    ESP_LOGI(my_tag, "Reconfiguramos para pasar de scaner a point to point\n");
+/*  Conexion al AP myListAP[ap_index]. Con bssid/channel el driver no escanea
+    todos los canales antes de asociarse */
+static EventBits_t wifi_connect_ap(int ap_index, const uint8_t* bssid, uint8_t channel,
+                                   int max_retry, TickType_t timeout)
+{
     wifi_config_t wifi_config;
     memset(&wifi_config, 0, sizeof(wifi_config));
-    memcpy(wifi_config.sta.ssid, ssid_buffer, buffer_size);
-    memcpy(wifi_config.sta.password, ssid_password, ssidpassword_len);
+    strncpy((char*) wifi_config.sta.ssid, myListAP[ap_index].ssid, sizeof(wifi_config.sta.ssid));
+    strncpy((char*) wifi_config.sta.password, myListAP[ap_index].password, sizeof(wifi_config.sta.password));
     wifi_config.sta.threshold.authmode = WIFI_AUTH_WPA2_PSK;
+    if (bssid != NULL) {
+        wifi_config.sta.bssid_set = true;
+        memcpy(wifi_config.sta.bssid, bssid, sizeof(wifi_config.sta.bssid));
+    }
+    wifi_config.sta.channel = channel;
+    s_net_mode = wifi_netif_prepare(ap_index);
+
+    xEventGroupClearBits(s_wifi_event_group, WIFI_CONNECTED_BIT | WIFI_FAIL_BIT);
+    s_retry_num = 0;
+    s_max_retry = max_retry;
 
     /* Iniciamos la conexion hacia el Wi-Fi Access Point deseado */
     ESP_ERROR_CHECK(esp_wifi_set_config(WIFI_IF_STA, &wifi_config));
     ESP_ERROR_CHECK(esp_wifi_connect());
-    ESP_LOGI(my_tag, "Iniciamos el intento de conexion \n");
+    ESP_LOGI(my_tag, "Iniciamos el intento de conexion a '%s' (canal %u)\n",
+             myListAP[ap_index].ssid, channel);
 
     /* Seteamos los datos del hanlder para esperar a que nos conectemos al Wi-Fi deseado*/
     EventBits_t bits = xEventGroupWaitBits(s_wifi_event_group,
         WIFI_CONNECTED_BIT | WIFI_FAIL_BIT,
         pdFALSE,
         pdFALSE,
-        portMAX_DELAY);
-
-    if (bits & WIFI_CONNECTED_BIT) {
-        ESP_LOGI(my_tag, "Connected to:\n\tSSID: %s\n\tPassword: %s\n",
-                 ssid_buffer, ssid_password);
-    } else if (bits & WIFI_FAIL_BIT) {
-        ESP_LOGE(my_tag, "Failed to connect to:\n\tSSID: %s\n\tPassword: %s\n",
-                 ssid_buffer, ssid_password);
-        strncpy(ssid_buffer, FAILED_WIFI_SCANNING, buffer_size - 1);
-        ssid_buffer[buffer_size - 1] = '\0';
-    } else {
-        ESP_LOGE(my_tag, "UNEXPECTED EVENT");
-        strncpy(ssid_buffer, FAILED_WIFI_SCANNING, buffer_size - 1);
-        ssid_buffer[buffer_size - 1] = '\0';
+        timeout);
+
+    if ((bits & WIFI_CONNECTED_BIT) == 0) {
+        // Cortamos los reintentos y esperamos el ultimo evento para no mezclarlo con el siguiente intento
+        s_retry_num = s_max_retry;
+        if ((bits & WIFI_FAIL_BIT) == 0) {
+            esp_wifi_disconnect();
+            xEventGroupWaitBits(s_wifi_event_group, WIFI_FAIL_BIT, pdFALSE, pdFALSE,
+                                WIFI_DISCONNECT_WAIT_MS / portTICK_PERIOD_MS);
+        }
+        bits = WIFI_FAIL_BIT;
     }
-
-    /* The event will not be processed after unregister */
-    ESP_ERROR_CHECK(esp_event_handler_instance_unregister(IP_EVENT, IP_EVENT_STA_GOT_IP, instance_got_ip));
-    ESP_ERROR_CHECK(esp_event_handler_instance_unregister(WIFI_EVENT, ESP_EVENT_ANY_ID, instance_any_id));
-    vEventGroupDelete(s_wifi_event_group);
+    return bits;
 }
 
 
-/*              GET() REQUEST              */
-void http_get_data(char* url_path_get, char* response_buffer, size_t size_response_buffer){
-    int content_length = 0;
-    memset(response_buffer, 0, size_response_buffer);
-
-    ESP_LOGI(my_tag, "Nos conectamos a la URL : '%s'\n", url_path_get);
-
-    esp_http_client_config_t config = {
-        .url = url_path_get,
-        .timeout_ms = 5000,
-        //.event_handler = _http_event_handler,
-    };
-    esp_http_client_handle_t client = esp_http_client_init(&config);
-
-    esp_http_client_set_method(client, HTTP_METHOD_GET);
-    esp_err_t err = esp_http_client_open(client, 0);
-
-    if (err != ESP_OK) {
-        ESP_LOGE(my_tag, "Failed to open HTTP connection: %s", esp_err_to_name(err));
-        led_set(WIFI, YELLOW);
+/*  Guardamos el AP para el siguiente ciclo */
+static void wifi_cache_update(int ap_index)
+{
+    wifi_ap_record_t ap_record;
+    if (esp_wifi_sta_get_ap_info(&ap_record) != ESP_OK) {
+        s_wifi_cache.magic = 0;
         return;
     }
+    s_wifi_cache.magic    = WIFI_CACHE_MAGIC;
+    s_wifi_cache.ap_index = ap_index;
+    s_wifi_cache.channel  = ap_record.primary;
+    s_wifi_cache.ip_addr  = s_ip_addr;
+    memcpy(s_wifi_cache.bssid, ap_record.bssid, sizeof(s_wifi_cache.bssid));
+}
 
-    content_length = esp_http_client_fetch_headers(client);
-    if (content_length < 0) {
-        ESP_LOGE(my_tag, "HTTP client fetch headers failed");
-        esp_http_client_close(client);
-        led_set(WIFI, YELLOW);
-        return;
-    }
 
-    if (content_length >= size_response_buffer) {
-        ESP_LOGE(my_tag, "Buffer size insufficent:\n - Needed = %d\n - Available = %d\n", content_length, size_response_buffer);
-        esp_http_client_close(client);
-        led_set(WIFI, RED);
-        return;
-    }
+static int wifi_cache_valid()
+{
+    return s_wifi_cache.magic == WIFI_CACHE_MAGIC &&
+           s_wifi_cache.ap_index < sizeof(myListAP) / sizeof(StructAP) &&
+           s_wifi_cache.channel > 0;
+}
 
-    int data_read = esp_http_client_read_response(client, response_buffer, size_response_buffer);
-    if (data_read < 0 ){
-        ESP_LOGE(my_tag, "Failed to read response");
-        esp_http_client_close(client);
-        led_set(WIFI, RED);
-        return;
-    }
 
-    int get_response = esp_http_client_get_status_code(client);
+/* Initialize Wi-Fi as STA and set scan method */
+void wifi_scan(char* ssid_buffer, size_t buffer_size)
+{
+    s_wifi_event_group = xEventGroupCreate();
     
-    if(get_response != 200){
-        ESP_LOGE(my_tag, "Fallo en el request GET(), HTTP Status = %d\n", get_response);
-        esp_http_client_close(client);
-        led_set(WIFI, RED);
-        return;
-    }
-
-    ESP_LOGI(my_tag, "HTTP GET Status = %d, content_length = %"PRId64,
-        esp_http_client_get_status_code(client),
-        esp_http_client_get_content_length(client));
+    ESP_LOGI(my_tag, " - Preconfiguramos el Wifi\n");
+    ESP_ERROR_CHECK(esp_netif_init());
+    ESP_ERROR_CHECK(esp_event_loop_create_default());
+    s_sta_netif = esp_netif_create_default_wifi_sta();
+    //assert(s_sta_netif);
 
-    esp_http_client_close(client);
-    led_set(WIFI, GREEN);
-}
+    /* Configure the RX and TX buffers for Wi-Fi communication */
+    wifi_init_config_t cfg = WIFI_INIT_CONFIG_DEFAULT();
+    ESP_ERROR_CHECK(esp_wifi_init(&cfg));
 
+    /*  Setemoas las banderas a usar para verificar la conexion hacia el 
+        Access Point */
+    ESP_LOGI(my_tag, " - Creamos los hanlders segun evento\n");    
+    esp_event_handler_instance_t instance_any_id;
+    esp_event_handler_instance_t instance_got_ip;
+    ESP_ERROR_CHECK(esp_event_handler_instance_register(WIFI_EVENT,
+                                                        ESP_EVENT_ANY_ID,
+                                                        &_wifi_event_handler,
+                                                        NULL,
+                                                        &instance_any_id));
+    ESP_ERROR_CHECK(esp_event_handler_instance_register(IP_EVENT,
+                                                        IP_EVENT_STA_GOT_IP,
+                                                        &_wifi_event_handler,
+                                                        NULL,
+                                                        &instance_got_ip));
 
-/*              POST() REQUEST              */
-int http_post_data(  char* url_path_post, char* data_to_send, size_t data_to_send_size, 
-                            char* response_buffer, size_t response_size ) {
-    ESP_LOGI(my_tag, "POST Request to:\n**%s\n", url_path_post);
-    int client_length_response = 0;
-    memset(response_buffer, 0, response_size);
+    ESP_LOGI(my_tag, " - Iniciamos el ESP32 Wifi Module\n");
+    /* Start Wi-Fi in station mode */
+    s_wifi_start_us = esp_timer_get_time();
+    s_stats.cycles++;
+    ESP_ERROR_CHECK(esp_wifi_set_mode(WIFI_MODE_STA));
+    ESP_ERROR_CHECK(esp_wifi_start());
 
-    esp_http_client_config_t config = {
-        .url                = url_path_post,
-        .timeout_ms         = 10000,
-        //.event_handler      = _http_event_handler,
-        .crt_bundle_attach  = esp_crt_bundle_attach,
-    };
-    ESP_LOGI(my_tag, "Clear the response buffer 101\n");
-    esp_http_client_handle_t client = esp_http_client_init(&config);
-    esp_http_client_set_method(client, HTTP_METHOD_POST);
-    // Set Content-Type header
-    esp_http_client_set_header(client, "Content-Type", tpi_format);
-    // Set ApiKey header
-    esp_http_client_set_header(client, "ApiKey", tpi_key);
-
-    esp_err_t err_post = esp_http_client_open(client, data_to_send_size);
-    if (err_post != ESP_OK) {
-        ESP_LOGE(my_tag, "Failed to open HTTP connection: %s", esp_err_to_name(err_post));
-        led_set(WIFI, RED);
-        return -1;
+    int ap_index = -1;
+    EventBits_t bits = 0;
+
+    /* 1) Conexion directa al AP del ciclo anterior (sin escaneo) */
+    if (wifi_cache_valid()) {
+        ESP_LOGI(my_tag, " - Conexion rapida al ultimo AP\n");
+        ap_index = s_wifi_cache.ap_index;
+        bits = wifi_connect_ap(ap_index, s_wifi_cache.bssid, s_wifi_cache.channel,
+                               0, WIFI_FAST_CONNECT_TIMEOUT_MS / portTICK_PERIOD_MS);
+        if (bits & WIFI_CONNECTED_BIT) {
+            s_stats.fast_connects++;
+        }
     }
-    client_length_response = esp_http_client_write(client, data_to_send, data_to_send_size);
-    client_length_response += esp_http_client_fetch_headers(client);
 
-    if (client_length_response < 0) {
-        ESP_LOGE(my_tag, "Failed writting data in endpoint\n");
-        esp_http_client_cleanup(client);
-        led_set(WIFI, RED);
-        return -1;
-    }
+    /* 2) Escaneo solo en el canal del ultimo AP, 3) escaneo de todos los canales */
+    for (int pass = 0; pass < 2 && (bits & WIFI_CONNECTED_BIT) == 0; pass++) {
+        uint8_t channel = (pass == 0) ? s_wifi_cache.channel : 0;
+        if (pass == 0 && !wifi_cache_valid()) {
+            continue;
+        }
+        ESP_LOGI(my_tag, " - Escaneamos redes cercanas (canal %u)\n", channel);
 
-    client_length_response = esp_http_client_read_response(client, response_buffer, response_size);
-    if(client_length_response < 0){
-        esp_http_client_cleanup(client);
-        led_set(WIFI, RED);
-        return -1;
-    }
-    ESP_LOGI(my_tag, "Clear the response buffer 2\n");
-    int status_code = esp_http_client_get_status_code(client);
-    esp_http_client_cleanup(client);
-    
-    ESP_LOGI(my_tag, "HTTP POST Status = %d\nRespuesta:\n%s\n", status_code, response_buffer);
-    if(status_code != 200){
-        led_set(WIFI, RED);
-        return -1;
+        wifi_ap_record_t ap_record;
+        ap_index = wifi_scan_for_ap(channel, &ap_record);
+        if (ap_index < 0) {
+            continue;
+        }
+        bits = wifi_connect_ap(ap_index, ap_record.bssid, ap_record.primary,
+                               ESP_MAXIMUM_RETRY_CONNECTION, WIFI_CONNECT_TIMEOUT_MS / portTICK_PERIOD_MS);
+        if (bits & WIFI_CONNECTED_BIT) {
+            if (pass == 0) {
+                s_stats.channel_connects++;
+            }
+            else {
+                s_stats.full_scan_connects++;
+            }
+        }
     }
-    led_set(WIFI, BLUE);
-    return 1;
-}
-
-
-void get_request(esp_http_client_handle_t client, char *response_buffer, size_t buffer_size) {
-    esp_http_client_set_method(client, HTTP_METHOD_GET);
-    memset(response_buffer, 0, buffer_size);
-    esp_err_t esp_http_err = esp_http_client_open(client, 0);
 
-    if (esp_http_err == ESP_OK) {
-        int content_length = esp_http_client_fetch_headers(client);
-        if (content_length < 0) {
-            ESP_LOGE(my_tag, "HTTP client fetch headers failed");
-        } else {
-            int data_read = esp_http_client_read_response(client, response_buffer, buffer_size);
-            if (data_read >= 0) {
-                ESP_LOGI(my_tag, "- Server respondio = %d", esp_http_client_get_status_code(client));
-            } else {
-                ESP_LOGE(my_tag, "Failed to read response");
-            }
+    if (bits & WIFI_CONNECTED_BIT) {
+        // SSID name copy
+        strncpy(ssid_buffer, myListAP[ap_index].ssid, buffer_size - 1);
+        ssid_buffer[buffer_size - 1] = '\0';    // add a null-terminated for robust
+        wifi_cache_update(ap_index);
+        if (s_net_mode == WIFI_NET_STATIC) {
+            s_stats.known_ip_connects++;
         }
+        s_stats.total_time_to_ip_ms += s_stats.last_time_to_ip_ms;
+        ESP_LOGI(my_tag, "Connected to:\n\tSSID: %s\n\tTime to IP: %lu ms\n",
+                 ssid_buffer, (unsigned long) s_stats.last_time_to_ip_ms);
+    }
+    else {
+        /* Si no hay AP de la lista, no nos conectamos y nos vamos a dormir*/
+        ESP_LOGE(my_tag, " No se encontraron redes cercanas\n");
+        s_wifi_cache.magic = 0;
+        s_stats.failures++;
+        strncpy(ssid_buffer, FAILED_WIFI_SCANNING, buffer_size - 1);
+        ssid_buffer[buffer_size - 1] = '\0';
     }
-    esp_http_client_close(client);
-}
 
+    /* The event will not be processed after unregister */
+    ESP_ERROR_CHECK(esp_event_handler_instance_unregister(IP_EVENT, IP_EVENT_STA_GOT_IP, instance_got_ip));
+    ESP_ERROR_CHECK(esp_event_handler_instance_unregister(WIFI_EVENT, ESP_EVENT_ANY_ID, instance_any_id));
+    vEventGroupDelete(s_wifi_event_group);
+}
 
 
+void wifi_get_stats(wifi_stats_t* stats)
+{
+    *stats = s_stats;
+}
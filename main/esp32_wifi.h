@@ -8,15 +8,13 @@
 #include "freertos/task.h"      // Header provides functions and macros for creating, starting, and managing tasks
 #include "freertos/event_groups.h" // This library is used for creating and managing event groups.
 
-#include "esp_http_client.h"    // API for creating and configuring HTTP/HTTPS clients.
-#include "esp_tls.h"        // Transport Layer Security for ESP-IDF - HTTPS
 #include "esp_wifi.h"       //  API for connecting to Wi-Fi networks, setting network configurations, and handling events related to Wi-Fi connectivity.
 #include "esp_event.h"      //  It allows you to register event handlers for various system and component events, including Wi-Fi
 #include "esp_netif.h"      //  Provides an abstraction for network interfaces and allows you to set up and manage network connections
+#include "esp_timer.h"      //  Time to IP is measured with esp_timer_get_time()
+#include "esp_attr.h"       //  RTC_DATA_ATTR: the last AP is kept during deep sleep
 
-#if CONFIG_MBEDTLS_CERTIFICATE_BUNDLE
-#include "esp_crt_bundle.h"
-#endif
+#include "esp32_http.h"     //  HTTP requests over the connection (esp32_http.c)
 
 /* Define variables for Wifi Connection */
 #define DEFAULT_SCAN_LIST_SIZE          5
@@ -24,30 +22,57 @@
 #define WIFI_FAIL_BIT                   BIT1
 #define ESP_MAXIMUM_RETRY_CONNECTION    3
 #define FAILED_WIFI_SCANNING            "None"
+#define WIFI_FAST_CONNECT_TIMEOUT_MS    3000    // Direct connect to the cached BSSID/channel
+#define WIFI_CONNECT_TIMEOUT_MS         15000   // Association + IP, including the retries
+#define WIFI_DISCONNECT_WAIT_MS         500     // Wait for the last event of a failed attempt
+#define WIFI_CACHE_MAGIC                0x57494649  // "WIFI"
+
+// How the STA interface gets its address
+enum _wifi_net_mode{
+    WIFI_NET_DHCP   = 0,    // Asks first for the last IP (INIT-REBOOT)
+    WIFI_NET_STATIC = 1     // CONFIG_NODO_WIFI_*_STATIC_IP
+};
 
 #define cst_wifi_log                    "cst_wifi"
 
+
 #define my_tag                          "Wifi_API"
 
 
+/* Connection counters, kept in RTC memory across deep sleep */
+typedef struct {
+    uint32_t cycles;                // Calls to wifi_scan()
+    uint32_t fast_connects;         // Connected to the cached BSSID/channel without scanning
+    uint32_t channel_connects;      // Connected after scanning only the cached channel
+    uint32_t full_scan_connects;    // Connected after scanning every channel
+    uint32_t failures;
+    uint32_t known_ip_connects;     // Static IP, no DHCP exchange
+    uint32_t last_time_to_ip_ms;    // esp_wifi_start() -> IP_EVENT_STA_GOT_IP
+    uint32_t total_time_to_ip_ms;   // Sum over the connected cycles (for the average)
+} wifi_stats_t;
+
 
 
 void _wifi_event_handler(void* arg, esp_event_base_t event_base,
                                 int32_t event_id, void* event_data);
 
 
+/**
+ * @brief This function connects to one of the APs of myListAP. The last AP
+ *        (BSSID, channel, IP) is kept in RTC memory, so on wake it first tries a
+ *        direct connect, then a scan of that channel and only then a full scan.
+ *        The address is the static IP of the AP (DHCP if it can not be set) or a
+ *        DHCP lease; the DHCP client first asks for the last IP (INIT-REBOOT) and
+ *        renews the lease while the cycle runs
+ * @param ssid_buffer: SSID of the AP, or FAILED_WIFI_SCANNING
+ */
 void wifi_scan(char* ssid_buffer, size_t buffer_size);
 
 
-void http_get_data(char* url_path_get, char* response_buffer, size_t size_response_buffer);
-
-
-int http_post_data(  char* url_path_post, char* data_to_send, size_t data_to_send_size, 
-                            char* response_buffer, size_t response_size);
-
-
-void get_request(esp_http_client_handle_t client, char *response_buffer, size_t buffer_size);
-
+/**
+ * @brief This function copies the connection counters (time to IP, fast connects, etc)
+ */
+void wifi_get_stats(wifi_stats_t* stats);
 
 
 // ----------------------------------------------------------------- //
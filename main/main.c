@@ -14,6 +14,12 @@
 #include "esp32_general.h"
 #include "esp32_sd.h"
 #include "esp32_wifi.h"
+#include "esp32_sync.h"
+#include "esp32_prof.h"
+#include "esp32_telem.h"
+#include "esp32_mem.h"
+#include "esp32_boot.h"
+#include "esp32_sched.h"
 
 #include <sys/param.h>
 
@@ -46,63 +52,29 @@ void update_led_battery(){
     }
 }
 
-esp_err_t update_battery_file(char* localtime, float battery_level) {
-    // Nombre del archivo donde se va a guardar el nuevo dato
-    char new_file_name[30];
-    sprintf(new_file_name, "/sdcard/bateria.txt");
-    char battery_buffer[150];
-
-    // Le damos el formato para almacenarlo en bateria.txt
-    sprintf(battery_buffer, "{\"Valor\":\"%.2f\",\"Identificador\":\"Voltaje\",\"Fecha\":\"%s\"}",
-            battery_level, localtime);
-    ESP_LOGI("SD_CARD", "New batterry entry = %s\n", battery_buffer);
-
-    // Evaluamos la cantidad de datos en el contenido
-    if(file_exists(new_file_name)){
-        // File exists
-        FILE* f = fopen(new_file_name, "r+");
-        ESP_LOGI("SD_CARD", "Ingresando nuevo valor\n");
-        fseek(f, -2, SEEK_END);
-        ftruncate(fileno(f), ftell(f));
-        fprintf(f,",");
-        fprintf(f, "%s", battery_buffer);
-        fprintf(f,"]}");
-        fclose(f);
-    }
-    else{
-        uint8_t base_mac[6];
-        esp_wifi_get_mac(ESP_IF_WIFI_STA, base_mac);
-        char macId[20];
-        uint8_t index = 0;
-        for(uint8_t i=0; i<6; i++){
-            index += sprintf(&macId[index], "%02x", base_mac[i]);
-        }
-        int id_empresa = 1;
-        char cargadora[9] = "EQP44";
-        char prefix_battery_file[250];
-        sprintf(prefix_battery_file, "{\"idEmpresa\":%d,\"idDispositivo\":\"%s\",\"Cargadora\":\"%s\",\"registro\":[%s]}", 
-                id_empresa, macId, cargadora, battery_buffer);
-        ESP_LOGE("SD_CARD", "NEW FILE = %s\n", prefix_battery_file);
-        FILE* f = fopen(new_file_name, "a");
-        fprintf(f, "%s", prefix_battery_file);
-        fclose(f);
-    }
-    return ESP_OK;
-}
-
 
 void app_main(void)
 {
+    // Arena estatica del ciclo: buffers de los logs y del envio sin fragmentar el heap (esp32_mem.h)
+    mem_init();
+    // Nuevo ciclo del profiler (PHASE_AWAKE termina en sleep_ESP32)
+    prof_init();
+    // Heap, stacks y archivos de la SD en cada fase: se envian con la bateria (esp32_telem.h)
+    telem_init();
+    // Lo que pasa en este ciclo decide cuanto se duerme (esp32_sched.h)
+    static sched_cycle_t cycle;
+
     // Initialize NVS
+    PHASE_BEGIN(PHASE_NVS);
     esp_err_t ret = nvs_flash_init();
     if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND) {
         ESP_ERROR_CHECK(nvs_flash_erase());
         ret = nvs_flash_init();
     }
     ESP_ERROR_CHECK(ret);
+    PHASE_END(PHASE_NVS);
     
     config_pin();
-    ADC_Channel_configure(BAT_ADC_CHANNEL);
 
     /* Desahibilitamos ciertos logs */
     esp_log_level_set("wifi_init", ESP_LOG_WARN);
@@ -110,106 +82,118 @@ void app_main(void)
     //esp_log_level_set("phy_init", ESP_LOG_WARN);    
     
 
-    // -----------------  Datos de Bateria ----------------------
-    battery_value = adc_get_value(BAT_ADC_CHANNEL);
-    ESP_LOGI(TAG, "Valor leido de bateria = %.2f\n", battery_value);
-    update_led_battery();
-    
-    //sleep_ESP32(TIME_TO_SLEEP);
-
+    /*  Bateria, Wi-Fi y SD no dependen entre si: se inician a la vez y
+        la sincronizacion empieza cuando la red y la SD estan listas */
     ESP_LOGI(TAG, "Inicializamos el programa prinicpal\n");
+    led_set(WIFI, WHITE);
+    led_set(CHECK, WHITE);
+    static boot_result_t boot;
+    PHASE_BEGIN(PHASE_BOOT);
+    if (boot_start(&boot) != ESP_OK) {
+        led_set(CHECK, RED);
+        delay_ms(1000);
+        cycle.failed = 1;
+        sched_sleep(&cycle);
+    }
+    EventBits_t boot_ready = boot_wait(BOOT_WIFI_READY | BOOT_SD_READY, BOOT_TIMEOUT_MS);
+    PHASE_END(PHASE_BOOT);
+    if (boot_ready != (BOOT_WIFI_READY | BOOT_SD_READY)) {
+        // Una tarea sigue corriendo: boot.ssid, boot.sd_status y boot.card no son validos
+        // todavia, y expulsar la SD a mitad del montaje la puede dejar mal
+        ESP_LOGE(TAG, "Arranque incompleto (wifi = %d, SD = %d), se duerme hasta el siguiente ciclo\n",
+                 (boot_ready & BOOT_WIFI_READY) != 0, (boot_ready & BOOT_SD_READY) != 0);
+        led_set(CHECK, RED);
+        delay_ms(1000);
+        cycle.failed = 1;
+        sched_sleep(&cycle);
+    }
 
-    /* Intentamos conectarnos a un ACCESS POINT y mostramos el IP obtenido */
-    led_set(WIFI, WHITE);  
-    char ssid_buffer[32];
+    // -----------------  Datos de Bateria ----------------------
+    if (boot_wait(BOOT_BATTERY_READY, BOOT_TIMEOUT_MS) != 0) {
+        battery_value = boot.battery_value;
+        cycle.battery = battery_value;
+        ESP_LOGI(TAG, "Valor leido de bateria = %.2f (%u %%)\n", battery_value, boot.battery_soc);
+        update_led_battery();
+    }
 
-    wifi_scan(ssid_buffer, sizeof(ssid_buffer));
+    ESP_LOGI(TAG, "Arranque: bateria = %lu ms, wifi = %lu ms, SD = %lu ms, listos en %lu ms (ahorro = %ld ms)\n",
+             (unsigned long) boot.battery_ms, (unsigned long) boot.wifi_ms, (unsigned long) boot.sd_ms,
+             (unsigned long) boot.ready_ms, (long) boot_saved_ms(&boot));
 
+    wifi_stats_t wifi_stats;
+    wifi_get_stats(&wifi_stats);
+    ESP_LOGI(TAG, "Wifi: %lu ms hasta IP (rapidas = %lu, canal = %lu, completas = %lu, fallos = %lu)\n",
+             (unsigned long) wifi_stats.last_time_to_ip_ms, (unsigned long) wifi_stats.fast_connects,
+             (unsigned long) wifi_stats.channel_connects, (unsigned long) wifi_stats.full_scan_connects,
+             (unsigned long) wifi_stats.failures);
+
+    char* ssid_buffer = boot.ssid;
     printf("\t\t - - - - Mejor red encontrada es '%s' - - - -\n\n", ssid_buffer);
 
+    /* Montamos la tarjeta SD para su uso */
+    static sdmmc_card_t *card = NULL;
+    sdmmc_host_t host = boot.host;
+    card = boot.card;
+
     if( strcmp(FAILED_WIFI_SCANNING , ssid_buffer) == 0){
         ESP_LOGE(TAG, "Finalizamos por no poder conectarse a una red Wifi \n");
         led_set(WIFI, RED);
+        if (boot.sd_status == ESP_OK) {
+            eject_SD(card, &host);
+        }
+        deactivate_pin(PinSD);
         delay_ms(500);
-        sleep_ESP32(TIME_TO_SLEEP);
+        sched_sleep(&cycle);
     }
 
     // Encendemos el LED segun el resultado obtenido
     if ( strcmp(EDGE_AP, ssid_buffer) == 0 ){
         led_set(WIFI, GREEN);
+        cycle.link = SCHED_LINK_EDGE;
     }
     else if ( strcmp(MODEM_AP, ssid_buffer) == 0 ){
         led_set(WIFI, BLUE);
+        cycle.link = SCHED_LINK_MODEM;
     }
 
-
-    /* Configuramos los pines de la ESP32 */
-    activate_pin(PinSD);
-
     /* Creamos el buffer para HTTP Request */
     static char buffer_http_response[MAX_HTTP_OUTPUT_BUFFER];
-    static char buffer_file_name[sd_file_buffer];
-    static char buffer_sd_qty[sd_file_buffer];
     char buffer_url[100] = "";
-    size_t free_heap_size = 0;
-
-    int old_qty_salud = 0;
-    int new_qty_salud = 0;
 
-    /* Montamos la tarjeta SD para su uso */
-    static sdmmc_card_t *card = NULL;
-    sdmmc_host_t host;
-
-    esp_err_t ret_SD = init_SD(&card, &host);
-
-    led_set(CHECK, WHITE);
-    if (ret_SD != ESP_OK) {
+    if (boot.sd_status != ESP_OK) {
         ESP_LOGE(TAG, "TARJETA SD NO DETECTADA\n, se va a apagar el equipo\n");
         led_set(CHECK, RED);
         delay_ms(1000);
-        sleep_ESP32(TIME_TO_SLEEP);
+        cycle.failed = 1;
+        sched_sleep(&cycle);
     }
 
-    // Inspeccionamos si existen los archivos
-    // salud nuevo
-    sprintf(buffer_file_name, "%s.txt", file_salud_size);
-    if (file_exists(buffer_file_name) == 0 ){
-        led_set(CHECK, YELLOW);
-        create_file(buffer_file_name, "0");
-        led_set(CHECK, OFF);
-    }
-    
-    // pesaje nuevo
-    sprintf(buffer_file_name, "%s.txt", file_pesaje_size);
-    if (file_exists(buffer_file_name) == 0 ){
-        led_set(CHECK, YELLOW);
-        create_file(buffer_file_name, "0");
-        led_set(CHECK, OFF);
+#if CONFIG_NODO_SD_BENCH
+    sd_bench(CONFIG_NODO_SD_BENCH_KB);
+#endif
+
+    // Abrimos los logs de cada stream (salud, pesaje, bateria) y la cuarentena,
+    // y movemos los archivos <prefijo>N.txt de versiones anteriores a los logs
+    PHASE_BEGIN(PHASE_SD_OPEN);
+    static sync_t streams;
+    if (sync_open(&streams, buffer_http_response, sizeof(buffer_http_response)) != ESP_OK){
+        ESP_LOGE(TAG, "No se pudieron abrir los logs de la SD\n");
+        led_set(CHECK, RED);
+        delay_ms(1000);
+        cycle.failed = 1;
+        sched_sleep(&cycle);
     }
-    
-    // salud error
-    sprintf(buffer_file_name, "%s.txt", file_err_salud_size);
-    if (file_exists(buffer_file_name) == 0 ){
-        led_set(CHECK, YELLOW);
-        create_file(buffer_file_name, "0");
-        led_set(CHECK, OFF);
+
+    // Muestra de bateria de este ciclo (una escritura de 16 bytes en el anillo)
+    if (streams.battery.file != NULL && battery_value > 0) {
+        sd_battery_append(&streams.battery, (uint32_t) time(NULL), (uint16_t) (battery_value * 1000),
+                          sync_clock_valid() ? SD_BATTERY_DATED : 0);
     }
+    PHASE_END(PHASE_SD_OPEN);
     led_set(CHECK, GREEN);
 
-    // Creamos un cliente para hacer HTTP Request
-    // *Observacion*: Si se crea varios clientes la memoria disponible se reduce
-    // *Recomendacion*: Usar un mismo cliente y reconfigurarlo varias veces, finalizar con WiFi
-    esp_err_t esp_http_err = ESP_OK;
-    esp_http_client_config_t config = {
-        .url = cst_server,
-        .timeout_ms = 5000,
-        // Opcional: Agregar un handler para chequear mejor la interaccion
-        //.event_handler = _http_event_handler,
-    };
-    config.event_handler = NULL;
-    esp_http_client_handle_t client = esp_http_client_init(&config);
-    esp_http_client_cleanup(client);
-
+    // Los clientes HTTP salen del pool (esp32_http.h): uno por destino durante todo
+    // el ciclo, se liberan con http_pool_cleanup() antes de apagar el WiFi
 
     // ---------------------------------------------------
     //              WIFI = ESP-AP (EDGE_AP)
@@ -218,56 +202,34 @@ void app_main(void)
         printf(" \n\t\t - - - - Empezamos la extraccion de Datos - - - - \n");
         
         // Set URL : La hora local
-        char localtime_buffer[60];
-        sprintf(buffer_url, "http://%s%s", edge_server, edge_localtime);
-        config.url = buffer_url;
-        client = esp_http_client_init(&config);
-        get_request(client, localtime_buffer, sizeof(localtime_buffer));
-        esp_http_client_cleanup(client);
-        printf(" Data obtenida = '%s' - '%d'\n", localtime_buffer, sizeof(localtime_buffer));
-
-        // ----------------- Datos de Salud ---------------------- 
-        // Apuntamos al servidor del Edge Computer que contiene la cantidad
-        // de paquetes almacenados
-        sprintf(buffer_url, "http://%s%s", edge_server, edge_salud_size);
-        config.url = buffer_url;
-        client = esp_http_client_init(&config);
-        get_request(client, buffer_sd_qty, sizeof(buffer_sd_qty));
-        esp_http_client_cleanup(client);
-        new_qty_salud = atoi(buffer_sd_qty);
-
-        // Leemos los archivos ya almacenados en Salud
-        sprintf(buffer_file_name,"%s.txt", file_salud_size);
-        leer_file_sd(buffer_file_name, buffer_sd_qty, sizeof(buffer_sd_qty));
-        old_qty_salud = atoi(buffer_sd_qty);
-
-        //ESP_LOGI(TAG, " - Antiguos archivos = %d \n\t\t -Nuevos archivos = %d\n", old_qty_salud, new_qty_salud);
-        
-        int new_total = old_qty_salud + new_qty_salud;
-        // Guardamos el nuevo valor de datos totales
-        sprintf(buffer_file_name,"%s.txt", file_salud_size);
-        sprintf(buffer_sd_qty, "%d", new_total);
-        guardar_file_sd(buffer_sd_qty, buffer_file_name);
-
-        ESP_LOGI(TAG, "Cantidad de nuevos datos = '%d'\n", new_qty_salud);
-
-        // Apuntamos el cliente http hacia la URL de datos de Salud
-        sprintf(buffer_url, "http://%s%s", edge_server, edge_salud_data);
-        config.url = buffer_url;
-        config.timeout_ms = 5000;
-        client = esp_http_client_init(&config);
-        for (int n = old_qty_salud; n < new_total; n++){
-            // Solicitamos datos al url = "/datos"
-            //free_heap_size = esp_get_free_heap_size();
-            //ESP_LOGI(TAG, "Free space = '%u'\n", free_heap_size);
-            // Obtenemos la nueva data
-            get_request(client, buffer_http_response, sizeof(buffer_http_response));
-            // Creamos el archivo sa_number.txt
-            sprintf(buffer_file_name,"%s%d.txt", file_salud_data, n);
-            create_file(buffer_file_name, buffer_http_response);
-            delay_ms(100);
+        PHASE_BEGIN(PHASE_EDGE_QUERY);
+        char localtime_buffer[60] = "";
+        esp_http_client_handle_t client = sync_edge_client();
+        if (client != NULL &&
+            snprintf(buffer_url, sizeof(buffer_url), "http://%s%s", edge_server, edge_localtime) < sizeof(buffer_url)) {
+            esp_http_client_set_url(client, buffer_url);
+            get_request(client, localtime_buffer, sizeof(localtime_buffer));
         }
-        esp_http_client_cleanup(client);
+        printf(" Data obtenida = '%s' - '%d'\n", localtime_buffer, sizeof(localtime_buffer));
+        // El Edge es la fuente de la hora: las muestras de bateria y la telemetria se fechan con ella
+        sync_set_clock(&streams, localtime_buffer);
+
+        // ----------------- Datos de Salud y Pesaje ---------------------- 
+        // Cantidad de registros de cada stream de la tabla (esp32_sync.c)
+        int edge_records = sync_edge_query(&streams);
+        PHASE_END(PHASE_EDGE_QUERY);
+
+        // Los streams se turnan sobre la misma conexion (keep-alive)
+        PHASE_BEGIN(PHASE_EDGE_DOWNLOAD);
+        led_set_pattern(CHECK, BLUE, LED_BLINK);
+        mem_trace_begin();
+        int downloaded = sync_edge_download(&streams, buffer_http_response, sizeof(buffer_http_response));
+        mem_trace_end("edge");
+        ESP_LOGI(TAG, "Registros descargados = %d de %d\n", downloaded, edge_records);
+        cycle.fetched = downloaded;
+        cycle.failed  = (streams.edge_failed > 0);
+        PHASE_END(PHASE_EDGE_DOWNLOAD);
+        led_set(CHECK, GREEN);
     }
     
 
@@ -276,212 +238,44 @@ void app_main(void)
     // ---------------------------------------------------
     if ( strcmp(MODEM_AP, ssid_buffer) == 0 ){
         printf(" \n\t\t - - - - Empezamos el envio de Datos - - - - \n");
-        int qty_files = 0;
-        int qty_err_files = 0;
-        int actual_failed_files = 0;
-        int resultado = 0;
-        int check_sd_length = 0;
-
-        // --- Salud Datos fallidos
-        sprintf(buffer_file_name, "%s.txt", file_err_salud_size);
-        leer_file_sd(buffer_file_name, buffer_sd_qty, sizeof(buffer_sd_qty));
-        // Obtenemos la cantidad de datos fallidos
-        qty_err_files = atoi(buffer_sd_qty);
-        actual_failed_files = 0;
-
-        // --- Salud Nuevos datos        
-        sprintf(buffer_file_name,"%s.txt", file_salud_size);
-        leer_file_sd(buffer_file_name, buffer_sd_qty, sizeof(buffer_sd_qty));
-        // Obtenemos la cantidad de datos nuevos
-        qty_files = atoi(buffer_sd_qty);
-
-        ESP_LOGI(TAG, "Se encontraron:\n\t- Archivos salud: %d\n\t- Archivos error_salud: %d\n",
-                    qty_files, qty_err_files);
-
-        //  ------------------ CST SERVER ---------------------------
-        // Iniciamos el cliente
-        sprintf(buffer_url, "%s%s", cst_server, cst_salud);
-        ESP_LOGI(TAG, "\n \t ------- Enviando datos a : '%s'  -------\n", buffer_url);
-        config.url = buffer_url;
-        config.timeout_ms = 10000;
-        config.crt_bundle_attach = esp_crt_bundle_attach;
-        config.disable_auto_redirect = true;
-        client = esp_http_client_init(&config);
-        // Set HTTP Method
-        esp_http_client_set_method(client, HTTP_METHOD_POST);
-        // Set Content-Type header
-        esp_http_client_set_header(client, "Content-Type", tpi_format);
-        // Set ApiKey header
-        esp_http_client_set_header(client, "ApiKey", tpi_key);
-
-        for(int n = 0; n < qty_err_files; n++){
-            // Leemos el archivo a enviar
-            led_set(CHECK, BLUE);
-            sprintf(buffer_file_name,"%s%d.txt", file_err_salud_dat, n);
-            if (file_exists(buffer_file_name) == 0){
-                //led_set(CHECK, WHITE);
-                continue;
-            }
-            memset(buffer_http_response, 0, sizeof(buffer_http_response));
-            check_sd_length = leer_file_sd(buffer_file_name, buffer_http_response, sizeof(buffer_http_response));
-            if (check_sd_length < 1){
-                delete_file_sd(buffer_file_name);
-                //led_set(CHECK, WHITE);
-                continue;
-            }
-
-            // Intentamos enviar datos hacia el servidor
-            // Si ocurre un error, el archivo se mantiene y no es eliminado
-            esp_http_client_set_post_field(client, buffer_http_response, strlen(buffer_http_response));
-            ret = esp_http_client_perform(client);
-            resultado = esp_http_client_get_status_code(client);
-            if(ret == ESP_OK && resultado == 200){
-                led_set(CHECK, GREEN);
-                ESP_LOGI(TAG, " \t- El archivo %s se envio correctamente\n", buffer_file_name);
-            }
-            else{
-                led_set(CHECK, RED);
-                ESP_LOGE(TAG, " \t- Fallo al enviar el archivo %s\n", buffer_file_name);
-            }
-        }
-
-        for(int n = 0; n < qty_files; n++){
-            // Leemos el archivo a enviar
-            led_set(CHECK, BLUE);
-            sprintf(buffer_file_name,"%s%d.txt", file_salud_data, n);
-            if (file_exists(buffer_file_name) == 0){
-                //led_set(CHECK, WHITE);
-                continue;
-            }
-            memset(buffer_http_response, 0, sizeof(buffer_http_response));
-            check_sd_length = leer_file_sd(buffer_file_name, buffer_http_response, sizeof(buffer_http_response));
-            if (check_sd_length < 1){
-                delete_file_sd(buffer_file_name);
-                //led_set(CHECK, OFF);
-                continue;
-            }
-            // Intentamos enviar datos hacia el servidor
-            // Si ocurre un error, el archivo se mantiene y no es eliminado
-            esp_http_client_set_post_field(client, buffer_http_response, strlen(buffer_http_response));
-            ret = esp_http_client_perform(client);
-            resultado = esp_http_client_get_status_code(client);
-            if(ret == ESP_OK && resultado == 200){
-                led_set(CHECK, GREEN);
-                ESP_LOGI(TAG, " \t- El archivo %s se envio correctamente\n", buffer_file_name);
-            }
-            else{
-                led_set(CHECK, RED);
-                ESP_LOGE(TAG, " \t- Fallo al enviar el archivo %s\n", buffer_file_name);
-            }
-        }
-        esp_http_client_cleanup(client);
-
-        //  ------------------ TPI SERVER ---------------------------
-        // Iniciamos el cliente
-        sprintf(buffer_url, "%s%s", tpi_server, tpi_salud);
-        ESP_LOGI(TAG, "\n \t ------- Enviando datos a : '%s'  -------\n", buffer_url);
-        config.url = buffer_url;
-        config.timeout_ms = 10000;
-        config.crt_bundle_attach = esp_crt_bundle_attach;
-        config.disable_auto_redirect = true;
-        client = esp_http_client_init(&config);
-        // Set HTTP Method
-        esp_http_client_set_method(client, HTTP_METHOD_POST);
-        // Set Content-Type header
-        esp_http_client_set_header(client, "Content-Type", tpi_format);
-        // Set ApiKey header
-        esp_http_client_set_header(client, "ApiKey", tpi_key);
-
-        for(int n = 0; n < qty_err_files; n++){
-            // Leemos el archivo a enviar
-            led_set(CHECK, BLUE);
-            sprintf(buffer_file_name,"%s%d.txt", file_err_salud_dat, n);
-            if (file_exists(buffer_file_name) == 0){
-                continue;
-            }
-            memset(buffer_http_response, 0, sizeof(buffer_http_response));
-            leer_file_sd(buffer_file_name, buffer_http_response, sizeof(buffer_http_response));
-
-            // Intentamos enviar datos hacia el servidor
-            // Si ocurre un error, el archivo se mantiene y no es eliminado
-            esp_http_client_set_post_field(client, buffer_http_response, strlen(buffer_http_response));
-            ret = esp_http_client_perform(client);
-            resultado = esp_http_client_get_status_code(client);
-            if(ret == ESP_OK && resultado == 200){
-                led_set(CHECK, GREEN);
-                ESP_LOGI(TAG, " \t- El archivo %s se envio correctamente\n", buffer_file_name);
-                delete_file_sd(buffer_file_name);
-            }
-            else{
-                led_set(CHECK, RED);
-                ESP_LOGE(TAG, " \t- Fallo al enviar el archivo %s\n", buffer_file_name);
-                sprintf(buffer_file_name, "%s%d.txt", file_err_salud_dat, actual_failed_files);
-                ESP_LOGI(TAG, " \t\t- Creando el archivo %s\n", buffer_file_name);
-                create_file(buffer_file_name, buffer_http_response);
-                actual_failed_files++;
-            }
-        }
 
-        for(int n = 0; n < qty_files; n++){
-            led_set(CHECK, BLUE);
-            // Leemos el archivo a enviar
-            sprintf(buffer_file_name,"%s%d.txt", file_salud_data, n);
-            if (file_exists(buffer_file_name) == 0){
-                continue;
-            }
-            memset(buffer_http_response, 0, sizeof(buffer_http_response));
-            leer_file_sd(buffer_file_name, buffer_http_response, sizeof(buffer_http_response));
-
-            // Intentamos enviar datos hacia el servidor
-            // Si ocurre un error, el archivo se mantiene y no es eliminado
-            esp_http_client_set_post_field(client, buffer_http_response, strlen(buffer_http_response));
-            ret = esp_http_client_perform(client);
-            resultado = esp_http_client_get_status_code(client);
-            if(ret == ESP_OK && resultado == 200){
-                led_set(CHECK, GREEN);
-                ESP_LOGI(TAG, " \t- El archivo %s se envio correctamente\n", buffer_file_name);
-                delete_file_sd(buffer_file_name);
-            }
-            else{
-                led_set(CHECK, RED);
-                ESP_LOGE(TAG, " \t- Fallo al enviar el archivo %s\n", buffer_file_name);
-                sprintf(buffer_file_name, "%s%d.txt", file_err_salud_dat, actual_failed_files);
-                ESP_LOGI(TAG, " \t\t- Creando el archivo %s\n", buffer_file_name);
-                create_file(buffer_file_name, buffer_http_response);
-                actual_failed_files++;
-            }
+        //  ------------------ CST + TPI SERVER ---------------------------
+        // Cada registro se lee una vez de la SD y se envia a los dos servidores a la vez.
+        // Solo el TPI es obligatorio: si falla, el registro pasa al log de errores de su stream
+        PHASE_BEGIN(PHASE_UPLOAD);
+        mem_trace_begin();
+        int failed_records = sync_upload(&streams);
+        mem_trace_end("upload");
+        if (failed_records < 0){
+            led_set(CHECK, RED);
         }
-        esp_http_client_cleanup(client);
-        
-        sprintf(buffer_file_name, "%s.txt", file_salud_size);
-        delete_file_sd(buffer_file_name);
-        delay_ms(30);
-        create_file(buffer_file_name, "0");
-        
-        sprintf(buffer_file_name, "%s.txt", file_err_salud_size);
-        delete_file_sd(buffer_file_name);
-        delay_ms(30);
-        char new_size_err[10];
-        sprintf(new_size_err, "%d", actual_failed_files);
-        create_file(buffer_file_name, new_size_err);
+        cycle.failed = (failed_records != 0);
+        PHASE_END(PHASE_UPLOAD);
     }
 
     // --------------  END PROGRAM  ----------------
+    PHASE_BEGIN(PHASE_SHUTDOWN);
     led_set(CHECK, GREEN);    
     ESP_LOGI(TAG, " - Apagamos el Modulo WIFI \n");
+    http_pool_cleanup();
     ESP_ERROR_CHECK( esp_wifi_stop() );
     led_set(WIFI, WHITE);
 
     ESP_LOGI(TAG, " - Ejectamos la tarjeta SD\n");
+    cycle.backlog = sync_pending(&streams);
+    sync_close(&streams);
+    // Las fases de este ciclo que faltan (shutdown, awake) se escriben en el siguiente
+    prof_flush_sd(MOUNT_POINT);
     eject_SD(card, &host);
     deactivate_pin(PinSD);
 
     ESP_LOGI(TAG, " - Apagamos las luces LED \n");
     power_off_leds();
     delay_ms(500);
+    PHASE_END(PHASE_SHUTDOWN);
 
     ESP_LOGI(TAG, " \n\t Comenzamos el deep_sleep \n");
-    sleep_ESP32(TIME_TO_SLEEP);
+    sched_sleep(&cycle);
 }
 
 
@@ -0,0 +1,92 @@
+#!/usr/bin/env python3
+"""
+Descarga del Edge por lotes contra un registro por peticion (main/esp32_sync.c).
+
+Compila host/sync_bench con cada CONFIG_NODO_EDGE_BATCH_SIZE, levanta un
+tools/edge_stub.py nuevo por corrida (los registros confirmados se borran) y
+mide un ciclo EDGE. El tamano 0 usa el Edge antiguo (--legacy): un GET por
+registro con la pausa de SYNC_RECORD_DELAY_MS, el protocolo de antes de los lotes.
+
+Uso:
+    python3 tools/edge_bench.py [--records 1000] [--latency 5] [--batch 0,1,5,20,50]
+
+--latency agrega esa espera a cada respuesta del stub, como la ida y vuelta por
+el AP del Edge; en localhost sin ella el costo por peticion casi no se ve.
+"""
+import argparse
+import os
+import re
+import socket
+import subprocess
+import sys
+import tempfile
+import time
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+REPORT = re.compile(r"^EDGE\s+(\d+) registros en\s+([\d.]+) s =\s+([\d.]+) reg/s \|\s+(\d+) peticiones, "
+                    r"latencia p50 = ([\d.]+) ms")
+
+
+def build(batch, work):
+    build_dir = os.path.join(work, "build_%d" % batch)
+    subprocess.run(["cmake", "-S", os.path.join(ROOT, "host"), "-B", build_dir,
+                    "-DNODO_EDGE_BATCH_SIZE=%d" % batch], check=True, stdout=subprocess.DEVNULL)
+    subprocess.run(["cmake", "--build", build_dir, "--target", "sync_bench", "-j%d" % (os.cpu_count() or 1)],
+                   check=True, stdout=subprocess.DEVNULL)
+    return os.path.join(build_dir, "sync_bench")
+
+
+def free_port():
+    with socket.socket() as s:
+        s.bind(("127.0.0.1", 0))
+        return s.getsockname()[1]
+
+
+def run(bench, batch, args, work):
+    port = free_port()
+    stub = [sys.executable, os.path.join(ROOT, "tools", "edge_stub.py"), "--port", str(port), "--drop", "0",
+            "--records", str(args.records), "--latency", str(args.latency)]
+    if batch == 0:
+        stub.append("--legacy")
+    server = subprocess.Popen(stub, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    try:
+        for _ in range(50):
+            try:
+                socket.create_connection(("127.0.0.1", port), timeout=0.1).close()
+                break
+            except OSError:
+                time.sleep(0.1)
+        sd = tempfile.mkdtemp(prefix="sd_%d_" % batch, dir=work)
+        address = "127.0.0.1:%d" % port
+        output = subprocess.run([bench, "--edge", address, "--upload", address, "--wifi", "EDGE", "--sd", sd],
+                                check=True, capture_output=True, text=True).stdout
+    finally:
+        server.terminate()
+        server.wait()
+    for line in output.splitlines():
+        match = REPORT.match(line)
+        if match:
+            return match.groups()
+    raise RuntimeError("sync_bench no reporto la descarga:\n" + output)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--records", type=int, default=1000, help="registros por stream en el Edge")
+    parser.add_argument("--latency", type=float, default=5, help="ms por respuesta del Edge")
+    parser.add_argument("--batch", default="0,1,5,20,50", help="valores de CONFIG_NODO_EDGE_BATCH_SIZE")
+    args = parser.parse_args()
+
+    with tempfile.TemporaryDirectory(prefix="edge_bench_") as work:
+        print("%d registros por stream, %.1f ms por respuesta" % (args.records, args.latency))
+        print("%-8s %9s %10s %11s %11s %9s" % ("lote", "registros", "tiempo s", "reg/s", "peticiones", "p50 ms"))
+        base = None
+        for batch in [int(b) for b in args.batch.split(",")]:
+            records, seconds, rate, requests, p50 = run(build(batch, work), batch, args, work)
+            base = base or float(rate)
+            print("%-8s %9s %10s %11s %11s %9s  x%.1f" % (batch if batch > 0 else "0 (GET)", records, seconds,
+                                                          rate, requests, p50, float(rate) / base))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,180 @@
+#!/usr/bin/env python3
+"""
+Edge local de prueba para la descarga por cursor (main/esp32_sync.c).
+
+Sirve los endpoints del Edge (credenciales.h) con registros generados y corta
+conexiones al azar a mitad de una respuesta, para ver que el nodo retoma la
+descarga donde quedo sin pedir registros dos veces.
+
+    GET /datetime
+    GET /<stream>/size                    registros sin confirmar
+    GET /<stream>/datos?after=S&count=K   "<seq>\\t<json>" por linea
+    GET /<stream>/datos?from=N&count=K    protocolo por indice (Edge antiguo)
+    GET /<stream>/datos                   un registro y se borra (Edge antiguo)
+    GET /<stream>/ack?seq=S               borra los registros hasta S
+
+Tambien recibe los POST de los servidores CST y TPI (cualquier otra ruta): responde
+200 y cuenta los registros de cada ruta. Asi host/sync_bench hace la descarga y el
+envio contra el mismo proceso.
+
+Uso:
+    python3 tools/edge_stub.py [--port 5000] [--records 500] [--drop 0.1] [--legacy] [--latency 0]
+
+Al terminar (Ctrl+C) muestra, por stream, los seq que se pidieron otra vez
+despues de haberlos entregado completos (deberia ser 0).
+"""
+import argparse
+import json
+import random
+import threading
+import time
+import zlib
+from collections import Counter
+from http.server import BaseHTTPRequestHandler, ThreadingHTTPServer
+from urllib.parse import parse_qs, urlparse
+
+STREAMS = ("salud", "pesaje")
+
+
+class Edge:
+    def __init__(self, records):
+        self.lock = threading.Lock()
+        self.records = {s: {seq: self.make(s, seq) for seq in range(1, records + 1)} for s in STREAMS}
+        self.next_seq = {s: records + 1 for s in STREAMS}
+        self.served = {s: Counter() for s in STREAMS}
+        self.posted = Counter()
+
+    @staticmethod
+    def make(stream, seq):
+        return json.dumps({"stream": stream, "seq": seq, "Fecha": time.strftime("%Y-%m-%d %H:%M:%S"),
+                           "Valor": round(random.uniform(0, 100), 2)}, separators=(",", ":"))
+
+    def produce(self):
+        # Registros nuevos mientras el nodo descarga
+        with self.lock:
+            for s in STREAMS:
+                seq = self.next_seq[s]
+                self.records[s][seq] = self.make(s, seq)
+                self.next_seq[s] = seq + 1
+
+
+def make_handler(edge, args):
+    class Handler(BaseHTTPRequestHandler):
+        protocol_version = "HTTP/1.1"       # keep-alive, como el cliente del nodo
+        disable_nagle_algorithm = True      # headers y cuerpo van en dos send(): sin esto cada respuesta espera el ACK retardado
+
+        def log_message(self, fmt, *params):
+            if args.verbose:
+                super().log_message(fmt, *params)
+
+        def reply(self, status, lines, cut=False):
+            body = "".join(line + "\n" for line in lines).encode()
+            self.send_response(status)
+            self.send_header("Content-Type", "text/plain")
+            self.send_header("Content-Length", str(len(body)))
+            self.end_headers()
+            if cut and body:
+                # Corte a mitad de la respuesta: el nodo recibe registros incompletos
+                self.wfile.write(body[:random.randrange(len(body))])
+                self.wfile.flush()
+                self.close_connection = True
+                return
+            self.wfile.write(body)
+
+        def do_GET(self):
+            if args.latency > 0:
+                # Ida y vuelta por el AP o el modem: en localhost cada peticion es casi gratis
+                time.sleep(args.latency / 1000)
+            url = urlparse(self.path)
+            query = {k: int(v[0]) for k, v in parse_qs(url.query).items()}
+            parts = url.path.strip("/").split("/")
+            cut = random.random() < args.drop
+
+            if url.path == "/datetime":
+                return self.reply(200, [time.strftime("%Y-%m-%d %H:%M:%S")])
+            if len(parts) != 2 or parts[0] not in STREAMS:
+                return self.reply(404, [])
+            stream, endpoint = parts
+            with edge.lock:
+                records = edge.records[stream]
+                if endpoint == "size":
+                    return self.reply(200, [str(len(records))])
+                if endpoint == "ack" and not args.legacy:
+                    for seq in [s for s in records if s <= query.get("seq", 0)]:
+                        del records[seq]
+                    return self.reply(200, ["ok"])
+                if endpoint != "datos":
+                    return self.reply(404, [])
+
+                if "after" in query and not args.legacy:
+                    seqs = sorted(s for s in records if s > query["after"])[:query.get("count", 1)]
+                    if not cut:
+                        # Un seq que se vuelve a pedir despues de una respuesta completa es un error del nodo
+                        edge.served[stream].update(seqs)
+                    return self.reply(200, ["%d\t%s" % (s, records[s]) for s in seqs], cut)
+                if "after" in query:
+                    return self.reply(400, [])
+                if "from" in query:
+                    seqs = sorted(records)[query["from"]:query["from"] + query.get("count", 1)]
+                    return self.reply(200, [records[s] for s in seqs], cut)
+                # Un registro por peticion: se entrega y se borra
+                if not records:
+                    return self.reply(200, [""])
+                seq = min(records)
+                return self.reply(200, [records.pop(seq)], cut)
+
+        def do_POST(self):
+            body = self.rfile.read(int(self.headers.get("Content-Length", 0)))
+            if args.latency > 0:
+                time.sleep(args.latency / 1000)
+            encoding = self.headers.get("Content-Encoding", "")
+            try:
+                if encoding in ("gzip", "deflate"):
+                    body = zlib.decompress(body, 16 + zlib.MAX_WBITS if encoding == "gzip" else zlib.MAX_WBITS)
+                document = json.loads(body)
+            except (ValueError, zlib.error):
+                return self.reply(400, [])
+            # Un lote es un arreglo JSON: un registro por elemento
+            with edge.lock:
+                edge.posted[urlparse(self.path).path] += len(document) if isinstance(document, list) else 1
+            return self.reply(200, ["ok"])
+
+    return Handler
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--port", type=int, default=5000)
+    parser.add_argument("--records", type=int, default=500, help="registros iniciales por stream")
+    parser.add_argument("--drop", type=float, default=0.1, help="probabilidad de cortar una respuesta")
+    parser.add_argument("--produce", type=float, default=0, help="registros nuevos por segundo (0 = ninguno)")
+    parser.add_argument("--legacy", action="store_true", help="Edge antiguo: sin cursor ni ack")
+    parser.add_argument("--latency", type=float, default=0, help="ms de espera antes de cada respuesta")
+    parser.add_argument("--verbose", action="store_true")
+    args = parser.parse_args()
+
+    edge = Edge(args.records)
+    if args.produce > 0:
+        def producer():
+            while True:
+                time.sleep(1 / args.produce)
+                edge.produce()
+        threading.Thread(target=producer, daemon=True).start()
+
+    server = ThreadingHTTPServer(("0.0.0.0", args.port), make_handler(edge, args))
+    print("Edge de prueba en el puerto %d (corte = %.0f %%)" % (args.port, args.drop * 100))
+    try:
+        server.serve_forever()
+    except KeyboardInterrupt:
+        pass
+    for stream in STREAMS:
+        served = edge.served[stream]
+        repeated = [s for s, n in served.items() if n > 1]
+        print("%s: %d seq entregados, %d pedidos mas de una vez, %d sin confirmar"
+              % (stream, len(served), len(repeated), len(edge.records[stream])))
+    for path, count in sorted(edge.posted.items()):
+        print("POST %s: %d registros" % (path, count))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,90 @@
+#!/usr/bin/env python3
+"""
+Resumen del profiler de ciclos (main/esp32_prof.c).
+
+Lee el archivo prof.bin de la tarjeta SD y muestra, por fase, la cantidad de
+muestras y los percentiles de duracion en milisegundos.
+
+Uso:
+    python3 tools/prof_report.py /media/sdcard/prof.bin [--last N]
+"""
+import argparse
+import struct
+import sys
+from collections import defaultdict
+
+# prof_sample_t: cycle, start_us, duration_us, phase, reserved[3]
+SAMPLE = struct.Struct("<IIIB3x")
+
+# WARNING: mismo orden que enum _phase en main/esp32_prof.h
+PHASES = [
+    "awake",
+    "nvs",
+    "battery",
+    "wifi",
+    "sd_mount",
+    "sd_open",
+    "edge_query",
+    "edge_download",
+    "upload",
+    "shutdown",
+    "boot",
+]
+
+
+def read_samples(path):
+    with open(path, "rb") as f:
+        data = f.read()
+    usable = len(data) - len(data) % SAMPLE.size
+    if usable != len(data):
+        print("Aviso: %d bytes incompletos al final del archivo" % (len(data) - usable),
+              file=sys.stderr)
+    for offset in range(0, usable, SAMPLE.size):
+        yield SAMPLE.unpack_from(data, offset)
+
+
+def percentile(values, p):
+    # Interpolacion lineal entre los dos valores mas cercanos
+    if len(values) == 1:
+        return values[0]
+    k = (len(values) - 1) * p / 100.0
+    low = int(k)
+    high = min(low + 1, len(values) - 1)
+    return values[low] + (values[high] - values[low]) * (k - low)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Percentiles por fase de prof.bin")
+    parser.add_argument("file", help="Archivo prof.bin")
+    parser.add_argument("--last", type=int, default=0,
+                        help="Solo los ultimos N ciclos (0 = todos)")
+    args = parser.parse_args()
+
+    samples = list(read_samples(args.file))
+    if not samples:
+        print("No hay muestras")
+        return
+
+    cycles = sorted({s[0] for s in samples})
+    if args.last > 0:
+        keep = set(cycles[-args.last:])
+        samples = [s for s in samples if s[0] in keep]
+        cycles = sorted(keep)
+
+    durations = defaultdict(list)
+    for cycle, start_us, duration_us, phase in samples:
+        durations[phase].append(duration_us / 1000.0)
+
+    print("Ciclos: %d (del %d al %d)\n" % (len(cycles), cycles[0], cycles[-1]))
+    print("%-14s %6s %9s %9s %9s %9s %9s" % ("fase", "n", "p50", "p90", "p99", "max", "total"))
+    for phase in sorted(durations):
+        values = sorted(durations[phase])
+        name = PHASES[phase] if phase < len(PHASES) else "fase_%d" % phase
+        print("%-14s %6d %9.1f %9.1f %9.1f %9.1f %9.1f" % (
+            name, len(values),
+            percentile(values, 50), percentile(values, 90), percentile(values, 99),
+            values[-1], sum(values)))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,133 @@
+#!/usr/bin/env python3
+"""
+Handshake TLS completo contra uno reanudado con la sesion de un ciclo anterior
+(main/esp32_http.c guarda la sesion en memoria RTC durante el deep sleep).
+
+Levanta un `openssl s_server` local (TLS 1.2 con session tickets, como el
+mbedTLS del nodo) detras de un proxy que agrega --latency ms a cada paquete en
+cada sentido, como la ida y vuelta por el AP o el modem. Cada conexion es un
+`openssl s_client` nuevo, igual que la primera conexion despues de despertar:
+  completo    sin sesion guardada
+  reanudado   -sess_in con la sesion que dejo la conexion anterior (-sess_out)
+
+Uso:
+    python3 tools/tls_bench.py [--connections 20] [--latency 50]
+
+Muestra el tiempo de cada modo (p50, incluye arrancar openssl, que es igual en
+los dos) y los bytes del handshake: el completo manda la cadena de certificados
+y tarda dos idas y vueltas, el reanudado una.
+"""
+import argparse
+import os
+import re
+import socket
+import statistics
+import subprocess
+import sys
+import tempfile
+import threading
+import time
+
+HANDSHAKE = re.compile(r"SSL handshake has read (\d+) bytes and written (\d+) bytes")
+
+
+def free_port():
+    with socket.socket() as s:
+        s.bind(("127.0.0.1", 0))
+        return s.getsockname()[1]
+
+
+def wait_port(port):
+    for _ in range(50):
+        try:
+            socket.create_connection(("127.0.0.1", port), timeout=0.1).close()
+            return
+        except OSError:
+            time.sleep(0.1)
+    raise RuntimeError("el servidor no abrio el puerto %d" % port)
+
+
+def forward(source, target, delay):
+    # Un sentido de la conexion: cada bloque sale delay segundos despues de llegar
+    try:
+        while True:
+            data = source.recv(65536)
+            if not data:
+                break
+            time.sleep(delay)
+            target.sendall(data)
+    except OSError:
+        pass
+    finally:
+        for sock in (source, target):
+            try:
+                sock.shutdown(socket.SHUT_RDWR)
+            except OSError:
+                pass
+
+
+def proxy(listen_port, server_port, delay):
+    listener = socket.socket()
+    listener.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    listener.bind(("127.0.0.1", listen_port))
+    listener.listen(8)
+    while True:
+        client, _ = listener.accept()
+        server = socket.create_connection(("127.0.0.1", server_port))
+        for source, target in ((client, server), (server, client)):
+            source.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+            threading.Thread(target=forward, args=(source, target, delay), daemon=True).start()
+
+
+def connect(port, session, resume):
+    command = ["openssl", "s_client", "-connect", "127.0.0.1:%d" % port, "-tls1_2", "-no_ign_eof"]
+    command += ["-sess_in", session] if resume else []
+    command += ["-sess_out", session]
+    start = time.monotonic()
+    output = subprocess.run(command, stdin=subprocess.DEVNULL, capture_output=True, text=True).stdout
+    elapsed = (time.monotonic() - start) * 1000
+    match = HANDSHAKE.search(output)
+    if match is None:
+        raise RuntimeError("s_client no completo el handshake:\n" + output)
+    return elapsed, int(match.group(1)), int(match.group(2)), "Reused," in output
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--connections", type=int, default=20, help="conexiones por modo")
+    parser.add_argument("--latency", type=float, default=50, help="ms de ida y vuelta agregados por el proxy")
+    args = parser.parse_args()
+
+    with tempfile.TemporaryDirectory(prefix="tls_bench_") as work:
+        key, cert, session = (os.path.join(work, name) for name in ("key.pem", "cert.pem", "session.pem"))
+        subprocess.run(["openssl", "req", "-x509", "-newkey", "rsa:2048", "-nodes", "-days", "1", "-subj", "/CN=localhost",
+                        "-keyout", key, "-out", cert], check=True, capture_output=True)
+        server_port, proxy_port = free_port(), free_port()
+        server = subprocess.Popen(["openssl", "s_server", "-accept", str(server_port), "-cert", cert, "-key", key,
+                                   "-tls1_2", "-quiet"], stdin=subprocess.PIPE, stdout=subprocess.DEVNULL,
+                                  stderr=subprocess.DEVNULL)
+        try:
+            wait_port(server_port)
+            threading.Thread(target=proxy, args=(proxy_port, server_port, args.latency / 2000), daemon=True).start()
+            wait_port(proxy_port)
+            print("%d conexiones por modo, %.1f ms de ida y vuelta" % (args.connections, args.latency))
+            print("%-10s %9s %9s %9s %10s" % ("modo", "p50 ms", "leidos", "escritos", "reanudadas"))
+            for name, resume in (("completo", False), ("reanudado", True)):
+                results = []
+                for _ in range(args.connections):
+                    if not resume and os.path.exists(session):
+                        os.remove(session)
+                    elif resume and not os.path.exists(session):
+                        connect(proxy_port, session, False)
+                    results.append(connect(proxy_port, session, resume))
+                print("%-10s %9.1f %9d %9d %7d/%d" % (name, statistics.median(r[0] for r in results),
+                                                       statistics.median(r[1] for r in results),
+                                                       statistics.median(r[2] for r in results),
+                                                       sum(r[3] for r in results), len(results)))
+        finally:
+            server.terminate()
+            server.wait()
+
+
+if __name__ == "__main__":
+    sys.exit(main())